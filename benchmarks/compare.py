@@ -0,0 +1,65 @@
+# compare.py
+#
+# Compare a cugrad_bench JSON result against a saved baseline and flag
+# regressions. Exits with status 1 if any benchmark got slower (or allocates
+# more) than the thresholds allow, so it can gate upgrades in CI.
+#
+# Usage: python benchmarks/compare.py baseline.json current.json [--threshold 0.10]
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return {(b["name"], b["size"]): b for b in data["benchmarks"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare cugrad_bench results against a baseline")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="Allowed relative slowdown in ns/iter (default 0.10 = 10%%)")
+    parser.add_argument("--min-ns", type=float, default=200.0,
+                        help="Ignore timing changes of benchmarks faster than this (too noisy)")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = []
+    print(f"{'benchmark':<28} {'size':>10} {'base ns':>14} {'new ns':>14} {'change':>8} {'allocs':>12}")
+    for key in sorted(current, key=lambda k: (k[0], k[1])):
+        if key not in baseline:
+            continue
+        base, new = baseline[key], current[key]
+        change = new["ns_per_iter"] / base["ns_per_iter"] - 1.0 if base["ns_per_iter"] > 0 else 0.0
+        allocs = f"{base['allocs_per_iter']:.0f}->{new['allocs_per_iter']:.0f}"
+
+        flags = []
+        if change > args.threshold and max(base["ns_per_iter"], new["ns_per_iter"]) >= args.min_ns:
+            flags.append("SLOWER")
+        if new["allocs_per_iter"] > base["allocs_per_iter"] + 0.5:
+            flags.append("MORE ALLOCS")
+        if flags:
+            regressions.append((key, flags))
+
+        print(f"{key[0]:<28} {key[1]:>10} {base['ns_per_iter']:>14.1f} {new['ns_per_iter']:>14.1f} "
+              f"{change * 100:>7.1f}% {allocs:>12} {' '.join(flags)}")
+
+    missing = sorted(set(baseline) - set(current))
+    for name, size in missing:
+        print(f"missing from current run: {name} (size {size})")
+
+    if regressions:
+        print(f"\n{len(regressions)} regression(s) above {args.threshold * 100:.0f}%")
+        return 1
+    print("\nNo regressions")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,510 @@
+// cugrad_bench.cpp
+//
+// Microbenchmarks for the C++ core: every op's forward and backward across
+// sizes, fused expressions, graph traversal, backward() on a deep MLP, SGD
+// and Adam steps and a full training step (single model and data-parallel). Results are printed as
+// a table and written as JSON for benchmarks/compare.py.
+//
+// Usage: cugrad_bench [--filter SUBSTRING] [--max-size N] [--min-time SECONDS] [--threads N] [--out FILE]
+
+#include "tensor.h"
+#include "op.h"
+#include "expr.h"
+#include "nn.h"
+#include "optimizer.h"
+#include "data_parallel.h"
+#include "inference.h"
+#include "random.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Every heap allocation in the process goes through here, so a benchmark
+// can report allocations per iteration
+static std::atomic<long long> allocation_count{0};
+
+void *operator new(size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    struct BenchResult
+    {
+        std::string name;
+        long long size = 0;         // Elements (or graph nodes) processed per iteration
+        long long iterations = 0;
+        double ns_per_iter = 0.0;
+        double ns_per_element = 0.0;
+        double gb_per_s = 0.0;      // 0 when no byte count is meaningful
+        double allocs_per_iter = 0.0;
+    };
+
+    struct Options
+    {
+        std::string filter;
+        long long max_size = 10000000;
+        double min_time = 0.2;
+        std::string out = "cugrad_bench.json";
+    };
+
+    Options options;
+    std::vector<BenchResult> results;
+
+    double now_seconds()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Runs body until min_time has passed (at least 3 times, after one warm-up
+    // run); setup runs before each iteration outside the timed region.
+    // bytes is the estimated traffic of one iteration.
+    void run(const std::string &name, long long size, double bytes, const std::function<void()> &body,
+             const std::function<void()> &setup = nullptr)
+    {
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+        {
+            return;
+        }
+
+        if (setup)
+        {
+            setup();
+        }
+        body();
+
+        long long iterations = 0;
+        long long allocations = 0;
+        double elapsed = 0.0;
+        while (iterations < 3 || elapsed < options.min_time)
+        {
+            if (setup)
+            {
+                setup();
+            }
+            long long allocations_before = allocation_count.load();
+            double start = now_seconds();
+            body();
+            elapsed += now_seconds() - start;
+            allocations += allocation_count.load() - allocations_before;
+            iterations++;
+        }
+
+        BenchResult result;
+        result.name = name;
+        result.size = size;
+        result.iterations = iterations;
+        result.ns_per_iter = elapsed * 1e9 / iterations;
+        result.ns_per_element = result.ns_per_iter / size;
+        result.gb_per_s = bytes > 0 ? bytes / result.ns_per_iter : 0.0;
+        result.allocs_per_iter = static_cast<double>(allocations) / iterations;
+        results.push_back(result);
+
+        std::printf("%-28s %10lld %10lld %14.1f %12.3f %10.3f %10.1f\n", name.c_str(), size, iterations,
+                    result.ns_per_iter, result.ns_per_element, result.gb_per_s, result.allocs_per_iter);
+        std::fflush(stdout);
+    }
+
+    std::shared_ptr<Tensor> filled(long long size, float value)
+    {
+        return std::make_shared<Tensor>(std::vector<int>{static_cast<int>(size)}, value);
+    }
+
+    // A graph that never ran backward() keeps itself alive (each output holds
+    // its op and the op holds the output), so forward-only benchmarks cut it
+    void discard(const std::shared_ptr<Tensor> &root)
+    {
+        std::vector<std::shared_ptr<Tensor>> nodes;
+        root->topological_sort(nodes);
+        for (auto &node : nodes)
+        {
+            node->release_graph(false);
+        }
+    }
+
+    struct OpCase
+    {
+        std::string name;
+        bool binary;
+        std::function<std::shared_ptr<Tensor>(std::shared_ptr<Tensor>, std::shared_ptr<Tensor>)> apply;
+        // Bytes per element moved by forward and backward (reads + writes)
+        double forward_bytes;
+        double backward_bytes;
+    };
+
+    void bench_ops()
+    {
+        const std::vector<OpCase> cases = {
+            {"add", true, [](std::shared_ptr<Tensor> a, std::shared_ptr<Tensor> b) { return a + b; }, 12, 20},
+            {"sub", true, [](std::shared_ptr<Tensor> a, std::shared_ptr<Tensor> b) { return a - b; }, 12, 20},
+            {"mul", true, [](std::shared_ptr<Tensor> a, std::shared_ptr<Tensor> b) { return a * b; }, 12, 28},
+            {"div", true, [](std::shared_ptr<Tensor> a, std::shared_ptr<Tensor> b) { return a / b; }, 12, 28},
+            {"exp", false, [](std::shared_ptr<Tensor> a, std::shared_ptr<Tensor>) { return a->exp(); }, 8, 16},
+            {"tanh", false, [](std::shared_ptr<Tensor> a, std::shared_ptr<Tensor>) { return a->tanh(); }, 8, 16},
+            {"relu", false, [](std::shared_ptr<Tensor> a, std::shared_ptr<Tensor>) { return a->relu(); }, 8, 16},
+            {"sum", false, [](std::shared_ptr<Tensor> a, std::shared_ptr<Tensor>) { return a->sum(); }, 4, 8},
+        };
+
+        for (const OpCase &op_case : cases)
+        {
+            for (long long size = 1; size <= options.max_size; size *= 10)
+            {
+                auto a = filled(size, 0.5f);
+                auto b = filled(size, 1.5f);
+
+                // Eager forward: builds the op and allocates (and frees) its output, as user code does
+                run(op_case.name + "/forward", size, op_case.forward_bytes * size, [&]()
+                    { discard(op_case.apply(a, b)); });
+
+                // Backward of one op, kept alive so only the kernel is timed
+                auto out = op_case.apply(a, b);
+                std::fill(out->grad.begin(), out->grad.end(), 1.0f);
+                run(op_case.name + "/backward", size, op_case.backward_bytes * size, [&]()
+                    { out->op->run_backward(); });
+            }
+        }
+    }
+
+    // tanh(a * b + c): three eager ops against one fused loop (see expr.h)
+    void bench_fused()
+    {
+        for (long long size = 1; size <= options.max_size; size *= 10)
+        {
+            auto a = filled(size, 0.5f);
+            auto b = filled(size, 1.5f);
+            auto c = filled(size, -0.25f);
+            auto e = (expr::leaf(a) * expr::leaf(b) + expr::leaf(c)).tanh();
+
+            run("tanh_mul_add/eager", size, 36.0 * size, [&]()
+                { discard((a * b + c)->tanh()); });
+            run("tanh_mul_add/fused", size, 16.0 * size, [&]()
+                { discard(expr::fuse(e)); });
+            auto d = filled(size, 0.0f);
+            run("tanh_mul_add/assign", size, 16.0 * size, [&]()
+                { expr::assign(*d, e); });
+
+            auto out = expr::fuse(e);
+            std::fill(out->grad.begin(), out->grad.end(), 1.0f);
+            run("tanh_mul_add/fused_backward", size, 40.0 * size, [&]()
+                { out->op->run_backward(); });
+        }
+    }
+
+    std::shared_ptr<Tensor> mlp_loss(MLP &mlp, const std::shared_ptr<Tensor> &x, const std::shared_ptr<Tensor> &y)
+    {
+        auto diff = mlp(x) - y;
+        return (diff * diff)->sum();
+    }
+
+    void bench_graph()
+    {
+        // Deep, narrow network: thousands of small nodes
+        const int width = 32;
+        MLP mlp(width, std::vector<int>(8, width));
+        auto x = filled(width, 0.25f);
+        auto y = filled(width, 0.5f);
+
+        auto loss = mlp_loss(mlp, x, y);
+        std::vector<std::shared_ptr<Tensor>> ordering;
+        loss->topological_sort(ordering);
+        long long nodes = static_cast<long long>(ordering.size());
+
+        run("topological_sort/mlp", nodes, 0, [&]()
+            {
+            std::vector<std::shared_ptr<Tensor>> order;
+            loss->topological_sort(order); });
+
+        run("backward/mlp", nodes, 0, [&]()
+            { loss->backward(true); });
+
+        run("forward/mlp", nodes, 0, [&]()
+            { discard(mlp_loss(mlp, x, y)); });
+
+        SGD sgd(mlp.parameters(), 0.01f);
+        long long num_params = 0;
+        for (auto &param : mlp.parameters())
+        {
+            num_params += param->size();
+        }
+        // Reads data and grad, writes data
+        run("sgd_step/mlp", num_params, 12.0 * num_params, [&]()
+            { sgd.step(); });
+
+        run("zero_grad/mlp", num_params, 4.0 * num_params, [&]()
+            { sgd.zero_grad(); });
+
+        // Same network with parameters flattened into one buffer
+        MLP flat_mlp(width, std::vector<int>(8, width));
+        flat_mlp.flatten_parameters();
+        SGD flat_sgd(flat_mlp.parameters(), 0.01f);
+        run("sgd_step/mlp_flat", num_params, 12.0 * num_params, [&]()
+            { flat_sgd.step(); });
+        run("zero_grad/mlp_flat", num_params, 4.0 * num_params, [&]()
+            { flat_sgd.zero_grad(); });
+
+        // Reads data, grad and both moments, writes data and both moments
+        Adam adam(mlp.parameters());
+        run("adam_step/mlp", num_params, 24.0 * num_params, [&]()
+            { adam.step(); });
+        Adam flat_adam(flat_mlp.parameters());
+        run("adam_step/mlp_flat", num_params, 24.0 * num_params, [&]()
+            { flat_adam.step(); });
+
+        run("train_step/mlp", nodes, 0, [&]()
+            {
+            sgd.zero_grad();
+            auto step_loss = mlp_loss(mlp, x, y);
+            step_loss->backward();
+            sgd.step(); });
+
+        // A batch of 32 samples split across one replica per thread
+        const int batch = 32;
+        auto dp_model = std::make_shared<MLP>(width, std::vector<int>(8, width));
+        DataParallel parallel(dp_model, std::make_shared<SGD>(dp_model->parameters(), 0.01f), get_num_threads());
+        auto inputs = std::make_shared<Tensor>(std::vector<int>{batch, width}, 0.25f);
+        auto targets = std::make_shared<Tensor>(std::vector<int>{batch, width}, 0.5f);
+        run("train_step/mlp_data_parallel", batch, 0, [&]()
+            { parallel.train_step(inputs, targets); });
+
+        // The same batch through a frozen, autograd-free copy of the network
+        auto plan = InferencePlan::freeze(mlp);
+        std::vector<float> plan_inputs(batch * width, 0.25f);
+        std::vector<float> plan_outputs(batch * plan->output_size());
+        InferencePlan::Scratch scratch;
+        run("inference/mlp_plan", batch, 0, [&]()
+            { plan->run(plan_inputs.data(), plan_outputs.data(), batch, scratch); });
+        auto int8_plan = plan->quantize(plan_inputs.data(), batch);
+        run("inference/mlp_plan_int8", batch, 0, [&]()
+            { int8_plan->run(plan_inputs.data(), plan_outputs.data(), batch, scratch); });
+    }
+
+    void bench_recurrent()
+    {
+        // One sequence of 64 steps through a 32 -> 64 LSTM and GRU
+        const int steps = 64;
+        const int input_size = 32;
+        const int hidden_size = 64;
+        auto x = std::make_shared<Tensor>(std::vector<int>{steps, input_size}, 0.25f);
+        LSTM lstm(input_size, hidden_size);
+        GRU gru(input_size, hidden_size);
+
+        run("lstm/forward", steps, 0, [&]()
+            { discard(lstm(x)->sum()); });
+        run("lstm/train_step", steps, 0, [&]()
+            {
+            lstm.zero_grad();
+            lstm(x)->sum()->backward(); });
+        run("gru/forward", steps, 0, [&]()
+            { discard(gru(x)->sum()); });
+        run("gru/train_step", steps, 0, [&]()
+            {
+            gru.zero_grad();
+            gru(x)->sum()->backward(); });
+    }
+
+    void bench_attention()
+    {
+        // Two heads of 512 queries and keys, width 64
+        const int heads = 2;
+        const int seq = 512;
+        const int width = 64;
+        auto q = std::make_shared<Tensor>(std::vector<int>{heads, seq, width}, 0.1f);
+        auto k = std::make_shared<Tensor>(std::vector<int>{heads, seq, width}, 0.2f);
+        auto v = std::make_shared<Tensor>(std::vector<int>{heads, seq, width}, 0.3f);
+        for (int i = 0; i < q->size(); i++)
+        {
+            q->data[i] = std::sin(0.01f * i);
+            k->data[i] = std::cos(0.013f * i);
+        }
+
+        run("attention/forward", heads * seq, 0, [&]()
+            { discard(attention(q, k, v)->sum()); });
+        run("attention/causal_train_step", heads * seq, 0, [&]()
+            {
+            q->zero_grad();
+            k->zero_grad();
+            v->zero_grad();
+            attention(q, k, v, nullptr, true)->sum()->backward(); });
+    }
+
+    void bench_sparse()
+    {
+        // A batch of 256 rows over 100000 features, 0.1% nonzero, into 64 outputs
+        const int batch = 256;
+        const int features = 100000;
+        std::vector<int> rows;
+        std::vector<int> cols;
+        std::vector<float> values;
+        unsigned state = 12345;
+        for (int r = 0; r < batch; r++)
+        {
+            for (int i = 0; i < features / 1000; i++)
+            {
+                state = state * 1664525u + 1013904223u;
+                rows.push_back(r);
+                cols.push_back(static_cast<int>(state % features));
+                values.push_back(1.0f);
+            }
+        }
+        auto input = SparseTensor::from_coo(batch, features, rows, cols, values);
+        SparseLinear layer(features, 64);
+
+        run("sparse/linear_forward", static_cast<long long>(input->nnz()), 0, [&]()
+            { discard(layer.forward(input)->sum()); });
+        run("sparse/linear_train_step", static_cast<long long>(input->nnz()), 0, [&]()
+            {
+            layer.zero_grad();
+            layer.forward(input)->sum()->backward(); });
+    }
+
+    std::string json_escape(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    void write_json(const std::string &path)
+    {
+        std::ostringstream out;
+        out << "{\n  \"context\": {\"threads\": " << get_num_threads() << ", \"min_time\": " << options.min_time
+            << "},\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const BenchResult &r = results[i];
+            char line[512];
+            std::snprintf(line, sizeof(line),
+                          "%s\n    {\"name\": \"%s\", \"size\": %lld, \"iterations\": %lld, \"ns_per_iter\": %.3f, "
+                          "\"ns_per_element\": %.6f, \"gb_per_s\": %.6f, \"allocs_per_iter\": %.3f}",
+                          i ? "," : "", json_escape(r.name).c_str(), r.size, r.iterations, r.ns_per_iter,
+                          r.ns_per_element, r.gb_per_s, r.allocs_per_iter);
+            out << line;
+        }
+        out << "\n  ]\n}\n";
+
+        std::ofstream file(path);
+        if (!file)
+        {
+            throw std::invalid_argument("Cannot open " + path + " for writing.");
+        }
+        file << out.str();
+    }
+
+    void parse_args(int argc, char **argv)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc)
+            {
+                throw std::invalid_argument("Missing value for " + arg);
+            }
+            std::string value = argv[++i];
+            if (arg == "--filter")
+            {
+                options.filter = value;
+            }
+            else if (arg == "--max-size")
+            {
+                options.max_size = std::stoll(value);
+            }
+            else if (arg == "--min-time")
+            {
+                options.min_time = std::stod(value);
+            }
+            else if (arg == "--out")
+            {
+                options.out = value;
+            }
+            else if (arg == "--threads")
+            {
+                set_num_threads(std::stoi(value));
+            }
+            else
+            {
+                throw std::invalid_argument("Unknown option " + arg);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        parse_args(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << "\n"
+                  << "Usage: cugrad_bench [--filter SUBSTRING] [--max-size N] [--min-time SECONDS] [--threads N] [--out FILE]\n";
+        return 2;
+    }
+
+    DeviceManager::get_instance().set_current_device(DeviceType::CPU);
+    manual_seed(0);
+
+    std::printf("%-28s %10s %10s %14s %12s %10s %10s\n", "benchmark", "size", "iters", "ns/iter", "ns/elem",
+                "GB/s", "allocs");
+    bench_ops();
+    bench_fused();
+    bench_graph();
+    bench_recurrent();
+    bench_attention();
+    bench_sparse();
+
+    write_json(options.out);
+    std::printf("Wrote %zu results to %s\n", results.size(), options.out.c_str());
+    return 0;
+}
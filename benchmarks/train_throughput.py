@@ -0,0 +1,205 @@
+# train_throughput.py
+#
+# End-to-end training throughput of the Python API, based on
+# examples/train_xor.py and examples/train_housing.py. The housing task uses a
+# synthetic dataset with the same shape as California housing (8 features,
+# one target), so no network access is needed.
+#
+# Every (task, width, threads) configuration runs in its own process so that
+# peak RSS and the thread pool are measured in isolation. Reported per config:
+#   samples/sec, mean ms per step for forward / backward / step / zero_grad,
+#   the share of forward time spent in Python vs in C++ ops (from the
+#   profiler), peak RSS and graph nodes per step.
+#
+# Usage: python benchmarks/train_throughput.py [--tasks xor,housing] [--widths 4,16,64]
+#            [--threads 1,2,4] [--steps 50] [--csv results.csv] [--json results.json]
+
+import argparse
+import csv
+import json
+import resource
+import subprocess
+import sys
+import time
+
+import numpy as np
+
+
+def xor_dataset():
+    inputs = np.array([[0.0, 0.0], [0.0, 1.0], [1.0, 0.0], [1.0, 1.0]], dtype=np.float32)
+    targets = np.array([0.0, 1.0, 1.0, 0.0], dtype=np.float32)
+    return inputs, targets
+
+
+def synthetic_housing(num_samples, seed=0):
+    # Normalized features and a smooth nonlinear target in roughly the same
+    # range as median house values (in 100k$)
+    rng = np.random.RandomState(seed)
+    X = rng.normal(size=(num_samples, 8)).astype(np.float32)
+    w = rng.normal(size=8).astype(np.float32)
+    y = 2.0 + 0.5 * X @ w + 0.3 * np.tanh(X[:, 0] * X[:, 1]) + 0.1 * rng.normal(size=num_samples)
+    return X, y.astype(np.float32)
+
+
+def run_config(task, width, threads, steps, warmup, batch_size, profile_steps):
+    from cugrad import set_device, DeviceType, set_num_threads, memory_snapshot, profiler
+    from cugrad.tensor import Tensor
+    from cugrad.nn import MLP
+    from cugrad.optimizer import SGD
+
+    set_device(DeviceType.CPU)
+    set_num_threads(threads)
+    np.random.seed(0)
+
+    if task == "xor":
+        X, y = xor_dataset()
+        batch_size = len(X)
+    else:
+        X, y = synthetic_housing(max(batch_size * 16, 1024))
+
+    model = MLP(input_size=X.shape[1], layer_sizes=[width, width, 1])
+    optimizer = SGD(model.parameters(), lr=0.01)
+
+    batches = []
+    for start in range(0, len(X) - batch_size + 1, batch_size):
+        batches.append(([Tensor(x) for x in X[start:start + batch_size]],
+                        [Tensor([t]) for t in y[start:start + batch_size]]))
+
+    def forward(inputs, targets):
+        loss = Tensor([0.0])
+        for inp, target in zip(inputs, targets):
+            error = model(inp) - target
+            loss = loss + error * error
+        return loss
+
+    # Graph size: tensors created by one forward pass
+    before = memory_snapshot().live_tensors
+    loss = forward(*batches[0])
+    nodes_per_step = memory_snapshot().live_tensors - before
+    loss.backward()
+
+    phases = {"forward": 0.0, "backward": 0.0, "step": 0.0, "zero_grad": 0.0}
+
+    def train_step(i, timed):
+        inputs, targets = batches[i % len(batches)]
+
+        t0 = time.perf_counter()
+        optimizer.zero_grad()
+        t1 = time.perf_counter()
+        loss = forward(inputs, targets)
+        t2 = time.perf_counter()
+        loss.backward()
+        t3 = time.perf_counter()
+        optimizer.step()
+        t4 = time.perf_counter()
+
+        if timed:
+            phases["zero_grad"] += t1 - t0
+            phases["forward"] += t2 - t1
+            phases["backward"] += t3 - t2
+            phases["step"] += t4 - t3
+        return loss.data[0]
+
+    for i in range(warmup):
+        train_step(i, timed=False)
+
+    start = time.perf_counter()
+    for i in range(steps):
+        loss = train_step(i, timed=True)
+    total = time.perf_counter() - start
+
+    # Python vs C++ split of the forward pass, from a separate profiled run
+    # (the profiler itself adds some overhead to the ops it times)
+    forward_wall = 0.0
+    with profiler.profile() as prof:
+        for i in range(profile_steps):
+            inputs, targets = batches[i % len(batches)]
+            t0 = time.perf_counter()
+            loss_p = forward(inputs, targets)
+            forward_wall += time.perf_counter() - t0
+            loss_p.backward()
+        op_seconds = sum(e.duration_us for e in prof.events() if not e.backward) * 1e-6
+    cpp_fraction = min(op_seconds / forward_wall, 1.0) if forward_wall > 0 else 0.0
+
+    return {
+        "task": task,
+        "width": width,
+        "threads": threads,
+        "batch_size": batch_size,
+        "steps": steps,
+        "samples_per_sec": steps * batch_size / total,
+        "forward_ms": phases["forward"] / steps * 1e3,
+        "backward_ms": phases["backward"] / steps * 1e3,
+        "step_ms": phases["step"] / steps * 1e3,
+        "zero_grad_ms": phases["zero_grad"] / steps * 1e3,
+        "forward_python_pct": (1.0 - cpp_fraction) * 100.0,
+        "forward_cpp_pct": cpp_fraction * 100.0,
+        "peak_rss_mb": resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024.0,
+        "nodes_per_step": nodes_per_step,
+        "final_loss": float(loss),
+    }
+
+
+COLUMNS = ["task", "width", "threads", "batch_size", "samples_per_sec", "forward_ms", "backward_ms",
+           "step_ms", "zero_grad_ms", "forward_python_pct", "forward_cpp_pct", "peak_rss_mb",
+           "nodes_per_step", "final_loss"]
+
+
+def print_header():
+    print(f"{'task':<8} {'width':>5} {'thr':>3} {'batch':>5} {'samples/s':>10} {'fwd ms':>8} {'bwd ms':>8} "
+          f"{'step ms':>8} {'zero ms':>8} {'py %':>6} {'c++ %':>6} {'rss MB':>8} {'nodes':>7}")
+
+
+def print_row(r):
+    print(f"{r['task']:<8} {r['width']:>5} {r['threads']:>3} {r['batch_size']:>5} {r['samples_per_sec']:>10.1f} "
+          f"{r['forward_ms']:>8.3f} {r['backward_ms']:>8.3f} {r['step_ms']:>8.3f} {r['zero_grad_ms']:>8.3f} "
+          f"{r['forward_python_pct']:>6.1f} {r['forward_cpp_pct']:>6.1f} {r['peak_rss_mb']:>8.1f} "
+          f"{r['nodes_per_step']:>7}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="cugrad end-to-end training throughput")
+    parser.add_argument("--tasks", default="xor,housing")
+    parser.add_argument("--widths", default="4,16,64")
+    parser.add_argument("--threads", default="1,2,4")
+    parser.add_argument("--steps", type=int, default=50)
+    parser.add_argument("--warmup", type=int, default=5)
+    parser.add_argument("--batch-size", type=int, default=32, help="Samples per step for housing (xor uses all 4)")
+    parser.add_argument("--profile-steps", type=int, default=5)
+    parser.add_argument("--csv", help="Write the table as CSV")
+    parser.add_argument("--json", help="Write the table as JSON")
+    parser.add_argument("--single", help=argparse.SUPPRESS)  # task,width,threads: run one config, print JSON
+    args = parser.parse_args()
+
+    if args.single:
+        task, width, threads = args.single.split(",")
+        result = run_config(task, int(width), int(threads), args.steps, args.warmup, args.batch_size,
+                            args.profile_steps)
+        print(json.dumps(result))
+        return 0
+
+    rows = []
+    print_header()
+    for task in args.tasks.split(","):
+        for width in [int(w) for w in args.widths.split(",")]:
+            for threads in [int(t) for t in args.threads.split(",")]:
+                cmd = [sys.executable, __file__, "--single", f"{task},{width},{threads}",
+                       "--steps", str(args.steps), "--warmup", str(args.warmup),
+                       "--batch-size", str(args.batch_size), "--profile-steps", str(args.profile_steps)]
+                out = subprocess.run(cmd, check=True, capture_output=True, text=True).stdout
+                rows.append(json.loads(out.strip().splitlines()[-1]))
+                print_row(rows[-1])
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=COLUMNS, extrasaction="ignore")
+            writer.writeheader()
+            writer.writerows(rows)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(rows, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,7 +1,9 @@
 import graphviz
 import itertools
 
-def draw_compute_graph(tensor, filename="compute_graph", format="png"):
+def draw_compute_graph(tensor, filename="compute_graph", format="png", color_by_time=False):
+    # backward() frees the graph; call tensor.backward(retain_graph=True) before drawing gradients
+    # color_by_time: shade op nodes by the time cugrad.profiler recorded for them
 
     dot = graphviz.Digraph(format=format)
     dot.attr(rankdir='LR', size='12,12')
@@ -24,6 +26,20 @@ def draw_compute_graph(tensor, filename="compute_graph", format="png"):
         # Add more operations and colors as needed
     }
 
+    if color_by_time:
+        from cugrad import profiler
+
+    def slowest_op_time(tensor, seen):
+        if id(tensor) in seen:
+            return 0.0
+        seen[id(tensor)] = tensor
+        slowest = profiler.op_time_us(tensor.op) if tensor.op else 0.0
+        for child in tensor.children:
+            slowest = max(slowest, slowest_op_time(child, seen))
+        return slowest
+
+    max_time = slowest_op_time(tensor, {}) if color_by_time else 0.0
+
     def add_nodes(tensor):
         if id(tensor) in tensor_id_to_node:
             return
@@ -46,6 +62,11 @@ def draw_compute_graph(tensor, filename="compute_graph", format="png"):
             op_id_to_node[id(op)] = op_node
             op_label = op.op_type
             color = op_colors.get(op_label, "gray")  # Default color if op_type not found
+            if color_by_time and max_time > 0:
+                # White (fast) to red (slowest op)
+                op_time = profiler.op_time_us(op)
+                color = "#ff{0:02x}{0:02x}".format(int(255 * (1 - op_time / max_time)))
+                op_label = f"{op_label}\n{op_time:.1f} us"
             dot.node(op_node, label=op_label, shape='box', style='filled', fillcolor=color)
 
             # Connect operation to tensor
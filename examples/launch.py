@@ -0,0 +1,54 @@
+# launch.py
+#
+# Run a training script as N processes on this machine, one per rank. Each
+# process gets RANK, WORLD_SIZE, MASTER_ADDR and MASTER_PORT in its
+# environment, which cugrad.distributed.ProcessGroup.from_env() reads. Rank r
+# listens on MASTER_PORT + r. If a rank fails, the others are stopped.
+#
+# Usage: python examples/launch.py --nproc 4 [--port 29500] script.py [script args...]
+
+import argparse
+import os
+import subprocess
+import sys
+import time
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Launch a cugrad script on N local ranks")
+    parser.add_argument("--nproc", type=int, default=2, help="Number of ranks")
+    parser.add_argument("--addr", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=29500, help="Base port (rank r uses port + r)")
+    parser.add_argument("script")
+    parser.add_argument("args", nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+
+    procs = []
+    for rank in range(args.nproc):
+        env = dict(os.environ, RANK=str(rank), WORLD_SIZE=str(args.nproc),
+                   MASTER_ADDR=args.addr, MASTER_PORT=str(args.port))
+        procs.append(subprocess.Popen([sys.executable, args.script] + args.args, env=env))
+
+    status = 0
+    try:
+        while procs:
+            for proc in list(procs):
+                code = proc.poll()
+                if code is None:
+                    continue
+                procs.remove(proc)
+                if code != 0:
+                    print(f"launch.py: a rank exited with status {code}, stopping the others", file=sys.stderr)
+                    status = code
+                    for other in procs:
+                        other.terminate()
+            time.sleep(0.05)
+    except KeyboardInterrupt:
+        for proc in procs:
+            proc.terminate()
+        status = 1
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -4,6 +4,7 @@ from sklearn.model_selection import train_test_split
 from cugrad.tensor import Tensor
 from cugrad.nn import MLP
 from cugrad.optimizer import SGD
+from cugrad.data import DataLoader
 from cugrad import set_device, DeviceType
 
 set_device(DeviceType.CPU)
@@ -21,8 +22,8 @@ X_norm = (X - X_mean) / X_std
 # Split into train and test
 X_train, X_test, y_train, y_test = train_test_split(X_norm, y, test_size=0.2, random_state=42)
 
-# Convert to lists of Tensors for easy iteration
-train_data = [(Tensor(x), Tensor([y_])) for x, y_ in zip(X_train, y_train)]
+# Batches are shuffled and gathered on background threads while the model trains
+train_loader = DataLoader(X_train, y_train, batch_size=256, shuffle=True, split_rows=True)
 test_data = [(Tensor(x), Tensor([y_])) for x, y_ in zip(X_test, y_test)]
 
 # Define a small MLP: 13 input features -> [16, 16] hidden layers -> 1 output
@@ -49,26 +50,22 @@ optimizer = SGD(model.parameters(), lr=0.01)
 # Training loop
 epochs = 100
 for epoch in range(epochs):
-    # Shuffle data
-    np.random.shuffle(train_data)
-    inputs = [d[0] for d in train_data]
-    targets = [d[1] for d in train_data]
-
-    model.zero_grad()
-    
-    # Forward pass
-    predictions = [model(inp) for inp in inputs]
-    loss = mse_loss(predictions, targets)
-
-    # Backward pass
-    loss.backward()
-    
-    # Update weights
-    optimizer.step()
-    optimizer.zero_grad()
-    
-    if (epoch + 1) % 1 == 0:
-        print(f"Epoch {epoch+1}/{epochs}, Loss: {loss.data[0]:.4f}")
+    epoch_loss = 0.0
+    for batch in train_loader:
+        optimizer.zero_grad()
+
+        # Forward pass
+        predictions = [model(inp) for inp in batch.input_rows]
+        loss = mse_loss(predictions, batch.target_rows)
+
+        # Backward pass
+        loss.backward()
+
+        # Update weights
+        optimizer.step()
+        epoch_loss += loss.data[0]
+
+    print(f"Epoch {epoch+1}/{epochs}, Loss: {epoch_loss / len(train_loader):.4f}")
 
 # Evaluate on the test set
 test_inps = [d[0] for d in test_data]
@@ -0,0 +1,78 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+// Float storage behind Tensor::data and Tensor::grad.
+// A Buffer either owns its elements or is a view into memory owned elsewhere
+// (e.g. an arena laid out by the memory planner); a view keeps its owner alive.
+// Owned storage of up to inline_elements elements (scalars and other tiny
+// tensors, most of a micrograd-style graph) lives inside the Buffer itself,
+// larger storage on the heap; both count towards MemoryStats.
+// The interface mirrors the parts of std::vector<float> the ops use.
+class Buffer
+{
+public:
+    static const size_t inline_elements = 4;
+
+    Buffer() {}
+    Buffer(size_t n, float value);
+    Buffer(const Buffer &other);
+    Buffer(Buffer &&other) noexcept;
+    ~Buffer();
+
+    // Assigning the same number of elements to a view writes through it;
+    // anything else makes the buffer own a fresh copy
+    Buffer &operator=(const Buffer &other);
+    Buffer &operator=(Buffer &&other) noexcept;
+    Buffer &operator=(const std::vector<float> &values);
+    Buffer &operator=(std::initializer_list<float> values);
+
+    float &operator[](size_t i) { return ptr[i]; }
+    const float &operator[](size_t i) const { return ptr[i]; }
+
+    float *data() { return ptr; }
+    const float *data() const { return ptr; }
+    float *begin() { return ptr; }
+    float *end() { return ptr + count; }
+    const float *begin() const { return ptr; }
+    const float *end() const { return ptr + count; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool is_view() const { return static_cast<bool>(owner); }
+
+    // Owned storage of n elements set to value
+    void assign(size_t n, float value);
+    // Like assign, but keeps the current elements (up to n) and the view if the size is unchanged
+    void resize(size_t n, float value = 0.0f);
+
+    // Point at count elements starting at first, kept alive by owner
+    void bind(std::shared_ptr<void> owner, float *first, size_t count);
+
+    // Drop the storage (owned or viewed)
+    void release();
+
+    std::vector<float> to_vector() const;
+
+private:
+    void assign_values(const float *values, size_t n);
+    // Point ptr at owned storage for n elements (inline or heap), dropping
+    // any view; the elements are left for the caller to write
+    void own(size_t n);
+    // Elements of owned storage, inline or heap
+    size_t held() const { return ptr == local ? count : owned.capacity(); }
+    // Report the change of the owned storage since old_held to MemoryStats
+    void track(size_t old_held);
+
+    std::vector<float> owned;
+    std::shared_ptr<void> owner; // Set for views
+    float *ptr = nullptr;
+    size_t count = 0;
+    float local[inline_elements];
+};
+
+#endif // BUFFER_H
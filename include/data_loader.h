@@ -0,0 +1,111 @@
+#ifndef DATA_LOADER_H
+#define DATA_LOADER_H
+
+#include "tensor.h"
+
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A read-only rows x cols float32 table. The storage is either an owned copy
+// or a memory-mapped .npy file; data keeps it alive.
+struct DataArray
+{
+    std::shared_ptr<const float> data;
+    size_t rows = 0;
+    size_t cols = 0;
+
+    bool empty() const { return rows == 0; }
+
+    // Take ownership of values (rows * cols elements, row-major)
+    static DataArray from_vector(std::vector<float> values, size_t rows, size_t cols);
+
+    // Memory-map a little-endian float32, C-order .npy file of 1 or 2
+    // dimensions (1-D files become one column)
+    static DataArray load_npy(const std::string &path);
+};
+
+struct Batch
+{
+    size_t index = 0;                // Position in the epoch
+    std::shared_ptr<Tensor> inputs;  // [batch, input cols]
+    std::shared_ptr<Tensor> targets; // [batch, target cols]; null without targets
+    // Per-row [cols] tensors viewing inputs / targets, filled when the loader
+    // splits rows (modules such as MLP take one sample at a time)
+    std::vector<std::shared_ptr<Tensor>> input_rows;
+    std::vector<std::shared_ptr<Tensor>> target_rows;
+};
+
+// [cols] tensors viewing each row of a [rows, cols] CPU tensor; they keep
+// the batch tensor alive
+std::vector<std::shared_ptr<Tensor>> split_rows(const std::shared_ptr<Tensor> &batch);
+
+// Iterates over (inputs, targets) in batches. Each epoch visits every row
+// once, in a fresh random order when shuffling (seeded by seed and the epoch
+// number). Worker threads gather the rows of upcoming batches into
+// contiguous tensors while the caller trains on the current one; at most
+// prefetch batches are in flight, and next() returns them in order.
+class DataLoader
+{
+public:
+    DataLoader(DataArray inputs, DataArray targets, int batch_size, bool shuffle = true, bool drop_last = false,
+               int num_workers = 2, int prefetch = 4, unsigned seed = 0, bool split_rows = false);
+    ~DataLoader();
+
+    DataLoader(DataLoader const &) = delete;
+    void operator=(DataLoader const &) = delete;
+
+    // Start a new epoch (reshuffling); batches of the previous one not yet
+    // returned by next() are dropped
+    void start_epoch();
+
+    // Block until the next batch of the current epoch is ready. Returns false
+    // once the epoch is exhausted. Rethrows an error raised while gathering.
+    bool next(Batch &batch);
+
+    size_t num_batches() const;
+    size_t num_rows() const { return inputs.rows; }
+    int epoch() const { return epoch_count; }
+
+private:
+    struct Result
+    {
+        Batch batch;
+        std::exception_ptr error;
+    };
+
+    void worker_loop();
+    Batch make_batch(const std::vector<size_t> &order, size_t index) const;
+    std::shared_ptr<Tensor> gather(const DataArray &array, const std::vector<size_t> &order, size_t first,
+                                   size_t count) const;
+
+    DataArray inputs;
+    DataArray targets;
+    size_t batch_size;
+    bool shuffle;
+    bool drop_last;
+    size_t prefetch;
+    unsigned seed;
+    bool split;
+    DeviceType device; // Device of the batch tensors (current device at construction)
+
+    std::mutex mutex;
+    std::condition_variable work_available; // Workers: a batch may be claimed, or stopping
+    std::condition_variable batch_ready;    // Consumer: a result was stored
+    std::shared_ptr<const std::vector<size_t>> order; // Row order of the current epoch
+    unsigned long generation = 0;                     // Bumped per epoch; stale results are dropped
+    size_t next_claim = 0;                            // Next batch index for a worker
+    size_t next_deliver = 0;                          // Next batch index for next()
+    std::map<size_t, Result> ready;
+    bool stopping = false;
+    int epoch_count = 0;
+
+    std::vector<std::thread> workers;
+};
+
+#endif // DATA_LOADER_H
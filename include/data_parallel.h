@@ -0,0 +1,110 @@
+#ifndef DATA_PARALLEL_H
+#define DATA_PARALLEL_H
+
+#include "nn.h"
+#include "optimizer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Synchronous data-parallel training on threads.
+// The module is replicated (Module::clone) once per thread and every replica
+// is flattened. A step splits the batch into one shard per replica; each
+// replica runs forward and backward on its shard. The flat gradients are cut
+// into buckets of whole parameters; as soon as backward has finalized a
+// bucket on every replica, the last replica to get there sums it across all
+// replicas in place, while the others are still running backward. Every
+// replica then applies the same optimizer step to the same summed gradient,
+// so they stay identical without broadcasting parameters. If a step fails on
+// some replicas, the others are reset to replica 0's parameters and
+// optimizer state; if it fails on replica 0, the wrapper refuses further steps.
+class DataParallel
+{
+public:
+    // Loss of one sample: the module output and target of one row, to a
+    // single-element tensor. Called on every replica's thread.
+    using LossFunction = std::function<std::shared_ptr<Tensor>(const std::shared_ptr<Tensor> &output,
+                                                               const std::shared_ptr<Tensor> &target)>;
+
+    // (output - target)^2 summed over the outputs
+    static std::shared_ptr<Tensor> squared_error(const std::shared_ptr<Tensor> &output,
+                                                 const std::shared_ptr<Tensor> &target);
+
+    // module and optimizer (built over module->parameters()) become replica
+    // 0; the others get clones of both. CPU only. loss defaults to squared_error.
+    DataParallel(std::shared_ptr<Module> module, std::shared_ptr<Optimizer> optimizer, int num_replicas,
+                 size_t bucket_elements = 1 << 14, LossFunction loss = nullptr);
+    ~DataParallel();
+
+    DataParallel(DataParallel const &) = delete;
+    void operator=(DataParallel const &) = delete;
+
+    // One training step on [batch, features] inputs and [batch, outputs]
+    // targets with the loss averaged over the batch (which is also the
+    // returned value)
+    float train_step(const std::shared_ptr<Tensor> &inputs, const std::shared_ptr<Tensor> &targets);
+
+    int num_replicas() const { return static_cast<int>(replicas.size()); }
+    size_t num_buckets() const { return buckets.size(); }
+    std::shared_ptr<Module> replica(int index) const;
+
+private:
+    struct Bucket
+    {
+        size_t begin = 0; // Range of the flat gradient
+        size_t end = 0;
+        int num_params = 0;
+        std::atomic<int> arrived{0}; // Replicas that finished this bucket in the current step
+    };
+
+    struct Replica
+    {
+        std::shared_ptr<Module> module;
+        std::shared_ptr<Optimizer> optimizer;
+        std::unordered_map<const Tensor *, size_t> bucket_of; // Parameter -> bucket
+        std::unique_ptr<std::atomic<int>[]> pending;          // Per bucket: parameters not final yet
+        size_t first_row = 0;                                 // Shard of the current step
+        size_t end_row = 0;
+        float loss = 0.0f;
+        std::exception_ptr error;
+        bool step_failed = false; // error came from optimizer->step()
+    };
+
+    void worker_loop(int index);
+    void run_replica(int index);
+    void arrive(size_t bucket);
+    void reduce(size_t bucket);
+    // Copy replica 0's parameters and optimizer state to the others
+    void resync();
+
+    LossFunction loss_function;
+
+    std::vector<std::unique_ptr<Replica>> replicas;
+    std::vector<std::unique_ptr<Bucket>> buckets;
+
+    // Inputs of the current step, split into rows
+    std::vector<std::shared_ptr<Tensor>> input_rows;
+    std::vector<std::shared_ptr<Tensor>> target_rows;
+    float inv_batch = 0.0f;
+
+    std::mutex mutex;
+    std::condition_variable work_available; // Workers: a new step (generation) or stopping
+    std::condition_variable progress;       // A bucket was reduced or a replica finished
+    unsigned long generation = 0;
+    size_t reduced = 0;      // Buckets summed in the current step
+    int running = 0;         // Worker replicas still in the current step
+    bool failed = false;     // Some replica threw; nobody steps
+    bool stopping = false;
+    bool broken = false;     // Replica 0 failed a step after others may have stepped
+
+    std::vector<std::thread> workers;
+};
+
+#endif // DATA_PARALLEL_H
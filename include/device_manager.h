@@ -1,8 +1,14 @@
 #ifndef DEVICE_MANAGER_H
 #define DEVICE_MANAGER_H
 
+#include <atomic>
+
 #include "device.h"
 
+// Device new tensors are created on.
+// The current device is per thread, so threads building independent graphs
+// do not see each other's set_current_device(). A thread that never set one
+// follows the process-wide default.
 class DeviceManager
 {
 public:
@@ -17,18 +23,68 @@ public:
 
     DeviceType get_current_device() const
     {
-        return current_device;
+        const ThreadDevice &state = thread_device();
+        return state.is_set ? state.device : default_device.load(std::memory_order_relaxed);
     }
 
+    // The calling thread's device
     void set_current_device(DeviceType device)
     {
-        this->current_device = device;
+        ThreadDevice &state = thread_device();
+        state.device = device;
+        state.is_set = true;
+    }
+
+    // For threads that never called set_current_device()
+    DeviceType get_default_device() const
+    {
+        return default_device.load(std::memory_order_relaxed);
+    }
+
+    void set_default_device(DeviceType device)
+    {
+        default_device.store(device, std::memory_order_relaxed);
     }
 
 private:
-    DeviceType current_device;
+    struct ThreadDevice
+    {
+        bool is_set = false;
+        DeviceType device = DeviceType::CPU;
+    };
+
+    static ThreadDevice &thread_device()
+    {
+        static thread_local ThreadDevice state;
+        return state;
+    }
+
+    friend class DeviceGuard;
+
+    std::atomic<DeviceType> default_device;
     // Singleton pattern
-    DeviceManager() : current_device(DeviceType::CPU) {}
+    DeviceManager() : default_device(DeviceType::CPU) {}
+};
+
+// Makes device the calling thread's current device for the guard's scope
+class DeviceGuard
+{
+public:
+    explicit DeviceGuard(DeviceType device) : saved(DeviceManager::thread_device())
+    {
+        DeviceManager::get_instance().set_current_device(device);
+    }
+
+    ~DeviceGuard()
+    {
+        DeviceManager::thread_device() = saved;
+    }
+
+    DeviceGuard(DeviceGuard const &) = delete;
+    void operator=(DeviceGuard const &) = delete;
+
+private:
+    DeviceManager::ThreadDevice saved;
 };
 
 #endif // DEVICE_MANAGER_H
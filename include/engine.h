@@ -0,0 +1,30 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <memory>
+#include <vector>
+
+#include "tensor.h"
+
+// Dependency-driven backward executor.
+// Every node keeps a count of the consumers whose backward has not run yet;
+// once it drops to zero the node's gradient is final and its op is scheduled
+// on the global work-stealing pool. Independent subgraphs (e.g. the neurons
+// under a StackOp) therefore run concurrently. An op whose input is also read
+// by other ops accumulates that gradient into per-thread scratch, added into
+// the input under a lock striped by address (the locks belong to one call).
+// Unless retain_graph is set, nodes are released as in Tensor::backward().
+class BackwardEngine
+{
+public:
+    // ordering: topological order of the graph rooted at its last element,
+    // with the root gradient already seeded
+    // on_leaf_ready, if set, is called as each leaf's gradient becomes final
+    static void execute(std::vector<std::shared_ptr<Tensor>> ordering, bool retain_graph = false,
+                        const LeafGradHook &on_leaf_ready = nullptr);
+
+    // Graphs smaller than this are not worth the scheduling overhead
+    static const int min_parallel_nodes = 64;
+};
+
+#endif // ENGINE_H
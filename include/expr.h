@@ -0,0 +1,434 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tensor.h"
+#include "node_pool.h"
+
+// Expression templates for elementwise math from C++.
+// The operators on std::shared_ptr<Tensor> build one op and one output tensor
+// per operation. Here an expression is only a value of a nested type, e.g.
+//
+//     auto a = expr::leaf(x), b = expr::leaf(w), c = expr::leaf(bias);
+//     auto e = (a * b + c).tanh();   // nothing computed yet
+//
+// and one loop over the elements computes the whole expression, with no
+// temporaries:
+//
+//     expr::eval(e)          // a new tensor (a leaf: no graph)
+//     expr::assign(*out, e)  // into an existing tensor of the same shape
+//     expr::fuse(e)          // one FusedOp in the autograd graph
+//
+// fuse() is the opt-in autograd hook: backward is generated from the same
+// expression, walking it in reverse for each element. Values of inner nodes
+// are recomputed there rather than stored, so the op saves nothing but its
+// inputs. Forward-mode tangents are supported as well.
+// Operands are tensors of one shape and float constants. CPU only.
+namespace expr
+{
+    template <typename F, typename A>
+    class Unary;
+    struct TanhFn;
+    struct ExpFn;
+    struct ReluFn;
+
+    // Base of every expression node (CRTP). A node E provides
+    //   static const size_t leaves       number of tensor operands, repeats included
+    //   const Shape *shape() const       shape of its tensors, null if it has none
+    //   void collect(inputs)             number its leaves by their tensor in inputs
+    //   void bind(inputs, grads, n)      point its leaves at their buffers (grads: one per
+    //                                    input, null outside backward)
+    //   float value(i) const             element i
+    //   float tangent(i) const           element i of the forward-mode tangent
+    //   void backprop(i, g) const        add g * d(value(i))/d(leaf) to each leaf's grad
+    template <typename E>
+    class Expr
+    {
+    public:
+        const E &self() const { return static_cast<const E &>(*this); }
+
+        Unary<TanhFn, E> tanh() const { return Unary<TanhFn, E>(self()); }
+        Unary<ExpFn, E> exp() const { return Unary<ExpFn, E>(self()); }
+        Unary<ReluFn, E> relu() const { return Unary<ReluFn, E>(self()); }
+    };
+
+    // A tensor operand. Once collected it refers to its tensor only by slot,
+    // so a FusedOp's inputs stay the graph's one owner of its children.
+    class Leaf : public Expr<Leaf>
+    {
+    public:
+        static const size_t leaves = 1;
+
+        explicit Leaf(std::shared_ptr<Tensor> tensor) : tensor(std::move(tensor))
+        {
+            if (!this->tensor)
+            {
+                throw std::invalid_argument("Expression operand is a null tensor.");
+            }
+        }
+
+        const Shape *shape() const { return &tensor->shape; }
+
+        void collect(std::vector<std::shared_ptr<Tensor>> &inputs)
+        {
+            slot = 0;
+            while (slot < inputs.size() && inputs[slot] != tensor)
+            {
+                slot++;
+            }
+            if (slot == inputs.size())
+            {
+                inputs.push_back(tensor);
+            }
+            tensor.reset();
+        }
+
+        void bind(const std::vector<std::shared_ptr<Tensor>> &inputs, float *const *grads, size_t n)
+        {
+            Tensor &t = *inputs[slot];
+            if (t.device != DeviceType::CPU)
+            {
+                throw std::invalid_argument("Fused expressions are only supported on the CPU.");
+            }
+            if (t.data.size() != n)
+            {
+                throw std::invalid_argument("Fused expression operands must have the same shape.");
+            }
+            x = t.data.data();
+            dx = grads ? grads[slot] : nullptr;
+            tx = t.tangent.data();
+        }
+
+        float value(size_t i) const { return x[i]; }
+        float tangent(size_t i) const { return tx[i]; }
+        void backprop(size_t i, float g) const { dx[i] += g; }
+
+    private:
+        std::shared_ptr<Tensor> tensor;
+        size_t slot = 0;
+        const float *x = nullptr;
+        float *dx = nullptr;
+        const float *tx = nullptr;
+    };
+
+    // A float constant, the same for every element
+    class Scalar : public Expr<Scalar>
+    {
+    public:
+        static const size_t leaves = 0;
+
+        explicit Scalar(float c) : c(c) {}
+
+        const Shape *shape() const { return nullptr; }
+        void collect(std::vector<std::shared_ptr<Tensor>> &) {}
+        void bind(const std::vector<std::shared_ptr<Tensor>> &, float *const *, size_t) {}
+
+        float value(size_t) const { return c; }
+        float tangent(size_t) const { return 0.0f; }
+        void backprop(size_t, float) const {}
+
+    private:
+        float c;
+    };
+
+    // F provides apply(x) and derivative(x, y) with y = apply(x)
+    template <typename F, typename A>
+    class Unary : public Expr<Unary<F, A>>
+    {
+    public:
+        static const size_t leaves = A::leaves;
+
+        explicit Unary(const A &arg) : arg(arg) {}
+
+        const Shape *shape() const { return arg.shape(); }
+        void collect(std::vector<std::shared_ptr<Tensor>> &inputs) { arg.collect(inputs); }
+        void bind(const std::vector<std::shared_ptr<Tensor>> &inputs, float *const *grads, size_t n)
+        {
+            arg.bind(inputs, grads, n);
+        }
+
+        float value(size_t i) const { return F::apply(arg.value(i)); }
+
+        float tangent(size_t i) const
+        {
+            float x = arg.value(i);
+            return F::derivative(x, F::apply(x)) * arg.tangent(i);
+        }
+
+        void backprop(size_t i, float g) const
+        {
+            float x = arg.value(i);
+            arg.backprop(i, g * F::derivative(x, F::apply(x)));
+        }
+
+    private:
+        A arg;
+    };
+
+    // F provides apply(a, b) and the partials d_lhs(a, b), d_rhs(a, b)
+    template <typename F, typename A, typename B>
+    class Binary : public Expr<Binary<F, A, B>>
+    {
+    public:
+        static const size_t leaves = A::leaves + B::leaves;
+
+        Binary(const A &lhs, const B &rhs) : lhs(lhs), rhs(rhs)
+        {
+            const Shape *a = lhs.shape();
+            const Shape *b = rhs.shape();
+            if (a && b && *a != *b)
+            {
+                throw std::invalid_argument("Binary op shapes must match.");
+            }
+        }
+
+        const Shape *shape() const
+        {
+            const Shape *a = lhs.shape();
+            return a ? a : rhs.shape();
+        }
+
+        void collect(std::vector<std::shared_ptr<Tensor>> &inputs)
+        {
+            lhs.collect(inputs);
+            rhs.collect(inputs);
+        }
+
+        void bind(const std::vector<std::shared_ptr<Tensor>> &inputs, float *const *grads, size_t n)
+        {
+            lhs.bind(inputs, grads, n);
+            rhs.bind(inputs, grads, n);
+        }
+
+        float value(size_t i) const { return F::apply(lhs.value(i), rhs.value(i)); }
+
+        float tangent(size_t i) const
+        {
+            float a = lhs.value(i);
+            float b = rhs.value(i);
+            return F::d_lhs(a, b) * lhs.tangent(i) + F::d_rhs(a, b) * rhs.tangent(i);
+        }
+
+        void backprop(size_t i, float g) const
+        {
+            float a = lhs.value(i);
+            float b = rhs.value(i);
+            lhs.backprop(i, g * F::d_lhs(a, b));
+            rhs.backprop(i, g * F::d_rhs(a, b));
+        }
+
+    private:
+        A lhs;
+        B rhs;
+    };
+
+    // Elementwise functions, with the same derivatives as the ops in op.cpp
+
+    struct AddFn
+    {
+        static float apply(float a, float b) { return a + b; }
+        static float d_lhs(float, float) { return 1.0f; }
+        static float d_rhs(float, float) { return 1.0f; }
+    };
+
+    struct SubFn
+    {
+        static float apply(float a, float b) { return a - b; }
+        static float d_lhs(float, float) { return 1.0f; }
+        static float d_rhs(float, float) { return -1.0f; }
+    };
+
+    struct MulFn
+    {
+        static float apply(float a, float b) { return a * b; }
+        static float d_lhs(float, float b) { return b; }
+        static float d_rhs(float a, float) { return a; }
+    };
+
+    struct DivFn
+    {
+        static float apply(float a, float b)
+        {
+            if (b == 0.0f)
+                throw std::domain_error("Division by zero");
+            return a / b;
+        }
+        static float d_lhs(float, float b) { return 1.0f / b; }
+        static float d_rhs(float a, float b) { return -a / (b * b); }
+    };
+
+    struct TanhFn
+    {
+        static float apply(float x) { return std::tanh(x); }
+        static float derivative(float, float y) { return 1.0f - y * y; }
+    };
+
+    struct ExpFn
+    {
+        static float apply(float x) { return std::exp(x); }
+        static float derivative(float, float y) { return y; }
+    };
+
+    struct ReluFn
+    {
+        static float apply(float x) { return x > 0.0f ? x : 0.0f; }
+        static float derivative(float x, float) { return x > 0.0f ? 1.0f : 0.0f; }
+    };
+
+    inline Leaf leaf(std::shared_ptr<Tensor> tensor) { return Leaf(std::move(tensor)); }
+
+    // Operands of the arithmetic operators: expressions, tensors and floats
+    template <typename E>
+    const E &operand(const Expr<E> &e) { return e.self(); }
+    inline Leaf operand(const std::shared_ptr<Tensor> &tensor) { return Leaf(tensor); }
+    inline Scalar operand(float c) { return Scalar(c); }
+
+    template <typename T>
+    using operand_t = std::decay_t<decltype(operand(std::declval<const T &>()))>;
+
+    template <typename T>
+    using is_expr = std::is_base_of<Expr<T>, T>;
+
+    // At least one side must be an expression, so tensor @ tensor keeps
+    // meaning the eager operators in tensor.h
+    template <typename A, typename B, typename F>
+    using binary_t = std::enable_if_t<is_expr<A>::value || is_expr<B>::value,
+                                      Binary<F, operand_t<A>, operand_t<B>>>;
+
+    template <typename A, typename B>
+    binary_t<A, B, AddFn> operator+(const A &a, const B &b) { return {operand(a), operand(b)}; }
+    template <typename A, typename B>
+    binary_t<A, B, SubFn> operator-(const A &a, const B &b) { return {operand(a), operand(b)}; }
+    template <typename A, typename B>
+    binary_t<A, B, MulFn> operator*(const A &a, const B &b) { return {operand(a), operand(b)}; }
+    template <typename A, typename B>
+    binary_t<A, B, DivFn> operator/(const A &a, const B &b) { return {operand(a), operand(b)}; }
+
+    // A copy of e with its leaves numbered by their tensor in inputs
+    template <typename E>
+    E collected(const Expr<E> &e, std::vector<std::shared_ptr<Tensor>> &inputs)
+    {
+        E bound = e.self();
+        inputs.reserve(E::leaves);
+        bound.collect(inputs);
+        if (inputs.empty())
+        {
+            throw std::invalid_argument("Expression has no tensor operand.");
+        }
+        return bound;
+    }
+
+    // out = e, in one loop. out may be one of e's operands.
+    template <typename E>
+    void assign(Tensor &out, const Expr<E> &e)
+    {
+        std::vector<std::shared_ptr<Tensor>> inputs;
+        E bound = collected(e, inputs);
+        if (out.shape != inputs[0]->shape || out.device != DeviceType::CPU)
+        {
+            throw std::invalid_argument("Fused expression assigned to a tensor of another shape or device.");
+        }
+        size_t n = out.data.size();
+        bound.bind(inputs, nullptr, n);
+        float *y = out.data.data();
+        for (size_t i = 0; i < n; i++)
+        {
+            y[i] = bound.value(i);
+        }
+    }
+
+    // A new tensor holding e (a leaf: nothing to differentiate through)
+    template <typename E>
+    std::shared_ptr<Tensor> eval(const Expr<E> &e)
+    {
+        std::vector<std::shared_ptr<Tensor>> inputs;
+        E bound = collected(e, inputs);
+        auto out = make_node<Tensor>(inputs[0]->shape);
+        size_t n = out->data.size();
+        bound.bind(inputs, nullptr, n);
+        float *y = out->data.data();
+        for (size_t i = 0; i < n; i++)
+        {
+            y[i] = bound.value(i);
+        }
+        return out;
+    }
+
+    // A whole expression as one graph node (see expr::fuse)
+    template <typename E>
+    class FusedOp : public Op
+    {
+    public:
+        FusedOp(const E &expression, std::vector<std::shared_ptr<Tensor>> inputs)
+            : Op(std::move(inputs), OpKind::Fused), expression(expression) {}
+
+        void forward() override
+        {
+            allocate_output(inputs[0]->shape);
+
+            size_t n = output->data.size();
+            bool tangents = output->device == DeviceType::CPU && prepare_tangents();
+            E bound = expression;
+            bound.bind(inputs, nullptr, n);
+            float *y = output->data.data();
+            if (tangents)
+            {
+                float *ty = output->tangent.data();
+                for (size_t i = 0; i < n; i++)
+                {
+                    y[i] = bound.value(i);
+                    ty[i] = bound.tangent(i);
+                }
+            }
+            else
+            {
+                for (size_t i = 0; i < n; i++)
+                {
+                    y[i] = bound.value(i);
+                }
+            }
+
+            output->op = shared_from_this();
+        }
+
+        void backward() override
+        {
+            size_t n = output->data.size();
+            std::vector<float *> grads(inputs.size());
+            for (size_t k = 0; k < grads.size(); k++)
+            {
+                grads[k] = input_grad(k);
+            }
+            E bound = expression;
+            bound.bind(inputs, grads.data(), n);
+            const float *d_out = output->grad.data();
+            for (size_t i = 0; i < n; i++)
+            {
+                bound.backprop(i, d_out[i]);
+            }
+        }
+
+    private:
+        E expression; // Leaves refer to inputs by slot
+    };
+
+    // e as one autograd node: a single forward loop, and a backward generated
+    // from e that accumulates into every tensor operand's gradient
+    template <typename E>
+    std::shared_ptr<Tensor> fuse(const Expr<E> &e)
+    {
+        std::vector<std::shared_ptr<Tensor>> inputs;
+        E bound = collected(e, inputs);
+        auto op = make_node<FusedOp<E>>(bound, std::move(inputs));
+        op->run_forward();
+        return op->output;
+    }
+}
+
+#endif // EXPR_H
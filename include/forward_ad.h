@@ -0,0 +1,27 @@
+#ifndef FORWARD_AD_H
+#define FORWARD_AD_H
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "tensor.h"
+
+// Forward-mode automatic differentiation (Jacobian-vector products).
+// The primals are given tangents before fn runs; every op then pushes
+// tangents forward inside its own forward loop, so one call yields the
+// outputs and J(primals) * tangents for about the cost of one forward pass.
+// Returns (outputs, output tangents). CPU only.
+std::pair<std::vector<std::shared_ptr<Tensor>>, std::vector<std::shared_ptr<Tensor>>>
+jvp(const std::function<std::vector<std::shared_ptr<Tensor>>(const std::vector<std::shared_ptr<Tensor>> &)> &fn,
+    const std::vector<std::shared_ptr<Tensor>> &primals,
+    const std::vector<std::shared_ptr<Tensor>> &tangents);
+
+// Called by Op::prepare_tangents for every tensor it gives a tangent. During
+// jvp() the calling thread's tensors are recorded, and exactly those are
+// cleared afterwards, including ones the outputs no longer reach (weights
+// under no_grad, dead branches).
+void record_tangent(Tensor &tensor);
+
+#endif // FORWARD_AD_H
@@ -0,0 +1,49 @@
+#ifndef GRAD_MODE_H
+#define GRAD_MODE_H
+
+// Whether ops record the graph for backward(), per thread (on by default).
+// With it off, Op::run_forward() still computes the output but leaves it
+// without an op or children, so inference keeps no intermediates alive.
+class GradMode
+{
+public:
+    static bool is_enabled() { return enabled_flag(); }
+    static void set_enabled(bool enabled) { enabled_flag() = enabled; }
+
+private:
+    static bool &enabled_flag()
+    {
+        static thread_local bool enabled = true;
+        return enabled;
+    }
+};
+
+// Sets the calling thread's grad mode for the guard's scope
+class GradModeGuard
+{
+public:
+    explicit GradModeGuard(bool enabled) : saved(GradMode::is_enabled())
+    {
+        GradMode::set_enabled(enabled);
+    }
+
+    ~GradModeGuard()
+    {
+        GradMode::set_enabled(saved);
+    }
+
+    GradModeGuard(GradModeGuard const &) = delete;
+    void operator=(GradModeGuard const &) = delete;
+
+private:
+    bool saved;
+};
+
+// Scope in which no graph is recorded
+class NoGradGuard : public GradModeGuard
+{
+public:
+    NoGradGuard() : GradModeGuard(false) {}
+};
+
+#endif // GRAD_MODE_H
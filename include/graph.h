@@ -0,0 +1,75 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <memory>
+#include <vector>
+
+#include "tensor.h"
+#include "op.h"
+#include "memory_planner.h"
+
+// A compute graph recorded once and replayed many times.
+// Capturing walks the graph a single time and keeps the ops in forward order
+// together with their (already allocated) output tensors. replay() then only
+// runs the kernels: no Op/Tensor construction and no topological sort per step.
+// Shapes are fixed at capture time. The captured nodes are kept alive by the
+// plan and are never released by replay().
+struct GraphOptimizationStats
+{
+    int ops_before = 0;
+    int ops_after = 0;
+    int cse_merged = 0;
+    int constants_folded = 0;
+    int dead_removed = 0;
+};
+
+class CapturedGraph
+{
+public:
+    // output: the tensor to differentiate (usually the loss)
+    // inputs: leaf tensors whose values change between replays
+    CapturedGraph(std::shared_ptr<Tensor> output, const std::vector<std::shared_ptr<Tensor>> &inputs);
+
+    // Copy new values into the inputs, then run forward and backward
+    void replay(const std::vector<std::vector<float>> &input_data);
+    // Run forward and backward with the current input values
+    void replay();
+
+    void forward();
+    void backward();
+
+    // Compute the live interval of every intermediate data and grad buffer
+    // over the forward+backward schedule, pack them into one arena and point
+    // the tensors at their slices. CPU only. Intermediate values are
+    // recomputed by a forward pass once the tensors are rebound.
+    MemoryPlanStats plan_memory();
+
+    // Simplify the recorded graph: merge identical (op_type, inputs) nodes,
+    // fold ops whose inputs are all constant leaves (Tensor::constant) and
+    // drop ops that no longer reach the output. Must run before plan_memory().
+    GraphOptimizationStats optimize();
+
+    int num_ops() const;
+
+    std::shared_ptr<Tensor> output;
+    std::vector<std::shared_ptr<Tensor>> inputs;
+
+private:
+    // Schedule steps: forward of op k runs at step k, its backward at step 2n - 1 - k
+    int forward_step(int k) const { return k; }
+    int backward_step(int k) const { return 2 * num_ops() - 1 - k; }
+
+    // Collect the ops reachable from output and when to clear their gradients
+    void build_schedule();
+
+    std::vector<std::shared_ptr<Op>> ops; // Forward execution order
+    // Latest op (in forward order) reading each intermediate; its backward
+    // is the first to write the intermediate's gradient
+    std::vector<int> last_consumer;
+    // Intermediate gradients to clear right before each op's backward
+    std::vector<std::vector<std::shared_ptr<Tensor>>> zero_before;
+
+    std::shared_ptr<float> arena; // Set once plan_memory() has run
+};
+
+#endif // GRAPH_H
@@ -0,0 +1,167 @@
+#ifndef INFERENCE_H
+#define INFERENCE_H
+
+#include "nn.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Error of a plan's outputs against a reference plan on the same inputs
+struct QuantizationReport
+{
+    size_t rows = 0;
+    double max_abs_error = 0.0;
+    double mean_abs_error = 0.0;
+    double rms_error = 0.0;
+    double reference_rms = 0.0; // RMS of the reference outputs, for scale
+    size_t weight_bytes = 0;
+    size_t reference_weight_bytes = 0;
+
+    std::string summary() const;
+};
+
+// A trained module frozen into dense per-layer matrices, without autograd.
+// Immutable once built, so any number of threads may run it at once.
+class InferencePlan
+{
+public:
+    // Working memory of one caller, reused between run() calls
+    struct Scratch
+    {
+        std::vector<float> values;
+        std::vector<uint8_t> activations;
+        std::vector<int32_t> accumulators;
+    };
+
+    // Supports MLP, Layer and Neuron; copies the current parameter values
+    static std::shared_ptr<InferencePlan> freeze(Module &module);
+
+    // int8 copy of this (fp32) plan. Weights are quantized symmetrically per
+    // output channel; each layer's input range is calibrated by running the
+    // rows of calibration through this plan. Activations are 7-bit unsigned
+    // with a zero point (see int8_kernels.h). Dequantization, bias, tanh and
+    // quantization for the next layer happen in one pass over the int32
+    // products.
+    std::shared_ptr<InferencePlan> quantize(const float *calibration, size_t rows) const;
+
+    // inputs: batch rows of input_size() floats; outputs: batch rows of
+    // output_size() floats
+    void run(const float *inputs, float *outputs, size_t batch, Scratch &scratch) const;
+
+    // Compare this plan's outputs with reference's on rows of inputs
+    QuantizationReport compare(const InferencePlan &reference, const float *inputs, size_t rows) const;
+
+    size_t input_size() const { return layers.front().in; }
+    size_t output_size() const { return layers.back().out; }
+    size_t num_layers() const { return layers.size(); }
+    bool is_quantized() const { return quantized; }
+    // Bytes of weights, biases and quantization parameters
+    size_t weight_bytes() const;
+
+private:
+    struct DenseLayer
+    {
+        size_t in = 0;
+        size_t out = 0;
+        std::vector<float> weights; // [out, in], row-major; empty once quantized
+        std::vector<float> bias;    // [out]
+        bool tanh = false;
+
+        // int8 form: x ~ input_scale * (q - input_zero) with q in [0, 127], and
+        // y[o] = channel_scales[o] * (sum_i q_i * qweights[o, i] - zero_offsets[o]) + bias[o]
+        std::vector<int8_t> qweights;      // [out, in]
+        std::vector<float> channel_scales; // input_scale * weight scale of channel o
+        std::vector<int32_t> zero_offsets; // input_zero * sum_i qweights[o, i]
+        float input_scale = 1.0f;
+        int32_t input_zero = 0;
+    };
+
+    void add_layer(const Layer &layer);
+    void run_fp32(const float *inputs, float *outputs, size_t batch, Scratch &scratch) const;
+    void run_int8(const float *inputs, float *outputs, size_t batch, Scratch &scratch) const;
+
+    std::vector<DenseLayer> layers;
+    bool quantized = false;
+};
+
+struct InferenceStats
+{
+    size_t requests = 0;
+    size_t batches = 0;
+    double mean_batch_size = 0.0;
+    // End-to-end request latency (queueing + compute), in microseconds,
+    // over the most recent requests
+    double p50_latency_us = 0.0;
+    double p90_latency_us = 0.0;
+    double p99_latency_us = 0.0;
+    double max_latency_us = 0.0;
+    std::vector<size_t> batch_histogram; // batch_histogram[n]: batches of n requests
+
+    std::string summary() const;
+};
+
+// Serves an InferencePlan to concurrent callers. Requests are queued and
+// coalesced: a worker takes up to max_batch requests at once, waiting at
+// most max_delay_us after the oldest queued request arrived for more to
+// join, then runs them as one batch.
+class InferenceServer
+{
+public:
+    InferenceServer(std::shared_ptr<const InferencePlan> plan, size_t max_batch = 32, double max_delay_us = 1000.0,
+                    int num_workers = 2);
+    ~InferenceServer();
+
+    InferenceServer(InferenceServer const &) = delete;
+    void operator=(InferenceServer const &) = delete;
+
+    // Queue one input row; the future gets its output row
+    std::future<std::vector<float>> submit(std::vector<float> input);
+    // submit() and wait
+    std::vector<float> infer(std::vector<float> input);
+
+    InferenceStats stats() const;
+    void reset_stats();
+
+    // Latencies kept for the percentiles
+    static const size_t latency_window = 100000;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request
+    {
+        std::vector<float> input;
+        std::promise<std::vector<float>> result;
+        Clock::time_point arrival;
+    };
+
+    void worker_loop();
+    void record(size_t batch_size, const std::vector<double> &latencies_us);
+
+    std::shared_ptr<const InferencePlan> plan;
+    size_t max_batch;
+    std::chrono::microseconds max_delay;
+
+    std::mutex mutex;
+    std::condition_variable queue_cv;
+    std::deque<Request> queue;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    mutable std::mutex stats_mutex;
+    size_t total_requests = 0;
+    size_t total_batches = 0;
+    std::vector<size_t> batch_histogram;
+    std::vector<double> latencies_us; // Ring buffer of the last latency_window requests
+    size_t next_latency = 0;
+};
+
+#endif // INFERENCE_H
@@ -0,0 +1,24 @@
+#ifndef INT8_KERNELS_H
+#define INT8_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Integer matrix products for quantized inference:
+//     out[b * n + o] = sum_i a[b * k + i] * w[o * k + i]
+// Activations are unsigned and must lie in [0, 127]: with 7-bit activations
+// the pairwise sums of vpmaddubsw cannot saturate, so every kernel returns
+// exactly the same result. The kernel is picked at runtime from the ones
+// the CPU supports (AVX-512 VNNI, AVX-VNNI, AVX2, then scalar).
+void int8_matmul(const uint8_t *a, const int8_t *w, int32_t *out, size_t batch, size_t n, size_t k);
+
+// Name of the kernel int8_matmul uses
+std::string int8_kernel();
+// Kernels this CPU can run, fastest first; "scalar" is always last
+std::vector<std::string> available_int8_kernels();
+// Force a kernel by name, or "auto" for the fastest available
+void set_int8_kernel(const std::string &name);
+
+#endif // INT8_KERNELS_H
@@ -0,0 +1,30 @@
+#ifndef MEMORY_PLANNER_H
+#define MEMORY_PLANNER_H
+
+#include <cstddef>
+#include <vector>
+
+// A buffer that must stay intact over the plan steps [first_use, last_use]
+struct BufferLifetime
+{
+    size_t size;    // Elements
+    int first_use;  // Step that first writes the buffer
+    int last_use;   // Last step that reads it
+    size_t offset;  // Assigned position in the arena (elements)
+};
+
+struct MemoryPlanStats
+{
+    size_t naive_bytes = 0;   // Every buffer in its own allocation
+    size_t planned_bytes = 0; // Size of the shared arena
+    int num_buffers = 0;
+};
+
+// Greedy-by-size offset assignment: buffers are placed largest first at the
+// lowest offset that does not overlap any already placed buffer whose
+// lifetime intersects theirs. Buffers of at least alignment elements start
+// at a multiple of alignment.
+// Returns the arena size in elements.
+size_t assign_offsets(std::vector<BufferLifetime> &buffers, size_t alignment = 16);
+
+#endif // MEMORY_PLANNER_H
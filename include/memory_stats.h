@@ -0,0 +1,94 @@
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Tensor;
+class Op;
+struct ThreadRegistry;
+
+// Links a live Tensor or Op into the MemoryStats registry of the thread that
+// created it, without allocating. Copies start unlinked.
+struct RegistryHook
+{
+    RegistryHook() {}
+    RegistryHook(const RegistryHook &) {}
+    RegistryHook &operator=(const RegistryHook &) { return *this; }
+
+    const void *owner = nullptr;
+    ThreadRegistry *registry = nullptr;
+    RegistryHook *prev = nullptr;
+    RegistryHook *next = nullptr;
+};
+
+// Process-wide view of what is alive
+struct MemorySnapshot
+{
+    long long live_tensors = 0;
+    long long live_ops = 0;
+    long long host_bytes = 0;        // Owned Buffer storage and planner arenas
+    long long device_bytes = 0;      // cudaMalloc'd tensor data and gradients
+    long long peak_host_bytes = 0;   // Since start or the last reset_peak()
+    long long peak_device_bytes = 0;
+    long long node_pool_bytes = 0;   // Slabs reserved for tensors and ops (see node_pool.h)
+    std::map<std::string, long long> tensors_by_op_type; // By producing op, "leaf" if none
+    std::map<std::string, long long> bytes_by_op_type;   // Host + device bytes of those tensors
+    std::map<std::string, long long> ops_by_op_type;
+};
+
+// What the calling thread created and freed (frees of objects created
+// elsewhere count for the thread that frees them)
+struct ThreadMemoryStats
+{
+    long long tensors_created = 0;
+    long long tensors_destroyed = 0;
+    long long ops_created = 0;
+    long long ops_destroyed = 0;
+    long long bytes_allocated = 0;
+    long long bytes_freed = 0;
+};
+
+// A live graph, identified by a node that no other live node consumes
+struct LiveGraph
+{
+    std::shared_ptr<Tensor> root;
+    int num_nodes = 0;
+    int num_ops = 0;
+    long long bytes = 0;
+};
+
+// Memory accounting for tensors, ops and their buffers.
+// Each thread keeps its own registry of the tensors and ops it created and
+// its own byte counts, so building graphs on several threads shares no lock
+// or counter; snapshot() merges them. Byte counts reach the process-wide
+// totals in batches of up to 64 KB, so peaks may miss that much per thread.
+// snapshot() and largest_graphs() read the graphs without locking them: call
+// them while no other thread is building or releasing one.
+class MemoryStats
+{
+public:
+    static void tensor_created(const Tensor *tensor);
+    static void tensor_destroyed(const Tensor *tensor);
+    static void op_created(const Op *op);
+    static void op_destroyed(const Op *op);
+
+    static void host_bytes_changed(long long delta);
+    static void device_bytes_changed(long long delta);
+
+    static MemorySnapshot snapshot();
+    // after - before, field by field (peaks are taken from after)
+    static MemorySnapshot diff(const MemorySnapshot &before, const MemorySnapshot &after);
+    static ThreadMemoryStats thread_stats();
+    // Restart peak tracking from the current usage
+    static void reset_peak();
+
+    // Live graphs sorted by bytes, largest first
+    static std::vector<LiveGraph> largest_graphs(int limit = 10);
+    // Counters, the per op type breakdown and the largest graphs as text
+    static std::string summary(int limit = 10);
+};
+
+#endif // MEMORY_STATS_H
@@ -8,23 +8,44 @@
 #include <memory>
 #include "tensor.h"
 #include "op.h"
+#include "sparse.h"
+
+// Contiguous storage behind a module's parameters (see Module::flatten_parameters)
+struct FlatParameters
+{
+    std::shared_ptr<float> data; // 64-byte aligned
+    std::shared_ptr<float> grad;
+    size_t size = 0;             // Elements; 0 until flattened
+};
+
+// True when params are CPU tensors lying back to back in memory, data and
+// grad alike (as after Module::flatten_parameters); data/grad/count then
+// describe the span covering all of them
+bool contiguous_parameters(const std::vector<std::shared_ptr<Tensor>> &params, float *&data, float *&grad, size_t &count);
 
 class Module
 {
 public:
-    virtual void zero_grad()
-    {
-        for (auto &param : parameters())
-        {
-            param->zero_grad();
-        }
-    }
+    // One fill over the flat gradient buffer when the parameters are flattened
+    virtual void zero_grad();
+
+    // Copy every parameter's data and grad into two contiguous aligned
+    // buffers and turn the parameter tensors into views of them, so that an
+    // optimizer step is one sweep and zero_grad one fill. CPU only.
+    void flatten_parameters();
+
+    FlatParameters flat;
 
     // Pure virtual method to retrieve parameters
     virtual std::vector<std::shared_ptr<Tensor>> parameters() = 0;
     // Forward pass
     virtual std::shared_ptr<Tensor> operator()(std::shared_ptr<Tensor> input) = 0;
 
+    // Deep copy holding its own parameters with the same values (not
+    // flattened, gradients zero), e.g. for data-parallel replicas. The
+    // default throws std::logic_error; DataParallel needs an override.
+    virtual std::shared_ptr<Module> clone() const;
+
     virtual ~Module() {}
 };
 
@@ -35,6 +56,7 @@ public:
 
     std::shared_ptr<Tensor> operator()(std::shared_ptr<Tensor> input) override;
     std::vector<std::shared_ptr<Tensor>> parameters() override;
+    std::shared_ptr<Module> clone() const override;
 
     std::shared_ptr<Tensor> weights;
     std::shared_ptr<Tensor> bias;
@@ -49,6 +71,7 @@ public:
     Layer(int in_features, int out_features, bool nonlin = true); // Added nonlin parameter
     std::shared_ptr<Tensor> operator()(std::shared_ptr<Tensor> input) override;
     std::vector<std::shared_ptr<Tensor>> parameters() override;
+    std::shared_ptr<Module> clone() const override;
 
     int in_features;
     int out_features;
@@ -62,8 +85,76 @@ public:
     MLP(int input_size, const std::vector<int> &layer_sizes);
     std::shared_ptr<Tensor> operator()(std::shared_ptr<Tensor> input) override;
     std::vector<std::shared_ptr<Tensor>> parameters() override;
+    std::shared_ptr<Module> clone() const override;
 
     std::vector<std::shared_ptr<Layer>> layers;
 };
 
+// Single-layer LSTM over a [steps, input_size] sequence (see LSTMCellOp).
+// Weights are stored input-major: weight_ih [input_size, 4 * hidden_size],
+// weight_hh [hidden_size, 4 * hidden_size], gate order i, f, g, o.
+class LSTM : public Module
+{
+public:
+    LSTM(int input_size, int hidden_size);
+
+    // Hidden states [steps, hidden_size], starting from a zero state
+    std::shared_ptr<Tensor> operator()(std::shared_ptr<Tensor> input) override;
+    // Starting from h0 and c0 ([hidden_size] each)
+    std::shared_ptr<Tensor> forward(std::shared_ptr<Tensor> input, std::shared_ptr<Tensor> h0, std::shared_ptr<Tensor> c0);
+    std::vector<std::shared_ptr<Tensor>> parameters() override;
+    std::shared_ptr<Module> clone() const override;
+
+    int input_size;
+    int hidden_size;
+    std::shared_ptr<Tensor> weight_ih;
+    std::shared_ptr<Tensor> weight_hh;
+    std::shared_ptr<Tensor> bias;
+};
+
+// Single-layer GRU over a [steps, input_size] sequence (see GRUCellOp).
+// weight_ih [input_size, 3 * hidden_size], weight_hh [hidden_size, 3 * hidden_size],
+// gate order r, z, n.
+class GRU : public Module
+{
+public:
+    GRU(int input_size, int hidden_size);
+
+    // Hidden states [steps, hidden_size], starting from a zero state
+    std::shared_ptr<Tensor> operator()(std::shared_ptr<Tensor> input) override;
+    // Starting from h0 ([hidden_size])
+    std::shared_ptr<Tensor> forward(std::shared_ptr<Tensor> input, std::shared_ptr<Tensor> h0);
+    std::vector<std::shared_ptr<Tensor>> parameters() override;
+    std::shared_ptr<Module> clone() const override;
+
+    int input_size;
+    int hidden_size;
+    std::shared_ptr<Tensor> weight_ih;
+    std::shared_ptr<Tensor> weight_hh;
+    std::shared_ptr<Tensor> bias_ih;
+    std::shared_ptr<Tensor> bias_hh;
+};
+
+// Linear layer over sparse [batch, in_features] inputs (see SpMMOp), so its
+// cost grows with the nonzeros rather than with in_features.
+// weight [in_features, out_features], bias [out_features], no nonlinearity.
+class SparseLinear : public Module
+{
+public:
+    SparseLinear(int in_features, int out_features);
+
+    // Dense [batch, in_features] (or [in_features]) input; its nonzeros are
+    // gathered into a SparseTensor first, and it receives no gradient
+    std::shared_ptr<Tensor> operator()(std::shared_ptr<Tensor> input) override;
+    // [batch, out_features]
+    std::shared_ptr<Tensor> forward(std::shared_ptr<const SparseTensor> input);
+    std::vector<std::shared_ptr<Tensor>> parameters() override;
+    std::shared_ptr<Module> clone() const override;
+
+    int in_features;
+    int out_features;
+    std::shared_ptr<Tensor> weight;
+    std::shared_ptr<Tensor> bias;
+};
+
 #endif // NN_H
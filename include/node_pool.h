@@ -0,0 +1,64 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+// Allocator for graph nodes (tensors, ops and their shared_ptr control
+// blocks). Every training step creates and frees the same nodes, so instead
+// of going through malloc each time, blocks come from per-thread free lists
+// carved out of 64 KiB slabs, one list per 16-byte size class. A node freed
+// at the end of a step is handed back to the next one that needs the size.
+// Blocks may be freed on any thread. A block freed by a thread other than
+// the one that carved its slab (found from a header at the slab's 64 KiB
+// aligned start) goes back to that thread, which takes such blocks before
+// carving a new slab. So when one thread allocates and another frees (a
+// DataLoader worker and the trainer, or the backward pool releasing the
+// main thread's graph), memory stays at what is in flight. A thread's lists
+// are adopted by the next new thread when it exits. Slabs are never returned
+// to the system. Sizes above max_block_bytes use operator new.
+namespace node_pool
+{
+    const size_t block_align = 16;
+    const size_t max_block_bytes = 1024;
+
+    void *allocate(size_t bytes);
+    void deallocate(void *block, size_t bytes) noexcept;
+
+    // Bytes reserved in slabs so far
+    long long slab_bytes();
+}
+
+template <typename T>
+struct NodeAllocator
+{
+    using value_type = T;
+
+    NodeAllocator() noexcept {}
+    template <typename U>
+    NodeAllocator(const NodeAllocator<U> &) noexcept {}
+
+    T *allocate(size_t n)
+    {
+        static_assert(alignof(T) <= node_pool::block_align, "node_pool blocks are 16-byte aligned");
+        return static_cast<T *>(node_pool::allocate(n * sizeof(T)));
+    }
+    void deallocate(T *p, size_t n) noexcept { node_pool::deallocate(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const NodeAllocator<U> &) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const NodeAllocator<U> &) const noexcept { return false; }
+};
+
+// std::make_shared for graph nodes: the object and its control block share
+// one pooled block
+template <typename T, typename... Args>
+std::shared_ptr<T> make_node(Args &&...args)
+{
+    return std::allocate_shared<T>(NodeAllocator<T>(), std::forward<Args>(args)...);
+}
+
+#endif // NODE_POOL_H
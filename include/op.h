@@ -5,57 +5,142 @@
 #include <memory>
 #include <vector>
 #include <cassert>
+#include <cstdint>
 
 #include "value.h"
+#include "profiler.h"
+#include "memory_stats.h"
+#include "grad_mode.h"
+#include "shape.h"
 // Remove the following line to prevent circular dependency
 // #include "tensor.h"
 
 class Tensor; // Forward declaration
 
+// What an op computes. Interned so that creating an op copies no string and
+// graph passes and the profiler compare integers.
+enum class OpKind : unsigned char
+{
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Exp,
+    Tanh,
+    Relu,
+    Sum,
+    Stack,
+    LSTM,
+    GRU,
+    Attention,
+    SpMM,
+    Fused, // See expr.h
+    Custom
+};
+
+// Short lowercase name ("add", "mul", ...), as reported by the profiler
+const char *op_kind_name(OpKind kind);
+
 class Op : public std::enable_shared_from_this<Op>
 {
 public:
     virtual void forward() = 0;
     virtual void backward() = 0;
 
-    Op(const std::vector<std::shared_ptr<Tensor>> &inputs, std::string op_type = "") : inputs(inputs), op_type(op_type)
+    Op(std::vector<std::shared_ptr<Tensor>> inputs, OpKind kind = OpKind::Custom)
+        : inputs(std::move(inputs)), kind(kind), id(next_id())
     {
+        MemoryStats::op_created(this);
     }
 
-    virtual ~Op() {}
+    virtual ~Op()
+    {
+        MemoryStats::op_destroyed(this);
+    }
+
+    // forward()/backward() timed by the profiler when it is enabled.
+    // With grad mode off (see grad_mode.h) the output is left as a leaf.
+    void run_forward()
+    {
+        {
+            OpProfileScope scope(*this, false);
+            forward();
+        }
+        if (!GradMode::is_enabled())
+        {
+            detach_output();
+        }
+    }
+    void run_backward()
+    {
+        OpProfileScope scope(*this, true);
+        backward();
+    }
+
+    // What backward() reads besides the output gradient. The memory planner
+    // uses this to decide how long each buffer must stay alive.
+    virtual bool saves_inputs() const { return true; }
+    virtual bool saves_output() const { return false; }
+
+    const char *op_type() const { return op_kind_name(kind); }
+
+    // Where backward() accumulates input k's gradient: the input's own grad
+    // buffer, unless the parallel backward engine redirected it (see engine.cpp)
+    float *input_grad(size_t k);
 
     std::shared_ptr<Tensor> output;
-    std::vector<std::shared_ptr<Tensor>> inputs;
-    std::string op_type;
+    std::vector<std::shared_ptr<Tensor>> inputs; // Also the output's children (see Tensor::children())
+    OpKind kind;
+    // Unique for the life of the process, unlike the address: freed ops'
+    // blocks are recycled every step (see node_pool.h)
+    const uint64_t id;
+    mutable RegistryHook registry_hook; // See MemoryStats
+    float *const *input_grads = nullptr; // Redirected gradient of each input, if set
+
+protected:
+    // Allocate output on the first forward, reuse it on later ones
+    void allocate_output(const Shape &shape);
+    // True when forward() must also propagate tangents (forward-mode AD)
+    bool prepare_tangents();
+    // True for a single-element CPU output without tangents (see op.cpp)
+    bool is_scalar() const;
+
+private:
+    static uint64_t next_id();
+
+    // Forget the output's op (and so its children) so the graph behind it can be freed
+    void detach_output();
 };
 
 class AddOp : public Op
 {
 public:
     // Constructor for AddOp
-    AddOp(const std::vector<std::shared_ptr<Tensor>> &inputs) : Op(inputs, "add") {}
+    AddOp(std::vector<std::shared_ptr<Tensor>> inputs) : Op(std::move(inputs), OpKind::Add) {}
 
     // Declare the methods
     void forward() override;
     void backward() override;
+    bool saves_inputs() const override { return false; }
 };
 
 class SubtractOp : public Op
 {
 public:
     // Constructor for SubtractOp
-    SubtractOp(const std::vector<std::shared_ptr<Tensor>> &inputs) : Op(inputs, "sub") {}
+    SubtractOp(std::vector<std::shared_ptr<Tensor>> inputs) : Op(std::move(inputs), OpKind::Subtract) {}
 
     // Declare the methods
     void forward() override;
     void backward() override;
+    bool saves_inputs() const override { return false; }
 };
 
 class MultiplyOp : public Op
 {
 public:
     // Constructor for MultiplyOp
-    MultiplyOp(const std::vector<std::shared_ptr<Tensor>> &inputs) : Op(inputs, "mul") {}
+    MultiplyOp(std::vector<std::shared_ptr<Tensor>> inputs) : Op(std::move(inputs), OpKind::Multiply) {}
 
     // Declare the methods
     void forward() override;
@@ -66,7 +151,7 @@ class DivideOp : public Op
 {
 public:
     // Constructor for DivideOp
-    DivideOp(const std::vector<std::shared_ptr<Tensor>> &inputs) : Op(inputs, "div") {}
+    DivideOp(std::vector<std::shared_ptr<Tensor>> inputs) : Op(std::move(inputs), OpKind::Divide) {}
 
     // Declare the methods
     void forward() override;
@@ -77,52 +162,126 @@ class ExpOp : public Op
 {
 public:
     // Constructor for ExpOp
-    ExpOp(const std::vector<std::shared_ptr<Tensor>> &inputs) : Op(inputs, "exp") {}
+    ExpOp(std::vector<std::shared_ptr<Tensor>> inputs) : Op(std::move(inputs), OpKind::Exp) {}
 
     // Declare the methods
     void forward() override;
     void backward() override;
+    bool saves_inputs() const override { return false; }
+    bool saves_output() const override { return true; }
 };
 
 class TanhOp : public Op
 {
 public:
     // Constructor for TanhOp
-    TanhOp(const std::vector<std::shared_ptr<Tensor>> &inputs) : Op(inputs, "tanh") {}
+    TanhOp(std::vector<std::shared_ptr<Tensor>> inputs) : Op(std::move(inputs), OpKind::Tanh) {}
 
     // Declare the methods
     void forward() override;
     void backward() override;
+    bool saves_inputs() const override { return false; }
+    bool saves_output() const override { return true; }
 };
 
 class ReluOp : public Op
 {
 public:
     // Constructor for ReluOp
-    ReluOp(const std::vector<std::shared_ptr<Tensor>> &inputs) : Op(inputs, "relu") {}
+    ReluOp(std::vector<std::shared_ptr<Tensor>> inputs) : Op(std::move(inputs), OpKind::Relu) {}
 
     // Declare the methods
     void forward() override;
     void backward() override;
+    bool saves_inputs() const override { return false; }
+    bool saves_output() const override { return true; }
 };
 
 class SumOp : public Op
 {
 public:
-    SumOp(const std::vector<std::shared_ptr<Tensor>> &inputs) : Op(inputs, "sum") {}
+    SumOp(std::vector<std::shared_ptr<Tensor>> inputs) : Op(std::move(inputs), OpKind::Sum) {}
     void forward() override;
     void backward() override;
+    bool saves_inputs() const override { return false; }
 };
 
 class StackOp : public Op
 {
 public:
     // Constructor: pass a list of single-value tensors.
-    StackOp(const std::vector<std::shared_ptr<Tensor>> &inputs)
-        : Op(inputs, "stack") {}
+    StackOp(std::vector<std::shared_ptr<Tensor>> inputs)
+        : Op(std::move(inputs), OpKind::Stack) {}
+
+    void forward() override;
+    void backward() override;
+    bool saves_inputs() const override { return false; }
+};
+
+// One LSTM layer over a whole sequence (gate order i, f, g, o).
+// inputs: x [T, I], weight_ih [I, 4H], weight_hh [H, 4H], bias [4H], h0 [H], c0 [H]
+// output: hidden states [T, H]
+// The input projection of all T steps is one matrix product; each step's
+// gate nonlinearities and state update are one fused loop; backward runs
+// through time inside the op from the saved gates, with no per-step nodes.
+// CPU only.
+class LSTMCellOp : public Op
+{
+public:
+    LSTMCellOp(std::vector<std::shared_ptr<Tensor>> inputs) : Op(std::move(inputs), OpKind::LSTM) {}
+
+    void forward() override;
+    void backward() override;
+    bool saves_output() const override { return true; }
+
+private:
+    std::vector<float> gates; // [T, 4H], after their nonlinearities
+    std::vector<float> cells; // [T, H]
+};
+
+// One GRU layer over a whole sequence (gate order r, z, n, as in PyTorch:
+// n = tanh(x W_in + b_in + r * (h W_hn + b_hn))).
+// inputs: x [T, I], weight_ih [I, 3H], weight_hh [H, 3H], bias_ih [3H], bias_hh [3H], h0 [H]
+// output: hidden states [T, H]
+// Same structure as LSTMCellOp. CPU only.
+class GRUCellOp : public Op
+{
+public:
+    GRUCellOp(std::vector<std::shared_ptr<Tensor>> inputs) : Op(std::move(inputs), OpKind::GRU) {}
 
     void forward() override;
     void backward() override;
+    bool saves_output() const override { return true; }
+
+private:
+    std::vector<float> gates;    // [T, 3H], after their nonlinearities
+    std::vector<float> hidden_n; // [T, H], h W_hn + b_hn
+};
+
+// Scaled dot-product attention softmax(q k^T / sqrt(d)) v.
+// inputs: q [..., N, d], k [..., M, d], v [..., M, dv] with the same leading
+// (batch/head) dimensions, and optionally mask [N, M] (0 = masked out,
+// shared by every batch); with causal, query i only sees keys j <= i.
+// output: [..., N, dv]
+// Forward walks key tiles with an online softmax, so no [N, M] score matrix
+// is ever stored; it saves only the per-row log-sum-exp. Backward recomputes
+// each score tile from it (one pass over key tiles for dk and dv, one over
+// query tiles for dq), so memory stays linear in the sequence length.
+// Fully masked rows give zeros. CPU only.
+class AttentionOp : public Op
+{
+public:
+    AttentionOp(std::vector<std::shared_ptr<Tensor>> inputs, bool causal = false)
+        : Op(std::move(inputs), OpKind::Attention), causal(causal) {}
+
+    void forward() override;
+    void backward() override;
+    bool saves_output() const override { return true; }
+
+    bool causal;
+
+private:
+    std::vector<float> log_sum_exp; // [batch * N]
 };
 
 #endif // OP_H
@@ -21,7 +21,7 @@ void div_backward_cuda(const float *grad_out, const float *a, const float *b, fl
 
 // Exp
 void exp_forward_cuda(const float *a, float *out, int size);
-void exp_backward_cuda(const float *grad_out, const float *a, float *grad_a, int size);
+void exp_backward_cuda(const float *grad_out, const float *out, float *grad_a, int size);
 
 // Tanh
 void tanh_forward_cuda(const float *a, float *out, int size);
@@ -29,7 +29,7 @@ void tanh_backward_cuda(const float *grad_out, const float *out, float *grad_a,
 
 // Relu
 void relu_forward_cuda(const float *a, float *out, int size);
-void relu_backward_cuda(const float *grad_out, const float *a, float *grad_a, int size);
+void relu_backward_cuda(const float *grad_out, const float *out, float *grad_a, int size);
 
 // Sum
 void sum_forward_cuda(const float *a, float *out, int size);
@@ -41,6 +41,15 @@ void stack_backward_cuda(const float *grad_out, float **grad_ins, int num_inputs
 
 // SGD
 void sgd_step_cuda(float *data, float *grad, float lr, int size);
+void sgd_momentum_step_cuda(float *data, const float *grad, float *velocity /* may be null */, float lr, float momentum,
+                            bool nesterov, float weight_decay, float grad_scale, int size);
+
+// Adam / AdamW
+void adam_step_cuda(float *data, const float *grad, float *m, float *v, float step_size, float inv_sqrt_bias_correction2,
+                    float beta1, float beta2, float eps, float l2_decay, float decoupled_decay, float grad_scale, int size);
+
+// Sum of squares (for gradient norms)
+float sum_squares_cuda(const float *a, int size);
 
 
 #endif // OP_CUDA_H
@@ -6,6 +6,9 @@
 #include <functional> // for std::reference_wrapper
 #include "tensor.h"
 
+class ProcessGroup;
+class GradientAverager;
+
 class Optimizer
 {
 public:
@@ -15,18 +18,118 @@ public:
     virtual void step() = 0;
     virtual void zero_grad();
 
+    // Same type, hyperparameters and state, over other parameters of the
+    // same sizes (e.g. those of a Module::clone() replica). The default
+    // throws std::logic_error; DataParallel needs an override.
+    virtual std::shared_ptr<Optimizer> clone(const std::vector<std::shared_ptr<Tensor>> &parameters) const;
+
+    // Scale the gradients inside step() so their global L2 norm is at most
+    // max_norm (0 disables clipping)
+    void set_max_grad_norm(float max_norm);
+    float get_max_grad_norm() const { return max_grad_norm; }
+    // Global gradient norm seen by the last clipping step(), before clipping
+    float last_grad_norm() const { return grad_norm; }
+
+    // Average the gradients across the ranks of group before every step()
+    // (null detaches). Parameters must have the same sizes on every rank.
+    void set_process_group(std::shared_ptr<ProcessGroup> group, size_t bucket_elements = 1 << 16);
+    std::shared_ptr<ProcessGroup> get_process_group() const;
+    // loss->backward(); with a process group and flat parameters, gradient
+    // buckets are all-reduced while backward is still running
+    void backward(const std::shared_ptr<Tensor> &loss);
+
 protected:
+    // When the parameters sit back to back in memory (Module::flatten_parameters),
+    // return the span covering all of them so a step can be one sweep
+    bool flat_span(float *&data, float *&grad, size_t &count) const;
+
+    // Calls update(data, grad, offset, count) over all CPU parameter elements,
+    // split across the thread pool. offset is the position of data[0] in the
+    // optimizer state (see state_offsets).
+    void for_each_cpu_span(const std::function<void(float *data, const float *grad, size_t offset, size_t count)> &update);
+
+    // Called at the start of step(): averages the gradients across the
+    // process group, if any, moves state to where each parameter now lives
+    // and returns clip_scale()
+    float begin_step();
+
+    // Factor to scale the gradients by this step: 1, or the clipping factor
+    float clip_scale();
+
+    // Allocate num_slots state values per parameter element, laid out slot
+    // by slot, zero initialized. CUDA parameters use a device copy, made on
+    // the first step() that finds one (see place_state()).
+    void allocate_state(int num_slots);
+    // Copy each parameter's state between host and device if the parameter
+    // moved since the last step
+    void place_state();
+    // Start of slot for parameter element offset, on the host / device
+    float *state_at(int slot, size_t offset) { return state.data() + slot * num_elements() + offset; }
+    float *device_state_at(int slot, size_t offset) { return d_state + slot * num_elements() + offset; }
+
+    size_t num_elements() const { return state_offsets.back(); }
+
+    // Copy state and clipping settings from other (used by clone())
+    void copy_state_from(const Optimizer &other);
+
     std::vector<std::shared_ptr<Tensor>> parameters;
+    // state_offsets[i]: first state element of parameter i; back(): total elements
+    std::vector<size_t> state_offsets;
+    std::vector<float> state;   // Contiguous optimizer state (momentum, Adam moments)
+    float *d_state = nullptr;   // Device copy of the state, once a CUDA parameter needs it
+    std::vector<char> state_on_device; // Per parameter: its current state is in d_state
+
+    float max_grad_norm = 0.0f;
+    float grad_norm = 0.0f;
+
+    std::shared_ptr<GradientAverager> averager;
 };
 
+// Stochastic gradient descent with optional (Nesterov) momentum and L2 weight decay:
+//   g = grad + weight_decay * p;  buf = momentum * buf + g
+//   p -= lr * (nesterov ? g + momentum * buf : buf)
 class SGD : public Optimizer
 {
 public:
-    SGD(const std::vector<std::shared_ptr<Tensor>> &parameters, float lr);
+    SGD(const std::vector<std::shared_ptr<Tensor>> &parameters, float lr,
+        float momentum = 0.0f, bool nesterov = false, float weight_decay = 0.0f);
     void step() override;
+    std::shared_ptr<Optimizer> clone(const std::vector<std::shared_ptr<Tensor>> &parameters) const override;
 
 private:
     float lr;
+    float momentum;
+    bool nesterov;
+    float weight_decay;
+};
+
+// Adam (Kingma & Ba). weight_decay is added to the gradient (L2 penalty).
+class Adam : public Optimizer
+{
+public:
+    Adam(const std::vector<std::shared_ptr<Tensor>> &parameters, float lr = 1e-3f,
+         float beta1 = 0.9f, float beta2 = 0.999f, float eps = 1e-8f, float weight_decay = 0.0f);
+    void step() override;
+    std::shared_ptr<Optimizer> clone(const std::vector<std::shared_ptr<Tensor>> &parameters) const override;
+
+protected:
+    float lr;
+    float beta1;
+    float beta2;
+    float eps;
+    float weight_decay;
+    bool decoupled_weight_decay = false;
+    int step_count = 0;
+};
+
+// AdamW (Loshchilov & Hutter): weight decay shrinks the parameters directly
+// instead of going through the moment estimates
+class AdamW : public Adam
+{
+public:
+    AdamW(const std::vector<std::shared_ptr<Tensor>> &parameters, float lr = 1e-3f,
+          float beta1 = 0.9f, float beta2 = 0.999f, float eps = 1e-8f, float weight_decay = 1e-2f);
+    std::shared_ptr<Optimizer> clone(const std::vector<std::shared_ptr<Tensor>> &parameters) const override;
 };
 
 #endif // OPTIMIZER_H
@@ -0,0 +1,147 @@
+#ifndef PROCESS_GROUP_H
+#define PROCESS_GROUP_H
+
+#include "tensor.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Completion handle of an asynchronous collective
+class Work
+{
+public:
+    // Block until the collective has finished; rethrows its error
+    void wait();
+    bool done();
+
+private:
+    friend class ProcessGroup;
+
+    std::mutex mutex;
+    std::condition_variable finished_cv;
+    bool finished = false;
+    std::exception_ptr error;
+    std::shared_ptr<void> keep_alive; // Keeps the buffer's owner alive until finished
+};
+
+// Collectives between world_size processes connected in a ring over TCP.
+// Rank r listens on base_port + r of host, connects to rank r + 1 and
+// accepts rank r - 1. All collectives run in order on one communication
+// thread; the blocking calls are the asynchronous ones plus wait(). Every
+// rank must issue the same collectives in the same order.
+class ProcessGroup
+{
+public:
+    ProcessGroup(int rank, int world_size, const std::string &host = "127.0.0.1", int base_port = 29500,
+                 double timeout_seconds = 60.0);
+    ~ProcessGroup();
+
+    ProcessGroup(ProcessGroup const &) = delete;
+    void operator=(ProcessGroup const &) = delete;
+
+    // From the RANK, WORLD_SIZE, MASTER_ADDR and MASTER_PORT environment
+    // variables (as set by examples/launch.py)
+    static std::shared_ptr<ProcessGroup> from_env();
+
+    int rank() const { return rank_; }
+    int world_size() const { return world_size_; }
+
+    // Sum count floats across all ranks, in place (ring reduce-scatter + all-gather)
+    void all_reduce(float *data, size_t count);
+    // Copy count floats from root to every rank
+    void broadcast(float *data, size_t count, int root);
+    // Return once every rank has called barrier()
+    void barrier();
+
+    // Queue an all_reduce on the communication thread and return at once.
+    // data must stay valid (keep_alive may own it) until the Work is done.
+    std::shared_ptr<Work> all_reduce_async(float *data, size_t count, std::shared_ptr<void> keep_alive = nullptr);
+    std::shared_ptr<Work> broadcast_async(float *data, size_t count, int root, std::shared_ptr<void> keep_alive = nullptr);
+
+private:
+    std::shared_ptr<Work> enqueue(std::function<void()> collective, std::shared_ptr<void> keep_alive);
+    void comm_loop();
+
+    void ring_all_reduce(float *data, size_t count);
+    void ring_broadcast(float *data, size_t count, int root);
+    // Send to the next rank and receive from the previous one at the same time
+    void exchange(const void *send_data, size_t send_bytes, void *recv_data, size_t recv_bytes);
+
+    int rank_;
+    int world_size_;
+    int next_fd = -1; // Connection to rank + 1
+    int prev_fd = -1; // Connection from rank - 1
+    double timeout_seconds;
+    std::vector<float> scratch;
+
+    std::mutex mutex;
+    std::condition_variable queue_cv;
+    std::deque<std::pair<std::function<void()>, std::shared_ptr<Work>>> queue;
+    bool stopping = false;
+    std::thread comm_thread;
+};
+
+// Averages gradients across the ranks of a process group (see
+// Optimizer::set_process_group). When the parameters are flat, backward()
+// all-reduces buckets of whole parameters on the communication thread as
+// soon as backward has finalized them, so communication overlaps the rest of
+// the backward pass; buckets are launched in a fixed order (last parameters
+// first) so that every rank issues the same sequence.
+class GradientAverager
+{
+public:
+    GradientAverager(std::shared_ptr<ProcessGroup> group, const std::vector<std::shared_ptr<Tensor>> &parameters,
+                     size_t bucket_elements);
+
+    // loss->backward() with bucketed asynchronous all-reduces. If backward
+    // throws, the buckets it already launched are not undone, so the other
+    // ranks wait in those collectives; the next backward() starts afresh.
+    void backward(const std::shared_ptr<Tensor> &loss);
+
+    // Wait for the buckets launched by backward() (launching any not yet
+    // launched, or all-reducing everything if backward() was not used), then
+    // divide the gradients by the world size
+    void finish();
+
+    std::shared_ptr<ProcessGroup> group() const { return process_group; }
+
+private:
+    struct Bucket
+    {
+        size_t begin = 0; // Range of the flat gradient
+        size_t end = 0;
+        int num_params = 0;
+        std::atomic<int> pending{0}; // Parameters whose gradient is not final yet
+        bool ready = false;          // Guarded by mutex
+        std::shared_ptr<Work> work;
+    };
+
+    void mark_ready(size_t bucket);
+    void launch_ready();
+    void sync_all();
+
+    std::shared_ptr<ProcessGroup> process_group;
+    std::vector<std::shared_ptr<Tensor>> parameters;
+    size_t bucket_elements;
+
+    float *flat_grad = nullptr; // Set while the buckets belong to a flat span
+    size_t flat_count = 0;
+    std::vector<std::unique_ptr<Bucket>> buckets;
+    std::unordered_map<const Tensor *, size_t> bucket_of;
+
+    std::mutex mutex;
+    size_t launched = 0;       // Buckets launched, from the last one down
+    bool in_flight = false;    // backward() ran and finish() has not
+    std::vector<float> staging; // Packed gradients for the synchronous path
+};
+
+#endif // PROCESS_GROUP_H
@@ -0,0 +1,106 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Op;
+
+// One timed forward() or backward() call
+struct ProfileEvent
+{
+    std::string op_type;
+    bool backward = false;
+    std::vector<std::vector<int>> input_shapes;
+    std::vector<int> output_shape;
+    double start_us = 0.0;    // Since the profiler was enabled
+    double duration_us = 0.0;
+    int thread = 0;           // Small per-thread number, 0 for the first thread seen
+    size_t bytes = 0;         // Estimated bytes read and written
+    double flops = 0.0;       // Estimated floating point operations
+    uint64_t op_id = 0;       // Op::id; the op may be gone by now, but ids are never reused
+};
+
+// Process-wide op profiler.
+// Ops are timed by OpProfileScope around Op::run_forward()/run_backward().
+// While disabled a scope costs a single relaxed atomic load.
+class Profiler
+{
+public:
+    static bool enabled() { return enabled_flag.load(std::memory_order_relaxed); }
+
+    // Start recording (events from an earlier session are kept until clear())
+    static void enable();
+    static void disable();
+    static void clear();
+
+    static void record(ProfileEvent event);
+    static std::vector<ProfileEvent> events();
+
+    // Per (op type, direction) totals sorted by time, as a text table
+    static std::string summary();
+    // Chrome trace ("X" events), viewable in chrome://tracing or Perfetto
+    static std::string chrome_trace();
+    static void export_chrome_trace(const std::string &path);
+
+    // Total recorded time of one op (forward + backward), in microseconds
+    static double op_time_us(const Op *op);
+
+    static double now_us();
+
+private:
+    static std::atomic<bool> enabled_flag;
+};
+
+// Times one forward or backward call of op when the profiler is enabled
+class OpProfileScope
+{
+public:
+    OpProfileScope(const Op &op, bool backward) : op(op), backward(backward), active(Profiler::enabled())
+    {
+        if (active)
+        {
+            begin();
+        }
+    }
+    ~OpProfileScope()
+    {
+        if (active)
+        {
+            finish();
+        }
+    }
+
+    OpProfileScope(OpProfileScope const &) = delete;
+    void operator=(OpProfileScope const &) = delete;
+
+private:
+    void begin();
+    void finish();
+
+    const Op &op;
+    bool backward;
+    bool active;
+    double start_us = 0.0;
+    std::vector<std::vector<int>> input_shapes;
+};
+
+// RAII profiling session: enables the profiler for its lifetime
+class ProfileSession
+{
+public:
+    explicit ProfileSession(bool clear_events = true);
+    ~ProfileSession();
+
+    void stop();
+
+private:
+    bool was_enabled;
+    bool stopped = false;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,18 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// Random numbers for parameter initialization.
+// Each thread draws from its own generator, so threads never contend for
+// (or race on) a shared one. A thread's generator is seeded on first use
+// from the process seed and a per-thread stream number.
+
+// Uniform in [-1, 1], from the calling thread's generator
+float make_random();
+
+// Reseed the calling thread's generator, and make seed the process seed
+// that threads starting their first draw from now on derive theirs from
+void manual_seed(uint64_t seed);
+
+#endif // RANDOM_H
@@ -0,0 +1,139 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <vector>
+
+// Dimensions of a tensor. Up to inline_dims of them are stored in the object
+// itself, so creating a graph node with an ordinary shape allocates nothing
+// for it; longer shapes fall back to the heap.
+// The interface mirrors the parts of std::vector<int> the ops use, and a
+// Shape converts to and from std::vector<int> implicitly.
+class Shape
+{
+public:
+    static const size_t inline_dims = 4;
+
+    Shape() {}
+    Shape(std::initializer_list<int> dims) { assign(dims.begin(), dims.size()); }
+    Shape(const std::vector<int> &dims) { assign(dims.data(), dims.size()); }
+    Shape(const int *first, const int *last) { assign(first, static_cast<size_t>(last - first)); }
+    Shape(const Shape &other) { assign(other.dims, other.count); }
+    Shape(Shape &&other) noexcept { take(other); }
+    ~Shape() { free_heap(); }
+
+    Shape &operator=(const Shape &other)
+    {
+        if (this != &other)
+        {
+            assign(other.dims, other.count);
+        }
+        return *this;
+    }
+    Shape &operator=(Shape &&other) noexcept
+    {
+        if (this != &other)
+        {
+            free_heap();
+            take(other);
+        }
+        return *this;
+    }
+
+    int &operator[](size_t i) { return dims[i]; }
+    int operator[](size_t i) const { return dims[i]; }
+
+    int *begin() { return dims; }
+    int *end() { return dims + count; }
+    const int *begin() const { return dims; }
+    const int *end() const { return dims + count; }
+    const int *data() const { return dims; }
+
+    int front() const { return dims[0]; }
+    int back() const { return dims[count - 1]; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    void push_back(int dim)
+    {
+        if (count == capacity)
+        {
+            grow(2 * capacity);
+        }
+        dims[count++] = dim;
+    }
+
+    std::vector<int> to_vector() const { return std::vector<int>(begin(), end()); }
+    operator std::vector<int>() const { return to_vector(); }
+
+    friend bool operator==(const Shape &a, const Shape &b)
+    {
+        return a.count == b.count && std::equal(a.begin(), a.end(), b.begin());
+    }
+    friend bool operator!=(const Shape &a, const Shape &b) { return !(a == b); }
+    friend bool operator<(const Shape &a, const Shape &b)
+    {
+        return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
+    }
+
+private:
+    bool on_heap() const { return dims != local; }
+
+    void free_heap()
+    {
+        if (on_heap())
+        {
+            delete[] dims;
+        }
+    }
+
+    void grow(unsigned new_capacity)
+    {
+        int *bigger = new int[new_capacity];
+        std::copy(dims, dims + count, bigger);
+        free_heap();
+        dims = bigger;
+        capacity = new_capacity;
+    }
+
+    void assign(const int *values, size_t n)
+    {
+        if (n > capacity)
+        {
+            count = 0;
+            grow(static_cast<unsigned>(n));
+        }
+        std::copy(values, values + n, dims);
+        count = static_cast<unsigned>(n);
+    }
+
+    // Steal other's heap storage, or copy its inline dimensions
+    void take(Shape &other)
+    {
+        if (other.on_heap())
+        {
+            dims = other.dims;
+            capacity = other.capacity;
+            other.dims = other.local;
+            other.capacity = inline_dims;
+        }
+        else
+        {
+            dims = local;
+            capacity = inline_dims;
+            std::copy(other.local, other.local + other.count, local);
+        }
+        count = other.count;
+        other.count = 0;
+    }
+
+    int *dims = local;
+    unsigned count = 0;
+    unsigned capacity = inline_dims;
+    int local[inline_dims];
+};
+
+#endif // SHAPE_H
@@ -0,0 +1,69 @@
+// sparse.h
+
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <memory>
+#include <vector>
+
+#include "tensor.h"
+
+// Immutable 2-D sparse matrix in CSR form, e.g. a batch of mostly-zero
+// feature rows. It is an input, not a graph node: it has no gradient.
+// A transposed (CSC) copy of the structure is built once at construction so
+// that SpMMOp::backward can walk the entries of each column without locks.
+class SparseTensor
+{
+public:
+    // Takes ownership of a valid CSR structure: row_ptr has rows + 1
+    // non-decreasing entries from 0 to nnz, column indices are in range.
+    // Columns within a row need not be sorted.
+    static std::shared_ptr<SparseTensor> from_csr(int rows, int cols, std::vector<int> row_ptr,
+                                                  std::vector<int> col_idx, std::vector<float> values);
+    // Coordinate triplets in any order; duplicates are summed
+    static std::shared_ptr<SparseTensor> from_coo(int rows, int cols, const std::vector<int> &row_idx,
+                                                  const std::vector<int> &col_idx, const std::vector<float> &values);
+    // The nonzeros of a row-major [rows, cols] array
+    static std::shared_ptr<SparseTensor> from_dense(const float *data, int rows, int cols);
+
+    std::vector<float> to_dense() const;
+    size_t nnz() const { return values.size(); }
+
+    const int rows;
+    const int cols;
+
+    const std::vector<int> row_ptr; // [rows + 1]
+    const std::vector<int> col_idx; // [nnz]
+    const std::vector<float> values; // [nnz]
+
+    // The same entries by column: col_ptr [cols + 1], t_row_idx and t_values [nnz]
+    const std::vector<int> col_ptr;
+    const std::vector<int> t_row_idx;
+    const std::vector<float> t_values;
+
+private:
+    SparseTensor(int rows, int cols, std::vector<int> row_ptr, std::vector<int> col_idx, std::vector<float> values,
+                 std::vector<int> col_ptr, std::vector<int> t_row_idx, std::vector<float> t_values);
+};
+
+// Sparse times dense: out [rows, N] = sparse [rows, K] weight [K, N] (+ bias [N]).
+// Forward is parallel over output rows and reads only the nonzeros; backward
+// writes the dense weight gradient directly, parallel over weight rows
+// through the transposed structure, so both cost O(nnz * N). CPU only.
+class SpMMOp : public Op
+{
+public:
+    SpMMOp(std::shared_ptr<const SparseTensor> sparse, std::vector<std::shared_ptr<Tensor>> inputs)
+        : Op(std::move(inputs), OpKind::SpMM), sparse(std::move(sparse)) {}
+
+    void forward() override;
+    void backward() override;
+    bool saves_inputs() const override { return false; }
+
+    std::shared_ptr<const SparseTensor> sparse;
+};
+
+std::shared_ptr<Tensor> spmm(const std::shared_ptr<const SparseTensor> &sparse, const std::shared_ptr<Tensor> &weight,
+                             const std::shared_ptr<Tensor> &bias = nullptr);
+
+#endif // SPARSE_H
@@ -5,19 +5,29 @@
 #include "op.h"
 #include "device.h"
 #include "device_manager.h"
+#include "buffer.h"
+#include "shape.h"
 
+#include <functional>
 #include <iostream>
 #include <vector>
 #include <memory>
 
 class Op;
+class Tensor;
+
+// Called during backward() with each leaf (a tensor without an op, such as a
+// parameter) as soon as its gradient is final, i.e. once every op consuming
+// it has run its backward. May be called from pool threads, concurrently.
+using LeafGradHook = std::function<void(Tensor &leaf)>;
 
 class Tensor : public std::enable_shared_from_this<Tensor>
 {
 public:
-    std::vector<int> shape;
-    std::vector<float> data;
-    std::vector<float> grad;
+    Shape shape;
+    Buffer data;
+    Buffer grad;
+    Buffer tangent; // Forward-mode AD direction; empty means zero (see forward_ad.h)
 
     // For CUDA support
     float *d_data = nullptr;
@@ -25,17 +35,28 @@ public:
 
     DeviceType device;
 
-    std::string label;                             // Label for debugging
-    std::shared_ptr<Op> op;                        // Operation that created this Tensor
-    std::vector<std::shared_ptr<Tensor>> children; // Children tensors
+    bool constant = false; // Value never changes (e.g. scalar_tensor); graph passes may fold it
+    bool graph_released = false; // Op freed by a backward() without retain_graph; backward through it throws
+
+    std::string label;      // Label for debugging
+    std::shared_ptr<Op> op; // Operation that created this Tensor
+
+    unsigned long visit_mark = 0;        // Generation of the last graph walk that reached this node (see traversal.h)
+    mutable RegistryHook registry_hook; // See MemoryStats
 
     Tensor();
     ~Tensor();
 
     // Custom constructor
-    Tensor(const std::vector<int> &shape, float init_val = 0.0f,
-           std::shared_ptr<Op> op = nullptr,
-           std::vector<std::shared_ptr<Tensor>> children = {});
+    Tensor(const Shape &shape, float init_val = 0.0f, std::shared_ptr<Op> op = nullptr);
+
+    // The tensors this one was computed from: its op's inputs, which are the
+    // graph's only copy of the edges. Empty for leaves and released nodes.
+    const std::vector<std::shared_ptr<Tensor>> &children() const
+    {
+        static const std::vector<std::shared_ptr<Tensor>> none;
+        return op ? op->inputs : none;
+    }
 
     // Operator Overloads
     std::shared_ptr<Tensor> operator+(const std::shared_ptr<Tensor> &other);
@@ -55,12 +76,25 @@ public:
     std::shared_ptr<Tensor> sum();
 
     // Backward Pass
-    void backward();
+    // Unless retain_graph is set, each node drops its op, its inputs and (for
+    // intermediates) its gradient as soon as its backward has run, so only the
+    // leaves and this tensor keep their buffers afterwards. Such nodes are
+    // marked graph_released: a later backward reaching one throws instead of
+    // treating it as a leaf.
+    void backward(bool retain_graph = false);
+    void backward(bool retain_graph, const LeafGradHook &on_leaf_ready);
+
+    // Cut this node out of the graph: forget the op and with it the children.
+    // release_grad also frees the gradient buffer (used for intermediates).
+    void release_graph(bool release_grad);
+
+    // (Re)allocate the gradient buffer if it was released
+    void allocate_grad();
 
     // Topological Sort Utility
     void topological_sort(std::vector<std::shared_ptr<Tensor>> &ordering);
 
-    // Reset gradients (useful for multiple backward passes)
+    // Reset gradients of this tensor and every node it was computed from
     void zero_grad();
 
     // Friend function for ostream
@@ -88,4 +122,9 @@ std::shared_ptr<Tensor> operator-(const std::shared_ptr<Tensor> &a, const std::s
 std::shared_ptr<Tensor> operator*(const std::shared_ptr<Tensor> &a, const std::shared_ptr<Tensor> &b);
 std::shared_ptr<Tensor> operator/(const std::shared_ptr<Tensor> &a, const std::shared_ptr<Tensor> &b);
 
+// softmax(q k^T / sqrt(d)) v without materializing the scores (see AttentionOp)
+std::shared_ptr<Tensor> attention(const std::shared_ptr<Tensor> &q, const std::shared_ptr<Tensor> &k,
+                                  const std::shared_ptr<Tensor> &v, const std::shared_ptr<Tensor> &mask = nullptr,
+                                  bool causal = false);
+
 #endif // TENSOR_H
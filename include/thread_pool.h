@@ -0,0 +1,69 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool.
+// Each worker owns a deque: tasks submitted from a worker go to the back of
+// its own deque and are popped LIFO, idle workers steal FIFO from the front
+// of the others. Tasks submitted from outside the pool are spread round-robin.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const &) = delete;
+    void operator=(ThreadPool const &) = delete;
+
+    void submit(std::function<void()> task);
+
+    int num_threads() const
+    {
+        return static_cast<int>(workers.size());
+    }
+
+    // Process-wide pool sized by set_num_threads(). Callers keep the pointer
+    // until their tasks finish: set_num_threads() from another thread only
+    // swaps in a new pool for later callers, the old one lives until released.
+    static std::shared_ptr<ThreadPool> global();
+
+private:
+    struct Queue
+    {
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+    };
+
+    void worker_loop(int index);
+    bool try_pop(int index, std::function<void()> &task);
+    bool try_steal(int index, std::function<void()> &task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    int queued = 0; // Tasks sitting in some deque (guarded by wake_mutex)
+    bool stop = false;
+    std::atomic<unsigned> next_queue{0};
+};
+
+// Number of threads used by the parallel CPU paths (1 = serial, the default)
+void set_num_threads(int num_threads);
+int get_num_threads();
+
+// Split [0, n) into at most get_num_threads() chunks of at least grain
+// elements and run fn(begin, end) on each, the caller running the first.
+// Runs inline when there is only one chunk or when called from a pool worker.
+// Rethrows the first exception thrown by any chunk.
+void parallel_for(size_t n, size_t grain, const std::function<void(size_t, size_t)> &fn);
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,47 @@
+#ifndef TRAVERSAL_H
+#define TRAVERSAL_H
+
+#include <memory>
+#include <vector>
+
+#include "tensor.h"
+
+// Iterative graph walks over Tensor::children().
+// Each walk takes a fresh generation number and stamps it into
+// Tensor::visit_mark, so a node shared by many paths is visited once without
+// a hash set, and deep graphs do not grow the call stack. Two walks over the
+// same nodes must not run concurrently; graphs that threads build from their
+// own tensors share no nodes, so each thread may walk its own.
+
+unsigned long next_visit_generation();
+
+// Calls fn(Tensor &) once for every node reachable from root (root first)
+template <typename Fn>
+void for_each_node(Tensor &root, Fn fn)
+{
+    unsigned long generation = next_visit_generation();
+    std::vector<Tensor *> stack;
+    root.visit_mark = generation;
+    stack.push_back(&root);
+
+    while (!stack.empty())
+    {
+        Tensor *current = stack.back();
+        stack.pop_back();
+        fn(*current);
+
+        for (auto &child : current->children())
+        {
+            if (child->visit_mark != generation)
+            {
+                child->visit_mark = generation;
+                stack.push_back(child.get());
+            }
+        }
+    }
+}
+
+// Post-order (children before parents) listing of the graph rooted at root
+void topological_order(Tensor &root, std::vector<std::shared_ptr<Tensor>> &ordering);
+
+#endif // TRAVERSAL_H
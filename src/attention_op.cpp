@@ -0,0 +1,427 @@
+// attention_op.cpp
+
+#include "op.h"
+#include "tensor.h"
+#include "thread_pool.h"
+#include "node_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+// A query tile's scores against one key tile (32 x 64 floats) stay in L1
+static const size_t query_tile = 32;
+static const size_t key_tile = 64;
+
+static const float neg_inf = -std::numeric_limits<float>::infinity();
+
+namespace
+{
+    struct AttentionShape
+    {
+        size_t batch = 1; // Product of the leading dimensions
+        size_t n = 0;     // Queries
+        size_t m = 0;     // Keys
+        size_t d = 0;     // Query/key width
+        size_t dv = 0;    // Value width
+    };
+
+    // Pointers into one batch entry
+    struct AttentionData
+    {
+        const float *q;
+        const float *k;
+        const float *v;
+        const float *mask; // Shared by all batch entries; may be null
+        bool causal;
+        float scale;
+    };
+}
+
+static AttentionShape check_attention_inputs(const std::vector<std::shared_ptr<Tensor>> &inputs)
+{
+    if (inputs.size() != 3 && inputs.size() != 4)
+    {
+        throw std::invalid_argument("AttentionOp expected q, k, v and an optional mask, got " +
+                                    std::to_string(inputs.size()) + " inputs");
+    }
+    for (auto &input : inputs)
+    {
+        if (input->device != DeviceType::CPU)
+        {
+            throw std::invalid_argument("AttentionOp is only supported on the CPU.");
+        }
+        if (!input->tangent.empty())
+        {
+            throw std::invalid_argument("Forward-mode AD is not supported by AttentionOp.");
+        }
+    }
+
+    const auto &q = inputs[0]->shape;
+    const auto &k = inputs[1]->shape;
+    const auto &v = inputs[2]->shape;
+    const size_t rank = q.size();
+    if (rank < 2 || k.size() != rank || v.size() != rank)
+    {
+        throw std::invalid_argument("AttentionOp: q, k and v must have the same rank (at least 2)");
+    }
+    AttentionShape shape;
+    for (size_t i = 0; i + 2 < rank; i++)
+    {
+        if (k[i] != q[i] || v[i] != q[i])
+        {
+            throw std::invalid_argument("AttentionOp: q, k and v must have the same leading dimensions");
+        }
+        shape.batch *= q[i];
+    }
+    shape.n = q[rank - 2];
+    shape.d = q[rank - 1];
+    shape.m = k[rank - 2];
+    shape.dv = v[rank - 1];
+    if (k[rank - 1] != q[rank - 1])
+    {
+        throw std::invalid_argument("AttentionOp: q and k must have the same last dimension");
+    }
+    if (v[rank - 2] != k[rank - 2])
+    {
+        throw std::invalid_argument("AttentionOp: k and v must have the same number of rows");
+    }
+    if (inputs.size() == 4 &&
+        inputs[3]->shape != std::vector<int>{static_cast<int>(shape.n), static_cast<int>(shape.m)})
+    {
+        throw std::invalid_argument("AttentionOp: mask must have shape [queries, keys]");
+    }
+    return shape;
+}
+
+// out[r * key_tile + c] = a_r . b_c for rows r of a [rows, width] and c of b [cols, width].
+// b is transposed into scratch first so the inner loop runs over c and
+// vectorizes, instead of a latency-bound dot product per entry.
+static void products_tile(const float *a, size_t rows, const float *b, size_t cols, size_t width,
+                          std::vector<float> &scratch, float *out)
+{
+    scratch.assign(width * key_tile, 0.0f);
+    for (size_t c = 0; c < cols; c++)
+    {
+        for (size_t j = 0; j < width; j++)
+        {
+            scratch[j * key_tile + c] = b[c * width + j];
+        }
+    }
+    for (size_t r = 0; r < rows; r++)
+    {
+        // A full-width local row the compiler knows aliases nothing
+        const float *a_row = a + r * width;
+        float sums[key_tile] = {};
+        for (size_t j = 0; j < width; j++)
+        {
+            const float a_value = a_row[j];
+            const float *b_column = scratch.data() + j * key_tile;
+            for (size_t c = 0; c < key_tile; c++)
+            {
+                sums[c] += a_value * b_column[c];
+            }
+        }
+        std::copy(sums, sums + cols, out + r * key_tile);
+    }
+}
+
+// s[r * key_tile + c] = scale * q_{r0 + r} . k_{c0 + c}, or -inf where masked
+static void score_tile(const AttentionData &in, const AttentionShape &shape, size_t r0, size_t rows, size_t c0,
+                       size_t cols, std::vector<float> &scratch, float *s)
+{
+    products_tile(in.q + r0 * shape.d, rows, in.k + c0 * shape.d, cols, shape.d, scratch, s);
+    for (size_t r = 0; r < rows; r++)
+    {
+        const size_t row = r0 + r;
+        const float *mask_row = in.mask ? in.mask + row * shape.m + c0 : nullptr;
+        float *s_row = s + r * key_tile;
+        for (size_t c = 0; c < cols; c++)
+        {
+            const bool masked = (in.causal && c0 + c > row) || (mask_row && mask_row[c] == 0.0f);
+            s_row[c] = masked ? neg_inf : in.scale * s_row[c];
+        }
+    }
+}
+
+// Replace a score tile by the probabilities exp(s - lse) of its rows
+static void probability_tile(const float *lse, size_t rows, size_t cols, float *s)
+{
+    for (size_t r = 0; r < rows; r++)
+    {
+        float *s_row = s + r * key_tile;
+        for (size_t c = 0; c < cols; c++)
+        {
+            // Fully masked rows have lse = -inf and no probabilities
+            s_row[c] = lse[r] == neg_inf ? 0.0f : std::exp(s_row[c] - lse[r]);
+        }
+    }
+}
+
+// Turn a probability tile into dS = P * (dO v^T - D), D = rowsum(dO * O).
+// dp is a second [query_tile, key_tile] buffer.
+static void score_gradient_tile(const AttentionData &in, const AttentionShape &shape, const float *d_out,
+                                const float *delta, size_t r0, size_t rows, size_t c0, size_t cols,
+                                std::vector<float> &scratch, float *dp, float *p)
+{
+    products_tile(d_out + r0 * shape.dv, rows, in.v + c0 * shape.dv, cols, shape.dv, scratch, dp);
+    for (size_t r = 0; r < rows; r++)
+    {
+        const float *dp_row = dp + r * key_tile;
+        float *p_row = p + r * key_tile;
+        for (size_t c = 0; c < cols; c++)
+        {
+            p_row[c] *= dp_row[c] - delta[r0 + r];
+        }
+    }
+}
+
+void AttentionOp::forward()
+{
+    const AttentionShape shape = check_attention_inputs(inputs);
+    std::vector<int> out_shape = inputs[0]->shape;
+    out_shape.back() = static_cast<int>(shape.dv);
+    allocate_output(out_shape);
+    log_sum_exp.resize(shape.batch * shape.n);
+
+    const float scale = 1.0f / std::sqrt(static_cast<float>(shape.d));
+    const float *mask = inputs.size() == 4 ? inputs[3]->data.data() : nullptr;
+    const size_t q_tiles = (shape.n + query_tile - 1) / query_tile;
+    float *out = output->data.data();
+
+    parallel_for(shape.batch * q_tiles, 1, [&](size_t begin, size_t end)
+                 {
+        std::vector<float> scores(query_tile * key_tile);
+        std::vector<float> scratch;
+        std::vector<float> acc(query_tile * shape.dv);
+        float row_max[query_tile];
+        float row_sum[query_tile];
+        for (size_t task = begin; task < end; task++)
+        {
+            const size_t b = task / q_tiles;
+            const size_t r0 = task % q_tiles * query_tile;
+            const size_t rows = std::min(query_tile, shape.n - r0);
+            const AttentionData in{inputs[0]->data.data() + b * shape.n * shape.d,
+                                   inputs[1]->data.data() + b * shape.m * shape.d,
+                                   inputs[2]->data.data() + b * shape.m * shape.dv, mask, causal, scale};
+
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            std::fill(row_max, row_max + rows, neg_inf);
+            std::fill(row_sum, row_sum + rows, 0.0f);
+
+            // Online softmax: rescale the running sums whenever a row's max grows
+            const size_t key_end = causal ? std::min(shape.m, r0 + rows) : shape.m;
+            for (size_t c0 = 0; c0 < key_end; c0 += key_tile)
+            {
+                const size_t cols = std::min(key_tile, key_end - c0);
+                score_tile(in, shape, r0, rows, c0, cols, scratch, scores.data());
+                for (size_t r = 0; r < rows; r++)
+                {
+                    float *s = scores.data() + r * key_tile;
+                    float new_max = row_max[r];
+                    for (size_t c = 0; c < cols; c++)
+                    {
+                        new_max = std::max(new_max, s[c]);
+                    }
+                    if (new_max == neg_inf)
+                    {
+                        continue; // Everything so far is masked
+                    }
+                    const float correction = std::exp(row_max[r] - new_max);
+                    float *a = acc.data() + r * shape.dv;
+                    for (size_t j = 0; j < shape.dv; j++)
+                    {
+                        a[j] *= correction;
+                    }
+                    float sum = 0.0f;
+                    for (size_t c = 0; c < cols; c++)
+                    {
+                        const float p = std::exp(s[c] - new_max);
+                        if (p == 0.0f)
+                        {
+                            continue;
+                        }
+                        sum += p;
+                        const float *v_row = in.v + (c0 + c) * shape.dv;
+                        for (size_t j = 0; j < shape.dv; j++)
+                        {
+                            a[j] += p * v_row[j];
+                        }
+                    }
+                    row_sum[r] = row_sum[r] * correction + sum;
+                    row_max[r] = new_max;
+                }
+            }
+
+            for (size_t r = 0; r < rows; r++)
+            {
+                float *o = out + (b * shape.n + r0 + r) * shape.dv;
+                const float *a = acc.data() + r * shape.dv;
+                const float inv_sum = row_sum[r] > 0.0f ? 1.0f / row_sum[r] : 0.0f;
+                for (size_t j = 0; j < shape.dv; j++)
+                {
+                    o[j] = a[j] * inv_sum;
+                }
+                log_sum_exp[b * shape.n + r0 + r] = row_sum[r] > 0.0f ? row_max[r] + std::log(row_sum[r]) : neg_inf;
+            }
+        } });
+
+    output->op = shared_from_this();
+}
+
+void AttentionOp::backward()
+{
+    const AttentionShape shape = check_attention_inputs(inputs);
+    const float scale = 1.0f / std::sqrt(static_cast<float>(shape.d));
+    const float *mask = inputs.size() == 4 ? inputs[3]->data.data() : nullptr;
+    const float *out = output->data.data();
+    const float *d_out = output->grad.data();
+
+    // D = rowsum(dO * O), the softmax backward's per-row correction
+    std::vector<float> delta(shape.batch * shape.n);
+    for (size_t i = 0; i < delta.size(); i++)
+    {
+        float dot = 0.0f;
+        for (size_t j = 0; j < shape.dv; j++)
+        {
+            dot += d_out[i * shape.dv + j] * out[i * shape.dv + j];
+        }
+        delta[i] = dot;
+    }
+
+    auto batch_data = [&](size_t b)
+    {
+        return AttentionData{inputs[0]->data.data() + b * shape.n * shape.d,
+                             inputs[1]->data.data() + b * shape.m * shape.d,
+                             inputs[2]->data.data() + b * shape.m * shape.dv, mask, causal, scale};
+    };
+
+    // dk and dv: each task owns one key tile and walks the query tiles
+    const size_t k_tiles = (shape.m + key_tile - 1) / key_tile;
+    parallel_for(shape.batch * k_tiles, 1, [&](size_t begin, size_t end)
+                 {
+        std::vector<float> p(query_tile * key_tile);
+        std::vector<float> dp(query_tile * key_tile);
+        std::vector<float> scratch;
+        for (size_t task = begin; task < end; task++)
+        {
+            const size_t b = task / k_tiles;
+            const size_t c0 = task % k_tiles * key_tile;
+            const size_t cols = std::min(key_tile, shape.m - c0);
+            const AttentionData in = batch_data(b);
+            const float *lse = log_sum_exp.data() + b * shape.n;
+            const float *d_out_b = d_out + b * shape.n * shape.dv;
+            const float *delta_b = delta.data() + b * shape.n;
+            float *d_k = input_grad(1) + b * shape.m * shape.d;
+            float *d_v = input_grad(2) + b * shape.m * shape.dv;
+
+            // With causal, queries before c0 see none of these keys
+            const size_t first = causal ? c0 / query_tile * query_tile : 0;
+            for (size_t r0 = first; r0 < shape.n; r0 += query_tile)
+            {
+                const size_t rows = std::min(query_tile, shape.n - r0);
+                score_tile(in, shape, r0, rows, c0, cols, scratch, p.data());
+                probability_tile(lse + r0, rows, cols, p.data());
+
+                // dv += P^T dO
+                for (size_t r = 0; r < rows; r++)
+                {
+                    const float *d_out_row = d_out_b + (r0 + r) * shape.dv;
+                    for (size_t c = 0; c < cols; c++)
+                    {
+                        const float prob = p[r * key_tile + c];
+                        if (prob == 0.0f)
+                        {
+                            continue;
+                        }
+                        float *d_v_row = d_v + (c0 + c) * shape.dv;
+                        for (size_t j = 0; j < shape.dv; j++)
+                        {
+                            d_v_row[j] += prob * d_out_row[j];
+                        }
+                    }
+                }
+
+                // dk += scale * dS^T q
+                score_gradient_tile(in, shape, d_out_b, delta_b, r0, rows, c0, cols, scratch, dp.data(), p.data());
+                for (size_t r = 0; r < rows; r++)
+                {
+                    const float *q_row = in.q + (r0 + r) * shape.d;
+                    for (size_t c = 0; c < cols; c++)
+                    {
+                        const float ds = scale * p[r * key_tile + c];
+                        if (ds == 0.0f)
+                        {
+                            continue;
+                        }
+                        float *d_k_row = d_k + (c0 + c) * shape.d;
+                        for (size_t j = 0; j < shape.d; j++)
+                        {
+                            d_k_row[j] += ds * q_row[j];
+                        }
+                    }
+                }
+            }
+        } });
+
+    // dq: each task owns one query tile and walks the key tiles
+    const size_t q_tiles = (shape.n + query_tile - 1) / query_tile;
+    parallel_for(shape.batch * q_tiles, 1, [&](size_t begin, size_t end)
+                 {
+        std::vector<float> p(query_tile * key_tile);
+        std::vector<float> dp(query_tile * key_tile);
+        std::vector<float> scratch;
+        for (size_t task = begin; task < end; task++)
+        {
+            const size_t b = task / q_tiles;
+            const size_t r0 = task % q_tiles * query_tile;
+            const size_t rows = std::min(query_tile, shape.n - r0);
+            const AttentionData in = batch_data(b);
+            const float *lse = log_sum_exp.data() + b * shape.n;
+            const float *d_out_b = d_out + b * shape.n * shape.dv;
+            const float *delta_b = delta.data() + b * shape.n;
+            float *d_q = input_grad(0) + b * shape.n * shape.d;
+
+            const size_t key_end = causal ? std::min(shape.m, r0 + rows) : shape.m;
+            for (size_t c0 = 0; c0 < key_end; c0 += key_tile)
+            {
+                const size_t cols = std::min(key_tile, key_end - c0);
+                score_tile(in, shape, r0, rows, c0, cols, scratch, p.data());
+                probability_tile(lse + r0, rows, cols, p.data());
+                score_gradient_tile(in, shape, d_out_b, delta_b, r0, rows, c0, cols, scratch, dp.data(), p.data());
+
+                // dq += scale * dS k
+                for (size_t r = 0; r < rows; r++)
+                {
+                    float *d_q_row = d_q + (r0 + r) * shape.d;
+                    for (size_t c = 0; c < cols; c++)
+                    {
+                        const float ds = scale * p[r * key_tile + c];
+                        if (ds == 0.0f)
+                        {
+                            continue;
+                        }
+                        const float *k_row = in.k + (c0 + c) * shape.d;
+                        for (size_t j = 0; j < shape.d; j++)
+                        {
+                            d_q_row[j] += ds * k_row[j];
+                        }
+                    }
+                }
+            }
+        } });
+}
+
+std::shared_ptr<Tensor> attention(const std::shared_ptr<Tensor> &q, const std::shared_ptr<Tensor> &k,
+                                  const std::shared_ptr<Tensor> &v, const std::shared_ptr<Tensor> &mask, bool causal)
+{
+    std::vector<std::shared_ptr<Tensor>> inputs{q, k, v};
+    if (mask)
+    {
+        inputs.push_back(mask);
+    }
+    auto op = make_node<AttentionOp>(std::move(inputs), causal);
+    op->run_forward();
+    return op->output;
+}
@@ -4,26 +4,79 @@
 #include <pybind11/operators.h>
 #include <pybind11/stl.h>
 #include <pybind11/numpy.h>
+#include <pybind11/functional.h>
 
+#include <chrono>
+#include <future>
 #include <memory>
 #include "tensor.h"
 #include "nn.h"
 #include "op.h"
 #include "optimizer.h"
 #include "device_manager.h"
+#include "graph.h"
+#include "thread_pool.h"
+#include "forward_ad.h"
+#include "profiler.h"
+#include "memory_stats.h"
+#include "data_loader.h"
+#include "data_parallel.h"
+#include "process_group.h"
+#include "inference.h"
+#include "int8_kernels.h"
+#include "sparse.h"
+#include "grad_mode.h"
+#include "random.h"
 
 namespace py = pybind11;
 
+namespace
+{
+    // Python context manager state for cugrad.no_grad
+    struct GradModeScope
+    {
+        bool enabled;
+        bool saved;
+    };
+}
+
 PYBIND11_MODULE(cugrad, m)
 {
     m.doc() = "cugrad: A CUDA-based automatic differentiation library";
 
     // Add a function to set the device from Python
     m.def("set_device", [](DeviceType device)
-          { DeviceManager::get_instance().set_current_device(device); }, py::arg("device"), "Set the current device (CPU or CUDA)");
+          { DeviceManager::get_instance().set_current_device(device); }, py::arg("device"), "Set the calling thread's device (CPU or CUDA)");
 
     m.def("get_device", []()
-          { return DeviceManager::get_instance().get_current_device(); }, "Get the current device");
+          { return DeviceManager::get_instance().get_current_device(); }, "Get the calling thread's device");
+
+    m.def("set_default_device", [](DeviceType device)
+          { DeviceManager::get_instance().set_default_device(device); }, py::arg("device"),
+          "Set the device of threads that never called set_device()");
+
+    m.def("get_default_device", []()
+          { return DeviceManager::get_instance().get_default_device(); }, "Get the device of threads that never called set_device()");
+
+    m.def("manual_seed", &manual_seed, py::arg("seed"),
+          "Seed the calling thread's parameter initialization, and the process seed later threads derive theirs from");
+
+    m.def("is_grad_enabled", &GradMode::is_enabled, "Whether the calling thread records graphs for backward()");
+    m.def("set_grad_enabled", &GradMode::set_enabled, py::arg("enabled"), "Turn graph recording on or off for the calling thread");
+
+    // with cugrad.no_grad(): ... (per thread, restores the previous mode on exit)
+    py::class_<GradModeScope>(m, "no_grad")
+        .def(py::init([]()
+                      { return GradModeScope{false}; }))
+        .def("__enter__", [](GradModeScope &scope)
+             {
+            scope.saved = GradMode::is_enabled();
+            GradMode::set_enabled(scope.enabled); })
+        .def("__exit__", [](GradModeScope &scope, py::object, py::object, py::object)
+             { GradMode::set_enabled(scope.saved); });
+
+    m.def("set_num_threads", &set_num_threads, py::arg("num_threads"), "Set the number of threads used by the CPU backend");
+    m.def("get_num_threads", &get_num_threads, "Get the number of threads used by the CPU backend");
 
     // Bind the DeviceType enum
     py::enum_<DeviceType>(m, "DeviceType")
@@ -33,7 +86,9 @@ PYBIND11_MODULE(cugrad, m)
 
     // Bind the Op base class
     py::class_<Op, std::shared_ptr<Op>>(m, "Op")
-        .def_readonly("op_type", &Op::op_type, "Type of operation");
+        .def_property_readonly("op_type", [](const Op &op)
+                               { return std::string(op.op_type()); }, "Type of operation")
+        .def_readonly("id", &Op::id, "Number of the op, unique for the life of the process");
 
     // Bind derived Op classes
     py::class_<AddOp, Op, std::shared_ptr<AddOp>>(m, "AddOp")
@@ -63,7 +118,7 @@ PYBIND11_MODULE(cugrad, m)
     py::class_<StackOp, Op, std::shared_ptr<StackOp>>(m, "StackOp")
         .def(py::init<const std::vector<std::shared_ptr<Tensor>> &>(), py::arg("inputs"))
         // forward()
-        .def("forward", &StackOp::forward, "Forward pass")
+        .def("forward", &StackOp::run_forward, "Forward pass")
         .def_readonly("output", &StackOp::output, "Output tensor");
 
     py::module tensor = m.def_submodule("tensor", "Tensor operations and classes");
@@ -71,10 +126,16 @@ PYBIND11_MODULE(cugrad, m)
     py::class_<Tensor, std::shared_ptr<Tensor>>(tensor, "Tensor")
         // Constructors
         .def(py::init<>(), "Default constructor")
-        .def(py::init<const std::vector<int> &,
-                      float,
-                      std::shared_ptr<Op>,
-                      std::vector<std::shared_ptr<Tensor>>>(),
+        .def(py::init([](const std::vector<int> &shape, float init_val, std::shared_ptr<Op> op,
+                         const std::vector<std::shared_ptr<Tensor>> &children)
+                      {
+        // The children are the op's inputs; there is no separate list to set
+        const auto &inputs = op ? op->inputs : std::vector<std::shared_ptr<Tensor>>();
+        if (!children.empty() && children != inputs)
+        {
+            throw std::invalid_argument("Tensor children are the inputs of its op.");
+        }
+        return std::make_shared<Tensor>(shape, init_val, op); }),
              py::arg("shape"),
              py::arg("init_val") = 0.0f,
              py::arg("op") = nullptr, // or py::arg("op") = py::none()
@@ -101,10 +162,7 @@ PYBIND11_MODULE(cugrad, m)
         }
 
         // Create a Tensor with the given shape (initialized to 0.0f)
-        auto t = std::make_shared<Tensor>(shape,
-                                          0.0f,
-                                          nullptr,
-                                          std::vector<std::shared_ptr<Tensor>>());
+        auto t = std::make_shared<Tensor>(shape);
 
         // Copy data from the NumPy array into the tensor's data vector
         float *ptr = static_cast<float *>(buf.ptr);
@@ -123,17 +181,45 @@ PYBIND11_MODULE(cugrad, m)
              "Construct a Tensor from a NumPy array")
 
         // Properties
-        .def_readwrite("data", &Tensor::data, "Tensor data")
-        .def_readwrite("grad", &Tensor::grad, "Gradient of the tensor")
-        .def_readwrite("shape", &Tensor::shape, "Shape of the tensor")
-        .def_readwrite("children", &Tensor::children, "Child tensors")
+        .def_property(
+            "data", [](const Tensor &t)
+            { return t.data.to_vector(); },
+            [](Tensor &t, const std::vector<float> &values)
+            { t.data = values; },
+            "Tensor data")
+        .def_property(
+            "grad", [](const Tensor &t)
+            { return t.grad.to_vector(); },
+            [](Tensor &t, const std::vector<float> &values)
+            { t.grad = values; },
+            "Gradient of the tensor")
+        .def_property_readonly(
+            "tangent", [](const Tensor &t)
+            { return t.tangent.to_vector(); },
+            "Forward-mode AD tangent, set only inside jvp() (empty otherwise)")
+        .def_property(
+            "shape", [](const Tensor &t)
+            { return t.shape.to_vector(); },
+            [](Tensor &t, const std::vector<int> &shape)
+            { t.shape = shape; },
+            "Shape of the tensor")
+        .def_property_readonly(
+            "children", [](const Tensor &t)
+            { return t.children(); },
+            "Child tensors (the inputs of its op)")
         .def_readwrite("label", &Tensor::label, "Label for debugging")
         .def_readwrite("device", &Tensor::device, "Device type")
+        .def_readwrite("constant", &Tensor::constant, "Whether the value never changes (foldable by graph passes)")
         .def_readonly("op", &Tensor::op, "Operation that created this tensor")
 
         // Methods
-        .def("backward", &Tensor::backward, "Compute the gradients")
-        .def("zero_grad", &Tensor::zero_grad, "Reset gradients to zero")
+        .def("backward", py::overload_cast<bool>(&Tensor::backward), py::arg("retain_graph") = false, py::call_guard<py::gil_scoped_release>(), "Compute the gradients; the graph is freed unless retain_graph=True")
+        .def("zero_grad", &Tensor::zero_grad, py::call_guard<py::gil_scoped_release>(), "Reset gradients to zero")
+        .def("topological_sort", [](Tensor &t)
+             {
+            std::vector<std::shared_ptr<Tensor>> ordering;
+            t.topological_sort(ordering);
+            return ordering; }, "Every node of the graph once, children before parents")
 
         // Device methods
         .def("allocate_memory_on_device", &Tensor::allocate_memory_on_device, "Allocate memory on the device")
@@ -142,39 +228,202 @@ PYBIND11_MODULE(cugrad, m)
         .def("copy_to_host", &Tensor::copy_to_host, "Copy tensor to the host")
 
         // Operator Overloads
-        .def("__add__", &operator+, py::is_operator())
-        .def("__sub__", &operator-, py::is_operator())
-        .def("__mul__", &operator*, py::is_operator())
-        .def("__truediv__", &operator/, py::is_operator())
+        .def("__add__", &operator+, py::is_operator(), py::call_guard<py::gil_scoped_release>())
+        .def("__sub__", &operator-, py::is_operator(), py::call_guard<py::gil_scoped_release>())
+        .def("__mul__", &operator*, py::is_operator(), py::call_guard<py::gil_scoped_release>())
+        .def("__truediv__", &operator/, py::is_operator(), py::call_guard<py::gil_scoped_release>())
 
         // Right hand side operator overloads
-        .def("__radd__", &operator+, py::is_operator())
-        .def("__rsub__", &operator-, py::is_operator())
-        .def("__rmul__", &operator*, py::is_operator())
-        .def("__rtruediv__", &operator/, py::is_operator())
+        .def("__radd__", &operator+, py::is_operator(), py::call_guard<py::gil_scoped_release>())
+        .def("__rsub__", &operator-, py::is_operator(), py::call_guard<py::gil_scoped_release>())
+        .def("__rmul__", &operator*, py::is_operator(), py::call_guard<py::gil_scoped_release>())
+        .def("__rtruediv__", &operator/, py::is_operator(), py::call_guard<py::gil_scoped_release>())
 
         // Other operations
-        .def("tanh", &Tensor::tanh, "Apply the tanh operation")
-        .def("relu", &Tensor::relu, "Apply the ReLU operation")
-        .def("exp", &Tensor::exp, "Apply the exponential operation")
-        .def("sum", &Tensor::sum, "Sum all elements of the tensor");
+        .def("tanh", &Tensor::tanh, py::call_guard<py::gil_scoped_release>(), "Apply the tanh operation")
+        .def("relu", &Tensor::relu, py::call_guard<py::gil_scoped_release>(), "Apply the ReLU operation")
+        .def("exp", &Tensor::exp, py::call_guard<py::gil_scoped_release>(), "Apply the exponential operation")
+        .def("sum", &Tensor::sum, py::call_guard<py::gil_scoped_release>(), "Sum all elements of the tensor");
+
+    tensor.def("attention", &attention, py::arg("q"), py::arg("k"), py::arg("v"), py::arg("mask") = nullptr,
+               py::arg("causal") = false, py::call_guard<py::gil_scoped_release>(),
+               "softmax(q k^T / sqrt(d)) v over the last two dimensions; mask [N, M] (0 = masked out) is optional");
+
+    using IndexArray = py::array_t<int, py::array::c_style | py::array::forcecast>;
+    using ValueArray = py::array_t<float, py::array::c_style | py::array::forcecast>;
+    auto to_vector = [](const auto &array)
+    {
+        if (array.ndim() != 1)
+        {
+            throw std::invalid_argument("SparseTensor expects 1-D index and value arrays.");
+        }
+        return std::vector<typename std::decay_t<decltype(array)>::value_type>(array.data(), array.data() + array.size());
+    };
+
+    py::class_<SparseTensor, std::shared_ptr<SparseTensor>>(tensor, "SparseTensor")
+        .def_static("from_csr", [to_vector](std::pair<int, int> shape, IndexArray indptr, IndexArray indices, ValueArray data)
+                    { return SparseTensor::from_csr(shape.first, shape.second, to_vector(indptr), to_vector(indices), to_vector(data)); },
+                    py::arg("shape"), py::arg("indptr"), py::arg("indices"), py::arg("data"), "From CSR arrays (as scipy.sparse.csr_matrix)")
+        .def_static("from_coo", [to_vector](std::pair<int, int> shape, IndexArray row, IndexArray col, ValueArray data)
+                    { return SparseTensor::from_coo(shape.first, shape.second, to_vector(row), to_vector(col), to_vector(data)); },
+                    py::arg("shape"), py::arg("row"), py::arg("col"), py::arg("data"), "From coordinate arrays; duplicates are summed")
+        .def_static("from_dense", [](ValueArray dense)
+                    {
+            if (dense.ndim() != 2)
+            {
+                throw std::invalid_argument("SparseTensor.from_dense expects a 2-D array.");
+            }
+            return SparseTensor::from_dense(dense.data(), static_cast<int>(dense.shape(0)), static_cast<int>(dense.shape(1))); },
+                    py::arg("dense"), "The nonzeros of a 2-D array")
+        .def_static("from_scipy", [to_vector](py::object matrix)
+                    {
+            py::object csr = matrix.attr("tocsr")();
+            auto shape = csr.attr("shape").cast<std::pair<int, int>>();
+            return SparseTensor::from_csr(shape.first, shape.second, to_vector(csr.attr("indptr").cast<IndexArray>()),
+                                          to_vector(csr.attr("indices").cast<IndexArray>()), to_vector(csr.attr("data").cast<ValueArray>())); },
+                    py::arg("matrix"), "From any scipy.sparse matrix (converted with tocsr())")
+        .def("to_dense", [](const SparseTensor &sparse)
+             {
+            py::array_t<float> dense(std::vector<size_t>{static_cast<size_t>(sparse.rows), static_cast<size_t>(sparse.cols)});
+            auto values = sparse.to_dense();
+            std::copy(values.begin(), values.end(), dense.mutable_data());
+            return dense; }, "Dense [rows, cols] float array")
+        .def_property_readonly("shape", [](const SparseTensor &sparse)
+                               { return std::vector<int>{sparse.rows, sparse.cols}; }, "[rows, cols]")
+        .def_property_readonly("nnz", &SparseTensor::nnz, "Number of stored entries");
+
+    tensor.def("spmm", [](std::shared_ptr<SparseTensor> sparse, std::shared_ptr<Tensor> weight, std::shared_ptr<Tensor> bias)
+               { return spmm(sparse, weight, bias); }, py::arg("sparse"), py::arg("weight"), py::arg("bias") = nullptr,
+               py::call_guard<py::gil_scoped_release>(), "sparse [rows, K] times weight [K, N] (+ bias [N]); gradients reach weight and bias");
+
+    py::class_<MemoryPlanStats>(m, "MemoryPlanStats")
+        .def_readonly("naive_bytes", &MemoryPlanStats::naive_bytes, "Bytes with one allocation per buffer")
+        .def_readonly("planned_bytes", &MemoryPlanStats::planned_bytes, "Bytes of the shared arena")
+        .def_readonly("num_buffers", &MemoryPlanStats::num_buffers, "Number of planned buffers");
+
+    py::class_<GraphOptimizationStats>(m, "GraphOptimizationStats")
+        .def_readonly("ops_before", &GraphOptimizationStats::ops_before, "Ops in the plan before optimizing")
+        .def_readonly("ops_after", &GraphOptimizationStats::ops_after, "Ops in the plan after optimizing")
+        .def_readonly("cse_merged", &GraphOptimizationStats::cse_merged, "Ops merged into an identical one")
+        .def_readonly("constants_folded", &GraphOptimizationStats::constants_folded, "Ops folded into constants")
+        .def_readonly("dead_removed", &GraphOptimizationStats::dead_removed, "Ops removed because they no longer reach the output");
+
+    // Bind the CapturedGraph class
+    py::class_<CapturedGraph, std::shared_ptr<CapturedGraph>>(m, "CapturedGraph")
+        .def("replay", py::overload_cast<const std::vector<std::vector<float>> &>(&CapturedGraph::replay), py::arg("input_data"), py::call_guard<py::gil_scoped_release>(), "Copy new input values, then run forward and backward")
+        .def("replay", py::overload_cast<>(&CapturedGraph::replay), py::call_guard<py::gil_scoped_release>(), "Run forward and backward with the current input values")
+        .def("forward", &CapturedGraph::forward, py::call_guard<py::gil_scoped_release>(), "Run the captured forward pass")
+        .def("backward", &CapturedGraph::backward, py::call_guard<py::gil_scoped_release>(), "Run the captured backward pass")
+        .def("optimize", &CapturedGraph::optimize, "Run CSE, constant folding and dead node elimination")
+        .def("plan_memory", &CapturedGraph::plan_memory, "Pack intermediate buffers into one arena by lifetime")
+        .def("num_ops", &CapturedGraph::num_ops, "Number of ops in the plan")
+        .def_readonly("output", &CapturedGraph::output, "Output tensor of the captured graph")
+        .def_readonly("inputs", &CapturedGraph::inputs, "Input tensors of the captured graph");
+
+    m.def("capture", [](std::shared_ptr<Tensor> output, const std::vector<std::shared_ptr<Tensor>> &inputs)
+          { return std::make_shared<CapturedGraph>(output, inputs); }, py::arg("output"), py::arg("inputs"), "Record the graph producing output for replay with new input values");
+
+    m.def(
+        "jvp", [](py::function fn, const std::vector<std::shared_ptr<Tensor>> &primals, const std::vector<std::shared_ptr<Tensor>> &tangents)
+        {
+            // fn(*primals) may return a single Tensor or a sequence of Tensors
+            bool single_output = false;
+            auto call = [&fn, &single_output](const std::vector<std::shared_ptr<Tensor>> &args)
+            {
+                py::object result = fn(*py::cast(args));
+                if (py::isinstance<Tensor>(result))
+                {
+                    single_output = true;
+                    return std::vector<std::shared_ptr<Tensor>>{result.cast<std::shared_ptr<Tensor>>()};
+                }
+                return result.cast<std::vector<std::shared_ptr<Tensor>>>();
+            };
+            auto result = jvp(call, primals, tangents);
+            if (single_output)
+            {
+                return py::make_tuple(result.first[0], result.second[0]);
+            }
+            return py::make_tuple(result.first, result.second); },
+        py::arg("fn"), py::arg("primals"), py::arg("tangents"), "Forward-mode AD: returns (fn(*primals), J * tangents)");
+
+    py::class_<MemorySnapshot>(m, "MemorySnapshot")
+        .def_readonly("live_tensors", &MemorySnapshot::live_tensors, "Tensors alive")
+        .def_readonly("live_ops", &MemorySnapshot::live_ops, "Ops alive")
+        .def_readonly("host_bytes", &MemorySnapshot::host_bytes, "Host bytes held by buffers")
+        .def_readonly("device_bytes", &MemorySnapshot::device_bytes, "Device bytes held by tensors")
+        .def_readonly("peak_host_bytes", &MemorySnapshot::peak_host_bytes, "Highest host_bytes seen")
+        .def_readonly("peak_device_bytes", &MemorySnapshot::peak_device_bytes, "Highest device_bytes seen")
+        .def_readonly("node_pool_bytes", &MemorySnapshot::node_pool_bytes, "Slab bytes reserved for tensors and ops")
+        .def_readonly("tensors_by_op_type", &MemorySnapshot::tensors_by_op_type, "Live tensors by producing op ('leaf' if none)")
+        .def_readonly("bytes_by_op_type", &MemorySnapshot::bytes_by_op_type, "Bytes of those tensors")
+        .def_readonly("ops_by_op_type", &MemorySnapshot::ops_by_op_type, "Live ops by type");
+
+    py::class_<ThreadMemoryStats>(m, "ThreadMemoryStats")
+        .def_readonly("tensors_created", &ThreadMemoryStats::tensors_created)
+        .def_readonly("tensors_destroyed", &ThreadMemoryStats::tensors_destroyed)
+        .def_readonly("ops_created", &ThreadMemoryStats::ops_created)
+        .def_readonly("ops_destroyed", &ThreadMemoryStats::ops_destroyed)
+        .def_readonly("bytes_allocated", &ThreadMemoryStats::bytes_allocated)
+        .def_readonly("bytes_freed", &ThreadMemoryStats::bytes_freed);
+
+    py::class_<LiveGraph>(m, "LiveGraph")
+        .def_readonly("root", &LiveGraph::root, "Node no other live node consumes")
+        .def_readonly("num_nodes", &LiveGraph::num_nodes)
+        .def_readonly("num_ops", &LiveGraph::num_ops)
+        .def_readonly("bytes", &LiveGraph::bytes);
+
+    m.def("memory_snapshot", &MemoryStats::snapshot, "Live tensors, ops and bytes");
+    m.def("memory_diff", &MemoryStats::diff, py::arg("before"), py::arg("after"), "after - before");
+    m.def("thread_memory_stats", &MemoryStats::thread_stats, "What the calling thread created and freed");
+    m.def("reset_peak_memory", &MemoryStats::reset_peak, "Restart peak tracking from the current usage");
+    m.def("largest_graphs", &MemoryStats::largest_graphs, py::arg("limit") = 10, "Live graphs sorted by bytes");
+    m.def("memory_summary", &MemoryStats::summary, py::arg("limit") = 10, "Memory counters and the largest live graphs as text");
 
     py::module optimizer = m.def_submodule("optimizer", "Optimization algorithms");
 
+    // Bind the Optimizer base class
+    py::class_<Optimizer, std::shared_ptr<Optimizer>>(optimizer, "Optimizer")
+        .def("step", &Optimizer::step, py::call_guard<py::gil_scoped_release>(), "Update parameters")
+        .def("zero_grad", &Optimizer::zero_grad, py::call_guard<py::gil_scoped_release>(), "Zero gradients")
+        .def_property("max_grad_norm", &Optimizer::get_max_grad_norm, &Optimizer::set_max_grad_norm,
+                      "Clip the global gradient L2 norm to this value inside step() (0 disables clipping)")
+        .def("last_grad_norm", &Optimizer::last_grad_norm, "Global gradient norm before clipping in the last step()")
+        .def("set_process_group", &Optimizer::set_process_group, py::arg("group"), py::arg("bucket_elements") = 1 << 16,
+             "Average gradients across the ranks of group before every step() (None detaches)")
+        .def_property_readonly("process_group", &Optimizer::get_process_group, "Process group the gradients are averaged over")
+        .def("backward", &Optimizer::backward, py::arg("loss"), py::call_guard<py::gil_scoped_release>(),
+             "loss.backward(), overlapping the gradient all-reduce with it when a process group is set");
+
     // Bind the SGD class
-    py::class_<SGD, std::shared_ptr<SGD>>(optimizer, "SGD")
-        .def(py::init<const std::vector<std::shared_ptr<Tensor>> &, float>(), py::arg("parameters"), py::arg("lr"), "SGD constructor with parameters and learning rate")
-        .def("step", &SGD::step, "Update parameters")
-        .def("zero_grad", &SGD::zero_grad, "Zero gradients");
+    py::class_<SGD, Optimizer, std::shared_ptr<SGD>>(optimizer, "SGD")
+        .def(py::init<const std::vector<std::shared_ptr<Tensor>> &, float, float, bool, float>(), py::arg("parameters"), py::arg("lr"),
+             py::arg("momentum") = 0.0f, py::arg("nesterov") = false, py::arg("weight_decay") = 0.0f,
+             "SGD constructor with parameters, learning rate and optional (Nesterov) momentum and weight decay");
+
+    // Bind the Adam class
+    py::class_<Adam, Optimizer, std::shared_ptr<Adam>>(optimizer, "Adam")
+        .def(py::init<const std::vector<std::shared_ptr<Tensor>> &, float, float, float, float, float>(), py::arg("parameters"),
+             py::arg("lr") = 1e-3f, py::arg("beta1") = 0.9f, py::arg("beta2") = 0.999f, py::arg("eps") = 1e-8f,
+             py::arg("weight_decay") = 0.0f, "Adam constructor; weight_decay is an L2 penalty added to the gradient");
+
+    // Bind the AdamW class
+    py::class_<AdamW, Adam, std::shared_ptr<AdamW>>(optimizer, "AdamW")
+        .def(py::init<const std::vector<std::shared_ptr<Tensor>> &, float, float, float, float, float>(), py::arg("parameters"),
+             py::arg("lr") = 1e-3f, py::arg("beta1") = 0.9f, py::arg("beta2") = 0.999f, py::arg("eps") = 1e-8f,
+             py::arg("weight_decay") = 1e-2f, "AdamW constructor; weight_decay shrinks the parameters directly");
 
     // Create the 'nn' submodule
     py::module nn = m.def_submodule("nn", "Neural network modules");
 
     // Bind the Module base class
     py::class_<Module, std::shared_ptr<Module>>(nn, "Module")
-        .def("__call__", &Module::operator(), "Call operator for the Module")
-        .def("zero_grad", &Module::zero_grad, "Zero gradients")
-        .def("parameters", &Module::parameters, "Get parameters");
+        .def("__call__", &Module::operator(), py::call_guard<py::gil_scoped_release>(), "Call operator for the Module")
+        .def("zero_grad", &Module::zero_grad, py::call_guard<py::gil_scoped_release>(), "Zero gradients")
+        .def("parameters", &Module::parameters, "Get parameters")
+        .def("flatten_parameters", &Module::flatten_parameters, "Store all parameters and gradients in two contiguous buffers (CPU only)")
+        .def_property_readonly("is_flat", [](const Module &module)
+                               { return module.flat.size > 0; }, "Whether flatten_parameters() has been called")
+        .def("clone", &Module::clone, "Deep copy with its own parameters");
 
     // Bind the Neuron class to the 'nn' submodule
     py::class_<Neuron, Module, std::shared_ptr<Neuron>>(nn, "Neuron")
@@ -183,18 +432,331 @@ PYBIND11_MODULE(cugrad, m)
         .def_readwrite("bias", &Neuron::bias, "Bias of the Neuron layer")
         .def_readwrite("activation", &Neuron::activation, "Activation operation")
         .def_readwrite("in_features", &Neuron::in_features, "Number of input features")
-        .def("zero_grad", &Module::zero_grad, "Zero gradients")
+        .def("zero_grad", &Module::zero_grad, py::call_guard<py::gil_scoped_release>(), "Zero gradients")
         .def("parameters", &Module::parameters, "Get parameters")
-        .def("__call__", &Neuron::operator(), py::arg("input"), "Call operator for the Neuron layer");
+        .def("__call__", &Neuron::operator(), py::arg("input"), py::call_guard<py::gil_scoped_release>(), "Call operator for the Neuron layer");
 
     // Bind the Layer class to the 'nn' submodule
     py::class_<Layer, Module, std::shared_ptr<Layer>>(nn, "Layer")
         .def(py::init<int, int, bool>(), py::arg("input_size"), py::arg("output_size"), py::arg("nonlin") = true, "Layer constructor")
-        .def("__call__", &Layer::operator(), py::arg("input"), "Call operator for the Layer");
+        .def("__call__", &Layer::operator(), py::arg("input"), py::call_guard<py::gil_scoped_release>(), "Call operator for the Layer");
 
     // Bind the MLP class to the 'nn' submodule
     py::class_<MLP, Module, std::shared_ptr<MLP>>(nn, "MLP")
         .def(py::init<int, const std::vector<int> &>(), py::arg("input_size"), py::arg("layer_sizes"), "MLP constructor with input size and layer sizes")
-        .def("__call__", &MLP::operator(), py::arg("input"), "Call operator for the MLP")
+        .def("__call__", &MLP::operator(), py::arg("input"), py::call_guard<py::gil_scoped_release>(), "Call operator for the MLP")
         .def("parameters", &MLP::parameters, "Get all parameters of the MLP");
+
+    py::class_<LSTM, Module, std::shared_ptr<LSTM>>(nn, "LSTM")
+        .def(py::init<int, int>(), py::arg("input_size"), py::arg("hidden_size"), "Single-layer LSTM over [steps, input_size] sequences")
+        .def("__call__", &LSTM::operator(), py::arg("input"), py::call_guard<py::gil_scoped_release>(), "Hidden states [steps, hidden_size] from a zero initial state")
+        .def("forward", &LSTM::forward, py::arg("input"), py::arg("h0"), py::arg("c0"), py::call_guard<py::gil_scoped_release>(), "Hidden states from the initial state (h0, c0)")
+        .def_readonly("input_size", &LSTM::input_size)
+        .def_readonly("hidden_size", &LSTM::hidden_size)
+        .def_readwrite("weight_ih", &LSTM::weight_ih, "[input_size, 4 * hidden_size], gates i, f, g, o")
+        .def_readwrite("weight_hh", &LSTM::weight_hh, "[hidden_size, 4 * hidden_size]")
+        .def_readwrite("bias", &LSTM::bias, "[4 * hidden_size]");
+
+    py::class_<GRU, Module, std::shared_ptr<GRU>>(nn, "GRU")
+        .def(py::init<int, int>(), py::arg("input_size"), py::arg("hidden_size"), "Single-layer GRU over [steps, input_size] sequences")
+        .def("__call__", &GRU::operator(), py::arg("input"), py::call_guard<py::gil_scoped_release>(), "Hidden states [steps, hidden_size] from a zero initial state")
+        .def("forward", &GRU::forward, py::arg("input"), py::arg("h0"), py::call_guard<py::gil_scoped_release>(), "Hidden states from the initial state h0")
+        .def_readonly("input_size", &GRU::input_size)
+        .def_readonly("hidden_size", &GRU::hidden_size)
+        .def_readwrite("weight_ih", &GRU::weight_ih, "[input_size, 3 * hidden_size], gates r, z, n")
+        .def_readwrite("weight_hh", &GRU::weight_hh, "[hidden_size, 3 * hidden_size]")
+        .def_readwrite("bias_ih", &GRU::bias_ih, "[3 * hidden_size]")
+        .def_readwrite("bias_hh", &GRU::bias_hh, "[3 * hidden_size]");
+
+    py::class_<SparseLinear, Module, std::shared_ptr<SparseLinear>>(nn, "SparseLinear")
+        .def(py::init<int, int>(), py::arg("in_features"), py::arg("out_features"), "Linear layer whose cost grows with the input nonzeros")
+        .def("__call__", &SparseLinear::operator(), py::arg("input"), py::call_guard<py::gil_scoped_release>(), "[batch, out_features] from a dense input (which gets no gradient)")
+        .def("forward", [](SparseLinear &layer, std::shared_ptr<SparseTensor> input)
+             { return layer.forward(input); }, py::arg("input"), py::call_guard<py::gil_scoped_release>(), "[batch, out_features] from a SparseTensor")
+        .def_readonly("in_features", &SparseLinear::in_features)
+        .def_readonly("out_features", &SparseLinear::out_features)
+        .def_readwrite("weight", &SparseLinear::weight, "[in_features, out_features]")
+        .def_readwrite("bias", &SparseLinear::bias, "[out_features]");
+
+    // Bind the DataParallel class to the 'nn' submodule
+    py::class_<DataParallel, std::shared_ptr<DataParallel>>(nn, "DataParallel")
+        .def(py::init<std::shared_ptr<Module>, std::shared_ptr<Optimizer>, int, size_t, DataParallel::LossFunction>(),
+             py::arg("module"), py::arg("optimizer"), py::arg("num_replicas"), py::arg("bucket_elements") = 1 << 14,
+             py::arg("loss") = nullptr,
+             "Train module on num_replicas threads; module and optimizer become replica 0. "
+             "loss(output, target) of one sample defaults to the squared error")
+        .def("train_step", &DataParallel::train_step, py::arg("inputs"), py::arg("targets"),
+             py::call_guard<py::gil_scoped_release>(),
+             "Training step on [batch, features] inputs and [batch, outputs] targets; returns the mean loss")
+        .def_property_readonly("num_replicas", &DataParallel::num_replicas, "Number of replicas (threads)")
+        .def_property_readonly("num_buckets", &DataParallel::num_buckets, "Gradient buckets reduced per step")
+        .def("replica", &DataParallel::replica, py::arg("index"), "Module of one replica");
+
+    py::module profiler = m.def_submodule("profiler", "Per-op timing of forward and backward calls");
+
+    py::class_<ProfileEvent>(profiler, "ProfileEvent")
+        .def_readonly("op_type", &ProfileEvent::op_type, "Type of the op")
+        .def_readonly("backward", &ProfileEvent::backward, "True for backward calls")
+        .def_readonly("input_shapes", &ProfileEvent::input_shapes, "Shapes of the op inputs")
+        .def_readonly("output_shape", &ProfileEvent::output_shape, "Shape of the op output")
+        .def_readonly("start_us", &ProfileEvent::start_us, "Start time in microseconds since profiling began")
+        .def_readonly("duration_us", &ProfileEvent::duration_us, "Wall time in microseconds")
+        .def_readonly("thread", &ProfileEvent::thread, "Number of the thread that ran the call")
+        .def_readonly("bytes", &ProfileEvent::bytes, "Estimated bytes read and written")
+        .def_readonly("flops", &ProfileEvent::flops, "Estimated floating point operations")
+        .def_readonly("op_id", &ProfileEvent::op_id, "id of the op that was timed");
+
+    // with cugrad.profiler.profile() as prof: ...
+    py::class_<ProfileSession>(profiler, "profile")
+        .def(py::init<bool>(), py::arg("clear") = true, "Enable the profiler, dropping earlier events unless clear=False")
+        .def("__enter__", [](ProfileSession &session) -> ProfileSession & { return session; }, py::return_value_policy::reference)
+        .def("__exit__", [](ProfileSession &session, py::object, py::object, py::object)
+             { session.stop(); })
+        .def("stop", &ProfileSession::stop, "Stop recording")
+        .def("events", [](ProfileSession &)
+             { return Profiler::events(); }, "Recorded events")
+        .def("summary", [](ProfileSession &)
+             { return Profiler::summary(); }, "Per-op totals sorted by time")
+        .def("export_chrome_trace", [](ProfileSession &, const std::string &path)
+             { Profiler::export_chrome_trace(path); }, py::arg("path"), "Write a Chrome trace JSON file");
+
+    profiler.def("enable", &Profiler::enable, "Start recording op calls");
+    profiler.def("disable", &Profiler::disable, "Stop recording op calls");
+    profiler.def("is_enabled", &Profiler::enabled, "Whether op calls are being recorded");
+    profiler.def("clear", &Profiler::clear, "Drop the recorded events");
+    profiler.def("events", &Profiler::events, "Recorded events");
+    profiler.def("summary", &Profiler::summary, "Per-op totals sorted by time");
+    profiler.def("chrome_trace", &Profiler::chrome_trace, "Recorded events as Chrome trace JSON");
+    profiler.def("export_chrome_trace", &Profiler::export_chrome_trace, py::arg("path"), "Write a Chrome trace JSON file");
+    profiler.def("op_time_us", [](std::shared_ptr<Op> op)
+                 { return Profiler::op_time_us(op.get()); }, py::arg("op"), "Recorded forward + backward time of one op, in microseconds");
+
+    py::module data = m.def_submodule("data", "Batching and background prefetch of training data");
+
+    // Copy a NumPy array (any dtype, converted to float32) into a DataArray;
+    // 1-D arrays become one column
+    auto to_data_array = [](py::object values)
+    {
+        auto arr = py::array_t<float, py::array::c_style | py::array::forcecast>::ensure(values);
+        if (!arr || (arr.ndim() != 1 && arr.ndim() != 2))
+        {
+            throw std::invalid_argument("DataLoader expects 1-D or 2-D arrays.");
+        }
+        size_t rows = arr.shape(0);
+        size_t cols = arr.ndim() == 2 ? arr.shape(1) : 1;
+        std::vector<float> values(arr.data(), arr.data() + rows * cols);
+        return DataArray::from_vector(std::move(values), rows, cols);
+    };
+
+    py::class_<Batch>(data, "Batch")
+        .def_readonly("index", &Batch::index, "Position of the batch in the epoch")
+        .def_readonly("inputs", &Batch::inputs, "Inputs as a [batch, features] tensor")
+        .def_readonly("targets", &Batch::targets, "Targets as a [batch, target columns] tensor, or None")
+        .def_readonly("input_rows", &Batch::input_rows, "Per-row input tensors (with split_rows=True)")
+        .def_readonly("target_rows", &Batch::target_rows, "Per-row target tensors (with split_rows=True)");
+
+    py::class_<DataLoader, std::shared_ptr<DataLoader>>(data, "DataLoader")
+        .def(py::init([to_data_array](py::object inputs, py::object targets, int batch_size, bool shuffle, bool drop_last,
+                                      int num_workers, int prefetch, unsigned seed, bool split_rows)
+                      { return std::make_shared<DataLoader>(to_data_array(inputs),
+                                                            targets.is_none() ? DataArray() : to_data_array(targets),
+                                                            batch_size, shuffle, drop_last, num_workers, prefetch, seed, split_rows); }),
+             py::arg("inputs"), py::arg("targets") = py::none(), py::arg("batch_size") = 32, py::arg("shuffle") = true,
+             py::arg("drop_last") = false, py::arg("num_workers") = 2, py::arg("prefetch") = 4, py::arg("seed") = 0,
+             py::arg("split_rows") = false, "Batch NumPy arrays (copied once) with background prefetch")
+        .def_static("from_npy", [](const std::string &inputs, const std::string &targets, int batch_size, bool shuffle, bool drop_last,
+                                   int num_workers, int prefetch, unsigned seed, bool split_rows)
+                    { return std::make_shared<DataLoader>(DataArray::load_npy(inputs),
+                                                          targets.empty() ? DataArray() : DataArray::load_npy(targets),
+                                                          batch_size, shuffle, drop_last, num_workers, prefetch, seed, split_rows); },
+                    py::arg("inputs"), py::arg("targets") = "", py::arg("batch_size") = 32, py::arg("shuffle") = true,
+                    py::arg("drop_last") = false, py::arg("num_workers") = 2, py::arg("prefetch") = 4, py::arg("seed") = 0,
+                    py::arg("split_rows") = false, "Batch memory-mapped float32 .npy files with background prefetch")
+        .def("__len__", &DataLoader::num_batches, "Batches per epoch")
+        .def("__iter__", [](std::shared_ptr<DataLoader> loader)
+             {
+            loader->start_epoch();
+            return loader; }, "Start a new (reshuffled) epoch")
+        .def("__next__", [](DataLoader &loader)
+             {
+            Batch batch;
+            bool more;
+            {
+                py::gil_scoped_release release;
+                more = loader.next(batch);
+            }
+            if (!more)
+            {
+                throw py::stop_iteration();
+            }
+            return batch; }, "Wait for the next batch (without holding the GIL)")
+        .def_property_readonly("num_rows", &DataLoader::num_rows, "Rows in the dataset")
+        .def_property_readonly("epoch", &DataLoader::epoch, "Number of epochs started");
+
+    data.def("split_rows", &split_rows, py::arg("batch"), "Per-row tensors viewing a [rows, cols] tensor");
+
+    py::module distributed = m.def_submodule("distributed", "Collectives between processes over TCP");
+
+    py::class_<Work, std::shared_ptr<Work>>(distributed, "Work")
+        .def("wait", &Work::wait, py::call_guard<py::gil_scoped_release>(), "Block until the collective has finished")
+        .def("done", &Work::done, "Whether the collective has finished");
+
+    py::class_<ProcessGroup, std::shared_ptr<ProcessGroup>>(distributed, "ProcessGroup")
+        .def(py::init<int, int, const std::string &, int, double>(), py::arg("rank"), py::arg("world_size"),
+             py::arg("host") = "127.0.0.1", py::arg("base_port") = 29500, py::arg("timeout") = 60.0,
+             py::call_guard<py::gil_scoped_release>(), "Connect to the other ranks (rank r listens on base_port + r)")
+        .def_static("from_env", &ProcessGroup::from_env, py::call_guard<py::gil_scoped_release>(),
+                    "Connect using RANK, WORLD_SIZE, MASTER_ADDR and MASTER_PORT")
+        .def_property_readonly("rank", &ProcessGroup::rank, "Rank of this process")
+        .def_property_readonly("world_size", &ProcessGroup::world_size, "Number of processes")
+        .def("all_reduce", [](ProcessGroup &group, std::shared_ptr<Tensor> tensor)
+             {
+            py::gil_scoped_release release;
+            tensor->copy_to_host();
+            group.all_reduce(tensor->data.data(), tensor->size());
+            tensor->copy_to_device(); }, py::arg("tensor"), "Sum the tensor's data across all ranks, in place")
+        .def("all_reduce", [](ProcessGroup &group, py::array_t<float, py::array::c_style> array)
+             {
+            float *data = array.mutable_data();
+            size_t size = array.size();
+            py::gil_scoped_release release;
+            group.all_reduce(data, size); }, py::arg("array"), "Sum a float32 NumPy array across all ranks, in place")
+        .def("broadcast", [](ProcessGroup &group, std::shared_ptr<Tensor> tensor, int root)
+             {
+            py::gil_scoped_release release;
+            tensor->copy_to_host();
+            group.broadcast(tensor->data.data(), tensor->size(), root);
+            tensor->copy_to_device(); }, py::arg("tensor"), py::arg("root") = 0, "Copy the tensor's data from root to every rank")
+        .def("broadcast", [](ProcessGroup &group, py::array_t<float, py::array::c_style> array, int root)
+             {
+            float *data = array.mutable_data();
+            size_t size = array.size();
+            py::gil_scoped_release release;
+            group.broadcast(data, size, root); }, py::arg("array"), py::arg("root") = 0, "Copy a float32 NumPy array from root to every rank")
+        .def("barrier", &ProcessGroup::barrier, py::call_guard<py::gil_scoped_release>(), "Wait until every rank gets here")
+        .def("all_reduce_async", [](ProcessGroup &group, std::shared_ptr<Tensor> tensor)
+             {
+            if (tensor->device != DeviceType::CPU)
+            {
+                throw std::invalid_argument("all_reduce_async supports CPU tensors only.");
+            }
+            return group.all_reduce_async(tensor->data.data(), tensor->size(), tensor); }, py::arg("tensor"),
+             "Start summing the tensor's data across all ranks on the communication thread");
+
+    // Broadcast every parameter of module from rank 0 so all ranks start equal
+    distributed.def("broadcast_parameters", [](ProcessGroup &group, Module &module)
+                    {
+        auto params = module.parameters();
+        py::gil_scoped_release release;
+        for (auto &param : params)
+        {
+            param->copy_to_host();
+            group.broadcast(param->data.data(), param->size(), 0);
+            param->copy_to_device();
+        } }, py::arg("group"), py::arg("module"), "Copy all parameters from rank 0 to every rank");
+
+    py::module inference = m.def_submodule("inference", "Autograd-free serving with dynamic request batching");
+
+    py::class_<InferencePlan, std::shared_ptr<InferencePlan>>(inference, "InferencePlan")
+        .def_static("freeze", &InferencePlan::freeze, py::arg("module"),
+                    "Copy an MLP, Layer or Neuron into dense per-layer matrices")
+        .def("run", [](const InferencePlan &plan, py::array_t<float, py::array::c_style | py::array::forcecast> inputs)
+             {
+            if (inputs.ndim() != 1 && inputs.ndim() != 2)
+            {
+                throw std::invalid_argument("InferencePlan.run expects a 1-D or 2-D array.");
+            }
+            size_t batch = inputs.ndim() == 2 ? inputs.shape(0) : 1;
+            size_t features = inputs.ndim() == 2 ? inputs.shape(1) : inputs.shape(0);
+            if (features != plan.input_size())
+            {
+                throw std::invalid_argument("InferencePlan.run expects " + std::to_string(plan.input_size()) + " features per row.");
+            }
+            py::array_t<float> outputs(inputs.ndim() == 2 ? std::vector<size_t>{batch, plan.output_size()}
+                                                          : std::vector<size_t>{plan.output_size()});
+            const float *in = inputs.data();
+            float *out = outputs.mutable_data();
+            {
+                py::gil_scoped_release release;
+                InferencePlan::Scratch scratch;
+                plan.run(in, out, batch, scratch);
+            }
+            return outputs; }, py::arg("inputs"), "Outputs for a [batch, features] (or one [features]) float array")
+        .def("quantize", [](const InferencePlan &plan, py::array_t<float, py::array::c_style | py::array::forcecast> calibration)
+             {
+            if (calibration.ndim() != 2 || static_cast<size_t>(calibration.shape(1)) != plan.input_size())
+            {
+                throw std::invalid_argument("quantize expects a [rows, " + std::to_string(plan.input_size()) + "] calibration array.");
+            }
+            const float *rows = calibration.data();
+            size_t count = calibration.shape(0);
+            py::gil_scoped_release release;
+            return plan.quantize(rows, count); }, py::arg("calibration"),
+             "int8 copy with per-channel weights and activation ranges calibrated on sample inputs")
+        .def("compare", [](const InferencePlan &plan, const InferencePlan &reference,
+                           py::array_t<float, py::array::c_style | py::array::forcecast> inputs)
+             {
+            if (inputs.ndim() != 2 || static_cast<size_t>(inputs.shape(1)) != plan.input_size())
+            {
+                throw std::invalid_argument("compare expects a [rows, " + std::to_string(plan.input_size()) + "] array.");
+            }
+            const float *rows = inputs.data();
+            size_t count = inputs.shape(0);
+            py::gil_scoped_release release;
+            return plan.compare(reference, rows, count); }, py::arg("reference"), py::arg("inputs"),
+             "Output error against reference (e.g. the fp32 plan) on the same inputs")
+        .def_property_readonly("quantized", &InferencePlan::is_quantized, "Whether the plan runs int8 kernels")
+        .def_property_readonly("weight_bytes", &InferencePlan::weight_bytes, "Bytes of weights, biases and scales")
+        .def_property_readonly("input_size", &InferencePlan::input_size, "Features per input row")
+        .def_property_readonly("output_size", &InferencePlan::output_size, "Values per output row")
+        .def_property_readonly("num_layers", &InferencePlan::num_layers, "Dense layers in the plan");
+
+    py::class_<QuantizationReport>(inference, "QuantizationReport")
+        .def_readonly("rows", &QuantizationReport::rows, "Rows compared")
+        .def_readonly("max_abs_error", &QuantizationReport::max_abs_error, "Largest absolute output error")
+        .def_readonly("mean_abs_error", &QuantizationReport::mean_abs_error, "Mean absolute output error")
+        .def_readonly("rms_error", &QuantizationReport::rms_error, "Root mean square output error")
+        .def_readonly("reference_rms", &QuantizationReport::reference_rms, "Root mean square of the reference outputs")
+        .def_readonly("weight_bytes", &QuantizationReport::weight_bytes, "Weight bytes of the compared plan")
+        .def_readonly("reference_weight_bytes", &QuantizationReport::reference_weight_bytes, "Weight bytes of the reference plan")
+        .def("summary", &QuantizationReport::summary, "Human-readable report")
+        .def("__repr__", &QuantizationReport::summary);
+
+    inference.def("int8_kernel", &int8_kernel, "Name of the int8 matmul kernel in use");
+    inference.def("available_int8_kernels", &available_int8_kernels, "int8 kernels this CPU supports, fastest first");
+    inference.def("set_int8_kernel", &set_int8_kernel, py::arg("name"), "Force an int8 kernel by name, or \"auto\"");
+
+    py::class_<InferenceStats>(inference, "InferenceStats")
+        .def_readonly("requests", &InferenceStats::requests, "Requests served")
+        .def_readonly("batches", &InferenceStats::batches, "Batches run")
+        .def_readonly("mean_batch_size", &InferenceStats::mean_batch_size, "Requests per batch")
+        .def_readonly("p50_latency_us", &InferenceStats::p50_latency_us, "Median request latency, in microseconds")
+        .def_readonly("p90_latency_us", &InferenceStats::p90_latency_us, "90th percentile request latency, in microseconds")
+        .def_readonly("p99_latency_us", &InferenceStats::p99_latency_us, "99th percentile request latency, in microseconds")
+        .def_readonly("max_latency_us", &InferenceStats::max_latency_us, "Slowest request latency, in microseconds")
+        .def_readonly("batch_histogram", &InferenceStats::batch_histogram, "batch_histogram[n]: batches of n requests")
+        .def("summary", &InferenceStats::summary, "Human-readable report")
+        .def("__repr__", &InferenceStats::summary);
+
+    using InferenceFuture = std::shared_future<std::vector<float>>;
+    py::class_<InferenceFuture>(inference, "InferenceFuture")
+        .def("result", [](const InferenceFuture &future)
+             { return future.get(); }, py::call_guard<py::gil_scoped_release>(), "Wait for the output row")
+        .def("done", [](const InferenceFuture &future)
+             { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; },
+             "Whether the output row is ready");
+
+    py::class_<InferenceServer, std::shared_ptr<InferenceServer>>(inference, "InferenceServer")
+        .def(py::init([](std::shared_ptr<InferencePlan> plan, size_t max_batch, double max_delay_us, int num_workers)
+                      { return std::make_shared<InferenceServer>(plan, max_batch, max_delay_us, num_workers); }),
+             py::arg("plan"),
+             py::arg("max_batch") = 32, py::arg("max_delay_us") = 1000.0, py::arg("num_workers") = 2,
+             "Serve plan, batching up to max_batch requests that arrive within max_delay_us of each other")
+        .def("submit", [](InferenceServer &server, std::vector<float> input)
+             { return InferenceFuture(server.submit(std::move(input))); }, py::arg("input"),
+             "Queue one input row and return at once")
+        .def("infer", &InferenceServer::infer, py::arg("input"), py::call_guard<py::gil_scoped_release>(),
+             "Output row for one input row (thread-safe; waits without holding the GIL)")
+        .def("stats", &InferenceServer::stats, "Request, batch and latency statistics so far")
+        .def("reset_stats", &InferenceServer::reset_stats, "Forget the statistics gathered so far");
 }
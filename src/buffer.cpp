@@ -0,0 +1,190 @@
+// buffer.cpp
+
+#include "buffer.h"
+#include "memory_stats.h"
+
+#include <algorithm>
+
+Buffer::Buffer(size_t n, float value)
+{
+    assign(n, value);
+}
+
+Buffer::Buffer(const Buffer &other)
+{
+    assign_values(other.ptr, other.count);
+}
+
+Buffer::~Buffer()
+{
+    release();
+}
+
+Buffer::Buffer(Buffer &&other) noexcept
+    : owned(std::move(other.owned)), owner(std::move(other.owner)), ptr(other.ptr), count(other.count)
+{
+    if (other.ptr == other.local)
+    {
+        std::copy(other.local, other.local + count, local);
+        ptr = local;
+    }
+    other.ptr = nullptr;
+    other.count = 0;
+}
+
+Buffer &Buffer::operator=(const Buffer &other)
+{
+    if (this != &other)
+    {
+        assign_values(other.ptr, other.count);
+    }
+    return *this;
+}
+
+Buffer &Buffer::operator=(Buffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        // The moved-in storage is already counted; only ours goes away
+        const size_t old_held = held();
+        owned = std::move(other.owned);
+        owner = std::move(other.owner);
+        count = other.count;
+        ptr = other.ptr;
+        if (other.ptr == other.local)
+        {
+            std::copy(other.local, other.local + count, local);
+            ptr = local;
+        }
+        other.ptr = nullptr;
+        other.count = 0;
+        if (old_held)
+        {
+            MemoryStats::host_bytes_changed(-static_cast<long long>(old_held * sizeof(float)));
+        }
+    }
+    return *this;
+}
+
+Buffer &Buffer::operator=(const std::vector<float> &values)
+{
+    assign_values(values.data(), values.size());
+    return *this;
+}
+
+Buffer &Buffer::operator=(std::initializer_list<float> values)
+{
+    assign_values(values.begin(), values.size());
+    return *this;
+}
+
+void Buffer::own(size_t n)
+{
+    owner.reset();
+    if (n == 0)
+    {
+        std::vector<float>().swap(owned);
+        ptr = nullptr;
+    }
+    else if (n <= inline_elements)
+    {
+        std::vector<float>().swap(owned);
+        ptr = local;
+    }
+    else
+    {
+        owned.resize(n);
+        ptr = owned.data();
+    }
+    count = n;
+}
+
+void Buffer::assign_values(const float *values, size_t n)
+{
+    if (n != count || !is_view())
+    {
+        // Copied out first in case values point into our own storage
+        float small[inline_elements];
+        if (n <= inline_elements)
+        {
+            std::copy(values, values + n, small);
+            values = small;
+        }
+        const size_t old_held = held();
+        own(n);
+        std::copy(values, values + n, ptr);
+        track(old_held);
+        return;
+    }
+    std::copy(values, values + n, ptr);
+}
+
+void Buffer::assign(size_t n, float value)
+{
+    const size_t old_held = held();
+    own(n);
+    std::fill(ptr, ptr + n, value);
+    track(old_held);
+}
+
+void Buffer::resize(size_t n, float value)
+{
+    if (n == count)
+    {
+        return;
+    }
+    const size_t old_held = held();
+    const size_t kept = std::min(n, count);
+    if (n <= inline_elements)
+    {
+        float values[inline_elements];
+        std::copy(ptr, ptr + kept, values);
+        own(n);
+        std::copy(values, values + kept, ptr);
+        std::fill(ptr + kept, ptr + n, value);
+    }
+    else
+    {
+        std::vector<float> values(ptr, ptr + kept);
+        values.resize(n, value);
+        owner.reset();
+        owned.swap(values);
+        ptr = owned.data();
+        count = n;
+    }
+    track(old_held);
+}
+
+void Buffer::bind(std::shared_ptr<void> new_owner, float *first, size_t n)
+{
+    const size_t old_held = held();
+    std::vector<float>().swap(owned);
+    owner = std::move(new_owner);
+    ptr = first;
+    count = n;
+    track(old_held);
+}
+
+void Buffer::release()
+{
+    const size_t old_held = held();
+    std::vector<float>().swap(owned);
+    owner.reset();
+    ptr = nullptr;
+    count = 0;
+    track(old_held);
+}
+
+void Buffer::track(size_t old_held)
+{
+    long long delta = static_cast<long long>(held()) - static_cast<long long>(old_held);
+    if (delta != 0)
+    {
+        MemoryStats::host_bytes_changed(delta * static_cast<long long>(sizeof(float)));
+    }
+}
+
+std::vector<float> Buffer::to_vector() const
+{
+    return std::vector<float>(ptr, ptr + count);
+}
@@ -0,0 +1,343 @@
+// data_loader.cpp
+
+#include "data_loader.h"
+#include "node_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    // Value of key in a .npy header dict, e.g. "'descr': '<f4', ..."
+    std::string npy_header_field(const std::string &header, const std::string &key, const std::string &path)
+    {
+        size_t pos = header.find("'" + key + "'");
+        if (pos == std::string::npos)
+        {
+            throw std::invalid_argument(path + ": .npy header has no " + key + ".");
+        }
+        pos = header.find(':', pos);
+        size_t end = pos;
+        if (key == "shape")
+        {
+            end = header.find(')', pos) + 1;
+        }
+        else
+        {
+            end = header.find_first_of(",}", pos);
+        }
+        std::string value = header.substr(pos + 1, end - pos - 1);
+        value.erase(0, value.find_first_not_of(" "));
+        return value;
+    }
+
+    std::vector<size_t> parse_npy_shape(const std::string &shape)
+    {
+        std::vector<size_t> dims;
+        size_t pos = shape.find('(') + 1;
+        while (pos < shape.size())
+        {
+            size_t next = shape.find_first_of(",)", pos);
+            std::string dim = shape.substr(pos, next - pos);
+            if (dim.find_first_not_of(" ") != std::string::npos)
+            {
+                dims.push_back(std::stoul(dim));
+            }
+            pos = next + 1;
+        }
+        return dims;
+    }
+
+    // Put a freshly gathered tensor on the loader's device
+    void place_on(Tensor &tensor, DeviceType device)
+    {
+        if (device == DeviceType::CUDA)
+        {
+            tensor.allocate_memory_on_device();
+            tensor.device = DeviceType::CUDA;
+            tensor.copy_to_device();
+        }
+        else
+        {
+            tensor.device = DeviceType::CPU;
+        }
+    }
+}
+
+DataArray DataArray::from_vector(std::vector<float> values, size_t rows, size_t cols)
+{
+    if (values.size() != rows * cols)
+    {
+        throw std::invalid_argument("DataArray expects rows * cols values.");
+    }
+    auto holder = std::make_shared<std::vector<float>>(std::move(values));
+    DataArray array;
+    array.data = std::shared_ptr<const float>(holder, holder->data());
+    array.rows = rows;
+    array.cols = cols;
+    return array;
+}
+
+DataArray DataArray::load_npy(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::invalid_argument("Cannot open " + path + ".");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 10)
+    {
+        close(fd);
+        throw std::invalid_argument(path + " is not a .npy file.");
+    }
+    size_t file_size = static_cast<size_t>(st.st_size);
+    void *mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        throw std::invalid_argument("Cannot memory-map " + path + ".");
+    }
+    std::shared_ptr<const char> file(static_cast<const char *>(mapped), [file_size](const char *p)
+                                     { munmap(const_cast<char *>(p), file_size); });
+
+    // Format: magic, version, header length (2 bytes in v1, 4 in v2/v3), header dict
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(file.get());
+    if (std::memcmp(bytes, "\x93NUMPY", 6) != 0)
+    {
+        throw std::invalid_argument(path + " is not a .npy file.");
+    }
+    size_t header_start = bytes[6] == 1 ? 10 : 12;
+    size_t header_len = bytes[6] == 1 ? bytes[8] | bytes[9] << 8
+                                      : bytes[8] | bytes[9] << 8 | bytes[10] << 16 | static_cast<size_t>(bytes[11]) << 24;
+    if (header_start + header_len > file_size)
+    {
+        throw std::invalid_argument(path + ": truncated .npy header.");
+    }
+    std::string header(file.get() + header_start, header_len);
+
+    std::string descr = npy_header_field(header, "descr", path);
+    if (descr != "'<f4'")
+    {
+        throw std::invalid_argument(path + ": expected float32 data ('<f4') but got " + descr +
+                                    "; save it with .astype(np.float32).");
+    }
+    if (npy_header_field(header, "fortran_order", path) != "False")
+    {
+        throw std::invalid_argument(path + ": Fortran-ordered arrays are not supported.");
+    }
+    std::vector<size_t> dims = parse_npy_shape(npy_header_field(header, "shape", path));
+    if (dims.empty() || dims.size() > 2)
+    {
+        throw std::invalid_argument(path + ": expected a 1-D or 2-D array.");
+    }
+
+    DataArray array;
+    array.rows = dims[0];
+    array.cols = dims.size() == 2 ? dims[1] : 1;
+    size_t data_start = header_start + header_len;
+    if (data_start + array.rows * array.cols * sizeof(float) > file_size)
+    {
+        throw std::invalid_argument(path + ": file is shorter than its shape.");
+    }
+    array.data = std::shared_ptr<const float>(file, reinterpret_cast<const float *>(file.get() + data_start));
+    return array;
+}
+
+std::vector<std::shared_ptr<Tensor>> split_rows(const std::shared_ptr<Tensor> &batch)
+{
+    if (batch->shape.size() != 2)
+    {
+        throw std::invalid_argument("split_rows expects a [rows, cols] tensor.");
+    }
+    int rows = batch->shape[0];
+    int cols = batch->shape[1];
+    std::vector<std::shared_ptr<Tensor>> result;
+    result.reserve(rows);
+    DeviceGuard host(DeviceType::CPU);
+    for (int r = 0; r < rows; r++)
+    {
+        auto row = make_node<Tensor>(Shape{cols});
+        row->data.bind(batch, batch->data.data() + static_cast<size_t>(r) * cols, cols);
+        place_on(*row, batch->device);
+        result.push_back(row);
+    }
+    return result;
+}
+
+DataLoader::DataLoader(DataArray inputs, DataArray targets, int batch_size, bool shuffle, bool drop_last,
+                       int num_workers, int prefetch, unsigned seed, bool split_rows)
+    : inputs(std::move(inputs)), targets(std::move(targets)), batch_size(batch_size), shuffle(shuffle),
+      drop_last(drop_last), prefetch(prefetch), seed(seed), split(split_rows),
+      device(DeviceManager::get_instance().get_current_device())
+{
+    if (batch_size <= 0 || num_workers <= 0 || prefetch <= 0)
+    {
+        throw std::invalid_argument("DataLoader batch_size, num_workers and prefetch must be positive.");
+    }
+    if (this->inputs.empty())
+    {
+        throw std::invalid_argument("DataLoader needs at least one input row.");
+    }
+    if (!this->targets.empty() && this->targets.rows != this->inputs.rows)
+    {
+        throw std::invalid_argument("DataLoader inputs have " + std::to_string(this->inputs.rows) +
+                                    " rows but targets have " + std::to_string(this->targets.rows) + ".");
+    }
+
+    for (int i = 0; i < num_workers; i++)
+    {
+        workers.emplace_back(&DataLoader::worker_loop, this);
+    }
+}
+
+DataLoader::~DataLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+size_t DataLoader::num_batches() const
+{
+    return drop_last ? inputs.rows / batch_size : (inputs.rows + batch_size - 1) / batch_size;
+}
+
+void DataLoader::start_epoch()
+{
+    auto epoch_order = std::make_shared<std::vector<size_t>>(inputs.rows);
+    std::iota(epoch_order->begin(), epoch_order->end(), 0);
+    if (shuffle)
+    {
+        std::mt19937 rng(seed + epoch_count);
+        std::shuffle(epoch_order->begin(), epoch_order->end(), rng);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        order = epoch_order;
+        generation++;
+        epoch_count++;
+        next_claim = 0;
+        next_deliver = 0;
+        ready.clear();
+    }
+    work_available.notify_all();
+}
+
+bool DataLoader::next(Batch &batch)
+{
+    if (epoch_count == 0)
+    {
+        start_epoch();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (next_deliver >= num_batches())
+    {
+        return false;
+    }
+    batch_ready.wait(lock, [this]
+                     { return ready.count(next_deliver) != 0; });
+    auto it = ready.find(next_deliver);
+    Result result = std::move(it->second);
+    ready.erase(it);
+    next_deliver++;
+    lock.unlock();
+    work_available.notify_all();
+
+    if (result.error)
+    {
+        std::rethrow_exception(result.error);
+    }
+    batch = std::move(result.batch);
+    return true;
+}
+
+void DataLoader::worker_loop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        work_available.wait(lock, [this]
+                            { return stopping || (order && next_claim < num_batches() && next_claim < next_deliver + prefetch); });
+        if (stopping)
+        {
+            return;
+        }
+        size_t index = next_claim++;
+        auto epoch_order = order;
+        unsigned long epoch_generation = generation;
+        lock.unlock();
+
+        Result result;
+        try
+        {
+            result.batch = make_batch(*epoch_order, index);
+        }
+        catch (...)
+        {
+            result.error = std::current_exception();
+        }
+
+        lock.lock();
+        if (epoch_generation == generation)
+        {
+            ready[index] = std::move(result);
+            batch_ready.notify_all();
+        }
+    }
+}
+
+Batch DataLoader::make_batch(const std::vector<size_t> &order, size_t index) const
+{
+    size_t first = index * batch_size;
+    size_t count = std::min(batch_size, order.size() - first);
+
+    Batch batch;
+    batch.index = index;
+    batch.inputs = gather(inputs, order, first, count);
+    if (!targets.empty())
+    {
+        batch.targets = gather(targets, order, first, count);
+    }
+    if (split)
+    {
+        batch.input_rows = split_rows(batch.inputs);
+        if (batch.targets)
+        {
+            batch.target_rows = split_rows(batch.targets);
+        }
+    }
+    return batch;
+}
+
+std::shared_ptr<Tensor> DataLoader::gather(const DataArray &array, const std::vector<size_t> &order, size_t first,
+                                           size_t count) const
+{
+    // Built on the host whatever this worker thread's device is; place_on moves it
+    DeviceGuard host(DeviceType::CPU);
+    auto tensor = make_node<Tensor>(Shape{static_cast<int>(count), static_cast<int>(array.cols)});
+    float *out = tensor->data.data();
+    const float *src = array.data.get();
+    for (size_t r = 0; r < count; r++)
+    {
+        std::memcpy(out + r * array.cols, src + order[first + r] * array.cols, array.cols * sizeof(float));
+    }
+    place_on(*tensor, device);
+    return tensor;
+}
@@ -0,0 +1,351 @@
+// data_parallel.cpp
+
+#include "data_parallel.h"
+#include "data_loader.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace
+{
+    // Parameters in flat-buffer order (each shared tensor once, as in
+    // Module::flatten_parameters)
+    std::vector<std::shared_ptr<Tensor>> unique_parameters(Module &module)
+    {
+        std::vector<std::shared_ptr<Tensor>> params;
+        std::unordered_set<Tensor *> seen;
+        for (auto &param : module.parameters())
+        {
+            if (seen.insert(param.get()).second)
+            {
+                params.push_back(param);
+            }
+        }
+        return params;
+    }
+}
+
+std::shared_ptr<Tensor> DataParallel::squared_error(const std::shared_ptr<Tensor> &output,
+                                                    const std::shared_ptr<Tensor> &target)
+{
+    auto diff = output - target;
+    return (diff * diff)->sum();
+}
+
+DataParallel::DataParallel(std::shared_ptr<Module> module, std::shared_ptr<Optimizer> optimizer, int num_replicas,
+                           size_t bucket_elements, LossFunction loss)
+    : loss_function(loss ? std::move(loss) : LossFunction(squared_error))
+{
+    if (!module || !optimizer)
+    {
+        throw std::invalid_argument("DataParallel needs a module and an optimizer.");
+    }
+    if (num_replicas <= 0 || bucket_elements == 0)
+    {
+        throw std::invalid_argument("DataParallel num_replicas and bucket_elements must be positive.");
+    }
+
+    for (int i = 0; i < num_replicas; i++)
+    {
+        std::unique_ptr<Replica> replica(new Replica());
+        if (i == 0)
+        {
+            replica->module = module;
+            replica->optimizer = optimizer;
+        }
+        else
+        {
+            replica->module = module->clone();
+            replica->optimizer = optimizer->clone(replica->module->parameters());
+        }
+        if (replica->module->flat.size == 0)
+        {
+            replica->module->flatten_parameters();
+        }
+        replicas.push_back(std::move(replica));
+    }
+
+    // Buckets of whole parameters, about bucket_elements each
+    std::vector<size_t> param_bucket;
+    size_t offset = 0;
+    for (auto &param : unique_parameters(*module))
+    {
+        if (buckets.empty() || buckets.back()->end - buckets.back()->begin >= bucket_elements)
+        {
+            buckets.emplace_back(new Bucket());
+            buckets.back()->begin = offset;
+            buckets.back()->end = offset;
+        }
+        offset += param->size();
+        buckets.back()->end = offset;
+        buckets.back()->num_params++;
+        param_bucket.push_back(buckets.size() - 1);
+    }
+
+    for (auto &replica : replicas)
+    {
+        auto params = unique_parameters(*replica->module);
+        for (size_t p = 0; p < params.size(); p++)
+        {
+            replica->bucket_of[params[p].get()] = param_bucket[p];
+        }
+        replica->pending.reset(new std::atomic<int>[buckets.size()]);
+    }
+
+    for (int i = 1; i < num_replicas; i++)
+    {
+        workers.emplace_back(&DataParallel::worker_loop, this, i);
+    }
+}
+
+DataParallel::~DataParallel()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+std::shared_ptr<Module> DataParallel::replica(int index) const
+{
+    if (index < 0 || index >= num_replicas())
+    {
+        throw std::invalid_argument("DataParallel has no replica " + std::to_string(index) + ".");
+    }
+    return replicas[index]->module;
+}
+
+float DataParallel::train_step(const std::shared_ptr<Tensor> &inputs, const std::shared_ptr<Tensor> &targets)
+{
+    if (broken)
+    {
+        throw std::runtime_error("DataParallel replicas diverged when an optimizer step failed; build a new one.");
+    }
+    if (inputs->shape.size() != 2 || targets->shape.size() != 2 || inputs->shape[0] != targets->shape[0])
+    {
+        throw std::invalid_argument("DataParallel expects [batch, features] inputs and [batch, outputs] targets.");
+    }
+    size_t batch = inputs->shape[0];
+    input_rows = split_rows(inputs);
+    target_rows = split_rows(targets);
+    inv_batch = 1.0f / batch;
+
+    size_t num = replicas.size();
+    for (size_t r = 0; r < num; r++)
+    {
+        Replica &replica = *replicas[r];
+        replica.first_row = batch * r / num;
+        replica.end_row = batch * (r + 1) / num;
+        for (size_t b = 0; b < buckets.size(); b++)
+        {
+            replica.pending[b].store(buckets[b]->num_params);
+        }
+    }
+    for (auto &bucket : buckets)
+    {
+        bucket->arrived.store(0);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        reduced = 0;
+        failed = false;
+        running = static_cast<int>(workers.size());
+        generation++;
+    }
+    work_available.notify_all();
+
+    run_replica(0);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        progress.wait(lock, [this]
+                      { return running == 0; });
+    }
+    input_rows.clear();
+    target_rows.clear();
+
+    // Some replicas may have stepped while others did not
+    bool step_failed = false;
+    for (auto &replica : replicas)
+    {
+        step_failed = step_failed || replica->step_failed;
+    }
+    if (step_failed)
+    {
+        if (replicas[0]->step_failed)
+        {
+            broken = true;
+        }
+        else
+        {
+            resync();
+        }
+    }
+
+    float loss = 0.0f;
+    for (auto &replica : replicas)
+    {
+        if (replica->error)
+        {
+            std::rethrow_exception(replica->error);
+        }
+        loss += replica->loss;
+    }
+    return loss;
+}
+
+void DataParallel::worker_loop(int index)
+{
+    unsigned long seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        work_available.wait(lock, [this, &seen]
+                            { return stopping || generation != seen; });
+        if (stopping)
+        {
+            return;
+        }
+        seen = generation;
+        lock.unlock();
+
+        run_replica(index);
+
+        lock.lock();
+        if (--running == 0)
+        {
+            progress.notify_all();
+        }
+    }
+}
+
+void DataParallel::run_replica(int index)
+{
+    Replica &replica = *replicas[index];
+    replica.loss = 0.0f;
+    replica.error = nullptr;
+    replica.step_failed = false;
+
+    try
+    {
+        replica.optimizer->zero_grad();
+        if (replica.first_row < replica.end_row)
+        {
+            std::shared_ptr<Tensor> loss;
+            for (size_t r = replica.first_row; r < replica.end_row; r++)
+            {
+                auto sample = loss_function((*replica.module)(input_rows[r]), target_rows[r]);
+                if (!sample || sample->size() != 1)
+                {
+                    throw std::invalid_argument("DataParallel loss must return a single-element tensor.");
+                }
+                loss = loss ? loss + sample : sample;
+            }
+            loss = (*loss) * inv_batch;
+            replica.loss = loss->data[0];
+
+            // A bucket is final on this replica once backward has finished
+            // all of its parameters
+            loss->backward(false, [this, &replica](Tensor &leaf)
+                           {
+                auto it = replica.bucket_of.find(&leaf);
+                if (it != replica.bucket_of.end() && replica.pending[it->second].fetch_sub(1) == 1)
+                {
+                    arrive(it->second);
+                } });
+        }
+    }
+    catch (...)
+    {
+        replica.error = std::current_exception();
+        std::lock_guard<std::mutex> lock(mutex);
+        failed = true;
+    }
+
+    // Buckets whose parameters the loss does not reach (or all of them after
+    // an error) still count as done
+    for (size_t b = 0; b < buckets.size(); b++)
+    {
+        if (replica.pending[b].exchange(0) > 0)
+        {
+            arrive(b);
+        }
+    }
+
+    // Every replica has arrived at every bucket once all are reduced
+    std::unique_lock<std::mutex> lock(mutex);
+    progress.wait(lock, [this]
+                  { return reduced == buckets.size(); });
+    if (failed)
+    {
+        return;
+    }
+    lock.unlock();
+
+    try
+    {
+        replica.optimizer->step();
+    }
+    catch (...)
+    {
+        replica.error = std::current_exception();
+        replica.step_failed = true;
+    }
+}
+
+void DataParallel::arrive(size_t bucket)
+{
+    if (buckets[bucket]->arrived.fetch_add(1) + 1 == static_cast<int>(replicas.size()))
+    {
+        reduce(bucket);
+        std::lock_guard<std::mutex> lock(mutex);
+        reduced++;
+        progress.notify_all();
+    }
+}
+
+void DataParallel::reduce(size_t bucket)
+{
+    const Bucket &range = *buckets[bucket];
+    size_t num = replicas.size();
+    if (num == 1)
+    {
+        return;
+    }
+    std::vector<float *> grads(num);
+    for (size_t r = 0; r < num; r++)
+    {
+        grads[r] = replicas[r]->module->flat.grad.get();
+    }
+    for (size_t i = range.begin; i < range.end; i++)
+    {
+        float sum = grads[0][i];
+        for (size_t r = 1; r < num; r++)
+        {
+            sum += grads[r][i];
+        }
+        for (size_t r = 0; r < num; r++)
+        {
+            grads[r][i] = sum;
+        }
+    }
+}
+
+void DataParallel::resync()
+{
+    Replica &source = *replicas[0];
+    for (size_t r = 1; r < replicas.size(); r++)
+    {
+        Replica &replica = *replicas[r];
+        std::copy(source.module->flat.data.get(), source.module->flat.data.get() + source.module->flat.size,
+                  replica.module->flat.data.get());
+        replica.optimizer = source.optimizer->clone(replica.module->parameters());
+    }
+}
@@ -0,0 +1,327 @@
+// engine.cpp
+
+#include "engine.h"
+#include "op.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+    // Accumulation into an input shared by several ops is guarded by one of
+    // these stripes, picked from the input's address
+    const int num_grad_stripes = 64;
+
+    enum EdgeKind : unsigned char
+    {
+        own_input,     // No other op reads the input: its gradient is written in place
+        shared_input,  // Other ops read it too
+        repeated_input // Shared, and an earlier input of the same op
+    };
+
+    int stripe_of(const Tensor *t)
+    {
+        return static_cast<int>((reinterpret_cast<std::uintptr_t>(t) >> 4) % num_grad_stripes);
+    }
+
+    struct BackwardState
+    {
+        std::vector<std::shared_ptr<Tensor>> owned; // Dropped node by node unless retain_graph
+        std::vector<Tensor *> nodes;
+        // Node i's inputs are the edges edge_begin[i] .. edge_begin[i + 1],
+        // one per op input, in order
+        std::vector<int> edge_begin;
+        std::vector<int> edge_child;          // Index of the input node
+        std::vector<unsigned char> edge_kind;  // One of the EdgeKind values
+        std::unique_ptr<std::atomic<int>[]> pending; // Consumers whose backward has not run yet
+        std::atomic<int> remaining{0};          // Ops still to run
+        bool retain_graph = false;
+        const LeafGradHook *on_leaf_ready = nullptr;
+
+        std::mutex grad_stripes[num_grad_stripes];
+
+        std::shared_ptr<ThreadPool> pool;
+
+        std::mutex done_mutex;
+        std::condition_variable done;
+        bool finished = false;
+        std::exception_ptr error;
+    };
+
+    // Clears an op's gradient redirection, also when its backward throws
+    struct RedirectGuard
+    {
+        Op &op;
+        ~RedirectGuard() { op.input_grads = nullptr; }
+    };
+}
+
+// Runs op's backward with the gradient of every shared input redirected to a
+// zeroed per-thread scratch area, then adds each area into the real gradient
+// under the input's stripe lock. Ops consuming the same tensor thus compute
+// concurrently and serialize only on the final addition. Inputs no other op
+// reads are written in place.
+static void run_backward_redirected(BackwardState *state, Op &op, int first_edge)
+{
+    static thread_local std::vector<float> scratch;
+    static thread_local std::vector<float *> grads;
+
+    const size_t num_inputs = op.inputs.size();
+    const unsigned char *kinds = state->edge_kind.data() + first_edge;
+    size_t total = 0;
+    for (size_t k = 0; k < num_inputs; k++)
+    {
+        if (kinds[k] == shared_input)
+        {
+            total += op.inputs[k]->grad.size();
+        }
+    }
+    if (scratch.size() < total)
+    {
+        scratch.resize(total);
+    }
+    grads.resize(num_inputs);
+
+    size_t offset = 0;
+    for (size_t k = 0; k < num_inputs; k++)
+    {
+        Tensor &input = *op.inputs[k];
+        if (kinds[k] == own_input)
+        {
+            grads[k] = input.grad.data();
+            continue;
+        }
+        if (kinds[k] == repeated_input)
+        {
+            size_t j = 0;
+            while (op.inputs[j].get() != &input)
+            {
+                j++;
+            }
+            grads[k] = grads[j];
+            continue;
+        }
+        grads[k] = scratch.data() + offset;
+        std::fill(grads[k], grads[k] + input.grad.size(), 0.0f);
+        offset += input.grad.size();
+    }
+
+    {
+        op.input_grads = grads.data();
+        RedirectGuard guard{op};
+        op.run_backward();
+    }
+
+    for (size_t k = 0; k < num_inputs; k++)
+    {
+        if (kinds[k] != shared_input)
+        {
+            continue;
+        }
+        Tensor &input = *op.inputs[k];
+        const float *partial = grads[k];
+        float *grad = input.grad.data();
+        const size_t size = input.grad.size();
+        std::lock_guard<std::mutex> lock(state->grad_stripes[stripe_of(&input)]);
+        for (size_t e = 0; e < size; e++)
+        {
+            grad[e] += partial[e];
+        }
+    }
+}
+
+static void record_error(BackwardState *state)
+{
+    std::lock_guard<std::mutex> lock(state->done_mutex);
+    if (!state->error)
+    {
+        state->error = std::current_exception();
+    }
+}
+
+static void run_node(BackwardState *state, int i)
+{
+    Tensor *node = state->nodes[i];
+    const int first_edge = state->edge_begin[i];
+    const int last_edge = state->edge_begin[i + 1];
+
+    try
+    {
+        bool shared = false;
+        for (int e = first_edge; e < last_edge; e++)
+        {
+            shared = shared || state->edge_kind[e] != own_input;
+        }
+        if (shared)
+        {
+            run_backward_redirected(state, *node->op, first_edge);
+        }
+        else
+        {
+            node->op->run_backward();
+        }
+    }
+    catch (...)
+    {
+        record_error(state);
+    }
+
+    if (!state->retain_graph)
+    {
+        // The root (last node) keeps its gradient
+        node->release_graph(i != static_cast<int>(state->nodes.size()) - 1);
+        node->graph_released = true;
+    }
+
+    // Release the inputs; those whose last consumer just finished are ready
+    for (int e = first_edge; e < last_edge; e++)
+    {
+        int c = state->edge_child[e];
+        if (state->pending[c].fetch_sub(1) == 1)
+        {
+            if (state->nodes[c]->op)
+            {
+                state->pool->submit([state, c]
+                                    { run_node(state, c); });
+            }
+            else if (state->on_leaf_ready)
+            {
+                try
+                {
+                    (*state->on_leaf_ready)(*state->nodes[c]);
+                }
+                catch (...)
+                {
+                    record_error(state);
+                }
+            }
+        }
+    }
+
+    if (!state->retain_graph)
+    {
+        state->owned[i].reset();
+    }
+
+    if (state->remaining.fetch_sub(1) == 1)
+    {
+        std::lock_guard<std::mutex> lock(state->done_mutex);
+        state->finished = true;
+        state->done.notify_all();
+    }
+}
+
+void BackwardEngine::execute(std::vector<std::shared_ptr<Tensor>> ordering, bool retain_graph,
+                             const LeafGradHook &on_leaf_ready)
+{
+    if (ordering.empty())
+    {
+        return;
+    }
+
+    BackwardState state;
+    state.retain_graph = retain_graph;
+    state.on_leaf_ready = on_leaf_ready ? &on_leaf_ready : nullptr;
+    int n = static_cast<int>(ordering.size());
+
+    // Node indices by address, for a binary search per edge
+    std::vector<std::pair<const Tensor *, int>> index(n);
+    state.nodes.reserve(n);
+    for (int i = 0; i < n; i++)
+    {
+        index[i] = std::make_pair(ordering[i].get(), i);
+        state.nodes.push_back(ordering[i].get());
+    }
+    std::sort(index.begin(), index.end());
+    auto index_of = [&index](const Tensor *t)
+    {
+        auto it = std::lower_bound(index.begin(), index.end(), std::make_pair(t, -1));
+        if (it == index.end() || it->first != t)
+        {
+            throw std::logic_error("Backward ordering is missing an input.");
+        }
+        return it->second;
+    };
+    state.owned = std::move(ordering);
+
+    state.pending.reset(new std::atomic<int>[n]);
+    std::vector<int> consumers(n, 0);      // Ops reading each node
+    std::vector<int> last_consumer(n, -1); // So that an op reading a node twice counts once
+    for (int i = 0; i < n; i++)
+    {
+        state.pending[i].store(0);
+    }
+
+    int ops = 0;
+    state.edge_begin.resize(n + 1);
+    for (int i = 0; i < n; i++)
+    {
+        state.edge_begin[i] = static_cast<int>(state.edge_child.size());
+        Tensor *node = state.nodes[i];
+        if (!node->op)
+        {
+            continue;
+        }
+        ops++;
+        const auto &inputs = node->op->inputs;
+        for (size_t k = 0; k < inputs.size(); k++)
+        {
+            int c = index_of(inputs[k].get());
+            state.edge_child.push_back(c);
+            state.pending[c].fetch_add(1);
+            if (last_consumer[c] != i)
+            {
+                last_consumer[c] = i;
+                consumers[c]++;
+            }
+        }
+    }
+    state.edge_begin[n] = static_cast<int>(state.edge_child.size());
+    // Now that every consumer is counted, classify the edges
+    state.edge_kind.resize(state.edge_child.size());
+    std::fill(last_consumer.begin(), last_consumer.end(), -1);
+    for (int i = 0; i < n; i++)
+    {
+        for (int e = state.edge_begin[i]; e < state.edge_begin[i + 1]; e++)
+        {
+            int c = state.edge_child[e];
+            if (consumers[c] == 1)
+            {
+                state.edge_kind[e] = own_input;
+            }
+            else
+            {
+                state.edge_kind[e] = last_consumer[c] == i ? repeated_input : shared_input;
+                last_consumer[c] = i;
+            }
+        }
+    }
+
+    Tensor *root = state.nodes[n - 1];
+    if (ops == 0 || !root->op)
+    {
+        return;
+    }
+    state.remaining.store(ops);
+    state.pool = ThreadPool::global();
+
+    int root_index = n - 1;
+    BackwardState *state_ptr = &state;
+    state.pool->submit([state_ptr, root_index]
+                       { run_node(state_ptr, root_index); });
+
+    std::unique_lock<std::mutex> lock(state.done_mutex);
+    state.done.wait(lock, [&state]
+                    { return state.finished; });
+    if (state.error)
+    {
+        std::rethrow_exception(state.error);
+    }
+}
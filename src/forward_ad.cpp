@@ -0,0 +1,93 @@
+// forward_ad.cpp
+
+#include "forward_ad.h"
+#include "node_pool.h"
+
+#include <stdexcept>
+#include <string>
+
+// Tensors given a tangent by the innermost jvp() running on this thread
+static thread_local std::vector<std::weak_ptr<Tensor>> *recorded_tangents = nullptr;
+
+void record_tangent(Tensor &tensor)
+{
+    if (recorded_tangents)
+    {
+        recorded_tangents->push_back(tensor.shared_from_this());
+    }
+}
+
+namespace
+{
+    // Tangents only live for the duration of one jvp() call: clears every
+    // recorded one on the way out, also when fn throws
+    class TangentScope
+    {
+    public:
+        TangentScope() : outer(recorded_tangents) { recorded_tangents = &recorded; }
+
+        ~TangentScope()
+        {
+            recorded_tangents = outer;
+            for (auto &weak : recorded)
+            {
+                if (auto tensor = weak.lock())
+                {
+                    tensor->tangent.release();
+                }
+            }
+        }
+
+        TangentScope(TangentScope const &) = delete;
+        void operator=(TangentScope const &) = delete;
+
+    private:
+        std::vector<std::weak_ptr<Tensor>> recorded;
+        std::vector<std::weak_ptr<Tensor>> *outer;
+    };
+}
+
+std::pair<std::vector<std::shared_ptr<Tensor>>, std::vector<std::shared_ptr<Tensor>>>
+jvp(const std::function<std::vector<std::shared_ptr<Tensor>>(const std::vector<std::shared_ptr<Tensor>> &)> &fn,
+    const std::vector<std::shared_ptr<Tensor>> &primals,
+    const std::vector<std::shared_ptr<Tensor>> &tangents)
+{
+    if (primals.size() != tangents.size())
+    {
+        throw std::invalid_argument("jvp expects one tangent per primal.");
+    }
+    for (size_t i = 0; i < primals.size(); i++)
+    {
+        if (primals[i]->shape != tangents[i]->shape)
+        {
+            throw std::invalid_argument("Tangent " + std::to_string(i) + " must have the shape of its primal.");
+        }
+        if (primals[i]->device != DeviceType::CPU)
+        {
+            throw std::invalid_argument("Forward-mode AD is only supported on the CPU.");
+        }
+    }
+
+    TangentScope scope;
+    for (size_t i = 0; i < primals.size(); i++)
+    {
+        primals[i]->tangent = tangents[i]->data;
+        record_tangent(*primals[i]);
+    }
+
+    std::vector<std::shared_ptr<Tensor>> outputs = fn(primals);
+
+    std::vector<std::shared_ptr<Tensor>> output_tangents;
+    for (auto &output : outputs)
+    {
+        // Outputs that do not depend on any primal have a zero tangent
+        auto t = make_node<Tensor>(output->shape);
+        if (!output->tangent.empty())
+        {
+            t->data = output->tangent;
+        }
+        output_tangents.push_back(t);
+    }
+
+    return std::make_pair(outputs, output_tangents);
+}
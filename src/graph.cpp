@@ -0,0 +1,371 @@
+// graph.cpp
+
+#include "graph.h"
+#include "memory_stats.h"
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <cuda_runtime.h>
+
+// Whether an op of this kind computes nothing but a function of its inputs.
+// Others also carry state (attention's causal flag, spmm's sparse matrix, a
+// fused op's expression, or anything a custom op holds), so two of them with
+// the same inputs may differ and are never merged.
+static bool defined_by_inputs(OpKind kind)
+{
+    switch (kind)
+    {
+    case OpKind::Attention:
+    case OpKind::SpMM:
+    case OpKind::Fused:
+    case OpKind::Custom:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// Fill a single tensor's gradient (no recursion into children)
+static void fill_grad(const std::shared_ptr<Tensor> &t, float value)
+{
+    std::fill(t->grad.begin(), t->grad.end(), value);
+    if (t->device == DeviceType::CUDA)
+    {
+        cudaMemcpy(t->d_grad, t->grad.data(), t->size() * sizeof(float), cudaMemcpyHostToDevice);
+    }
+}
+
+CapturedGraph::CapturedGraph(std::shared_ptr<Tensor> output, const std::vector<std::shared_ptr<Tensor>> &inputs)
+    : output(output), inputs(inputs)
+{
+    if (!output || !output->op)
+    {
+        throw std::invalid_argument("Nothing to capture: capture before backward() or call backward(retain_graph=True).");
+    }
+    for (auto &input : inputs)
+    {
+        if (input->op)
+        {
+            throw std::invalid_argument("Captured graph inputs must be leaf tensors.");
+        }
+    }
+
+    build_schedule();
+}
+
+void CapturedGraph::build_schedule()
+{
+    // The topological order is computed once here and reused by every replay
+    std::vector<std::shared_ptr<Tensor>> ordering;
+    output->topological_sort(ordering);
+    ops.clear();
+    for (auto &tensor : ordering)
+    {
+        tensor->allocate_grad();
+        if (tensor->op)
+        {
+            ops.push_back(tensor->op);
+        }
+    }
+
+    // Each intermediate gradient is cleared just before its first write
+    // rather than all up front, so it may share memory with buffers that
+    // die earlier in the backward pass (see plan_memory())
+    std::unordered_map<const Tensor *, int> producer;
+    for (int k = 0; k < num_ops(); k++)
+    {
+        producer[ops[k]->output.get()] = k;
+    }
+    last_consumer.assign(ops.size(), -1);
+    for (int k = 0; k < num_ops(); k++)
+    {
+        for (auto &input : ops[k]->inputs)
+        {
+            auto it = producer.find(input.get());
+            if (it != producer.end())
+            {
+                last_consumer[it->second] = k;
+            }
+        }
+    }
+    zero_before.assign(ops.size(), {});
+    for (int k = 0; k < num_ops(); k++)
+    {
+        if (last_consumer[k] >= 0)
+        {
+            zero_before[last_consumer[k]].push_back(ops[k]->output);
+        }
+    }
+}
+
+void CapturedGraph::replay(const std::vector<std::vector<float>> &input_data)
+{
+    if (input_data.size() != inputs.size())
+    {
+        throw std::invalid_argument("Expected " + std::to_string(inputs.size()) + " inputs, got " + std::to_string(input_data.size()));
+    }
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        auto &input = inputs[i];
+        if (static_cast<int>(input_data[i].size()) != input->size())
+        {
+            throw std::invalid_argument("Input " + std::to_string(i) + " has the wrong number of elements for the captured shape.");
+        }
+        std::copy(input_data[i].begin(), input_data[i].end(), input->data.begin());
+        if (input->device == DeviceType::CUDA)
+        {
+            cudaMemcpy(input->d_data, input->data.data(), input->size() * sizeof(float), cudaMemcpyHostToDevice);
+        }
+    }
+    replay();
+}
+
+void CapturedGraph::replay()
+{
+    forward();
+    backward();
+}
+
+void CapturedGraph::forward()
+{
+    // Every op writes into the output it allocated during capture; the plan
+    // keeps its graph even when replayed under no_grad
+    GradModeGuard keep_graph(true);
+    for (auto &op : ops)
+    {
+        op->run_forward();
+    }
+}
+
+void CapturedGraph::backward()
+{
+    // Intermediate gradients are rebuilt from scratch each replay; leaf
+    // gradients accumulate as in Tensor::backward()
+    fill_grad(output, 1.0f);
+
+    for (int k = num_ops() - 1; k >= 0; k--)
+    {
+        for (auto &tensor : zero_before[k])
+        {
+            fill_grad(tensor, 0.0f);
+        }
+        ops[k]->run_backward();
+    }
+}
+
+MemoryPlanStats CapturedGraph::plan_memory()
+{
+    int n = num_ops();
+    std::unordered_map<const Tensor *, int> producer;
+    for (int k = 0; k < n; k++)
+    {
+        if (ops[k]->output->device != DeviceType::CPU)
+        {
+            throw std::invalid_argument("Memory planning is only supported on the CPU.");
+        }
+        producer[ops[k]->output.get()] = k;
+    }
+
+    // Two buffers per intermediate: data at 2k, grad at 2k + 1.
+    // The graph output keeps its own storage so it can be read after replay.
+    std::vector<BufferLifetime> buffers(2 * n);
+    for (int k = 0; k < n; k++)
+    {
+        size_t size = ops[k]->output->size();
+        BufferLifetime &data = buffers[2 * k];
+        data.size = size;
+        data.first_use = forward_step(k);
+        data.last_use = ops[k]->saves_output() ? backward_step(k) : forward_step(k);
+
+        BufferLifetime &grad = buffers[2 * k + 1];
+        grad.size = size;
+        grad.first_use = last_consumer[k] >= 0 ? backward_step(last_consumer[k]) : backward_step(k);
+        grad.last_use = backward_step(k);
+    }
+    for (int j = 0; j < n; j++)
+    {
+        for (auto &input : ops[j]->inputs)
+        {
+            auto it = producer.find(input.get());
+            if (it == producer.end())
+            {
+                continue;
+            }
+            BufferLifetime &data = buffers[2 * it->second];
+            data.last_use = std::max(data.last_use, forward_step(j));
+            if (ops[j]->saves_inputs())
+            {
+                data.last_use = std::max(data.last_use, backward_step(j));
+            }
+        }
+    }
+
+    std::vector<BufferLifetime> planned;
+    std::vector<Buffer *> targets;
+    MemoryPlanStats stats;
+    for (int k = 0; k < n; k++)
+    {
+        if (ops[k]->output == output)
+        {
+            continue;
+        }
+        planned.push_back(buffers[2 * k]);
+        targets.push_back(&ops[k]->output->data);
+        planned.push_back(buffers[2 * k + 1]);
+        targets.push_back(&ops[k]->output->grad);
+    }
+    for (auto &buffer : planned)
+    {
+        stats.naive_bytes += buffer.size * sizeof(float);
+    }
+    stats.num_buffers = static_cast<int>(planned.size());
+
+    size_t arena_size = assign_offsets(planned);
+    stats.planned_bytes = arena_size * sizeof(float);
+
+    size_t arena_elements = std::max<size_t>(arena_size, 1);
+    long long arena_bytes = static_cast<long long>(arena_elements * sizeof(float));
+    MemoryStats::host_bytes_changed(arena_bytes);
+    arena = std::shared_ptr<float>(new float[arena_elements], [arena_bytes](float *p)
+                                   {
+        delete[] p;
+        MemoryStats::host_bytes_changed(-arena_bytes); });
+    for (size_t i = 0; i < planned.size(); i++)
+    {
+        targets[i]->bind(arena, arena.get() + planned[i].offset, planned[i].size);
+    }
+
+    // Rebound data buffers hold garbage until the next forward
+    forward();
+    return stats;
+}
+
+GraphOptimizationStats CapturedGraph::optimize()
+{
+    if (arena)
+    {
+        throw std::logic_error("optimize() must run before plan_memory().");
+    }
+
+    GraphOptimizationStats stats;
+    stats.ops_before = num_ops();
+
+    std::unordered_set<const Tensor *> input_set;
+    for (auto &input : inputs)
+    {
+        input_set.insert(input.get());
+    }
+    auto is_constant = [&input_set](const std::shared_ptr<Tensor> &t)
+    {
+        return t->constant && !t->op && input_set.find(t.get()) == input_set.end();
+    };
+
+    // Tensors replaced by an equivalent one
+    std::unordered_map<const Tensor *, std::shared_ptr<Tensor>> replacement;
+    auto canonical = [&replacement](const std::shared_ptr<Tensor> &t)
+    {
+        auto it = replacement.find(t.get());
+        return it == replacement.end() ? t : it->second;
+    };
+
+    // Constant leaves with equal shape and values are interchangeable
+    std::map<std::pair<std::vector<int>, std::vector<float>>, std::shared_ptr<Tensor>> constants;
+    // (kind, inputs) -> first op computing it
+    std::map<std::pair<OpKind, std::vector<const Tensor *>>, std::shared_ptr<Tensor>> computed;
+
+    for (auto &op : ops)
+    {
+        for (auto &input : op->inputs)
+        {
+            if (is_constant(input) && replacement.find(input.get()) == replacement.end())
+            {
+                auto key = std::make_pair(input->shape, input->data.to_vector());
+                auto it = constants.find(key);
+                if (it == constants.end())
+                {
+                    constants[key] = input;
+                }
+                else if (it->second != input)
+                {
+                    replacement[input.get()] = it->second;
+                }
+            }
+            input = canonical(input);
+        }
+
+        // Constant folding: the value computed at capture time never changes
+        bool all_constant = true;
+        for (auto &input : op->inputs)
+        {
+            all_constant = all_constant && is_constant(input);
+        }
+        if (all_constant)
+        {
+            auto folded = op->output;
+            folded->release_graph(false);
+            folded->constant = true;
+            stats.constants_folded++;
+            continue;
+        }
+
+        // Common subexpression elimination (hash-consing)
+        if (!defined_by_inputs(op->kind))
+        {
+            continue;
+        }
+        std::vector<const Tensor *> key_inputs;
+        for (auto &input : op->inputs)
+        {
+            key_inputs.push_back(input.get());
+        }
+        if (op->kind == OpKind::Add || op->kind == OpKind::Multiply)
+        {
+            std::sort(key_inputs.begin(), key_inputs.end());
+        }
+        auto key = std::make_pair(op->kind, key_inputs);
+        auto it = computed.find(key);
+        if (it == computed.end())
+        {
+            computed[key] = op->output;
+        }
+        else
+        {
+            replacement[op->output.get()] = it->second;
+            op->output->release_graph(true);
+            stats.cse_merged++;
+        }
+    }
+
+    output = canonical(output);
+
+    // Dead node elimination: rebuilding the schedule from the output keeps
+    // only ops that still contribute to it
+    std::vector<std::shared_ptr<Op>> old_ops = ops;
+    build_schedule();
+    std::unordered_set<const Op *> live_ops;
+    for (auto &op : ops)
+    {
+        live_ops.insert(op.get());
+    }
+    for (auto &op : old_ops)
+    {
+        // Break the op <-> output cycle of everything dropped
+        if (live_ops.find(op.get()) == live_ops.end() && op->output && op->output->op == op)
+        {
+            op->output->release_graph(true);
+        }
+    }
+    stats.ops_after = num_ops();
+    stats.dead_removed = stats.ops_before - stats.ops_after - stats.constants_folded - stats.cse_merged;
+    return stats;
+}
+
+int CapturedGraph::num_ops() const
+{
+    return static_cast<int>(ops.size());
+}
@@ -0,0 +1,593 @@
+// inference.cpp
+
+#include "inference.h"
+#include "int8_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+// Host copy of a parameter's values
+static std::vector<float> host_values(const std::shared_ptr<Tensor> &param)
+{
+    if (param->device == DeviceType::CUDA)
+    {
+        param->copy_to_host();
+    }
+    return std::vector<float>(param->data.begin(), param->data.end());
+}
+
+void InferencePlan::add_layer(const Layer &layer)
+{
+    if (!layers.empty() && layers.back().out != static_cast<size_t>(layer.in_features))
+    {
+        throw std::invalid_argument("InferencePlan: layer expects " + std::to_string(layer.in_features) +
+                                    " inputs but the previous layer has " + std::to_string(layers.back().out) +
+                                    " outputs");
+    }
+
+    DenseLayer dense;
+    dense.in = layer.in_features;
+    dense.out = layer.neurons.size();
+    dense.tanh = layer.nonlin;
+    dense.weights.reserve(dense.in * dense.out);
+    dense.bias.reserve(dense.out);
+    for (const auto &neuron : layer.neurons)
+    {
+        if (neuron->nonlin != layer.nonlin)
+        {
+            throw std::invalid_argument("InferencePlan: neurons of a layer must share one activation");
+        }
+        std::vector<float> weights = host_values(neuron->weights);
+        if (weights.size() != dense.in)
+        {
+            throw std::invalid_argument("InferencePlan: neuron weights do not match the layer's input size");
+        }
+        dense.weights.insert(dense.weights.end(), weights.begin(), weights.end());
+        dense.bias.push_back(host_values(neuron->bias)[0]);
+    }
+    layers.push_back(std::move(dense));
+}
+
+std::shared_ptr<InferencePlan> InferencePlan::freeze(Module &module)
+{
+    auto plan = std::make_shared<InferencePlan>();
+    if (auto *mlp = dynamic_cast<MLP *>(&module))
+    {
+        for (const auto &layer : mlp->layers)
+        {
+            plan->add_layer(*layer);
+        }
+    }
+    else if (auto *layer = dynamic_cast<Layer *>(&module))
+    {
+        plan->add_layer(*layer);
+    }
+    else if (auto *neuron = dynamic_cast<Neuron *>(&module))
+    {
+        // A neuron is a layer of one
+        DenseLayer dense;
+        dense.in = neuron->in_features;
+        dense.out = 1;
+        dense.tanh = neuron->nonlin;
+        dense.weights = host_values(neuron->weights);
+        dense.bias = host_values(neuron->bias);
+        plan->layers.push_back(std::move(dense));
+    }
+    else
+    {
+        throw std::invalid_argument("InferencePlan: unsupported module type");
+    }
+
+    if (plan->layers.empty() || plan->layers.front().in == 0)
+    {
+        throw std::invalid_argument("InferencePlan: module has no layers");
+    }
+    return plan;
+}
+
+// y = x W^T + b for one fp32 layer, with the optional tanh
+static void forward_dense(const float *x, float *y, size_t batch, size_t in, size_t out, const float *weights,
+                          const float *bias, bool tanh)
+{
+    for (size_t b = 0; b < batch; b++)
+    {
+        const float *row = x + b * in;
+        float *dst = y + b * out;
+        for (size_t o = 0; o < out; o++)
+        {
+            const float *w = weights + o * in;
+            float acc = 0.0f;
+            for (size_t i = 0; i < in; i++)
+            {
+                acc += w[i] * row[i];
+            }
+            acc += bias[o];
+            dst[o] = tanh ? std::tanh(acc) : acc;
+        }
+    }
+}
+
+// 7-bit activation code of value
+static inline uint8_t quantize_activation(float value, float inv_scale, int32_t zero)
+{
+    float q = value * inv_scale + static_cast<float>(zero);
+    q = std::min(127.0f, std::max(0.0f, q));
+    return static_cast<uint8_t>(q + 0.5f);
+}
+
+// Branch-free rational approximation of tanh (absolute error below 1e-6),
+// several times cheaper than std::tanh; its error is far below the int8
+// quantization step
+static inline float tanh_approx(float x)
+{
+    x = std::min(7.90531110763549805f, std::max(-7.90531110763549805f, x));
+    const float x2 = x * x;
+    float p = -2.76076847742355e-16f;
+    p = p * x2 + 2.00018790482477e-13f;
+    p = p * x2 - 8.60467152213735e-11f;
+    p = p * x2 + 5.12229709037114e-08f;
+    p = p * x2 + 1.48572235717979e-05f;
+    p = p * x2 + 6.37261928875436e-04f;
+    p = p * x2 + 4.89352455891786e-03f;
+    float q = 1.19825839466702e-06f;
+    q = q * x2 + 1.18534705686654e-04f;
+    q = q * x2 + 2.26843463243900e-03f;
+    q = q * x2 + 4.89352518554385e-03f;
+    return x * p / q;
+}
+
+void InferencePlan::run(const float *inputs, float *outputs, size_t batch, Scratch &scratch) const
+{
+    if (quantized)
+    {
+        run_int8(inputs, outputs, batch, scratch);
+    }
+    else
+    {
+        run_fp32(inputs, outputs, batch, scratch);
+    }
+}
+
+void InferencePlan::run_fp32(const float *inputs, float *outputs, size_t batch, Scratch &scratch) const
+{
+    // Ping-pong between two halves of scratch; the last layer writes outputs
+    size_t widest = 0;
+    for (const auto &layer : layers)
+    {
+        widest = std::max(widest, layer.out);
+    }
+    scratch.values.resize(2 * widest * batch);
+    float *buffers[2] = {scratch.values.data(), scratch.values.data() + widest * batch};
+
+    const float *x = inputs;
+    for (size_t l = 0; l < layers.size(); l++)
+    {
+        const DenseLayer &layer = layers[l];
+        float *y = l + 1 == layers.size() ? outputs : buffers[l % 2];
+        forward_dense(x, y, batch, layer.in, layer.out, layer.weights.data(), layer.bias.data(), layer.tanh);
+        x = y;
+    }
+}
+
+void InferencePlan::run_int8(const float *inputs, float *outputs, size_t batch, Scratch &scratch) const
+{
+    size_t widest = 0;
+    size_t widest_out = 0;
+    for (const auto &layer : layers)
+    {
+        widest = std::max(widest, std::max(layer.in, layer.out));
+        widest_out = std::max(widest_out, layer.out);
+    }
+    scratch.activations.resize(2 * widest * batch);
+    scratch.accumulators.resize(widest_out * batch);
+    scratch.values.resize(widest_out);
+    uint8_t *codes[2] = {scratch.activations.data(), scratch.activations.data() + widest * batch};
+    int32_t *acc = scratch.accumulators.data();
+    float *values = scratch.values.data();
+
+    const DenseLayer &first = layers.front();
+    const float inv_scale = 1.0f / first.input_scale;
+    for (size_t j = 0; j < batch * first.in; j++)
+    {
+        codes[0][j] = quantize_activation(inputs[j], inv_scale, first.input_zero);
+    }
+
+    for (size_t l = 0; l < layers.size(); l++)
+    {
+        const DenseLayer &layer = layers[l];
+        const bool last = l + 1 == layers.size();
+        const uint8_t *x = codes[l % 2];
+        uint8_t *next = codes[(l + 1) % 2];
+        const float next_inv_scale = last ? 0.0f : 1.0f / layers[l + 1].input_scale;
+        const int32_t next_zero = last ? 0 : layers[l + 1].input_zero;
+
+        int8_matmul(x, layer.qweights.data(), acc, batch, layer.out, layer.in);
+
+        // Dequantize, add bias, activate and (before another layer) requantize,
+        // one row at a time so the row stays in cache
+        for (size_t b = 0; b < batch; b++)
+        {
+            const int32_t *row = acc + b * layer.out;
+            float *y = last ? outputs + b * layer.out : values;
+            for (size_t o = 0; o < layer.out; o++)
+            {
+                y[o] = layer.channel_scales[o] * static_cast<float>(row[o] - layer.zero_offsets[o]) + layer.bias[o];
+            }
+            if (layer.tanh)
+            {
+                for (size_t o = 0; o < layer.out; o++)
+                {
+                    y[o] = tanh_approx(y[o]);
+                }
+            }
+            if (!last)
+            {
+                uint8_t *codes_out = next + b * layer.out;
+                for (size_t o = 0; o < layer.out; o++)
+                {
+                    codes_out[o] = quantize_activation(y[o], next_inv_scale, next_zero);
+                }
+            }
+        }
+    }
+}
+
+std::shared_ptr<InferencePlan> InferencePlan::quantize(const float *calibration, size_t rows) const
+{
+    if (quantized)
+    {
+        throw std::logic_error("InferencePlan: plan is already quantized");
+    }
+    if (rows == 0)
+    {
+        throw std::invalid_argument("InferencePlan: quantize needs at least one calibration row");
+    }
+
+    auto plan = std::make_shared<InferencePlan>(*this);
+    plan->quantized = true;
+
+    std::vector<float> current(calibration, calibration + rows * input_size());
+    std::vector<float> next;
+    for (DenseLayer &layer : plan->layers)
+    {
+        // Observed input range, widened to include 0 so that 0 is exact
+        float lo = 0.0f;
+        float hi = 0.0f;
+        for (float value : current)
+        {
+            lo = std::min(lo, value);
+            hi = std::max(hi, value);
+        }
+        layer.input_scale = hi > lo ? (hi - lo) / 127.0f : 1.0f;
+        layer.input_zero = static_cast<int32_t>(std::lrint(-lo / layer.input_scale));
+
+        // Calibrate the next layer on fp32 outputs of this one
+        next.resize(rows * layer.out);
+        forward_dense(current.data(), next.data(), rows, layer.in, layer.out, layer.weights.data(), layer.bias.data(),
+                      layer.tanh);
+        current.swap(next);
+
+        layer.qweights.resize(layer.out * layer.in);
+        layer.channel_scales.resize(layer.out);
+        layer.zero_offsets.resize(layer.out);
+        for (size_t o = 0; o < layer.out; o++)
+        {
+            const float *w = layer.weights.data() + o * layer.in;
+            float max_abs = 0.0f;
+            for (size_t i = 0; i < layer.in; i++)
+            {
+                max_abs = std::max(max_abs, std::fabs(w[i]));
+            }
+            const float weight_scale = max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+            int32_t sum = 0;
+            for (size_t i = 0; i < layer.in; i++)
+            {
+                long q = std::lrint(w[i] / weight_scale);
+                int8_t code = static_cast<int8_t>(std::min(127L, std::max(-127L, q)));
+                layer.qweights[o * layer.in + i] = code;
+                sum += code;
+            }
+            layer.channel_scales[o] = layer.input_scale * weight_scale;
+            layer.zero_offsets[o] = layer.input_zero * sum;
+        }
+        std::vector<float>().swap(layer.weights);
+    }
+    return plan;
+}
+
+size_t InferencePlan::weight_bytes() const
+{
+    size_t bytes = 0;
+    for (const auto &layer : layers)
+    {
+        bytes += layer.weights.size() * sizeof(float) + layer.bias.size() * sizeof(float);
+        bytes += layer.qweights.size() * sizeof(int8_t) + layer.channel_scales.size() * sizeof(float) +
+                 layer.zero_offsets.size() * sizeof(int32_t);
+    }
+    return bytes;
+}
+
+QuantizationReport InferencePlan::compare(const InferencePlan &reference, const float *inputs, size_t rows) const
+{
+    if (reference.input_size() != input_size() || reference.output_size() != output_size())
+    {
+        throw std::invalid_argument("InferencePlan: compare needs plans with the same input and output sizes");
+    }
+
+    std::vector<float> expected(rows * output_size());
+    std::vector<float> actual(rows * output_size());
+    Scratch scratch;
+    reference.run(inputs, expected.data(), rows, scratch);
+    run(inputs, actual.data(), rows, scratch);
+
+    QuantizationReport report;
+    report.rows = rows;
+    report.weight_bytes = weight_bytes();
+    report.reference_weight_bytes = reference.weight_bytes();
+    double abs_sum = 0.0;
+    double squared_sum = 0.0;
+    double reference_squared_sum = 0.0;
+    for (size_t j = 0; j < expected.size(); j++)
+    {
+        double error = std::fabs(static_cast<double>(actual[j]) - expected[j]);
+        report.max_abs_error = std::max(report.max_abs_error, error);
+        abs_sum += error;
+        squared_sum += error * error;
+        reference_squared_sum += static_cast<double>(expected[j]) * expected[j];
+    }
+    if (!expected.empty())
+    {
+        report.mean_abs_error = abs_sum / expected.size();
+        report.rms_error = std::sqrt(squared_sum / expected.size());
+        report.reference_rms = std::sqrt(reference_squared_sum / expected.size());
+    }
+    return report;
+}
+
+std::string QuantizationReport::summary() const
+{
+    std::ostringstream out;
+    out << rows << " rows: max abs error " << max_abs_error << ", mean abs error " << mean_abs_error << ", rms error "
+        << rms_error << " (reference rms " << reference_rms << ")\n";
+    out << "weights: " << weight_bytes << " bytes vs " << reference_weight_bytes << " bytes\n";
+    return out.str();
+}
+
+std::string InferenceStats::summary() const
+{
+    std::ostringstream out;
+    out << requests << " requests in " << batches << " batches (mean batch " << mean_batch_size << ")\n";
+    out << "latency us: p50 " << p50_latency_us << ", p90 " << p90_latency_us << ", p99 " << p99_latency_us
+        << ", max " << max_latency_us << "\n";
+    out << "batch sizes:";
+    for (size_t n = 1; n < batch_histogram.size(); n++)
+    {
+        if (batch_histogram[n])
+        {
+            out << " " << n << "x" << batch_histogram[n];
+        }
+    }
+    out << "\n";
+    return out.str();
+}
+
+InferenceServer::InferenceServer(std::shared_ptr<const InferencePlan> plan, size_t max_batch, double max_delay_us,
+                                 int num_workers)
+    : plan(std::move(plan)), max_batch(max_batch),
+      max_delay(static_cast<long long>(max_delay_us)), batch_histogram(max_batch + 1, 0)
+{
+    if (!this->plan)
+    {
+        throw std::invalid_argument("InferenceServer: plan is null");
+    }
+    if (max_batch == 0)
+    {
+        throw std::invalid_argument("InferenceServer: max_batch must be positive");
+    }
+    if (max_delay_us < 0)
+    {
+        throw std::invalid_argument("InferenceServer: max_delay_us must be non-negative");
+    }
+    if (num_workers < 1)
+    {
+        throw std::invalid_argument("InferenceServer: num_workers must be positive");
+    }
+    for (int i = 0; i < num_workers; i++)
+    {
+        workers.emplace_back(&InferenceServer::worker_loop, this);
+    }
+}
+
+InferenceServer::~InferenceServer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queue_cv.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+std::future<std::vector<float>> InferenceServer::submit(std::vector<float> input)
+{
+    if (input.size() != plan->input_size())
+    {
+        throw std::invalid_argument("InferenceServer: expected " + std::to_string(plan->input_size()) +
+                                    " inputs but got " + std::to_string(input.size()));
+    }
+
+    Request request;
+    request.input = std::move(input);
+    request.arrival = Clock::now();
+    std::future<std::vector<float>> result = request.result.get_future();
+    bool fill_batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+        {
+            throw std::logic_error("InferenceServer: server is shutting down");
+        }
+        queue.push_back(std::move(request));
+        fill_batch = queue.size() >= max_batch;
+    }
+    // One waiter per request, but a full batch must not wait for its deadline
+    if (fill_batch)
+    {
+        queue_cv.notify_all();
+    }
+    else
+    {
+        queue_cv.notify_one();
+    }
+    return result;
+}
+
+std::vector<float> InferenceServer::infer(std::vector<float> input)
+{
+    return submit(std::move(input)).get();
+}
+
+void InferenceServer::worker_loop()
+{
+    std::vector<Request> batch;
+    std::vector<float> inputs;
+    std::vector<float> outputs;
+    InferencePlan::Scratch scratch;
+    std::vector<double> latencies;
+    const size_t in_size = plan->input_size();
+    const size_t out_size = plan->output_size();
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queue_cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty())
+            {
+                return; // Stopping and drained
+            }
+            // Give later requests until the oldest one's deadline to join
+            while (!stopping && !queue.empty() && queue.size() < max_batch)
+            {
+                Clock::time_point deadline = queue.front().arrival + max_delay;
+                if (queue_cv.wait_until(lock, deadline) == std::cv_status::timeout)
+                {
+                    break;
+                }
+            }
+            if (queue.empty())
+            {
+                continue; // Another worker took them
+            }
+            size_t take = std::min(queue.size(), max_batch);
+            batch.clear();
+            for (size_t i = 0; i < take; i++)
+            {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+        }
+        // Let another worker start collecting the next batch
+        queue_cv.notify_one();
+
+        const size_t n = batch.size();
+        inputs.resize(n * in_size);
+        outputs.resize(n * out_size);
+        for (size_t b = 0; b < n; b++)
+        {
+            std::copy(batch[b].input.begin(), batch[b].input.end(), inputs.begin() + b * in_size);
+        }
+
+        try
+        {
+            plan->run(inputs.data(), outputs.data(), n, scratch);
+        }
+        catch (...)
+        {
+            for (auto &request : batch)
+            {
+                request.result.set_exception(std::current_exception());
+            }
+            continue;
+        }
+
+        Clock::time_point now = Clock::now();
+        latencies.clear();
+        for (size_t b = 0; b < n; b++)
+        {
+            latencies.push_back(std::chrono::duration<double, std::micro>(now - batch[b].arrival).count());
+        }
+        record(n, latencies);
+        for (size_t b = 0; b < n; b++)
+        {
+            batch[b].result.set_value(std::vector<float>(outputs.begin() + b * out_size,
+                                                         outputs.begin() + (b + 1) * out_size));
+        }
+    }
+}
+
+void InferenceServer::record(size_t batch_size, const std::vector<double> &latencies)
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    total_requests += batch_size;
+    total_batches++;
+    batch_histogram[batch_size]++;
+    for (double latency : latencies)
+    {
+        if (latencies_us.size() < latency_window)
+        {
+            latencies_us.push_back(latency);
+        }
+        else
+        {
+            latencies_us[next_latency] = latency;
+        }
+        next_latency = (next_latency + 1) % latency_window;
+    }
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+InferenceStats InferenceServer::stats() const
+{
+    InferenceStats stats;
+    std::vector<double> sorted;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats.requests = total_requests;
+        stats.batches = total_batches;
+        stats.batch_histogram = batch_histogram;
+        sorted = latencies_us;
+    }
+    stats.mean_batch_size = stats.batches ? static_cast<double>(stats.requests) / stats.batches : 0.0;
+    std::sort(sorted.begin(), sorted.end());
+    stats.p50_latency_us = percentile(sorted, 50);
+    stats.p90_latency_us = percentile(sorted, 90);
+    stats.p99_latency_us = percentile(sorted, 99);
+    stats.max_latency_us = sorted.empty() ? 0.0 : sorted.back();
+    return stats;
+}
+
+void InferenceServer::reset_stats()
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    total_requests = 0;
+    total_batches = 0;
+    std::fill(batch_histogram.begin(), batch_histogram.end(), 0);
+    latencies_us.clear();
+    next_latency = 0;
+}
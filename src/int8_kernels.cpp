@@ -0,0 +1,298 @@
+// int8_kernels.cpp
+
+#include "int8_kernels.h"
+
+#include <atomic>
+#include <stdexcept>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CUGRAD_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+using MatmulKernel = void (*)(const uint8_t *, const int8_t *, int32_t *, size_t, size_t, size_t);
+
+static int32_t dot_scalar(const uint8_t *x, const int8_t *w, size_t begin, size_t k)
+{
+    int32_t acc = 0;
+    for (size_t i = begin; i < k; i++)
+    {
+        acc += static_cast<int32_t>(x[i]) * w[i];
+    }
+    return acc;
+}
+
+static void matmul_scalar(const uint8_t *a, const int8_t *w, int32_t *out, size_t batch, size_t n, size_t k)
+{
+    for (size_t b = 0; b < batch; b++)
+    {
+        for (size_t o = 0; o < n; o++)
+        {
+            out[b * n + o] = dot_scalar(a + b * k, w + o * k, 0, k);
+        }
+    }
+}
+
+#ifdef CUGRAD_X86_KERNELS
+
+// The AVX kernels compute four output channels per pass over an activation
+// row, so each activation chunk is loaded once for four weight rows
+
+__attribute__((target("avx2"))) static inline int32_t hsum_avx2(__m256i v)
+{
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+// u8 x s8 products summed in pairs to s16 (vpmaddubsw), then in pairs to s32
+__attribute__((target("avx2"))) static inline __m256i dot_step_avx2(__m256i acc, __m256i x, const int8_t *w)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i pairs = _mm256_maddubs_epi16(x, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w)));
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(pairs, ones));
+}
+
+__attribute__((target("avx2"))) static void matmul_avx2(const uint8_t *a, const int8_t *w, int32_t *out, size_t batch,
+                                                        size_t n, size_t k)
+{
+    const size_t k32 = k / 32 * 32;
+    for (size_t b = 0; b < batch; b++)
+    {
+        const uint8_t *x = a + b * k;
+        int32_t *y = out + b * n;
+        size_t o = 0;
+        for (; o + 4 <= n; o += 4)
+        {
+            const int8_t *w0 = w + o * k;
+            const int8_t *w1 = w0 + k;
+            const int8_t *w2 = w1 + k;
+            const int8_t *w3 = w2 + k;
+            __m256i acc0 = _mm256_setzero_si256();
+            __m256i acc1 = _mm256_setzero_si256();
+            __m256i acc2 = _mm256_setzero_si256();
+            __m256i acc3 = _mm256_setzero_si256();
+            for (size_t i = 0; i < k32; i += 32)
+            {
+                __m256i xv = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i));
+                acc0 = dot_step_avx2(acc0, xv, w0 + i);
+                acc1 = dot_step_avx2(acc1, xv, w1 + i);
+                acc2 = dot_step_avx2(acc2, xv, w2 + i);
+                acc3 = dot_step_avx2(acc3, xv, w3 + i);
+            }
+            y[o] = hsum_avx2(acc0) + dot_scalar(x, w0, k32, k);
+            y[o + 1] = hsum_avx2(acc1) + dot_scalar(x, w1, k32, k);
+            y[o + 2] = hsum_avx2(acc2) + dot_scalar(x, w2, k32, k);
+            y[o + 3] = hsum_avx2(acc3) + dot_scalar(x, w3, k32, k);
+        }
+        for (; o < n; o++)
+        {
+            const int8_t *wo = w + o * k;
+            __m256i acc = _mm256_setzero_si256();
+            for (size_t i = 0; i < k32; i += 32)
+            {
+                acc = dot_step_avx2(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i)), wo + i);
+            }
+            y[o] = hsum_avx2(acc) + dot_scalar(x, wo, k32, k);
+        }
+    }
+}
+
+// AVX-VNNI: vpdpbusd multiplies and accumulates straight into s32
+__attribute__((target("avx2,avxvnni"))) static void matmul_avx_vnni(const uint8_t *a, const int8_t *w, int32_t *out,
+                                                                    size_t batch, size_t n, size_t k)
+{
+    const size_t k32 = k / 32 * 32;
+    for (size_t b = 0; b < batch; b++)
+    {
+        const uint8_t *x = a + b * k;
+        int32_t *y = out + b * n;
+        size_t o = 0;
+        for (; o + 4 <= n; o += 4)
+        {
+            const int8_t *w0 = w + o * k;
+            const int8_t *w1 = w0 + k;
+            const int8_t *w2 = w1 + k;
+            const int8_t *w3 = w2 + k;
+            __m256i acc0 = _mm256_setzero_si256();
+            __m256i acc1 = _mm256_setzero_si256();
+            __m256i acc2 = _mm256_setzero_si256();
+            __m256i acc3 = _mm256_setzero_si256();
+            for (size_t i = 0; i < k32; i += 32)
+            {
+                __m256i xv = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i));
+                acc0 = _mm256_dpbusd_avx_epi32(acc0, xv, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w0 + i)));
+                acc1 = _mm256_dpbusd_avx_epi32(acc1, xv, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w1 + i)));
+                acc2 = _mm256_dpbusd_avx_epi32(acc2, xv, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w2 + i)));
+                acc3 = _mm256_dpbusd_avx_epi32(acc3, xv, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w3 + i)));
+            }
+            y[o] = hsum_avx2(acc0) + dot_scalar(x, w0, k32, k);
+            y[o + 1] = hsum_avx2(acc1) + dot_scalar(x, w1, k32, k);
+            y[o + 2] = hsum_avx2(acc2) + dot_scalar(x, w2, k32, k);
+            y[o + 3] = hsum_avx2(acc3) + dot_scalar(x, w3, k32, k);
+        }
+        for (; o < n; o++)
+        {
+            const int8_t *wo = w + o * k;
+            __m256i acc = _mm256_setzero_si256();
+            for (size_t i = 0; i < k32; i += 32)
+            {
+                acc = _mm256_dpbusd_avx_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i)),
+                                              _mm256_loadu_si256(reinterpret_cast<const __m256i *>(wo + i)));
+            }
+            y[o] = hsum_avx2(acc) + dot_scalar(x, wo, k32, k);
+        }
+    }
+}
+
+__attribute__((target("avx512f"))) static inline int32_t hsum_avx512(__m512i v)
+{
+    int32_t lanes[16];
+    _mm512_storeu_si512(lanes, v);
+    int32_t sum = 0;
+    for (int32_t lane : lanes)
+    {
+        sum += lane;
+    }
+    return sum;
+}
+
+// AVX-512 VNNI: 64 products per instruction; the tail uses a masked load
+__attribute__((target("avx512f,avx512bw,avx512vnni"))) static void matmul_avx512_vnni(const uint8_t *a, const int8_t *w,
+                                                                                      int32_t *out, size_t batch,
+                                                                                      size_t n, size_t k)
+{
+    const size_t k64 = k / 64 * 64;
+    const __mmask64 tail = k > k64 ? (~0ULL >> (64 - (k - k64))) : 0;
+    for (size_t b = 0; b < batch; b++)
+    {
+        const uint8_t *x = a + b * k;
+        int32_t *y = out + b * n;
+        __m512i x_tail = _mm512_maskz_loadu_epi8(tail, x + k64);
+        size_t o = 0;
+        for (; o + 4 <= n; o += 4)
+        {
+            const int8_t *w0 = w + o * k;
+            const int8_t *w1 = w0 + k;
+            const int8_t *w2 = w1 + k;
+            const int8_t *w3 = w2 + k;
+            __m512i acc0 = _mm512_setzero_si512();
+            __m512i acc1 = _mm512_setzero_si512();
+            __m512i acc2 = _mm512_setzero_si512();
+            __m512i acc3 = _mm512_setzero_si512();
+            for (size_t i = 0; i < k64; i += 64)
+            {
+                __m512i xv = _mm512_loadu_si512(x + i);
+                acc0 = _mm512_dpbusd_epi32(acc0, xv, _mm512_loadu_si512(w0 + i));
+                acc1 = _mm512_dpbusd_epi32(acc1, xv, _mm512_loadu_si512(w1 + i));
+                acc2 = _mm512_dpbusd_epi32(acc2, xv, _mm512_loadu_si512(w2 + i));
+                acc3 = _mm512_dpbusd_epi32(acc3, xv, _mm512_loadu_si512(w3 + i));
+            }
+            acc0 = _mm512_dpbusd_epi32(acc0, x_tail, _mm512_maskz_loadu_epi8(tail, w0 + k64));
+            acc1 = _mm512_dpbusd_epi32(acc1, x_tail, _mm512_maskz_loadu_epi8(tail, w1 + k64));
+            acc2 = _mm512_dpbusd_epi32(acc2, x_tail, _mm512_maskz_loadu_epi8(tail, w2 + k64));
+            acc3 = _mm512_dpbusd_epi32(acc3, x_tail, _mm512_maskz_loadu_epi8(tail, w3 + k64));
+            y[o] = hsum_avx512(acc0);
+            y[o + 1] = hsum_avx512(acc1);
+            y[o + 2] = hsum_avx512(acc2);
+            y[o + 3] = hsum_avx512(acc3);
+        }
+        for (; o < n; o++)
+        {
+            const int8_t *wo = w + o * k;
+            __m512i acc = _mm512_setzero_si512();
+            for (size_t i = 0; i < k64; i += 64)
+            {
+                acc = _mm512_dpbusd_epi32(acc, _mm512_loadu_si512(x + i), _mm512_loadu_si512(wo + i));
+            }
+            acc = _mm512_dpbusd_epi32(acc, x_tail, _mm512_maskz_loadu_epi8(tail, wo + k64));
+            y[o] = hsum_avx512(acc);
+        }
+    }
+}
+
+#endif // CUGRAD_X86_KERNELS
+
+struct KernelEntry
+{
+    const char *name;
+    MatmulKernel kernel;
+    bool (*supported)();
+};
+
+static const KernelEntry kernel_table[] = {
+#ifdef CUGRAD_X86_KERNELS
+    {"avx512_vnni", matmul_avx512_vnni, []
+     { return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni"); }},
+    {"avx_vnni", matmul_avx_vnni, []
+     { return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("avxvnni"); }},
+    {"avx2", matmul_avx2, []
+     { return static_cast<bool>(__builtin_cpu_supports("avx2")); }},
+#endif
+    {"scalar", matmul_scalar, []
+     { return true; }},
+};
+
+static const KernelEntry *best_kernel()
+{
+    for (const KernelEntry &entry : kernel_table)
+    {
+        if (entry.supported())
+        {
+            return &entry;
+        }
+    }
+    return nullptr; // Unreachable: scalar is always supported
+}
+
+static std::atomic<const KernelEntry *> &current_kernel()
+{
+    static std::atomic<const KernelEntry *> current{best_kernel()};
+    return current;
+}
+
+void int8_matmul(const uint8_t *a, const int8_t *w, int32_t *out, size_t batch, size_t n, size_t k)
+{
+    current_kernel().load(std::memory_order_relaxed)->kernel(a, w, out, batch, n, k);
+}
+
+std::string int8_kernel()
+{
+    return current_kernel().load()->name;
+}
+
+std::vector<std::string> available_int8_kernels()
+{
+    std::vector<std::string> names;
+    for (const KernelEntry &entry : kernel_table)
+    {
+        if (entry.supported())
+        {
+            names.push_back(entry.name);
+        }
+    }
+    return names;
+}
+
+void set_int8_kernel(const std::string &name)
+{
+    if (name == "auto")
+    {
+        current_kernel().store(best_kernel());
+        return;
+    }
+    for (const KernelEntry &entry : kernel_table)
+    {
+        if (name == entry.name)
+        {
+            if (!entry.supported())
+            {
+                throw std::invalid_argument("int8 kernel " + name + " is not supported by this CPU");
+            }
+            current_kernel().store(&entry);
+            return;
+        }
+    }
+    throw std::invalid_argument("Unknown int8 kernel " + name);
+}
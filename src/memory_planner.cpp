@@ -0,0 +1,63 @@
+// memory_planner.cpp
+
+#include "memory_planner.h"
+
+#include <algorithm>
+#include <numeric>
+
+static size_t align_up(size_t n, size_t alignment)
+{
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+static bool lifetimes_overlap(const BufferLifetime &a, const BufferLifetime &b)
+{
+    return a.first_use <= b.last_use && b.first_use <= a.last_use;
+}
+
+size_t assign_offsets(std::vector<BufferLifetime> &buffers, size_t alignment)
+{
+    std::vector<size_t> order(buffers.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&buffers](size_t a, size_t b)
+                     { return buffers[a].size > buffers[b].size; });
+
+    size_t arena_size = 0;
+    std::vector<size_t> placed;
+    for (size_t index : order)
+    {
+        BufferLifetime &buffer = buffers[index];
+        // Buffers smaller than the alignment (mostly [1]-shaped) are packed tightly
+        size_t align = buffer.size >= alignment ? alignment : 1;
+        size_t size = align_up(buffer.size, align);
+
+        // Placed buffers that are alive at the same time, by offset
+        std::vector<size_t> conflicts;
+        for (size_t other : placed)
+        {
+            if (lifetimes_overlap(buffer, buffers[other]))
+            {
+                conflicts.push_back(other);
+            }
+        }
+        std::sort(conflicts.begin(), conflicts.end(), [&buffers](size_t a, size_t b)
+                  { return buffers[a].offset < buffers[b].offset; });
+
+        // Lowest gap that fits
+        size_t offset = 0;
+        for (size_t other : conflicts)
+        {
+            const BufferLifetime &o = buffers[other];
+            if (offset + size <= o.offset)
+            {
+                break;
+            }
+            offset = std::max(offset, align_up(o.offset + o.size, align));
+        }
+
+        buffer.offset = offset;
+        arena_size = std::max(arena_size, offset + size);
+        placed.push_back(index);
+    }
+    return arena_size;
+}
@@ -0,0 +1,492 @@
+// memory_stats.cpp
+
+#include "memory_stats.h"
+#include "tensor.h"
+#include "op.h"
+#include "traversal.h"
+#include "node_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <sstream>
+#include <unordered_set>
+
+namespace
+{
+    struct ByteCounter
+    {
+        std::atomic<long long> current{0};
+        std::atomic<long long> peak{0};
+
+        void add(long long delta)
+        {
+            raise_peak(current.fetch_add(delta) + delta);
+        }
+
+        void raise_peak(long long now)
+        {
+            long long seen = peak.load();
+            while (now > seen && !peak.compare_exchange_weak(seen, now))
+            {
+            }
+        }
+    };
+}
+
+static ByteCounter host_bytes;
+static ByteCounter device_bytes;
+
+// Bytes a thread may change before adding them to the totals
+static const long long flush_bytes = 64 * 1024;
+
+// Live tensors and ops created by one thread, as circular lists threaded
+// through their hooks, and its byte changes not yet in the totals. Only the
+// owner links into it; frees from other threads and snapshots lock it too.
+struct ThreadRegistry
+{
+    std::mutex mutex;
+    RegistryHook tensors;
+    RegistryHook ops;
+    long long num_tensors = 0;
+    long long num_ops = 0;
+    std::atomic<long long> host_pending{0};
+    std::atomic<long long> device_pending{0};
+    bool in_use = false; // Guarded by registries_mutex()
+
+    ThreadRegistry()
+    {
+        tensors.prev = tensors.next = &tensors;
+        ops.prev = ops.next = &ops;
+    }
+};
+
+// Never destroyed: tensors owned by other static objects may outlive this
+// file's statics. A registry outlives its thread (its objects may still be
+// alive) and is handed to the next new thread.
+static std::mutex &registries_mutex()
+{
+    static std::mutex *instance = new std::mutex();
+    return *instance;
+}
+
+static std::vector<ThreadRegistry *> &registries()
+{
+    static std::vector<ThreadRegistry *> *instance = new std::vector<ThreadRegistry *>();
+    return *instance;
+}
+
+static ThreadRegistry *acquire_registry()
+{
+    std::lock_guard<std::mutex> lock(registries_mutex());
+    for (ThreadRegistry *registry : registries())
+    {
+        if (!registry->in_use)
+        {
+            registry->in_use = true;
+            return registry;
+        }
+    }
+    registries().push_back(new ThreadRegistry());
+    registries().back()->in_use = true;
+    return registries().back();
+}
+
+static void flush(std::atomic<long long> &pending, ByteCounter &total)
+{
+    long long bytes = pending.exchange(0);
+    if (bytes)
+    {
+        total.add(bytes);
+    }
+}
+
+namespace
+{
+    // Returns the thread's registry when the thread exits
+    struct RegistryLease
+    {
+        ThreadRegistry *registry = nullptr;
+        ~RegistryLease();
+    };
+}
+
+static thread_local ThreadRegistry *current_registry = nullptr;
+static thread_local bool thread_exiting = false;
+static thread_local RegistryLease lease;
+
+RegistryLease::~RegistryLease()
+{
+    thread_exiting = true;
+    current_registry = nullptr;
+    if (registry)
+    {
+        flush(registry->host_pending, host_bytes);
+        flush(registry->device_pending, device_bytes);
+        std::lock_guard<std::mutex> lock(registries_mutex());
+        registry->in_use = false;
+    }
+}
+
+// Shared by objects created by thread-local destructors after the lease is gone
+static ThreadRegistry &exiting_registry()
+{
+    static ThreadRegistry *instance = [] {
+        ThreadRegistry *registry = new ThreadRegistry();
+        registry->in_use = true;
+        std::lock_guard<std::mutex> lock(registries_mutex());
+        registries().push_back(registry);
+        return registry;
+    }();
+    return *instance;
+}
+
+static ThreadRegistry &this_registry()
+{
+    if (!current_registry)
+    {
+        if (thread_exiting)
+        {
+            return exiting_registry();
+        }
+        current_registry = lease.registry = acquire_registry();
+    }
+    return *current_registry;
+}
+
+static thread_local ThreadMemoryStats this_thread;
+
+static void count_bytes(long long delta)
+{
+    if (delta > 0)
+    {
+        this_thread.bytes_allocated += delta;
+    }
+    else
+    {
+        this_thread.bytes_freed -= delta;
+    }
+}
+
+static void add_bytes(std::atomic<long long> &pending, ByteCounter &total, long long delta)
+{
+    long long bytes = pending.fetch_add(delta, std::memory_order_relaxed) + delta;
+    if (bytes >= flush_bytes || bytes <= -flush_bytes)
+    {
+        pending.fetch_sub(bytes, std::memory_order_relaxed);
+        total.add(bytes);
+    }
+}
+
+// Callers hold the registry mutex
+static void link(ThreadRegistry &registry, RegistryHook &list, RegistryHook &hook, const void *owner)
+{
+    hook.owner = owner;
+    hook.registry = &registry;
+    hook.prev = &list;
+    hook.next = list.next;
+    list.next->prev = &hook;
+    list.next = &hook;
+}
+
+static bool unlink(RegistryHook &hook)
+{
+    if (!hook.prev)
+    {
+        return false;
+    }
+    hook.prev->next = hook.next;
+    hook.next->prev = hook.prev;
+    hook.prev = hook.next = nullptr;
+    return true;
+}
+
+void MemoryStats::tensor_created(const Tensor *tensor)
+{
+    this_thread.tensors_created++;
+    ThreadRegistry &registry = this_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    link(registry, registry.tensors, tensor->registry_hook, tensor);
+    registry.num_tensors++;
+}
+
+void MemoryStats::tensor_destroyed(const Tensor *tensor)
+{
+    this_thread.tensors_destroyed++;
+    ThreadRegistry *registry = tensor->registry_hook.registry;
+    if (registry)
+    {
+        std::lock_guard<std::mutex> lock(registry->mutex);
+        registry->num_tensors -= unlink(tensor->registry_hook);
+    }
+}
+
+void MemoryStats::op_created(const Op *op)
+{
+    this_thread.ops_created++;
+    ThreadRegistry &registry = this_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    link(registry, registry.ops, op->registry_hook, op);
+    registry.num_ops++;
+}
+
+void MemoryStats::op_destroyed(const Op *op)
+{
+    this_thread.ops_destroyed++;
+    ThreadRegistry *registry = op->registry_hook.registry;
+    if (registry)
+    {
+        std::lock_guard<std::mutex> lock(registry->mutex);
+        registry->num_ops -= unlink(op->registry_hook);
+    }
+}
+
+void MemoryStats::host_bytes_changed(long long delta)
+{
+    add_bytes(this_registry().host_pending, host_bytes, delta);
+    count_bytes(delta);
+}
+
+void MemoryStats::device_bytes_changed(long long delta)
+{
+    add_bytes(this_registry().device_pending, device_bytes, delta);
+    count_bytes(delta);
+}
+
+ThreadMemoryStats MemoryStats::thread_stats()
+{
+    return this_thread;
+}
+
+// Totals including what the threads have not added yet
+static void current_bytes(long long &host, long long &device)
+{
+    host = host_bytes.current.load();
+    device = device_bytes.current.load();
+    std::lock_guard<std::mutex> lock(registries_mutex());
+    for (ThreadRegistry *registry : registries())
+    {
+        host += registry->host_pending.load(std::memory_order_relaxed);
+        device += registry->device_pending.load(std::memory_order_relaxed);
+    }
+}
+
+void MemoryStats::reset_peak()
+{
+    long long host, device;
+    current_bytes(host, device);
+    host_bytes.peak.store(host);
+    device_bytes.peak.store(device);
+}
+
+static long long owned_bytes(const Buffer &buffer)
+{
+    return buffer.is_view() ? 0 : static_cast<long long>(buffer.size() * sizeof(float));
+}
+
+// Bytes held by one node: owned host buffers plus its device copies
+static long long tensor_bytes(const Tensor &tensor)
+{
+    long long bytes = owned_bytes(tensor.data) + owned_bytes(tensor.grad) + owned_bytes(tensor.tangent);
+    long long device_size = static_cast<long long>(tensor.size() * sizeof(float));
+    if (tensor.d_data)
+    {
+        bytes += device_size;
+    }
+    if (tensor.d_grad)
+    {
+        bytes += device_size;
+    }
+    return bytes;
+}
+
+// Shared references to every live tensor, so they cannot go away while we
+// look at them. Tensors still being constructed or already being destroyed
+// have no owner and are skipped.
+static std::vector<std::shared_ptr<Tensor>> pin_live_tensors()
+{
+    std::vector<std::shared_ptr<Tensor>> pinned;
+    std::lock_guard<std::mutex> registries_lock(registries_mutex());
+    for (ThreadRegistry *registry : registries())
+    {
+        std::lock_guard<std::mutex> lock(registry->mutex);
+        for (RegistryHook *hook = registry->tensors.next; hook != &registry->tensors; hook = hook->next)
+        {
+            const Tensor *tensor = static_cast<const Tensor *>(hook->owner);
+            try
+            {
+                pinned.push_back(const_cast<Tensor *>(tensor)->shared_from_this());
+            }
+            catch (const std::bad_weak_ptr &)
+            {
+            }
+        }
+    }
+    return pinned;
+}
+
+MemorySnapshot MemoryStats::snapshot()
+{
+    MemorySnapshot snapshot;
+    current_bytes(snapshot.host_bytes, snapshot.device_bytes);
+    host_bytes.raise_peak(snapshot.host_bytes);
+    device_bytes.raise_peak(snapshot.device_bytes);
+    snapshot.peak_host_bytes = host_bytes.peak.load();
+    snapshot.peak_device_bytes = device_bytes.peak.load();
+    snapshot.node_pool_bytes = node_pool::slab_bytes();
+
+    {
+        std::lock_guard<std::mutex> registries_lock(registries_mutex());
+        for (ThreadRegistry *registry : registries())
+        {
+            std::lock_guard<std::mutex> lock(registry->mutex);
+            snapshot.live_tensors += registry->num_tensors;
+            snapshot.live_ops += registry->num_ops;
+            for (RegistryHook *hook = registry->ops.next; hook != &registry->ops; hook = hook->next)
+            {
+                snapshot.ops_by_op_type[static_cast<const Op *>(hook->owner)->op_type()]++;
+            }
+        }
+    }
+
+    for (auto &tensor : pin_live_tensors())
+    {
+        std::string op_type = tensor->op ? tensor->op->op_type() : "leaf";
+        snapshot.tensors_by_op_type[op_type]++;
+        snapshot.bytes_by_op_type[op_type] += tensor_bytes(*tensor);
+    }
+    return snapshot;
+}
+
+static std::map<std::string, long long> subtract(const std::map<std::string, long long> &before,
+                                                  const std::map<std::string, long long> &after)
+{
+    std::map<std::string, long long> result = after;
+    for (auto &entry : before)
+    {
+        result[entry.first] -= entry.second;
+    }
+    for (auto it = result.begin(); it != result.end();)
+    {
+        it = it->second == 0 ? result.erase(it) : std::next(it);
+    }
+    return result;
+}
+
+MemorySnapshot MemoryStats::diff(const MemorySnapshot &before, const MemorySnapshot &after)
+{
+    MemorySnapshot delta;
+    delta.live_tensors = after.live_tensors - before.live_tensors;
+    delta.live_ops = after.live_ops - before.live_ops;
+    delta.host_bytes = after.host_bytes - before.host_bytes;
+    delta.device_bytes = after.device_bytes - before.device_bytes;
+    delta.peak_host_bytes = after.peak_host_bytes;
+    delta.peak_device_bytes = after.peak_device_bytes;
+    delta.node_pool_bytes = after.node_pool_bytes - before.node_pool_bytes;
+    delta.tensors_by_op_type = subtract(before.tensors_by_op_type, after.tensors_by_op_type);
+    delta.bytes_by_op_type = subtract(before.bytes_by_op_type, after.bytes_by_op_type);
+    delta.ops_by_op_type = subtract(before.ops_by_op_type, after.ops_by_op_type);
+    return delta;
+}
+
+std::vector<LiveGraph> MemoryStats::largest_graphs(int limit)
+{
+    std::vector<std::shared_ptr<Tensor>> pinned = pin_live_tensors();
+
+    // A root is a node with inputs that no other live node consumes
+    std::unordered_set<const Tensor *> consumed;
+    for (auto &tensor : pinned)
+    {
+        for (auto &child : tensor->children())
+        {
+            consumed.insert(child.get());
+        }
+    }
+
+    // Nodes shared by several graphs (e.g. parameters) count for each of them
+    std::vector<LiveGraph> graphs;
+    for (auto &tensor : pinned)
+    {
+        if (tensor->children().empty() || consumed.count(tensor.get()))
+        {
+            continue;
+        }
+        LiveGraph graph;
+        graph.root = tensor;
+        for_each_node(*tensor, [&graph](Tensor &node)
+                      {
+            graph.num_nodes++;
+            graph.num_ops += node.op ? 1 : 0;
+            graph.bytes += tensor_bytes(node); });
+        graphs.push_back(graph);
+    }
+
+    std::sort(graphs.begin(), graphs.end(), [](const LiveGraph &a, const LiveGraph &b)
+              { return a.bytes > b.bytes; });
+    if (limit >= 0 && static_cast<int>(graphs.size()) > limit)
+    {
+        graphs.resize(limit);
+    }
+    return graphs;
+}
+
+static std::string format_bytes(long long bytes)
+{
+    char text[32];
+    if (bytes >= (1LL << 20) || bytes <= -(1LL << 20))
+    {
+        std::snprintf(text, sizeof(text), "%.2f MB", bytes / double(1 << 20));
+    }
+    else if (bytes >= 1024 || bytes <= -1024)
+    {
+        std::snprintf(text, sizeof(text), "%.2f KB", bytes / 1024.0);
+    }
+    else
+    {
+        std::snprintf(text, sizeof(text), "%lld B", bytes);
+    }
+    return text;
+}
+
+std::string MemoryStats::summary(int limit)
+{
+    MemorySnapshot now = snapshot();
+
+    std::ostringstream out;
+    out << "live tensors: " << now.live_tensors << ", live ops: " << now.live_ops << "\n";
+    out << "host: " << format_bytes(now.host_bytes) << " (peak " << format_bytes(now.peak_host_bytes) << ")"
+        << ", device: " << format_bytes(now.device_bytes) << " (peak " << format_bytes(now.peak_device_bytes) << ")"
+        << ", node pool: " << format_bytes(now.node_pool_bytes) << "\n";
+
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-12s %10s %14s %8s\n", "op", "tensors", "bytes", "ops");
+    out << "\n" << line;
+    for (auto &entry : now.tensors_by_op_type)
+    {
+        auto ops = now.ops_by_op_type.find(entry.first);
+        std::snprintf(line, sizeof(line), "%-12s %10lld %14s %8lld\n", entry.first.c_str(), entry.second,
+                      format_bytes(now.bytes_by_op_type[entry.first]).c_str(),
+                      ops == now.ops_by_op_type.end() ? 0LL : ops->second);
+        out << line;
+    }
+
+    std::vector<LiveGraph> graphs = largest_graphs(limit);
+    if (!graphs.empty())
+    {
+        std::snprintf(line, sizeof(line), "%-24s %8s %8s %14s\n", "graph root", "nodes", "ops", "bytes");
+        out << "\n" << line;
+        for (auto &graph : graphs)
+        {
+            std::string name = graph.root->label.empty() ? "<unlabeled>" : graph.root->label;
+            if (graph.root->op)
+            {
+                name += std::string(" (") + graph.root->op->op_type() + ")";
+            }
+            std::snprintf(line, sizeof(line), "%-24s %8d %8d %14s\n", name.c_str(), graph.num_nodes, graph.num_ops,
+                          format_bytes(graph.bytes).c_str());
+            out << line;
+        }
+    }
+    return out.str();
+}
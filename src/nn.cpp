@@ -2,18 +2,39 @@
 
 #include "nn.h"
 #include "tensor.h"
+#include "memory_stats.h"
+#include "random.h"
+#include "node_pool.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <memory>
 #include <random>
 #include <stdexcept>
+#include <unordered_set>
 
-float make_random()
+// New tensor with param's shape, values and device
+static std::shared_ptr<Tensor> clone_parameter(const std::shared_ptr<Tensor> &param)
 {
-    // Create a random float between -1 and 1
-    float random = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-    random = 2 * random - 1;
-    return random;
+    if (param->device == DeviceType::CUDA)
+    {
+        param->copy_to_host();
+    }
+    auto copy = std::make_shared<Tensor>(param->shape);
+    std::copy(param->data.begin(), param->data.end(), copy->data.begin());
+    copy->label = param->label;
+    if (param->device == DeviceType::CUDA)
+    {
+        copy->allocate_memory_on_device();
+        copy->device = DeviceType::CUDA;
+        copy->copy_to_device();
+    }
+    else
+    {
+        copy->device = DeviceType::CPU;
+    }
+    return copy;
 }
 
 Neuron::Neuron(int in_features, bool nonlin) : in_features(in_features), nonlin(nonlin)
@@ -57,6 +78,15 @@ std::vector<std::shared_ptr<Tensor>> Neuron::parameters()
     return {weights, bias};
 }
 
+std::shared_ptr<Module> Neuron::clone() const
+{
+    auto copy = std::make_shared<Neuron>(*this);
+    copy->flat = FlatParameters();
+    copy->weights = clone_parameter(weights);
+    copy->bias = clone_parameter(bias);
+    return copy;
+}
+
 Layer::Layer(int in_features, int out_features, bool nonlin) : in_features(in_features), out_features(out_features), nonlin(nonlin)
 {
     // Initialize neurons for the layer
@@ -80,8 +110,8 @@ std::shared_ptr<Tensor> Layer::operator()(std::shared_ptr<Tensor> input)
     }
 
     // Use StackOp to combine these into a single [out_features]-shaped tensor
-    auto stack_op = std::make_shared<StackOp>(neuron_outputs);
-    stack_op->forward();
+    auto stack_op = make_node<StackOp>(std::move(neuron_outputs));
+    stack_op->run_forward();
 
     return stack_op->output; // This output now has a proper op and children set
 }
@@ -97,6 +127,17 @@ std::vector<std::shared_ptr<Tensor>> Layer::parameters()
     return params;
 }
 
+std::shared_ptr<Module> Layer::clone() const
+{
+    auto copy = std::make_shared<Layer>(*this);
+    copy->flat = FlatParameters();
+    for (auto &neuron : copy->neurons)
+    {
+        neuron = std::static_pointer_cast<Neuron>(neuron->clone());
+    }
+    return copy;
+}
+
 MLP::MLP(int input_size, const std::vector<int> &layer_sizes)
 {
     if (layer_sizes.empty())
@@ -134,6 +175,255 @@ std::vector<std::shared_ptr<Tensor>> MLP::parameters()
     return params;
 }
 
+std::shared_ptr<Module> MLP::clone() const
+{
+    auto copy = std::make_shared<MLP>(*this);
+    copy->flat = FlatParameters();
+    for (auto &layer : copy->layers)
+    {
+        layer = std::static_pointer_cast<Layer>(layer->clone());
+    }
+    return copy;
+}
+
+// Tensor of the given shape, uniform in [-scale, scale], on the current device
+static std::shared_ptr<Tensor> random_parameter(const std::vector<int> &shape, float scale)
+{
+    auto param = std::make_shared<Tensor>(shape);
+    for (auto &value : param->data)
+    {
+        value = scale * make_random();
+    }
+    param->to_device(DeviceManager::get_instance().get_current_device());
+    return param;
+}
+
+LSTM::LSTM(int input_size, int hidden_size) : input_size(input_size), hidden_size(hidden_size)
+{
+    if (input_size < 1 || hidden_size < 1)
+    {
+        throw std::invalid_argument("LSTM sizes must be positive.");
+    }
+    const float scale = 1.0f / std::sqrt(static_cast<float>(hidden_size));
+    weight_ih = random_parameter({input_size, 4 * hidden_size}, scale);
+    weight_hh = random_parameter({hidden_size, 4 * hidden_size}, scale);
+    bias = random_parameter({4 * hidden_size}, scale);
+}
+
+std::shared_ptr<Tensor> LSTM::operator()(std::shared_ptr<Tensor> input)
+{
+    return forward(input, make_node<Tensor>(Shape{hidden_size}), make_node<Tensor>(Shape{hidden_size}));
+}
+
+std::shared_ptr<Tensor> LSTM::forward(std::shared_ptr<Tensor> input, std::shared_ptr<Tensor> h0, std::shared_ptr<Tensor> c0)
+{
+    auto op = make_node<LSTMCellOp>(std::vector<std::shared_ptr<Tensor>>{input, weight_ih, weight_hh, bias, h0, c0});
+    op->run_forward();
+    return op->output;
+}
+
+std::vector<std::shared_ptr<Tensor>> LSTM::parameters()
+{
+    return {weight_ih, weight_hh, bias};
+}
+
+std::shared_ptr<Module> LSTM::clone() const
+{
+    auto copy = std::make_shared<LSTM>(*this);
+    copy->flat = FlatParameters();
+    copy->weight_ih = clone_parameter(weight_ih);
+    copy->weight_hh = clone_parameter(weight_hh);
+    copy->bias = clone_parameter(bias);
+    return copy;
+}
+
+GRU::GRU(int input_size, int hidden_size) : input_size(input_size), hidden_size(hidden_size)
+{
+    if (input_size < 1 || hidden_size < 1)
+    {
+        throw std::invalid_argument("GRU sizes must be positive.");
+    }
+    const float scale = 1.0f / std::sqrt(static_cast<float>(hidden_size));
+    weight_ih = random_parameter({input_size, 3 * hidden_size}, scale);
+    weight_hh = random_parameter({hidden_size, 3 * hidden_size}, scale);
+    bias_ih = random_parameter({3 * hidden_size}, scale);
+    bias_hh = random_parameter({3 * hidden_size}, scale);
+}
+
+std::shared_ptr<Tensor> GRU::operator()(std::shared_ptr<Tensor> input)
+{
+    return forward(input, make_node<Tensor>(Shape{hidden_size}));
+}
+
+std::shared_ptr<Tensor> GRU::forward(std::shared_ptr<Tensor> input, std::shared_ptr<Tensor> h0)
+{
+    auto op = make_node<GRUCellOp>(std::vector<std::shared_ptr<Tensor>>{input, weight_ih, weight_hh, bias_ih, bias_hh, h0});
+    op->run_forward();
+    return op->output;
+}
+
+std::vector<std::shared_ptr<Tensor>> GRU::parameters()
+{
+    return {weight_ih, weight_hh, bias_ih, bias_hh};
+}
+
+std::shared_ptr<Module> GRU::clone() const
+{
+    auto copy = std::make_shared<GRU>(*this);
+    copy->flat = FlatParameters();
+    copy->weight_ih = clone_parameter(weight_ih);
+    copy->weight_hh = clone_parameter(weight_hh);
+    copy->bias_ih = clone_parameter(bias_ih);
+    copy->bias_hh = clone_parameter(bias_hh);
+    return copy;
+}
+
+SparseLinear::SparseLinear(int in_features, int out_features) : in_features(in_features), out_features(out_features)
+{
+    if (in_features < 1 || out_features < 1)
+    {
+        throw std::invalid_argument("SparseLinear sizes must be positive.");
+    }
+    const float scale = 1.0f / std::sqrt(static_cast<float>(in_features));
+    weight = random_parameter({in_features, out_features}, scale);
+    bias = random_parameter({out_features}, scale);
+}
+
+std::shared_ptr<Tensor> SparseLinear::operator()(std::shared_ptr<Tensor> input)
+{
+    if (input->device != DeviceType::CPU)
+    {
+        throw std::invalid_argument("SparseLinear is only supported on the CPU.");
+    }
+    if (input->shape.empty() || input->shape.size() > 2 || input->shape.back() != in_features)
+    {
+        throw std::invalid_argument("SparseLinear expected a [batch, " + std::to_string(in_features) + "] input");
+    }
+    const int batch = input->shape.size() == 2 ? input->shape[0] : 1;
+    return forward(SparseTensor::from_dense(input->data.data(), batch, in_features));
+}
+
+std::shared_ptr<Tensor> SparseLinear::forward(std::shared_ptr<const SparseTensor> input)
+{
+    return spmm(input, weight, bias);
+}
+
+std::vector<std::shared_ptr<Tensor>> SparseLinear::parameters()
+{
+    return {weight, bias};
+}
+
+std::shared_ptr<Module> SparseLinear::clone() const
+{
+    auto copy = std::make_shared<SparseLinear>(*this);
+    copy->flat = FlatParameters();
+    copy->weight = clone_parameter(weight);
+    copy->bias = clone_parameter(bias);
+    return copy;
+}
+
+bool contiguous_parameters(const std::vector<std::shared_ptr<Tensor>> &params, float *&data, float *&grad, size_t &count)
+{
+    if (params.empty())
+    {
+        return false;
+    }
+    data = params[0]->data.data();
+    grad = params[0]->grad.data();
+    count = 0;
+    for (auto &param : params)
+    {
+        if (param->device != DeviceType::CPU || param->data.data() != data + count || param->grad.data() != grad + count ||
+            param->grad.size() != param->data.size())
+        {
+            return false;
+        }
+        count += param->data.size();
+    }
+    return true;
+}
+
+void Module::zero_grad()
+{
+    auto params = parameters();
+    float *data, *grad;
+    size_t count;
+    if (contiguous_parameters(params, data, grad, count))
+    {
+        std::fill(grad, grad + count, 0.0f);
+        return;
+    }
+    for (auto &param : params)
+    {
+        param->zero_grad();
+    }
+}
+
+std::shared_ptr<Module> Module::clone() const
+{
+    throw std::logic_error("This module does not override clone(); DataParallel needs a clone() override.");
+}
+
+// Zeroed float storage starting on a 64-byte boundary
+static std::shared_ptr<float> allocate_aligned(size_t n)
+{
+    const size_t alignment = 64;
+    size_t padded = n + alignment / sizeof(float);
+    float *raw = new float[padded]();
+    void *first = raw;
+    size_t space = padded * sizeof(float);
+    std::align(alignment, n * sizeof(float), first, space);
+
+    long long bytes = static_cast<long long>(padded * sizeof(float));
+    MemoryStats::host_bytes_changed(bytes);
+    return std::shared_ptr<float>(static_cast<float *>(first), [raw, bytes](float *)
+                                  {
+        delete[] raw;
+        MemoryStats::host_bytes_changed(-bytes); });
+}
+
+void Module::flatten_parameters()
+{
+    // A tensor shared by several submodules gets a single slot
+    std::vector<std::shared_ptr<Tensor>> params;
+    std::unordered_set<Tensor *> seen;
+    size_t total = 0;
+    for (auto &param : parameters())
+    {
+        if (param->device != DeviceType::CPU)
+        {
+            throw std::invalid_argument("flatten_parameters() is only supported on the CPU.");
+        }
+        if (seen.insert(param.get()).second)
+        {
+            params.push_back(param);
+            total += param->size();
+        }
+    }
+
+    FlatParameters new_flat;
+    new_flat.data = allocate_aligned(total);
+    new_flat.grad = allocate_aligned(total);
+    new_flat.size = total;
+
+    size_t offset = 0;
+    for (auto &param : params)
+    {
+        size_t n = param->size();
+        float *data = new_flat.data.get() + offset;
+        float *grad = new_flat.grad.get() + offset;
+        std::copy(param->data.begin(), param->data.end(), data);
+        if (param->grad.size() == n)
+        {
+            std::copy(param->grad.begin(), param->grad.end(), grad);
+        }
+        param->data.bind(new_flat.data, data, n);
+        param->grad.bind(new_flat.grad, grad, n);
+        offset += n;
+    }
+    flat = new_flat;
+}
+
 std::ostream &operator<<(std::ostream &os, const Layer &layer)
 {
     os << "Layer(" << layer.in_features << "->" << layer.out_features << ", nonlin=" << (layer.nonlin ? "True" : "False") << ")";
@@ -0,0 +1,239 @@
+// node_pool.cpp
+
+#include "node_pool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    const size_t num_classes = node_pool::max_block_bytes / node_pool::block_align;
+    const size_t slab_bytes_each = 64 * 1024;
+    const size_t slabs_per_chunk = 32;
+
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    // The free lists of one thread, and of the slabs it carved. Outlives the
+    // thread: the next new thread adopts it, slabs and lists included.
+    struct Owner
+    {
+        FreeBlock *lists[num_classes] = {};
+        // Blocks of this owner's slabs freed by other threads, taken back
+        // all at once when lists[c] runs dry
+        std::atomic<FreeBlock *> remote[num_classes];
+        bool in_use = false; // Guarded by owners_mutex()
+
+        Owner()
+        {
+            for (auto &list : remote)
+            {
+                list.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    // Start of every slab; blocks follow it
+    struct alignas(node_pool::block_align) SlabHeader
+    {
+        Owner *owner;
+    };
+
+    // Returns the thread's owner when the thread exits
+    struct OwnerLease
+    {
+        Owner *owner = nullptr;
+        ~OwnerLease();
+    };
+}
+
+static std::atomic<long long> reserved_bytes{0};
+
+// Never destroyed: nodes owned by static objects may be freed after this file's statics
+static std::mutex &owners_mutex()
+{
+    static std::mutex *instance = new std::mutex();
+    return *instance;
+}
+
+static std::vector<Owner *> &owners()
+{
+    static std::vector<Owner *> *instance = new std::vector<Owner *>();
+    return *instance;
+}
+
+static Owner *acquire_owner()
+{
+    std::lock_guard<std::mutex> lock(owners_mutex());
+    for (Owner *owner : owners())
+    {
+        if (!owner->in_use)
+        {
+            owner->in_use = true;
+            return owner;
+        }
+    }
+    owners().push_back(new Owner());
+    owners().back()->in_use = true;
+    return owners().back();
+}
+
+static thread_local Owner *current_owner = nullptr;
+// Set once the lease is gone; blocks allocated afterwards (by other
+// thread_local destructors) come from exiting_owner()
+static thread_local bool thread_exited = false;
+static thread_local OwnerLease lease;
+
+OwnerLease::~OwnerLease()
+{
+    thread_exited = true;
+    current_owner = nullptr;
+    if (owner)
+    {
+        std::lock_guard<std::mutex> lock(owners_mutex());
+        owner->in_use = false;
+    }
+}
+
+static Owner *this_owner()
+{
+    if (!current_owner && !thread_exited)
+    {
+        current_owner = lease.owner = acquire_owner();
+    }
+    return current_owner;
+}
+
+// Shared by exiting threads, under its mutex
+static std::mutex &exiting_mutex()
+{
+    static std::mutex *instance = new std::mutex();
+    return *instance;
+}
+
+static Owner &exiting_owner()
+{
+    static Owner *instance = new Owner();
+    return *instance;
+}
+
+static size_t size_class(size_t bytes)
+{
+    return (bytes + node_pool::block_align - 1) / node_pool::block_align - 1;
+}
+
+// Slabs are slab_bytes_each aligned, so a block finds its header by masking
+static SlabHeader *slab_of(void *block)
+{
+    return reinterpret_cast<SlabHeader *>(reinterpret_cast<uintptr_t>(block) & ~(uintptr_t(slab_bytes_each) - 1));
+}
+
+// A new aligned slab, cut from chunks of slabs_per_chunk
+static char *new_slab()
+{
+    static std::mutex *mutex = new std::mutex();
+    static char *next = nullptr;
+    static size_t left = 0;
+
+    std::lock_guard<std::mutex> lock(*mutex);
+    if (left == 0)
+    {
+        // One extra slab's worth to align the first one
+        const size_t bytes = (slabs_per_chunk + 1) * slab_bytes_each;
+        char *chunk = static_cast<char *>(::operator new(bytes));
+        next = reinterpret_cast<char *>(slab_of(chunk + slab_bytes_each - 1));
+        left = slabs_per_chunk;
+    }
+    char *slab = next;
+    next += slab_bytes_each;
+    left--;
+    reserved_bytes.fetch_add(static_cast<long long>(slab_bytes_each), std::memory_order_relaxed);
+    return slab;
+}
+
+// A chain of free blocks of class c: those other threads gave back, or a new slab
+static FreeBlock *refill(Owner &owner, size_t c)
+{
+    if (FreeBlock *chain = owner.remote[c].exchange(nullptr, std::memory_order_acquire))
+    {
+        return chain;
+    }
+
+    const size_t block = (c + 1) * node_pool::block_align;
+    const size_t count = (slab_bytes_each - sizeof(SlabHeader)) / block;
+    char *slab = new_slab();
+    reinterpret_cast<SlabHeader *>(slab)->owner = &owner;
+    char *first = slab + sizeof(SlabHeader);
+    for (size_t i = 0; i + 1 < count; i++)
+    {
+        reinterpret_cast<FreeBlock *>(first + i * block)->next = reinterpret_cast<FreeBlock *>(first + (i + 1) * block);
+    }
+    reinterpret_cast<FreeBlock *>(first + (count - 1) * block)->next = nullptr;
+    return reinterpret_cast<FreeBlock *>(first);
+}
+
+static void *take(Owner &owner, size_t c)
+{
+    FreeBlock *&list = owner.lists[c];
+    if (!list)
+    {
+        list = refill(owner, c);
+    }
+    FreeBlock *block = list;
+    list = block->next;
+    return block;
+}
+
+void *node_pool::allocate(size_t bytes)
+{
+    if (bytes == 0 || bytes > max_block_bytes)
+    {
+        return ::operator new(bytes);
+    }
+    const size_t c = size_class(bytes);
+    if (Owner *owner = this_owner())
+    {
+        return take(*owner, c);
+    }
+    std::lock_guard<std::mutex> lock(exiting_mutex());
+    return take(exiting_owner(), c);
+}
+
+void node_pool::deallocate(void *block, size_t bytes) noexcept
+{
+    if (!block)
+    {
+        return;
+    }
+    if (bytes == 0 || bytes > max_block_bytes)
+    {
+        ::operator delete(block);
+        return;
+    }
+    const size_t c = size_class(bytes);
+    FreeBlock *freed = static_cast<FreeBlock *>(block);
+    Owner *owner = slab_of(block)->owner;
+    if (owner == this_owner())
+    {
+        freed->next = owner->lists[c];
+        owner->lists[c] = freed;
+        return;
+    }
+    // Back to the thread that carved the slab (e.g. the DataLoader worker
+    // that built a batch), so it reuses the block instead of a new slab
+    FreeBlock *head = owner->remote[c].load(std::memory_order_relaxed);
+    do
+    {
+        freed->next = head;
+    } while (!owner->remote[c].compare_exchange_weak(head, freed, std::memory_order_release,
+                                                     std::memory_order_relaxed));
+}
+
+long long node_pool::slab_bytes()
+{
+    return reserved_bytes.load(std::memory_order_relaxed);
+}
@@ -1,8 +1,49 @@
 #include <math.h>
+#include <atomic>
 #include <stdexcept>
 #include "op.h"
 #include "tensor.h"
 #include "op_cuda.h"
+#include "node_pool.h"
+#include "forward_ad.h"
+
+const char *op_kind_name(OpKind kind)
+{
+    switch (kind)
+    {
+    case OpKind::Add:
+        return "add";
+    case OpKind::Subtract:
+        return "sub";
+    case OpKind::Multiply:
+        return "mul";
+    case OpKind::Divide:
+        return "div";
+    case OpKind::Exp:
+        return "exp";
+    case OpKind::Tanh:
+        return "tanh";
+    case OpKind::Relu:
+        return "relu";
+    case OpKind::Sum:
+        return "sum";
+    case OpKind::Stack:
+        return "stack";
+    case OpKind::LSTM:
+        return "lstm";
+    case OpKind::GRU:
+        return "gru";
+    case OpKind::Attention:
+        return "attention";
+    case OpKind::SpMM:
+        return "spmm";
+    case OpKind::Fused:
+        return "fused";
+    case OpKind::Custom:
+        break;
+    }
+    return "custom";
+}
 
 // Utility functions for shape checks
 static void check_same_shape_for_binary(const std::vector<std::shared_ptr<Tensor>> &inputs)
@@ -25,21 +66,121 @@ static void check_one_input(const std::vector<std::shared_ptr<Tensor>> &inputs)
     }
 }
 
+// Creates the output tensor on the first forward() and reuses it afterwards,
+// so re-running forward (e.g. from a CapturedGraph) writes into the same buffers.
+void Op::allocate_output(const Shape &shape)
+{
+    if (inputs.empty())
+    {
+        throw std::logic_error("Op has no inputs (they are released by backward() unless retain_graph=True).");
+    }
+    if (!output || output->shape != shape)
+    {
+        // Created on the inputs' device, whatever the calling thread's is
+        DeviceGuard guard(inputs[0]->device);
+        output = make_node<Tensor>(shape);
+    }
+    output->device = inputs[0]->device;
+}
+
+uint64_t Op::next_id()
+{
+    static std::atomic<uint64_t> last_id{0};
+    return last_id.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+float *Op::input_grad(size_t k)
+{
+    return input_grads ? input_grads[k] : inputs[k]->grad.data();
+}
+
+void Op::detach_output()
+{
+    if (output)
+    {
+        output->op.reset();
+    }
+}
+
+// Micrograd-style graphs are mostly [1]-shaped CPU tensors. For those the
+// elementwise ops compute the one element directly, skipping the tangent
+// bookkeeping and the generic loops.
+bool Op::is_scalar() const
+{
+    if (output->device != DeviceType::CPU || output->data.size() != 1)
+    {
+        return false;
+    }
+    for (auto &input : inputs)
+    {
+        if (!input->tangent.empty())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Forward-mode AD: when any input carries a tangent, every op computes the
+// output tangent (its JVP rule) in the same loop as the primal. Inputs without
+// a tangent get a zero one so the fused loops need no special cases.
+bool Op::prepare_tangents()
+{
+    bool any = false;
+    for (auto &input : inputs)
+    {
+        any = any || !input->tangent.empty();
+    }
+    if (!any)
+    {
+        return false;
+    }
+    if (output->device != DeviceType::CPU)
+    {
+        throw std::invalid_argument("Forward-mode AD is only supported on the CPU.");
+    }
+    for (auto &input : inputs)
+    {
+        if (input->tangent.empty())
+        {
+            input->tangent.assign(input->size(), 0.0f);
+            record_tangent(*input);
+        }
+    }
+    output->tangent.assign(output->size(), 0.0f);
+    record_tangent(*output);
+    return true;
+}
+
 /////////////////// AddOp ///////////////////
 
 void AddOp::forward()
 {
     check_same_shape_for_binary(inputs);
-    output = std::make_shared<Tensor>(inputs[0]->shape);
-    output->device = inputs[0]->device; // assume same device
+    allocate_output(inputs[0]->shape); // assume same device
 
     int sz = output->size();
-    if (output->device == DeviceType::CPU)
+    if (is_scalar())
+    {
+        output->data[0] = inputs[0]->data[0] + inputs[1]->data[0];
+    }
+    else if (prepare_tangents())
     {
-        // CPU path
         for (int i = 0; i < sz; i++)
         {
             output->data[i] = inputs[0]->data[i] + inputs[1]->data[i];
+            output->tangent[i] = inputs[0]->tangent[i] + inputs[1]->tangent[i];
+        }
+    }
+    else if (output->device == DeviceType::CPU)
+    {
+        // CPU path
+        const float *a = inputs[0]->data.data();
+        const float *b = inputs[1]->data.data();
+        float *out = output->data.data();
+        for (int i = 0; i < sz; i++)
+        {
+            out[i] = a[i] + b[i];
         }
     }
     else
@@ -68,7 +209,6 @@ void AddOp::forward()
         // std::cout << "output-d_data after" << output_after << std::endl;
     }
     output->op = shared_from_this();
-    output->children = inputs;
 }
 
 void AddOp::backward()
@@ -77,10 +217,13 @@ void AddOp::backward()
     int sz = output->size();
     if (output->device == DeviceType::CPU)
     {
+        const float *d_out = output->grad.data();
+        float *d_a = input_grad(0);
+        float *d_b = input_grad(1);
         for (int i = 0; i < sz; i++)
         {
-            inputs[0]->grad[i] += output->grad[i];
-            inputs[1]->grad[i] += output->grad[i];
+            d_a[i] += d_out[i];
+            d_b[i] += d_out[i];
         }
     }
     else
@@ -97,15 +240,29 @@ void AddOp::backward()
 void SubtractOp::forward()
 {
     check_same_shape_for_binary(inputs);
-    output = std::make_shared<Tensor>(inputs[0]->shape);
-    output->device = inputs[0]->device;
+    allocate_output(inputs[0]->shape);
 
     int sz = output->size();
-    if (output->device == DeviceType::CPU)
+    if (is_scalar())
+    {
+        output->data[0] = inputs[0]->data[0] - inputs[1]->data[0];
+    }
+    else if (prepare_tangents())
     {
         for (int i = 0; i < sz; i++)
         {
             output->data[i] = inputs[0]->data[i] - inputs[1]->data[i];
+            output->tangent[i] = inputs[0]->tangent[i] - inputs[1]->tangent[i];
+        }
+    }
+    else if (output->device == DeviceType::CPU)
+    {
+        const float *a = inputs[0]->data.data();
+        const float *b = inputs[1]->data.data();
+        float *out = output->data.data();
+        for (int i = 0; i < sz; i++)
+        {
+            out[i] = a[i] - b[i];
         }
     }
     else
@@ -116,7 +273,6 @@ void SubtractOp::forward()
     }
 
     output->op = shared_from_this();
-    output->children = inputs;
 }
 
 void SubtractOp::backward()
@@ -124,10 +280,13 @@ void SubtractOp::backward()
     int sz = output->size();
     if (output->device == DeviceType::CPU)
     {
+        const float *d_out = output->grad.data();
+        float *d_a = input_grad(0);
+        float *d_b = input_grad(1);
         for (int i = 0; i < sz; i++)
         {
-            inputs[0]->grad[i] += output->grad[i];
-            inputs[1]->grad[i] -= output->grad[i];
+            d_a[i] += d_out[i];
+            d_b[i] -= d_out[i];
         }
     }
     else
@@ -146,15 +305,31 @@ void SubtractOp::backward()
 void MultiplyOp::forward()
 {
     check_same_shape_for_binary(inputs);
-    output = std::make_shared<Tensor>(inputs[0]->shape);
-    output->device = inputs[0]->device;
+    allocate_output(inputs[0]->shape);
 
     int sz = output->size();
-    if (output->device == DeviceType::CPU)
+    if (is_scalar())
+    {
+        output->data[0] = inputs[0]->data[0] * inputs[1]->data[0];
+    }
+    else if (prepare_tangents())
     {
         for (int i = 0; i < sz; i++)
         {
-            output->data[i] = inputs[0]->data[i] * inputs[1]->data[i];
+            float a = inputs[0]->data[i];
+            float b = inputs[1]->data[i];
+            output->data[i] = a * b;
+            output->tangent[i] = inputs[0]->tangent[i] * b + a * inputs[1]->tangent[i];
+        }
+    }
+    else if (output->device == DeviceType::CPU)
+    {
+        const float *a = inputs[0]->data.data();
+        const float *b = inputs[1]->data.data();
+        float *out = output->data.data();
+        for (int i = 0; i < sz; i++)
+        {
+            out[i] = a[i] * b[i];
         }
     }
     else
@@ -164,7 +339,6 @@ void MultiplyOp::forward()
     }
 
     output->op = shared_from_this();
-    output->children = inputs;
 }
 
 void MultiplyOp::backward()
@@ -172,10 +346,15 @@ void MultiplyOp::backward()
     int sz = output->size();
     if (output->device == DeviceType::CPU)
     {
+        const float *d_out = output->grad.data();
+        const float *a = inputs[0]->data.data();
+        const float *b = inputs[1]->data.data();
+        float *d_a = input_grad(0);
+        float *d_b = input_grad(1);
         for (int i = 0; i < sz; i++)
         {
-            inputs[0]->grad[i] += inputs[1]->data[i] * output->grad[i];
-            inputs[1]->grad[i] += inputs[0]->data[i] * output->grad[i];
+            d_a[i] += b[i] * d_out[i];
+            d_b[i] += a[i] * d_out[i];
         }
     }
     else
@@ -199,17 +378,37 @@ void MultiplyOp::backward()
 void DivideOp::forward()
 {
     check_same_shape_for_binary(inputs);
-    output = std::make_shared<Tensor>(inputs[0]->shape);
-    output->device = inputs[0]->device;
+    allocate_output(inputs[0]->shape);
 
     int sz = output->size();
-    if (output->device == DeviceType::CPU)
+    if (is_scalar())
+    {
+        if (inputs[1]->data[0] == 0.0f)
+            throw std::domain_error("Division by zero");
+        output->data[0] = inputs[0]->data[0] / inputs[1]->data[0];
+    }
+    else if (prepare_tangents())
+    {
+        for (int i = 0; i < sz; i++)
+        {
+            float a = inputs[0]->data[i];
+            float b = inputs[1]->data[i];
+            if (b == 0.0f)
+                throw std::domain_error("Division by zero");
+            output->data[i] = a / b;
+            output->tangent[i] = inputs[0]->tangent[i] / b - (a * inputs[1]->tangent[i]) / (b * b);
+        }
+    }
+    else if (output->device == DeviceType::CPU)
     {
+        const float *a = inputs[0]->data.data();
+        const float *b = inputs[1]->data.data();
+        float *out = output->data.data();
         for (int i = 0; i < sz; i++)
         {
-            if (inputs[1]->data[i] == 0.0f)
+            if (b[i] == 0.0f)
                 throw std::domain_error("Division by zero");
-            output->data[i] = inputs[0]->data[i] / inputs[1]->data[i];
+            out[i] = a[i] / b[i];
         }
     }
     else
@@ -222,7 +421,6 @@ void DivideOp::forward()
     }
 
     output->op = shared_from_this();
-    output->children = inputs;
 }
 
 void DivideOp::backward()
@@ -230,12 +428,15 @@ void DivideOp::backward()
     int sz = output->size();
     if (output->device == DeviceType::CPU)
     {
+        const float *d_out = output->grad.data();
+        const float *a = inputs[0]->data.data();
+        const float *b = inputs[1]->data.data();
+        float *d_a = input_grad(0);
+        float *d_b = input_grad(1);
         for (int i = 0; i < sz; i++)
         {
-            float a = inputs[0]->data[i];
-            float b = inputs[1]->data[i];
-            inputs[0]->grad[i] += output->grad[i] / b;
-            inputs[1]->grad[i] -= (a * output->grad[i]) / (b * b);
+            d_a[i] += d_out[i] / b[i];
+            d_b[i] -= (a[i] * d_out[i]) / (b[i] * b[i]);
         }
     }
     else
@@ -259,15 +460,29 @@ void DivideOp::backward()
 void ExpOp::forward()
 {
     check_one_input(inputs);
-    output = std::make_shared<Tensor>(inputs[0]->shape);
-    output->device = inputs[0]->device;
+    allocate_output(inputs[0]->shape);
 
     int sz = output->size();
-    if (output->device == DeviceType::CPU)
+    if (is_scalar())
+    {
+        output->data[0] = std::exp(inputs[0]->data[0]);
+    }
+    else if (prepare_tangents())
     {
         for (int i = 0; i < sz; i++)
         {
-            output->data[i] = std::exp(inputs[0]->data[i]);
+            float e = std::exp(inputs[0]->data[i]);
+            output->data[i] = e;
+            output->tangent[i] = e * inputs[0]->tangent[i];
+        }
+    }
+    else if (output->device == DeviceType::CPU)
+    {
+        const float *x = inputs[0]->data.data();
+        float *out = output->data.data();
+        for (int i = 0; i < sz; i++)
+        {
+            out[i] = std::exp(x[i]);
         }
     }
     else
@@ -279,7 +494,6 @@ void ExpOp::forward()
     }
 
     output->op = shared_from_this();
-    output->children = inputs;
 }
 
 void ExpOp::backward()
@@ -287,9 +501,13 @@ void ExpOp::backward()
     int sz = output->size();
     if (output->device == DeviceType::CPU)
     {
+        const float *d_out = output->grad.data();
+        const float *out = output->data.data();
+        float *d_x = input_grad(0);
         for (int i = 0; i < sz; i++)
         {
-            inputs[0]->grad[i] += std::exp(inputs[0]->data[i]) * output->grad[i];
+            // d/dx exp(x) = exp(x), which is the output
+            d_x[i] += out[i] * d_out[i];
         }
     }
     else
@@ -298,7 +516,7 @@ void ExpOp::backward()
 
         inputs[0]->allocate_memory_on_device();
 
-        exp_backward_cuda(output->d_grad, inputs[0]->d_data, inputs[0]->d_grad, sz);
+        exp_backward_cuda(output->d_grad, output->d_data, inputs[0]->d_grad, sz);
     }
 }
 
@@ -307,15 +525,29 @@ void ExpOp::backward()
 void TanhOp::forward()
 {
     check_one_input(inputs);
-    output = std::make_shared<Tensor>(inputs[0]->shape);
-    output->device = inputs[0]->device;
+    allocate_output(inputs[0]->shape);
 
     int sz = output->size();
-    if (output->device == DeviceType::CPU)
+    if (is_scalar())
+    {
+        output->data[0] = std::tanh(inputs[0]->data[0]);
+    }
+    else if (prepare_tangents())
+    {
+        for (int i = 0; i < sz; i++)
+        {
+            float t = std::tanh(inputs[0]->data[i]);
+            output->data[i] = t;
+            output->tangent[i] = (1.0f - t * t) * inputs[0]->tangent[i];
+        }
+    }
+    else if (output->device == DeviceType::CPU)
     {
+        const float *x = inputs[0]->data.data();
+        float *out = output->data.data();
         for (int i = 0; i < sz; i++)
         {
-            output->data[i] = std::tanh(inputs[0]->data[i]);
+            out[i] = std::tanh(x[i]);
         }
     }
     else
@@ -325,7 +557,6 @@ void TanhOp::forward()
     }
 
     output->op = shared_from_this();
-    output->children = inputs;
 }
 
 void TanhOp::backward()
@@ -333,10 +564,13 @@ void TanhOp::backward()
     int sz = output->size();
     if (output->device == DeviceType::CPU)
     {
+        const float *d_out = output->grad.data();
+        const float *out = output->data.data();
+        float *d_x = input_grad(0);
         for (int i = 0; i < sz; i++)
         {
-            float t = std::tanh(inputs[0]->data[i]);
-            inputs[0]->grad[i] += (1.0f - t * t) * output->grad[i];
+            float t = out[i];
+            d_x[i] += (1.0f - t * t) * d_out[i];
         }
     }
     else
@@ -354,15 +588,29 @@ void TanhOp::backward()
 void ReluOp::forward()
 {
     check_one_input(inputs);
-    output = std::make_shared<Tensor>(inputs[0]->shape);
-    output->device = inputs[0]->device;
+    allocate_output(inputs[0]->shape);
 
     int sz = output->size();
-    if (output->device == DeviceType::CPU)
+    if (is_scalar())
+    {
+        output->data[0] = inputs[0]->data[0] > 0.0f ? inputs[0]->data[0] : 0.0f;
+    }
+    else if (prepare_tangents())
     {
         for (int i = 0; i < sz; i++)
         {
-            output->data[i] = (inputs[0]->data[i] > 0.0f) ? inputs[0]->data[i] : 0.0f;
+            bool positive = inputs[0]->data[i] > 0.0f;
+            output->data[i] = positive ? inputs[0]->data[i] : 0.0f;
+            output->tangent[i] = positive ? inputs[0]->tangent[i] : 0.0f;
+        }
+    }
+    else if (output->device == DeviceType::CPU)
+    {
+        const float *x = inputs[0]->data.data();
+        float *out = output->data.data();
+        for (int i = 0; i < sz; i++)
+        {
+            out[i] = (x[i] > 0.0f) ? x[i] : 0.0f;
         }
     }
     else
@@ -372,7 +620,6 @@ void ReluOp::forward()
     }
 
     output->op = shared_from_this();
-    output->children = inputs;
 }
 
 void ReluOp::backward()
@@ -380,9 +627,13 @@ void ReluOp::backward()
     int sz = output->size();
     if (output->device == DeviceType::CPU)
     {
+        const float *d_out = output->grad.data();
+        const float *out = output->data.data();
+        float *d_x = input_grad(0);
         for (int i = 0; i < sz; i++)
         {
-            inputs[0]->grad[i] += (inputs[0]->data[i] > 0.0f) ? output->grad[i] : 0.0f;
+            // The output is positive exactly where the input is
+            d_x[i] += (out[i] > 0.0f) ? d_out[i] : 0.0f;
         }
     }
     else
@@ -391,7 +642,7 @@ void ReluOp::backward()
 
         inputs[0]->allocate_memory_on_device();
 
-        relu_backward_cuda(output->d_grad, inputs[0]->d_data, inputs[0]->d_grad, sz);
+        relu_backward_cuda(output->d_grad, output->d_data, inputs[0]->d_grad, sz);
     }
 }
 
@@ -400,12 +651,27 @@ void ReluOp::backward()
 void SumOp::forward()
 {
     check_one_input(inputs);
-    auto in = inputs[0];
-    output = std::make_shared<Tensor>(std::vector<int>{1});
-    output->device = in->device;
+    const auto &in = inputs[0];
+    allocate_output(Shape{1});
 
     int sz = in->size();
-    if (output->device == DeviceType::CPU)
+    if (is_scalar() && sz == 1)
+    {
+        output->data[0] = in->data[0];
+    }
+    else if (prepare_tangents())
+    {
+        float total = 0.0f;
+        float tangent_total = 0.0f;
+        for (int i = 0; i < sz; i++)
+        {
+            total += in->data[i];
+            tangent_total += in->tangent[i];
+        }
+        output->data[0] = total;
+        output->tangent[0] = tangent_total;
+    }
+    else if (output->device == DeviceType::CPU)
     {
         float total = 0.0f;
         for (auto v : in->data)
@@ -419,20 +685,20 @@ void SumOp::forward()
     }
 
     output->op = shared_from_this();
-    output->children = inputs;
 }
 
 void SumOp::backward()
 {
-    auto in = inputs[0];
+    const auto &in = inputs[0];
     int sz = in->size();
 
     if (output->device == DeviceType::CPU)
     {
         float grad_val = output->grad[0];
-        for (auto &g : in->grad)
+        float *d_x = input_grad(0);
+        for (int i = 0; i < sz; i++)
         {
-            g += grad_val;
+            d_x[i] += grad_val;
         }
     }
     else
@@ -453,10 +719,21 @@ void StackOp::forward()
 {
     // Suppose each input is shape [1]. Output is [N]
     int N = static_cast<int>(inputs.size());
-    output = std::make_shared<Tensor>(std::vector<int>{N});
-    output->device = inputs[0]->device; // assume all same device
+    allocate_output(Shape{N}); // assume all same device
 
-    if (output->device == DeviceType::CPU)
+    if (is_scalar())
+    {
+        output->data[0] = inputs[0]->data[0];
+    }
+    else if (prepare_tangents())
+    {
+        for (int i = 0; i < N; i++)
+        {
+            output->data[i] = inputs[i]->data[0];
+            output->tangent[i] = inputs[i]->tangent[0];
+        }
+    }
+    else if (output->device == DeviceType::CPU)
     {
         for (int i = 0; i < N; i++)
         {
@@ -486,7 +763,6 @@ void StackOp::forward()
     }
 
     output->op = shared_from_this();
-    output->children = inputs;
 }
 
 void StackOp::backward()
@@ -497,7 +773,7 @@ void StackOp::backward()
         float *g_out = output->grad.data();
         for (int i = 0; i < N; i++)
         {
-            inputs[i]->grad[0] += g_out[i];
+            input_grad(i)[0] += g_out[i];
         }
     }
     else
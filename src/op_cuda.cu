@@ -140,17 +140,16 @@ void exp_forward_cuda(const float* a, float* out, int size) {
     cudaDeviceSynchronize();
 }
 
-__global__ void exp_backward_kernel(const float* grad_out, const float* a, float* grad_a, int size) {
+__global__ void exp_backward_kernel(const float* grad_out, const float* out, float* grad_a, int size) {
     int idx = blockIdx.x * blockDim.x + threadIdx.x;
     if (idx < size) {
-        float val = expf(a[idx]);
-        grad_a[idx] += grad_out[idx] * val;
+        grad_a[idx] += grad_out[idx] * out[idx];
     }
 }
 
-void exp_backward_cuda(const float* grad_out, const float* a, float* grad_a, int size) {
+void exp_backward_cuda(const float* grad_out, const float* out, float* grad_a, int size) {
     int grid = getGridSize(size);
-    exp_backward_kernel<<<grid, 256>>>(grad_out, a, grad_a, size);
+    exp_backward_kernel<<<grid, 256>>>(grad_out, out, grad_a, size);
     cudaDeviceSynchronize();
 }
 
@@ -196,16 +195,16 @@ void relu_forward_cuda(const float* a, float* out, int size) {
     cudaDeviceSynchronize();
 }
 
-__global__ void relu_backward_kernel(const float* grad_out, const float* a, float* grad_a, int size) {
+__global__ void relu_backward_kernel(const float* grad_out, const float* out, float* grad_a, int size) {
     int idx = blockIdx.x * blockDim.x + threadIdx.x;
     if (idx < size) {
-        grad_a[idx] += (a[idx] > 0.0f) ? grad_out[idx] : 0.0f;
+        grad_a[idx] += (out[idx] > 0.0f) ? grad_out[idx] : 0.0f;
     }
 }
 
-void relu_backward_cuda(const float* grad_out, const float* a, float* grad_a, int size) {
+void relu_backward_cuda(const float* grad_out, const float* out, float* grad_a, int size) {
     int grid = getGridSize(size);
-    relu_backward_kernel<<<grid, 256>>>(grad_out, a, grad_a, size);
+    relu_backward_kernel<<<grid, 256>>>(grad_out, out, grad_a, size);
     cudaDeviceSynchronize();
 }
 
@@ -294,3 +293,79 @@ void sgd_step_cuda(float* param, float* grad, float lr, int size) {
     sgd_step_kernel<<<grid, 256>>>(param, grad, lr, size);
     cudaDeviceSynchronize();
 }
+
+// -------------------- SGD with momentum --------------------
+__global__ void sgd_momentum_step_kernel(float* param, const float* grad, float* velocity, float lr, float momentum,
+                                         bool nesterov, float weight_decay, float grad_scale, int size) {
+    int idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (idx < size) {
+        float g = grad[idx] * grad_scale + weight_decay * param[idx];
+        float buf = g;
+        if (velocity) {
+            buf = momentum * velocity[idx] + g;
+            velocity[idx] = buf;
+        }
+        param[idx] -= lr * (nesterov ? g + momentum * buf : buf);
+    }
+}
+
+void sgd_momentum_step_cuda(float* param, const float* grad, float* velocity, float lr, float momentum,
+                            bool nesterov, float weight_decay, float grad_scale, int size) {
+    int grid = getGridSize(size);
+    sgd_momentum_step_kernel<<<grid, 256>>>(param, grad, velocity, lr, momentum, nesterov, weight_decay, grad_scale, size);
+    cudaDeviceSynchronize();
+}
+
+// -------------------- Adam --------------------
+__global__ void adam_step_kernel(float* param, const float* grad, float* m, float* v, float step_size,
+                                 float inv_sqrt_bias_correction2, float beta1, float beta2, float eps,
+                                 float l2_decay, float decoupled_decay, float grad_scale, int size) {
+    int idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (idx < size) {
+        float p = param[idx] * (1.0f - decoupled_decay);
+        float g = grad[idx] * grad_scale + l2_decay * param[idx];
+        float mi = beta1 * m[idx] + (1.0f - beta1) * g;
+        float vi = beta2 * v[idx] + (1.0f - beta2) * g * g;
+        m[idx] = mi;
+        v[idx] = vi;
+        param[idx] = p - step_size * mi / (sqrtf(vi) * inv_sqrt_bias_correction2 + eps);
+    }
+}
+
+void adam_step_cuda(float* param, const float* grad, float* m, float* v, float step_size, float inv_sqrt_bias_correction2,
+                    float beta1, float beta2, float eps, float l2_decay, float decoupled_decay, float grad_scale, int size) {
+    int grid = getGridSize(size);
+    adam_step_kernel<<<grid, 256>>>(param, grad, m, v, step_size, inv_sqrt_bias_correction2, beta1, beta2, eps,
+                                    l2_decay, decoupled_decay, grad_scale, size);
+    cudaDeviceSynchronize();
+}
+
+// -------------------- Sum of squares --------------------
+__global__ void sum_squares_kernel(const float* a, float* out, int size) {
+    __shared__ float sdata[256];
+    int tid = threadIdx.x;
+    int idx = blockIdx.x * blockDim.x + threadIdx.x;
+    sdata[tid] = idx < size ? a[idx] * a[idx] : 0.0f;
+    __syncthreads();
+    for (int s = blockDim.x / 2; s > 0; s >>= 1) {
+        if (tid < s) {
+            sdata[tid] += sdata[tid + s];
+        }
+        __syncthreads();
+    }
+    if (tid == 0) {
+        atomicAdd(out, sdata[0]);
+    }
+}
+
+float sum_squares_cuda(const float* a, int size) {
+    float* d_out;
+    cudaMalloc(&d_out, sizeof(float));
+    cudaMemset(d_out, 0, sizeof(float));
+    int grid = getGridSize(size);
+    sum_squares_kernel<<<grid, 256>>>(a, d_out, size);
+    float result = 0.0f;
+    cudaMemcpy(&result, d_out, sizeof(float), cudaMemcpyDeviceToHost);
+    cudaFree(d_out);
+    return result;
+}
@@ -2,53 +2,423 @@
 
 #include "optimizer.h"
 #include "op_cuda.h"
+#include "nn.h"
+#include "thread_pool.h"
+#include "process_group.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef> // for size_t
+#include <mutex>
+#include <stdexcept>
+#include <cuda_runtime.h>
+
+namespace
+{
+    // Elements per parallel_for chunk; below this a step runs on one thread
+    const size_t step_grain = 1 << 15;
+
+    // One CPU parameter as seen by for_each_cpu_span: start is its position
+    // in the concatenation of all CPU parameters
+    struct CpuSpan
+    {
+        float *data;
+        const float *grad;
+        size_t offset;
+        size_t count;
+        size_t start;
+    };
+}
 
 // Optimizer Methods
 Optimizer::Optimizer(const std::vector<std::shared_ptr<Tensor>> &parameters)
     : parameters(parameters)
 {
+    state_offsets.reserve(parameters.size() + 1);
+    state_offsets.push_back(0);
+    for (auto &param : parameters)
+    {
+        state_offsets.push_back(state_offsets.back() + param->size());
+    }
 }
 
-Optimizer::~Optimizer() {}
+Optimizer::~Optimizer()
+{
+    if (d_state)
+    {
+        cudaFree(d_state);
+    }
+}
 
-void Optimizer::zero_grad()
+void Optimizer::set_max_grad_norm(float max_norm)
 {
-    for (auto &param : parameters)
+    if (max_norm < 0.0f)
     {
-        param->zero_grad();
+        throw std::invalid_argument("max_grad_norm must be non-negative.");
     }
+    max_grad_norm = max_norm;
 }
 
-// SGD Methods
-SGD::SGD(const std::vector<std::shared_ptr<Tensor>> &parameters, float lr)
-    : Optimizer(parameters), lr(lr)
+void Optimizer::set_process_group(std::shared_ptr<ProcessGroup> group, size_t bucket_elements)
 {
+    averager = group ? std::make_shared<GradientAverager>(group, parameters, bucket_elements) : nullptr;
 }
 
-void SGD::step()
+std::shared_ptr<ProcessGroup> Optimizer::get_process_group() const
+{
+    return averager ? averager->group() : nullptr;
+}
+
+void Optimizer::backward(const std::shared_ptr<Tensor> &loss)
+{
+    if (averager)
+    {
+        averager->backward(loss);
+    }
+    else
+    {
+        loss->backward();
+    }
+}
+
+float Optimizer::begin_step()
+{
+    if (averager)
+    {
+        averager->finish();
+    }
+    place_state();
+    return clip_scale();
+}
+
+bool Optimizer::flat_span(float *&data, float *&grad, size_t &count) const
+{
+    return contiguous_parameters(parameters, data, grad, count);
+}
+
+void Optimizer::for_each_cpu_span(const std::function<void(float *data, const float *grad, size_t offset, size_t count)> &update)
+{
+    std::vector<CpuSpan> spans;
+    float *flat_data, *flat_grad;
+    size_t flat_count;
+    if (flat_span(flat_data, flat_grad, flat_count))
+    {
+        spans.push_back({flat_data, flat_grad, 0, flat_count, 0});
+    }
+    else
+    {
+        size_t start = 0;
+        for (size_t i = 0; i < parameters.size(); i++)
+        {
+            auto &param = parameters[i];
+            if (param->device == DeviceType::CUDA || param->size() == 0)
+            {
+                continue;
+            }
+            size_t count = param->size();
+            spans.push_back({param->data.data(), param->grad.data(), state_offsets[i], count, start});
+            start += count;
+        }
+    }
+    if (spans.empty())
+    {
+        return;
+    }
+
+    // Each chunk covers [begin, end) of the concatenated parameters and
+    // updates the part of every span that falls inside it
+    size_t total = spans.back().start + spans.back().count;
+    parallel_for(total, step_grain, [&](size_t begin, size_t end)
+                 {
+        auto it = std::upper_bound(spans.begin(), spans.end(), begin,
+                                   [](size_t pos, const CpuSpan &span) { return pos < span.start; });
+        for (--it; it != spans.end() && it->start < end; ++it)
+        {
+            size_t lo = std::max(begin, it->start) - it->start;
+            size_t hi = std::min(end, it->start + it->count) - it->start;
+            update(it->data + lo, it->grad + lo, it->offset + lo, hi - lo);
+        } });
+}
+
+float Optimizer::clip_scale()
 {
+    if (max_grad_norm <= 0.0f)
+    {
+        return 1.0f;
+    }
+
+    // The global norm has to be known before any parameter is updated, so
+    // this is a separate read-only pass over the gradients
+    double sum = 0.0;
+    std::mutex sum_mutex;
+    for_each_cpu_span([&](float *, const float *grad, size_t, size_t count)
+                      {
+        double partial = 0.0;
+        for (size_t i = 0; i < count; i++)
+        {
+            partial += static_cast<double>(grad[i]) * grad[i];
+        }
+        std::lock_guard<std::mutex> lock(sum_mutex);
+        sum += partial; });
     for (auto &param : parameters)
     {
-        int sz = param->size();
         if (param->device == DeviceType::CUDA)
         {
-            // Ensure memory is allocated and data is on the device
             param->allocate_memory_on_device();
+            sum += sum_squares_cuda(param->d_grad, param->size());
+        }
+    }
 
-            // Launch CUDA kernel for SGD step
-            sgd_step_cuda(param->d_data, param->d_grad, lr, sz);
+    grad_norm = static_cast<float>(std::sqrt(sum));
+    return grad_norm > max_grad_norm ? max_grad_norm / (grad_norm + 1e-6f) : 1.0f;
+}
 
-            // Optionally, copy updated data back to host if needed
-            // param->copy_to_host();
+void Optimizer::allocate_state(int num_slots)
+{
+    state.assign(num_slots * num_elements(), 0.0f);
+    state_on_device.assign(parameters.size(), 0);
+}
+
+void Optimizer::place_state()
+{
+    if (state.empty())
+    {
+        return;
+    }
+    const size_t num_slots = state.size() / num_elements();
+    for (size_t i = 0; i < parameters.size(); i++)
+    {
+        const bool on_device = parameters[i]->device == DeviceType::CUDA;
+        if (on_device == static_cast<bool>(state_on_device[i]))
+        {
+            continue;
         }
-        else // CPU
+        if (!d_state)
         {
-            for (int i = 0; i < sz; i++)
+            cudaMalloc(&d_state, state.size() * sizeof(float));
+        }
+        const size_t bytes = (state_offsets[i + 1] - state_offsets[i]) * sizeof(float);
+        for (size_t slot = 0; slot < num_slots; slot++)
+        {
+            float *host = state_at(static_cast<int>(slot), state_offsets[i]);
+            float *device = device_state_at(static_cast<int>(slot), state_offsets[i]);
+            if (on_device)
+            {
+                cudaMemcpy(device, host, bytes, cudaMemcpyHostToDevice);
+            }
+            else
             {
-                param->data[i] -= lr * param->grad[i];
+                cudaMemcpy(host, device, bytes, cudaMemcpyDeviceToHost);
             }
         }
+        state_on_device[i] = on_device;
+    }
+}
+
+void Optimizer::copy_state_from(const Optimizer &other)
+{
+    if (state_offsets != other.state_offsets)
+    {
+        throw std::invalid_argument("Optimizer clone needs parameters of the same sizes.");
+    }
+    state = other.state;
+    state_on_device = other.state_on_device;
+    if (other.d_state)
+    {
+        if (!d_state)
+        {
+            cudaMalloc(&d_state, state.size() * sizeof(float));
+        }
+        cudaMemcpy(d_state, other.d_state, state.size() * sizeof(float), cudaMemcpyDeviceToDevice);
+    }
+    max_grad_norm = other.max_grad_norm;
+    grad_norm = other.grad_norm;
+}
+
+void Optimizer::zero_grad()
+{
+    float *data, *grad;
+    size_t count;
+    if (flat_span(data, grad, count))
+    {
+        std::fill(grad, grad + count, 0.0f);
+        return;
+    }
+    for (auto &param : parameters)
+    {
+        param->zero_grad();
+    }
+}
+
+std::shared_ptr<Optimizer> Optimizer::clone(const std::vector<std::shared_ptr<Tensor>> &) const
+{
+    throw std::logic_error("This optimizer does not override clone(); DataParallel needs a clone() override.");
+}
+
+// SGD Methods
+SGD::SGD(const std::vector<std::shared_ptr<Tensor>> &parameters, float lr,
+         float momentum, bool nesterov, float weight_decay)
+    : Optimizer(parameters), lr(lr), momentum(momentum), nesterov(nesterov), weight_decay(weight_decay)
+{
+    if (momentum < 0.0f || weight_decay < 0.0f)
+    {
+        throw std::invalid_argument("SGD momentum and weight_decay must be non-negative.");
+    }
+    if (nesterov && momentum == 0.0f)
+    {
+        throw std::invalid_argument("Nesterov momentum requires momentum > 0.");
+    }
+    if (momentum != 0.0f)
+    {
+        allocate_state(1);
+    }
+}
+
+std::shared_ptr<Optimizer> SGD::clone(const std::vector<std::shared_ptr<Tensor>> &parameters) const
+{
+    auto copy = std::make_shared<SGD>(parameters, lr, momentum, nesterov, weight_decay);
+    copy->copy_state_from(*this);
+    return copy;
+}
+
+void SGD::step()
+{
+    const float scale = begin_step();
+    const float lr = this->lr;
+    const float momentum = this->momentum;
+    const bool nesterov = this->nesterov;
+    const float weight_decay = this->weight_decay;
+
+    if (momentum == 0.0f)
+    {
+        const float scaled_lr = lr * scale;
+        for_each_cpu_span([&](float *data, const float *grad, size_t, size_t count)
+                          {
+            for (size_t i = 0; i < count; i++)
+            {
+                data[i] -= lr * weight_decay * data[i] + scaled_lr * grad[i];
+            } });
+    }
+    else
+    {
+        for_each_cpu_span([&](float *data, const float *grad, size_t offset, size_t count)
+                          {
+            float *velocity = state_at(0, offset);
+            for (size_t i = 0; i < count; i++)
+            {
+                float g = grad[i] * scale + weight_decay * data[i];
+                float buf = momentum * velocity[i] + g;
+                velocity[i] = buf;
+                data[i] -= lr * (nesterov ? g + momentum * buf : buf);
+            } });
+    }
+
+    for (size_t i = 0; i < parameters.size(); i++)
+    {
+        auto &param = parameters[i];
+        if (param->device != DeviceType::CUDA)
+        {
+            continue;
+        }
+        // Ensure memory is allocated and data is on the device
+        param->allocate_memory_on_device();
+        int sz = param->size();
+        if (momentum == 0.0f && weight_decay == 0.0f && scale == 1.0f)
+        {
+            sgd_step_cuda(param->d_data, param->d_grad, lr, sz);
+        }
+        else
+        {
+            // Without momentum there is no velocity state to update
+            sgd_momentum_step_cuda(param->d_data, param->d_grad,
+                                   momentum != 0.0f ? device_state_at(0, state_offsets[i]) : nullptr,
+                                   lr, momentum, nesterov, weight_decay, scale, sz);
+        }
+    }
+}
+
+// Adam Methods
+Adam::Adam(const std::vector<std::shared_ptr<Tensor>> &parameters, float lr,
+           float beta1, float beta2, float eps, float weight_decay)
+    : Optimizer(parameters), lr(lr), beta1(beta1), beta2(beta2), eps(eps), weight_decay(weight_decay)
+{
+    if (beta1 < 0.0f || beta1 >= 1.0f || beta2 < 0.0f || beta2 >= 1.0f)
+    {
+        throw std::invalid_argument("Adam betas must be in [0, 1).");
     }
+    if (eps <= 0.0f || weight_decay < 0.0f)
+    {
+        throw std::invalid_argument("Adam eps must be positive and weight_decay non-negative.");
+    }
+    // Slot 0: first moment, slot 1: second moment
+    allocate_state(2);
+}
+
+std::shared_ptr<Optimizer> Adam::clone(const std::vector<std::shared_ptr<Tensor>> &parameters) const
+{
+    auto copy = std::make_shared<Adam>(parameters, lr, beta1, beta2, eps, weight_decay);
+    copy->copy_state_from(*this);
+    copy->step_count = step_count;
+    return copy;
+}
+
+void Adam::step()
+{
+    const float scale = begin_step();
+    step_count++;
+
+    // Bias corrections folded into the step size and the denominator:
+    //   p -= lr / bc1 * m / (sqrt(v) / sqrt(bc2) + eps)
+    const float bias_correction1 = 1.0f - static_cast<float>(std::pow(beta1, step_count));
+    const float bias_correction2 = 1.0f - static_cast<float>(std::pow(beta2, step_count));
+    const float step_size = lr / bias_correction1;
+    const float inv_sqrt_bc2 = 1.0f / std::sqrt(bias_correction2);
+    const float l2_decay = decoupled_weight_decay ? 0.0f : weight_decay;
+    const float decoupled_decay = decoupled_weight_decay ? lr * weight_decay : 0.0f;
+    const float beta1 = this->beta1;
+    const float beta2 = this->beta2;
+    const float eps = this->eps;
+
+    for_each_cpu_span([&](float *data, const float *grad, size_t offset, size_t count)
+                      {
+        float *m = state_at(0, offset);
+        float *v = state_at(1, offset);
+        for (size_t i = 0; i < count; i++)
+        {
+            float g = grad[i] * scale + l2_decay * data[i];
+            float mi = beta1 * m[i] + (1.0f - beta1) * g;
+            float vi = beta2 * v[i] + (1.0f - beta2) * g * g;
+            m[i] = mi;
+            v[i] = vi;
+            data[i] = data[i] * (1.0f - decoupled_decay) - step_size * mi / (std::sqrt(vi) * inv_sqrt_bc2 + eps);
+        } });
+
+    for (size_t i = 0; i < parameters.size(); i++)
+    {
+        auto &param = parameters[i];
+        if (param->device != DeviceType::CUDA)
+        {
+            continue;
+        }
+        param->allocate_memory_on_device();
+        adam_step_cuda(param->d_data, param->d_grad, device_state_at(0, state_offsets[i]),
+                       device_state_at(1, state_offsets[i]), step_size, inv_sqrt_bc2, beta1, beta2, eps,
+                       l2_decay, decoupled_decay, scale, param->size());
+    }
+}
+
+// AdamW Methods
+AdamW::AdamW(const std::vector<std::shared_ptr<Tensor>> &parameters, float lr,
+             float beta1, float beta2, float eps, float weight_decay)
+    : Adam(parameters, lr, beta1, beta2, eps, weight_decay)
+{
+    decoupled_weight_decay = true;
+}
+
+std::shared_ptr<Optimizer> AdamW::clone(const std::vector<std::shared_ptr<Tensor>> &parameters) const
+{
+    auto copy = std::make_shared<AdamW>(parameters, lr, beta1, beta2, eps, weight_decay);
+    copy->copy_state_from(*this);
+    copy->step_count = step_count;
+    return copy;
 }
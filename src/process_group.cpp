@@ -0,0 +1,633 @@
+// process_group.cpp
+
+#include "process_group.h"
+#include "nn.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cuda_runtime.h>
+
+namespace
+{
+    double seconds_since(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::runtime_error socket_error(const std::string &what)
+    {
+        return std::runtime_error("ProcessGroup: " + what + ": " + std::strerror(errno));
+    }
+
+    sockaddr_in resolve(const std::string &host, int port)
+    {
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *result = nullptr;
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || !result)
+        {
+            throw std::invalid_argument("ProcessGroup: cannot resolve host " + host + ".");
+        }
+        sockaddr_in addr = *reinterpret_cast<sockaddr_in *>(result->ai_addr);
+        freeaddrinfo(result);
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        return addr;
+    }
+
+    // Blocking send/recv of exactly n bytes (used during the handshake only)
+    void send_all(int fd, const void *data, size_t n)
+    {
+        const char *p = static_cast<const char *>(data);
+        while (n > 0)
+        {
+            ssize_t sent = send(fd, p, n, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (sent <= 0)
+            {
+                throw socket_error("send failed");
+            }
+            p += sent;
+            n -= sent;
+        }
+    }
+
+    void recv_all(int fd, void *data, size_t n)
+    {
+        char *p = static_cast<char *>(data);
+        while (n > 0)
+        {
+            ssize_t got = recv(fd, p, n, 0);
+            if (got < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (got <= 0)
+            {
+                throw socket_error("connection closed during handshake");
+            }
+            p += got;
+            n -= got;
+        }
+    }
+
+    void configure(int fd)
+    {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+}
+
+// Work
+
+void Work::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    finished_cv.wait(lock, [this]
+                     { return finished; });
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+bool Work::done()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return finished;
+}
+
+// ProcessGroup
+
+ProcessGroup::ProcessGroup(int rank, int world_size, const std::string &host, int base_port, double timeout_seconds)
+    : rank_(rank), world_size_(world_size), timeout_seconds(timeout_seconds)
+{
+    if (world_size <= 0 || rank < 0 || rank >= world_size)
+    {
+        throw std::invalid_argument("ProcessGroup needs 0 <= rank < world_size.");
+    }
+
+    if (world_size > 1)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        // Listen for the previous rank
+        int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd < 0)
+        {
+            throw socket_error("socket failed");
+        }
+        int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in listen_addr = resolve(host, base_port + rank);
+        if (bind(listen_fd, reinterpret_cast<sockaddr *>(&listen_addr), sizeof(listen_addr)) != 0 || listen(listen_fd, 1) != 0)
+        {
+            close(listen_fd);
+            throw socket_error("cannot listen on port " + std::to_string(base_port + rank));
+        }
+
+        try
+        {
+            // Connect to the next rank, retrying until it listens
+            int next = (rank + 1) % world_size;
+            sockaddr_in next_addr = resolve(host, base_port + next);
+            while (true)
+            {
+                next_fd = socket(AF_INET, SOCK_STREAM, 0);
+                if (connect(next_fd, reinterpret_cast<sockaddr *>(&next_addr), sizeof(next_addr)) == 0)
+                {
+                    break;
+                }
+                close(next_fd);
+                next_fd = -1;
+                if (seconds_since(start) > timeout_seconds)
+                {
+                    throw std::runtime_error("ProcessGroup: timed out connecting to rank " + std::to_string(next) + ".");
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+            int32_t my_rank = rank;
+            send_all(next_fd, &my_rank, sizeof(my_rank));
+
+            // Accept the previous rank
+            pollfd pfd = {listen_fd, POLLIN, 0};
+            int remaining_ms = static_cast<int>(std::max(0.0, timeout_seconds - seconds_since(start)) * 1000);
+            if (poll(&pfd, 1, remaining_ms) <= 0)
+            {
+                throw std::runtime_error("ProcessGroup: timed out waiting for rank " +
+                                         std::to_string((rank + world_size - 1) % world_size) + ".");
+            }
+            prev_fd = accept(listen_fd, nullptr, nullptr);
+            if (prev_fd < 0)
+            {
+                throw socket_error("accept failed");
+            }
+            int32_t peer_rank = -1;
+            recv_all(prev_fd, &peer_rank, sizeof(peer_rank));
+            if (peer_rank != (rank + world_size - 1) % world_size)
+            {
+                throw std::runtime_error("ProcessGroup: unexpected peer rank " + std::to_string(peer_rank) + ".");
+            }
+        }
+        catch (...)
+        {
+            close(listen_fd);
+            if (next_fd >= 0)
+            {
+                close(next_fd);
+            }
+            if (prev_fd >= 0)
+            {
+                close(prev_fd);
+            }
+            throw;
+        }
+        close(listen_fd);
+        configure(next_fd);
+        configure(prev_fd);
+    }
+
+    comm_thread = std::thread(&ProcessGroup::comm_loop, this);
+}
+
+ProcessGroup::~ProcessGroup()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queue_cv.notify_all();
+    comm_thread.join();
+    if (next_fd >= 0)
+    {
+        close(next_fd);
+    }
+    if (prev_fd >= 0)
+    {
+        close(prev_fd);
+    }
+}
+
+std::shared_ptr<ProcessGroup> ProcessGroup::from_env()
+{
+    auto get = [](const char *name, const char *fallback)
+    {
+        const char *value = std::getenv(name);
+        if (!value && !fallback)
+        {
+            throw std::invalid_argument(std::string("ProcessGroup.from_env: ") + name + " is not set.");
+        }
+        return std::string(value ? value : fallback);
+    };
+    return std::make_shared<ProcessGroup>(std::stoi(get("RANK", nullptr)), std::stoi(get("WORLD_SIZE", nullptr)),
+                                          get("MASTER_ADDR", "127.0.0.1"), std::stoi(get("MASTER_PORT", "29500")));
+}
+
+void ProcessGroup::all_reduce(float *data, size_t count)
+{
+    all_reduce_async(data, count)->wait();
+}
+
+void ProcessGroup::broadcast(float *data, size_t count, int root)
+{
+    broadcast_async(data, count, root)->wait();
+}
+
+void ProcessGroup::barrier()
+{
+    auto token = std::make_shared<float>(0.0f);
+    all_reduce_async(token.get(), 1, token)->wait();
+}
+
+std::shared_ptr<Work> ProcessGroup::all_reduce_async(float *data, size_t count, std::shared_ptr<void> keep_alive)
+{
+    return enqueue([this, data, count]
+                   { ring_all_reduce(data, count); }, std::move(keep_alive));
+}
+
+std::shared_ptr<Work> ProcessGroup::broadcast_async(float *data, size_t count, int root, std::shared_ptr<void> keep_alive)
+{
+    if (root < 0 || root >= world_size_)
+    {
+        throw std::invalid_argument("ProcessGroup.broadcast: root " + std::to_string(root) + " is not a rank.");
+    }
+    return enqueue([this, data, count, root]
+                   { ring_broadcast(data, count, root); }, std::move(keep_alive));
+}
+
+std::shared_ptr<Work> ProcessGroup::enqueue(std::function<void()> collective, std::shared_ptr<void> keep_alive)
+{
+    auto work = std::make_shared<Work>();
+    work->keep_alive = std::move(keep_alive);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.emplace_back(std::move(collective), work);
+    }
+    queue_cv.notify_one();
+    return work;
+}
+
+void ProcessGroup::comm_loop()
+{
+    while (true)
+    {
+        std::pair<std::function<void()>, std::shared_ptr<Work>> item;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queue_cv.wait(lock, [this]
+                          { return stopping || !queue.empty(); });
+            if (queue.empty())
+            {
+                return;
+            }
+            item = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        std::exception_ptr error;
+        try
+        {
+            item.first();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        Work &work = *item.second;
+        std::lock_guard<std::mutex> lock(work.mutex);
+        work.finished = true;
+        work.error = error;
+        work.keep_alive.reset();
+        work.finished_cv.notify_all();
+    }
+}
+
+void ProcessGroup::exchange(const void *send_data, size_t send_bytes, void *recv_data, size_t recv_bytes)
+{
+    const char *send_ptr = static_cast<const char *>(send_data);
+    char *recv_ptr = static_cast<char *>(recv_data);
+    auto start = std::chrono::steady_clock::now();
+
+    while (send_bytes > 0 || recv_bytes > 0)
+    {
+        pollfd fds[2];
+        int n = 0;
+        int send_index = -1;
+        int recv_index = -1;
+        if (send_bytes > 0)
+        {
+            send_index = n;
+            fds[n++] = {next_fd, POLLOUT, 0};
+        }
+        if (recv_bytes > 0)
+        {
+            recv_index = n;
+            fds[n++] = {prev_fd, POLLIN, 0};
+        }
+        int ready = poll(fds, n, 1000);
+        if (ready < 0 && errno != EINTR)
+        {
+            throw socket_error("poll failed");
+        }
+        if (ready <= 0)
+        {
+            if (seconds_since(start) > timeout_seconds)
+            {
+                throw std::runtime_error("ProcessGroup: timed out waiting for a peer.");
+            }
+            continue;
+        }
+
+        if (send_index >= 0 && fds[send_index].revents)
+        {
+            ssize_t sent = send(next_fd, send_ptr, send_bytes, MSG_NOSIGNAL);
+            if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                throw socket_error("send to rank " + std::to_string((rank_ + 1) % world_size_) + " failed");
+            }
+            if (sent > 0)
+            {
+                send_ptr += sent;
+                send_bytes -= sent;
+            }
+        }
+        if (recv_index >= 0 && fds[recv_index].revents)
+        {
+            ssize_t got = recv(prev_fd, recv_ptr, recv_bytes, 0);
+            if (got == 0)
+            {
+                throw std::runtime_error("ProcessGroup: rank " + std::to_string((rank_ + world_size_ - 1) % world_size_) +
+                                         " closed the connection.");
+            }
+            if (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                throw socket_error("recv failed");
+            }
+            if (got > 0)
+            {
+                recv_ptr += got;
+                recv_bytes -= got;
+            }
+        }
+    }
+}
+
+void ProcessGroup::ring_all_reduce(float *data, size_t count)
+{
+    int n = world_size_;
+    if (n == 1 || count == 0)
+    {
+        return;
+    }
+
+    // Chunk c covers [count * c / n, count * (c + 1) / n)
+    auto chunk_begin = [count, n](int c)
+    { return count * c / n; };
+    auto chunk_size = [&](int c)
+    { return chunk_begin(c + 1) - chunk_begin(c); };
+    scratch.resize(count / n + 1);
+
+    // Reduce-scatter: after n - 1 steps rank r holds the full sum of chunk r + 1
+    for (int step = 0; step < n - 1; step++)
+    {
+        int send_chunk = ((rank_ - step) % n + n) % n;
+        int recv_chunk = ((rank_ - step - 1) % n + n) % n;
+        exchange(data + chunk_begin(send_chunk), chunk_size(send_chunk) * sizeof(float),
+                 scratch.data(), chunk_size(recv_chunk) * sizeof(float));
+        float *target = data + chunk_begin(recv_chunk);
+        for (size_t i = 0, size = chunk_size(recv_chunk); i < size; i++)
+        {
+            target[i] += scratch[i];
+        }
+    }
+
+    // All-gather: pass the reduced chunks around the ring
+    for (int step = 0; step < n - 1; step++)
+    {
+        int send_chunk = ((rank_ + 1 - step) % n + n) % n;
+        int recv_chunk = ((rank_ - step) % n + n) % n;
+        exchange(data + chunk_begin(send_chunk), chunk_size(send_chunk) * sizeof(float),
+                 data + chunk_begin(recv_chunk), chunk_size(recv_chunk) * sizeof(float));
+    }
+}
+
+void ProcessGroup::ring_broadcast(float *data, size_t count, int root)
+{
+    if (world_size_ == 1 || count == 0)
+    {
+        return;
+    }
+    // Pass the data along the ring from root; the rank before root does not forward
+    int last = (root + world_size_ - 1) % world_size_;
+    size_t bytes = count * sizeof(float);
+    if (rank_ != root)
+    {
+        exchange(nullptr, 0, data, bytes);
+    }
+    if (rank_ != last)
+    {
+        exchange(data, bytes, nullptr, 0);
+    }
+}
+
+// GradientAverager
+
+GradientAverager::GradientAverager(std::shared_ptr<ProcessGroup> group, const std::vector<std::shared_ptr<Tensor>> &parameters,
+                                   size_t bucket_elements)
+    : process_group(std::move(group)), parameters(parameters), bucket_elements(bucket_elements)
+{
+    if (!process_group || bucket_elements == 0)
+    {
+        throw std::invalid_argument("GradientAverager needs a process group and a positive bucket size.");
+    }
+}
+
+void GradientAverager::backward(const std::shared_ptr<Tensor> &loss)
+{
+    if (in_flight)
+    {
+        throw std::logic_error("backward() called twice without an optimizer step in between.");
+    }
+
+    float *data, *grad;
+    size_t count;
+    if (process_group->world_size() == 1 || !contiguous_parameters(parameters, data, grad, count))
+    {
+        // Reduced synchronously in finish()
+        loss->backward();
+        return;
+    }
+
+    // (Re)build the buckets for the current flat layout
+    if (grad != flat_grad || count != flat_count)
+    {
+        flat_grad = grad;
+        flat_count = count;
+        buckets.clear();
+        bucket_of.clear();
+        size_t offset = 0;
+        for (auto &param : parameters)
+        {
+            if (buckets.empty() || buckets.back()->end - buckets.back()->begin >= bucket_elements)
+            {
+                buckets.emplace_back(new Bucket());
+                buckets.back()->begin = offset;
+            }
+            offset += param->size();
+            buckets.back()->end = offset;
+            buckets.back()->num_params++;
+            bucket_of[param.get()] = buckets.size() - 1;
+        }
+    }
+
+    for (auto &bucket : buckets)
+    {
+        bucket->pending.store(bucket->num_params);
+        bucket->ready = false;
+        bucket->work = nullptr;
+    }
+    launched = 0;
+    in_flight = true;
+
+    try
+    {
+        loss->backward(false, [this](Tensor &leaf)
+                       {
+            auto it = bucket_of.find(&leaf);
+            if (it != bucket_of.end() && buckets[it->second]->pending.fetch_sub(1) == 1)
+            {
+                mark_ready(it->second);
+            } });
+    }
+    catch (...)
+    {
+        // Buckets already launched stay launched: the other ranks are left
+        // waiting in those collectives until this rank calls backward() again
+        in_flight = false;
+        throw;
+    }
+}
+
+void GradientAverager::mark_ready(size_t bucket)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    buckets[bucket]->ready = true;
+    launch_ready();
+}
+
+void GradientAverager::launch_ready()
+{
+    // Launch in a fixed order, last bucket first (the order backward
+    // usually finishes them), so all ranks issue the same collectives
+    while (launched < buckets.size())
+    {
+        Bucket &bucket = *buckets[buckets.size() - 1 - launched];
+        if (!bucket.ready)
+        {
+            return;
+        }
+        bucket.work = process_group->all_reduce_async(flat_grad + bucket.begin, bucket.end - bucket.begin);
+        launched++;
+    }
+}
+
+void GradientAverager::finish()
+{
+    int world_size = process_group->world_size();
+    if (world_size == 1)
+    {
+        return;
+    }
+
+    if (!in_flight)
+    {
+        sync_all();
+    }
+    else
+    {
+        in_flight = false;
+        {
+            // Buckets whose parameters the loss does not reach
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto &bucket : buckets)
+            {
+                bucket->ready = true;
+            }
+            launch_ready();
+        }
+        for (auto &bucket : buckets)
+        {
+            bucket->work->wait();
+        }
+        float scale = 1.0f / world_size;
+        for (size_t i = 0; i < flat_count; i++)
+        {
+            flat_grad[i] *= scale;
+        }
+    }
+}
+
+void GradientAverager::sync_all()
+{
+    // Pack every gradient into one buffer, reduce it and unpack the mean
+    size_t total = 0;
+    for (auto &param : parameters)
+    {
+        total += param->size();
+    }
+    staging.resize(total);
+
+    size_t offset = 0;
+    for (auto &param : parameters)
+    {
+        param->allocate_grad();
+        if (param->device == DeviceType::CUDA)
+        {
+            cudaMemcpy(staging.data() + offset, param->d_grad, param->size() * sizeof(float), cudaMemcpyDeviceToHost);
+        }
+        else
+        {
+            std::copy(param->grad.begin(), param->grad.end(), staging.data() + offset);
+        }
+        offset += param->size();
+    }
+
+    process_group->all_reduce(staging.data(), total);
+
+    float scale = 1.0f / process_group->world_size();
+    offset = 0;
+    for (auto &param : parameters)
+    {
+        float *values = staging.data() + offset;
+        for (int i = 0; i < param->size(); i++)
+        {
+            values[i] *= scale;
+        }
+        std::copy(values, values + param->size(), param->grad.begin());
+        if (param->device == DeviceType::CUDA)
+        {
+            cudaMemcpy(param->d_grad, values, param->size() * sizeof(float), cudaMemcpyHostToDevice);
+        }
+        offset += param->size();
+    }
+}
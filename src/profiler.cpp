@@ -0,0 +1,302 @@
+// profiler.cpp
+
+#include "profiler.h"
+#include "op.h"
+#include "tensor.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+std::atomic<bool> Profiler::enabled_flag{false};
+
+static std::mutex events_mutex;
+static std::vector<ProfileEvent> recorded;
+static double session_start_us = 0.0;
+
+static std::atomic<int> next_thread_number{0};
+
+static int thread_number()
+{
+    static thread_local int number = next_thread_number.fetch_add(1);
+    return number;
+}
+
+double Profiler::now_us()
+{
+    auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double, std::micro>(since_epoch).count();
+}
+
+void Profiler::enable()
+{
+    {
+        std::lock_guard<std::mutex> lock(events_mutex);
+        if (recorded.empty())
+        {
+            session_start_us = now_us();
+        }
+    }
+    enabled_flag.store(true);
+}
+
+void Profiler::disable()
+{
+    enabled_flag.store(false);
+}
+
+void Profiler::clear()
+{
+    std::lock_guard<std::mutex> lock(events_mutex);
+    recorded.clear();
+    session_start_us = now_us();
+}
+
+void Profiler::record(ProfileEvent event)
+{
+    std::lock_guard<std::mutex> lock(events_mutex);
+    event.start_us -= session_start_us;
+    recorded.push_back(std::move(event));
+}
+
+std::vector<ProfileEvent> Profiler::events()
+{
+    std::lock_guard<std::mutex> lock(events_mutex);
+    return recorded;
+}
+
+double Profiler::op_time_us(const Op *op)
+{
+    std::lock_guard<std::mutex> lock(events_mutex);
+    double total = 0.0;
+    for (auto &event : recorded)
+    {
+        if (event.op_id == op->id)
+        {
+            total += event.duration_us;
+        }
+    }
+    return total;
+}
+
+// Rough per-element cost of each op; transcendental functions count as one
+// operation. Reductions and stacks are charged per input element.
+static double flops_per_element(OpKind kind, bool backward)
+{
+    switch (kind)
+    {
+    case OpKind::Add:
+    case OpKind::Subtract:
+    case OpKind::Exp:
+    case OpKind::Relu:
+        return backward ? 2 : 1;
+    case OpKind::Multiply:
+    case OpKind::Tanh:
+        return backward ? 4 : 1;
+    case OpKind::Divide:
+        return backward ? 6 : 1;
+    case OpKind::Sum:
+        return 1;
+    case OpKind::Stack:
+        return backward ? 1 : 0;
+    default:
+        return 0.0;
+    }
+}
+
+void OpProfileScope::begin()
+{
+    input_shapes.reserve(op.inputs.size());
+    for (auto &input : op.inputs)
+    {
+        input_shapes.push_back(input->shape);
+    }
+    start_us = Profiler::now_us();
+}
+
+void OpProfileScope::finish()
+{
+    double end_us = Profiler::now_us();
+
+    ProfileEvent event;
+    event.op_type = op.op_type();
+    event.backward = backward;
+    event.start_us = start_us;
+    event.duration_us = end_us - start_us;
+    event.thread = thread_number();
+    event.op_id = op.id;
+
+    size_t input_elements = 0;
+    for (auto &shape : input_shapes)
+    {
+        size_t n = 1;
+        for (int d : shape)
+        {
+            n *= d;
+        }
+        input_elements += n;
+    }
+    size_t output_elements = 0;
+    if (op.output)
+    {
+        event.output_shape = op.output->shape;
+        output_elements = op.output->size();
+    }
+    event.input_shapes = std::move(input_shapes);
+
+    // Reductions and stacks do their work per input element, the rest per output element
+    bool per_input = op.kind == OpKind::Sum || op.kind == OpKind::Stack;
+    event.flops = flops_per_element(op.kind, backward) * (per_input ? input_elements : output_elements);
+
+    if (!backward)
+    {
+        event.bytes = (input_elements + output_elements) * sizeof(float);
+    }
+    else
+    {
+        // Output gradient, saved values, and a read-modify-write of every input gradient
+        size_t elements = output_elements + 2 * input_elements;
+        if (op.saves_inputs())
+        {
+            elements += input_elements;
+        }
+        if (op.saves_output())
+        {
+            elements += output_elements;
+        }
+        event.bytes = elements * sizeof(float);
+    }
+
+    Profiler::record(std::move(event));
+}
+
+namespace
+{
+    struct OpTotals
+    {
+        std::string name;
+        int calls = 0;
+        double total_us = 0.0;
+        size_t bytes = 0;
+        double flops = 0.0;
+    };
+}
+
+std::string Profiler::summary()
+{
+    std::vector<ProfileEvent> all = events();
+
+    std::map<std::string, OpTotals> by_name;
+    double total_us = 0.0;
+    for (auto &event : all)
+    {
+        std::string name = event.op_type + (event.backward ? " (backward)" : " (forward)");
+        OpTotals &totals = by_name[name];
+        totals.name = name;
+        totals.calls++;
+        totals.total_us += event.duration_us;
+        totals.bytes += event.bytes;
+        totals.flops += event.flops;
+        total_us += event.duration_us;
+    }
+
+    std::vector<OpTotals> rows;
+    for (auto &entry : by_name)
+    {
+        rows.push_back(entry.second);
+    }
+    std::sort(rows.begin(), rows.end(), [](const OpTotals &a, const OpTotals &b)
+              { return a.total_us > b.total_us; });
+
+    std::ostringstream out;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-20s %8s %12s %10s %7s %10s %9s\n",
+                  "op", "calls", "total (ms)", "avg (us)", "%", "MB", "GFLOP/s");
+    out << line;
+    for (auto &row : rows)
+    {
+        double percent = total_us > 0.0 ? 100.0 * row.total_us / total_us : 0.0;
+        double gflops = row.total_us > 0.0 ? row.flops / row.total_us * 1e-3 : 0.0;
+        std::snprintf(line, sizeof(line), "%-20s %8d %12.3f %10.3f %7.1f %10.3f %9.3f\n",
+                      row.name.c_str(), row.calls, row.total_us * 1e-3, row.total_us / row.calls,
+                      percent, row.bytes / 1e6, gflops);
+        out << line;
+    }
+    std::snprintf(line, sizeof(line), "%-20s %8d %12.3f\n", "total", static_cast<int>(all.size()), total_us * 1e-3);
+    out << line;
+    return out.str();
+}
+
+static std::string shapes_to_string(const std::vector<std::vector<int>> &shapes)
+{
+    std::ostringstream out;
+    for (size_t i = 0; i < shapes.size(); i++)
+    {
+        out << (i ? ", " : "") << "[";
+        for (size_t j = 0; j < shapes[i].size(); j++)
+        {
+            out << (j ? ", " : "") << shapes[i][j];
+        }
+        out << "]";
+    }
+    return out.str();
+}
+
+std::string Profiler::chrome_trace()
+{
+    std::vector<ProfileEvent> all = events();
+
+    std::ostringstream out;
+    out << "{\"traceEvents\": [";
+    for (size_t i = 0; i < all.size(); i++)
+    {
+        const ProfileEvent &event = all[i];
+        char times[96];
+        std::snprintf(times, sizeof(times), "\"ts\": %.3f, \"dur\": %.3f", event.start_us, event.duration_us);
+        out << (i ? "," : "") << "\n  {\"name\": \"" << event.op_type << "\", "
+            << "\"cat\": \"" << (event.backward ? "backward" : "forward") << "\", "
+            << "\"ph\": \"X\", " << times << ", \"pid\": 0, \"tid\": " << event.thread << ", "
+            << "\"args\": {\"inputs\": \"" << shapes_to_string(event.input_shapes) << "\", "
+            << "\"output\": \"" << shapes_to_string({event.output_shape}) << "\", "
+            << "\"bytes\": " << event.bytes << ", \"flops\": " << event.flops << "}}";
+    }
+    out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+    return out.str();
+}
+
+void Profiler::export_chrome_trace(const std::string &path)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        throw std::invalid_argument("Cannot open " + path + " for writing.");
+    }
+    file << chrome_trace();
+}
+
+ProfileSession::ProfileSession(bool clear_events) : was_enabled(Profiler::enabled())
+{
+    if (clear_events)
+    {
+        Profiler::clear();
+    }
+    Profiler::enable();
+}
+
+ProfileSession::~ProfileSession()
+{
+    stop();
+}
+
+void ProfileSession::stop()
+{
+    if (!stopped && !was_enabled)
+    {
+        Profiler::disable();
+    }
+    stopped = true;
+}
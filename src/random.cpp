@@ -0,0 +1,42 @@
+// random.cpp
+
+#include "random.h"
+
+#include <atomic>
+#include <memory>
+#include <random>
+
+static std::atomic<uint64_t> process_seed{0};
+static std::atomic<uint64_t> next_stream{0};
+
+// Lazily seeded so that a manual_seed() before the first draw takes effect
+static std::unique_ptr<std::mt19937> &thread_generator()
+{
+    static thread_local std::unique_ptr<std::mt19937> generator;
+    return generator;
+}
+
+static void seed_generator(std::unique_ptr<std::mt19937> &generator, uint64_t seed, uint64_t stream)
+{
+    std::seed_seq sequence{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+                           static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)};
+    generator.reset(new std::mt19937(sequence));
+}
+
+float make_random()
+{
+    auto &generator = thread_generator();
+    if (!generator)
+    {
+        seed_generator(generator, process_seed.load(), next_stream.fetch_add(1));
+    }
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    return uniform(*generator);
+}
+
+void manual_seed(uint64_t seed)
+{
+    process_seed.store(seed);
+    next_stream.store(1);
+    seed_generator(thread_generator(), seed, 0);
+}
@@ -0,0 +1,364 @@
+// recurrent_ops.cpp
+
+#include "op.h"
+#include "tensor.h"
+#include "thread_pool.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+// Rows per parallel_for chunk of the sequence-level matrix products
+static const size_t rows_grain = 16;
+
+// C[M, N] += A[M, K] B[K, N]; the inner loop runs along rows of B and C
+static void matmul_acc(const float *a, const float *b, float *c, size_t m, size_t k, size_t n)
+{
+    parallel_for(m, rows_grain, [&](size_t begin, size_t end)
+                 {
+        for (size_t i = begin; i < end; i++)
+        {
+            float *c_row = c + i * n;
+            for (size_t p = 0; p < k; p++)
+            {
+                const float a_ip = a[i * k + p];
+                const float *b_row = b + p * n;
+                for (size_t j = 0; j < n; j++)
+                {
+                    c_row[j] += a_ip * b_row[j];
+                }
+            }
+        } });
+}
+
+// C[M, N] += A[K, M]^T B[K, N] (weight gradients: inputs^T gate gradients)
+static void matmul_at_b_acc(const float *a, const float *b, float *c, size_t k, size_t m, size_t n)
+{
+    parallel_for(m, rows_grain, [&](size_t begin, size_t end)
+                 {
+        for (size_t p = 0; p < k; p++)
+        {
+            const float *b_row = b + p * n;
+            for (size_t i = begin; i < end; i++)
+            {
+                const float a_pi = a[p * m + i];
+                float *c_row = c + i * n;
+                for (size_t j = 0; j < n; j++)
+                {
+                    c_row[j] += a_pi * b_row[j];
+                }
+            }
+        } });
+}
+
+// C[M, N] += A[M, K] B[N, K]^T (input gradients: gate gradients W^T)
+static void matmul_a_bt_acc(const float *a, const float *b, float *c, size_t m, size_t k, size_t n)
+{
+    parallel_for(m, rows_grain, [&](size_t begin, size_t end)
+                 {
+        for (size_t i = begin; i < end; i++)
+        {
+            const float *a_row = a + i * k;
+            for (size_t j = 0; j < n; j++)
+            {
+                const float *b_row = b + j * k;
+                float acc = 0.0f;
+                for (size_t p = 0; p < k; p++)
+                {
+                    acc += a_row[p] * b_row[p];
+                }
+                c[i * n + j] += acc;
+            }
+        } });
+}
+
+// out[N] += column sums of A[M, N]
+static void column_sums_acc(const float *a, float *out, size_t m, size_t n)
+{
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            out[j] += a[i * n + j];
+        }
+    }
+}
+
+static inline float sigmoid(float x)
+{
+    return 1.0f / (1.0f + std::exp(-x));
+}
+
+static void check_shape(const std::shared_ptr<Tensor> &tensor, const std::vector<int> &shape, const std::string &what,
+                        const std::string &op)
+{
+    if (tensor->shape != shape)
+    {
+        std::string expected;
+        for (size_t i = 0; i < shape.size(); i++)
+        {
+            expected += (i ? ", " : "") + std::to_string(shape[i]);
+        }
+        throw std::invalid_argument(op + ": " + what + " must have shape [" + expected + "]");
+    }
+}
+
+// Validates inputs[0] = x [T, I] and inputs[2] = weight_hh [H, gates * H];
+// sets T, I and H
+static void check_recurrent_inputs(const std::vector<std::shared_ptr<Tensor>> &inputs, size_t count, int gates,
+                                   const std::string &op, int &steps, int &in, int &hidden)
+{
+    if (inputs.size() != count)
+    {
+        throw std::invalid_argument(op + " expected " + std::to_string(count) + " inputs, got " +
+                                    std::to_string(inputs.size()));
+    }
+    for (auto &input : inputs)
+    {
+        if (input->device != DeviceType::CPU)
+        {
+            throw std::invalid_argument(op + " is only supported on the CPU.");
+        }
+        if (!input->tangent.empty())
+        {
+            throw std::invalid_argument("Forward-mode AD is not supported by " + op + ".");
+        }
+    }
+    if (inputs[0]->shape.size() != 2 || inputs[2]->shape.size() != 2)
+    {
+        throw std::invalid_argument(op + ": x must be [steps, input_size] and weight_hh [hidden_size, gates * hidden_size]");
+    }
+    steps = inputs[0]->shape[0];
+    in = inputs[0]->shape[1];
+    hidden = inputs[2]->shape[0];
+    if (steps < 1)
+    {
+        throw std::invalid_argument(op + ": the sequence must have at least one step");
+    }
+    check_shape(inputs[1], {in, gates * hidden}, "weight_ih", op);
+    check_shape(inputs[2], {hidden, gates * hidden}, "weight_hh", op);
+}
+
+/////////////////// LSTMCellOp ///////////////////
+
+void LSTMCellOp::forward()
+{
+    int steps, in, hidden;
+    check_recurrent_inputs(inputs, 6, 4, "LSTMCellOp", steps, in, hidden);
+    check_shape(inputs[3], {4 * hidden}, "bias", "LSTMCellOp");
+    check_shape(inputs[4], {hidden}, "h0", "LSTMCellOp");
+    check_shape(inputs[5], {hidden}, "c0", "LSTMCellOp");
+    allocate_output({steps, hidden});
+
+    const size_t T = steps, I = in, H = hidden, G = 4 * H;
+    const float *x = inputs[0]->data.data();
+    const float *w_ih = inputs[1]->data.data();
+    const float *w_hh = inputs[2]->data.data();
+    const float *bias = inputs[3]->data.data();
+    float *hs = output->data.data();
+    gates.resize(T * G);
+    cells.resize(T * H);
+
+    // Input projection of every step at once: gates = bias + x W_ih
+    for (size_t t = 0; t < T; t++)
+    {
+        std::copy(bias, bias + G, gates.begin() + t * G);
+    }
+    matmul_acc(x, w_ih, gates.data(), T, I, G);
+
+    const float *h_prev = inputs[4]->data.data();
+    const float *c_prev = inputs[5]->data.data();
+    for (size_t t = 0; t < T; t++)
+    {
+        float *g = gates.data() + t * G;
+        matmul_acc(h_prev, w_hh, g, 1, H, G);
+
+        // Gate nonlinearities and state update in one pass
+        float *h = hs + t * H;
+        float *c = cells.data() + t * H;
+        for (size_t j = 0; j < H; j++)
+        {
+            const float i_gate = sigmoid(g[j]);
+            const float f_gate = sigmoid(g[H + j]);
+            const float g_gate = std::tanh(g[2 * H + j]);
+            const float o_gate = sigmoid(g[3 * H + j]);
+            g[j] = i_gate;
+            g[H + j] = f_gate;
+            g[2 * H + j] = g_gate;
+            g[3 * H + j] = o_gate;
+            c[j] = f_gate * c_prev[j] + i_gate * g_gate;
+            h[j] = o_gate * std::tanh(c[j]);
+        }
+        h_prev = h;
+        c_prev = c;
+    }
+
+    output->op = shared_from_this();
+}
+
+void LSTMCellOp::backward()
+{
+    const size_t T = output->shape[0], H = output->shape[1], I = inputs[0]->shape[1], G = 4 * H;
+    const float *x = inputs[0]->data.data();
+    const float *w_ih = inputs[1]->data.data();
+    const float *w_hh = inputs[2]->data.data();
+    const float *h0 = inputs[4]->data.data();
+    const float *c0 = inputs[5]->data.data();
+    const float *hs = output->data.data();
+    const float *d_hs = output->grad.data();
+
+    // Pre-activation gate gradients of every step, then one product per weight
+    std::vector<float> d_gates(T * G);
+    std::vector<float> dh_next(H, 0.0f);
+    std::vector<float> dc_next(H, 0.0f);
+    for (size_t t = T; t-- > 0;)
+    {
+        const float *g = gates.data() + t * G;
+        const float *c = cells.data() + t * H;
+        const float *c_prev = t ? cells.data() + (t - 1) * H : c0;
+        const float *d_h = d_hs + t * H;
+        float *dg = d_gates.data() + t * G;
+        for (size_t j = 0; j < H; j++)
+        {
+            const float i_gate = g[j], f_gate = g[H + j], g_gate = g[2 * H + j], o_gate = g[3 * H + j];
+            const float tanh_c = std::tanh(c[j]);
+            const float dh = d_h[j] + dh_next[j];
+            const float dc = dc_next[j] + dh * o_gate * (1.0f - tanh_c * tanh_c);
+            dg[j] = dc * g_gate * i_gate * (1.0f - i_gate);
+            dg[H + j] = dc * c_prev[j] * f_gate * (1.0f - f_gate);
+            dg[2 * H + j] = dc * i_gate * (1.0f - g_gate * g_gate);
+            dg[3 * H + j] = dh * tanh_c * o_gate * (1.0f - o_gate);
+            dc_next[j] = dc * f_gate;
+        }
+        // dh_prev = dg W_hh^T
+        std::fill(dh_next.begin(), dh_next.end(), 0.0f);
+        matmul_a_bt_acc(dg, w_hh, dh_next.data(), 1, G, H);
+    }
+
+    float *d_h0 = input_grad(4);
+    float *d_c0 = input_grad(5);
+    for (size_t j = 0; j < H; j++)
+    {
+        d_h0[j] += dh_next[j];
+        d_c0[j] += dc_next[j];
+    }
+
+    // Step t's recurrent input is h_{t-1} (h0 for the first step)
+    float *d_w_hh = input_grad(2);
+    matmul_at_b_acc(h0, d_gates.data(), d_w_hh, 1, H, G);
+    matmul_at_b_acc(hs, d_gates.data() + G, d_w_hh, T - 1, H, G);
+    matmul_at_b_acc(x, d_gates.data(), input_grad(1), T, I, G);
+    column_sums_acc(d_gates.data(), input_grad(3), T, G);
+    matmul_a_bt_acc(d_gates.data(), w_ih, input_grad(0), T, G, I);
+}
+
+/////////////////// GRUCellOp ///////////////////
+
+void GRUCellOp::forward()
+{
+    int steps, in, hidden;
+    check_recurrent_inputs(inputs, 6, 3, "GRUCellOp", steps, in, hidden);
+    check_shape(inputs[3], {3 * hidden}, "bias_ih", "GRUCellOp");
+    check_shape(inputs[4], {3 * hidden}, "bias_hh", "GRUCellOp");
+    check_shape(inputs[5], {hidden}, "h0", "GRUCellOp");
+    allocate_output({steps, hidden});
+
+    const size_t T = steps, I = in, H = hidden, G = 3 * H;
+    const float *x = inputs[0]->data.data();
+    const float *w_ih = inputs[1]->data.data();
+    const float *w_hh = inputs[2]->data.data();
+    const float *bias_ih = inputs[3]->data.data();
+    const float *bias_hh = inputs[4]->data.data();
+    float *hs = output->data.data();
+    gates.resize(T * G);
+    hidden_n.resize(T * H);
+
+    for (size_t t = 0; t < T; t++)
+    {
+        std::copy(bias_ih, bias_ih + G, gates.begin() + t * G);
+    }
+    matmul_acc(x, w_ih, gates.data(), T, I, G);
+
+    std::vector<float> recurrent(G);
+    const float *h_prev = inputs[5]->data.data();
+    for (size_t t = 0; t < T; t++)
+    {
+        std::copy(bias_hh, bias_hh + G, recurrent.begin());
+        matmul_acc(h_prev, w_hh, recurrent.data(), 1, H, G);
+
+        float *g = gates.data() + t * G;
+        float *hn = hidden_n.data() + t * H;
+        float *h = hs + t * H;
+        for (size_t j = 0; j < H; j++)
+        {
+            const float r_gate = sigmoid(g[j] + recurrent[j]);
+            const float z_gate = sigmoid(g[H + j] + recurrent[H + j]);
+            const float n_gate = std::tanh(g[2 * H + j] + r_gate * recurrent[2 * H + j]);
+            g[j] = r_gate;
+            g[H + j] = z_gate;
+            g[2 * H + j] = n_gate;
+            hn[j] = recurrent[2 * H + j];
+            h[j] = (1.0f - z_gate) * n_gate + z_gate * h_prev[j];
+        }
+        h_prev = h;
+    }
+
+    output->op = shared_from_this();
+}
+
+void GRUCellOp::backward()
+{
+    const size_t T = output->shape[0], H = output->shape[1], I = inputs[0]->shape[1], G = 3 * H;
+    const float *x = inputs[0]->data.data();
+    const float *w_ih = inputs[1]->data.data();
+    const float *w_hh = inputs[2]->data.data();
+    const float *h0 = inputs[5]->data.data();
+    const float *hs = output->data.data();
+    const float *d_hs = output->grad.data();
+
+    // Gradients of the input projections (x W_ih + b_ih) and of the
+    // recurrent ones (h W_hh + b_hh); they differ only in the n gate
+    std::vector<float> d_input(T * G);
+    std::vector<float> d_recurrent(T * G);
+    std::vector<float> dh_next(H, 0.0f);
+    for (size_t t = T; t-- > 0;)
+    {
+        const float *g = gates.data() + t * G;
+        const float *hn = hidden_n.data() + t * H;
+        const float *h_prev = t ? hs + (t - 1) * H : h0;
+        const float *d_h = d_hs + t * H;
+        float *di = d_input.data() + t * G;
+        float *dr = d_recurrent.data() + t * G;
+        for (size_t j = 0; j < H; j++)
+        {
+            const float r_gate = g[j], z_gate = g[H + j], n_gate = g[2 * H + j];
+            const float dh = d_h[j] + dh_next[j];
+            const float dn = dh * (1.0f - z_gate) * (1.0f - n_gate * n_gate);
+            const float dz = dh * (h_prev[j] - n_gate) * z_gate * (1.0f - z_gate);
+            const float d_reset = dn * hn[j] * r_gate * (1.0f - r_gate);
+            di[j] = d_reset;
+            di[H + j] = dz;
+            di[2 * H + j] = dn;
+            dr[j] = d_reset;
+            dr[H + j] = dz;
+            dr[2 * H + j] = dn * r_gate;
+            dh_next[j] = dh * z_gate;
+        }
+        // dh_prev = dh z + dr W_hh^T
+        matmul_a_bt_acc(dr, w_hh, dh_next.data(), 1, G, H);
+    }
+
+    float *d_h0 = input_grad(5);
+    for (size_t j = 0; j < H; j++)
+    {
+        d_h0[j] += dh_next[j];
+    }
+
+    float *d_w_hh = input_grad(2);
+    matmul_at_b_acc(h0, d_recurrent.data(), d_w_hh, 1, H, G);
+    matmul_at_b_acc(hs, d_recurrent.data() + G, d_w_hh, T - 1, H, G);
+    column_sums_acc(d_recurrent.data(), input_grad(4), T, G);
+    matmul_at_b_acc(x, d_input.data(), input_grad(1), T, I, G);
+    column_sums_acc(d_input.data(), input_grad(3), T, G);
+    matmul_a_bt_acc(d_input.data(), w_ih, input_grad(0), T, G, I);
+}
@@ -0,0 +1,275 @@
+// sparse.cpp
+
+#include "sparse.h"
+#include "thread_pool.h"
+#include "node_pool.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+// Output rows (forward) or weight rows (backward) per parallel_for chunk
+static const size_t rows_grain = 16;
+
+SparseTensor::SparseTensor(int rows, int cols, std::vector<int> row_ptr, std::vector<int> col_idx,
+                           std::vector<float> values, std::vector<int> col_ptr, std::vector<int> t_row_idx,
+                           std::vector<float> t_values)
+    : rows(rows), cols(cols), row_ptr(std::move(row_ptr)), col_idx(std::move(col_idx)), values(std::move(values)),
+      col_ptr(std::move(col_ptr)), t_row_idx(std::move(t_row_idx)), t_values(std::move(t_values))
+{
+}
+
+std::shared_ptr<SparseTensor> SparseTensor::from_csr(int rows, int cols, std::vector<int> row_ptr,
+                                                     std::vector<int> col_idx, std::vector<float> values)
+{
+    if (rows < 0 || cols < 0)
+    {
+        throw std::invalid_argument("SparseTensor: negative shape");
+    }
+    if (row_ptr.size() != static_cast<size_t>(rows) + 1 || row_ptr.front() != 0 ||
+        static_cast<size_t>(row_ptr.back()) != col_idx.size() || col_idx.size() != values.size())
+    {
+        throw std::invalid_argument("SparseTensor: row_ptr must have rows + 1 entries from 0 to nnz, "
+                                    "and col_idx and values nnz entries");
+    }
+    for (int r = 0; r < rows; r++)
+    {
+        if (row_ptr[r] > row_ptr[r + 1])
+        {
+            throw std::invalid_argument("SparseTensor: row_ptr must be non-decreasing");
+        }
+    }
+
+    // Counting sort of the entries by column builds the transposed structure
+    std::vector<int> col_ptr(static_cast<size_t>(cols) + 1, 0);
+    for (int c : col_idx)
+    {
+        if (c < 0 || c >= cols)
+        {
+            throw std::invalid_argument("SparseTensor: column index " + std::to_string(c) + " out of range for " +
+                                        std::to_string(cols) + " columns");
+        }
+        col_ptr[c + 1]++;
+    }
+    std::partial_sum(col_ptr.begin(), col_ptr.end(), col_ptr.begin());
+    std::vector<int> next(col_ptr.begin(), col_ptr.end() - 1);
+    std::vector<int> t_row_idx(values.size());
+    std::vector<float> t_values(values.size());
+    for (int r = 0; r < rows; r++)
+    {
+        for (int i = row_ptr[r]; i < row_ptr[r + 1]; i++)
+        {
+            const int slot = next[col_idx[i]]++;
+            t_row_idx[slot] = r;
+            t_values[slot] = values[i];
+        }
+    }
+
+    return std::shared_ptr<SparseTensor>(new SparseTensor(rows, cols, std::move(row_ptr), std::move(col_idx),
+                                                          std::move(values), std::move(col_ptr),
+                                                          std::move(t_row_idx), std::move(t_values)));
+}
+
+std::shared_ptr<SparseTensor> SparseTensor::from_coo(int rows, int cols, const std::vector<int> &row_idx,
+                                                     const std::vector<int> &col_idx, const std::vector<float> &values)
+{
+    if (row_idx.size() != col_idx.size() || row_idx.size() != values.size())
+    {
+        throw std::invalid_argument("SparseTensor: row, column and value arrays must have the same length");
+    }
+    if (rows < 0 || cols < 0)
+    {
+        throw std::invalid_argument("SparseTensor: negative shape");
+    }
+    for (size_t i = 0; i < row_idx.size(); i++)
+    {
+        if (row_idx[i] < 0 || row_idx[i] >= rows || col_idx[i] < 0 || col_idx[i] >= cols)
+        {
+            throw std::invalid_argument("SparseTensor: entry (" + std::to_string(row_idx[i]) + ", " +
+                                        std::to_string(col_idx[i]) + ") out of range");
+        }
+    }
+
+    std::vector<size_t> order(values.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+              { return row_idx[a] != row_idx[b] ? row_idx[a] < row_idx[b] : col_idx[a] < col_idx[b]; });
+
+    std::vector<int> row_ptr(static_cast<size_t>(rows) + 1, 0);
+    std::vector<int> csr_cols;
+    std::vector<float> csr_values;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const size_t e = order[i];
+        if (i > 0 && row_idx[e] == row_idx[order[i - 1]] && col_idx[e] == col_idx[order[i - 1]])
+        {
+            csr_values.back() += values[e];
+            continue;
+        }
+        row_ptr[row_idx[e] + 1]++;
+        csr_cols.push_back(col_idx[e]);
+        csr_values.push_back(values[e]);
+    }
+    std::partial_sum(row_ptr.begin(), row_ptr.end(), row_ptr.begin());
+    return from_csr(rows, cols, std::move(row_ptr), std::move(csr_cols), std::move(csr_values));
+}
+
+std::shared_ptr<SparseTensor> SparseTensor::from_dense(const float *data, int rows, int cols)
+{
+    if (rows < 0 || cols < 0)
+    {
+        throw std::invalid_argument("SparseTensor: negative shape");
+    }
+    std::vector<int> row_ptr(static_cast<size_t>(rows) + 1, 0);
+    std::vector<int> csr_cols;
+    std::vector<float> csr_values;
+    for (int r = 0; r < rows; r++)
+    {
+        const float *row = data + static_cast<size_t>(r) * cols;
+        for (int c = 0; c < cols; c++)
+        {
+            if (row[c] != 0.0f)
+            {
+                csr_cols.push_back(c);
+                csr_values.push_back(row[c]);
+            }
+        }
+        row_ptr[r + 1] = static_cast<int>(csr_cols.size());
+    }
+    return from_csr(rows, cols, std::move(row_ptr), std::move(csr_cols), std::move(csr_values));
+}
+
+std::vector<float> SparseTensor::to_dense() const
+{
+    std::vector<float> dense(static_cast<size_t>(rows) * cols, 0.0f);
+    for (int r = 0; r < rows; r++)
+    {
+        for (int i = row_ptr[r]; i < row_ptr[r + 1]; i++)
+        {
+            dense[static_cast<size_t>(r) * cols + col_idx[i]] += values[i];
+        }
+    }
+    return dense;
+}
+
+// Checks shared by forward and backward; returns the output width N
+static size_t check_spmm_inputs(const SparseTensor &sparse, const std::vector<std::shared_ptr<Tensor>> &inputs)
+{
+    if (inputs.empty() || inputs.size() > 2)
+    {
+        throw std::invalid_argument("SpMMOp expected a weight and an optional bias, got " +
+                                    std::to_string(inputs.size()) + " inputs");
+    }
+    for (auto &input : inputs)
+    {
+        if (input->device != DeviceType::CPU)
+        {
+            throw std::invalid_argument("SpMMOp is only supported on the CPU.");
+        }
+        if (!input->tangent.empty())
+        {
+            throw std::invalid_argument("Forward-mode AD is not supported by SpMMOp.");
+        }
+    }
+    const auto &weight = inputs[0]->shape;
+    if (weight.size() != 2 || weight[0] != sparse.cols)
+    {
+        throw std::invalid_argument("SpMMOp: weight must have shape [" + std::to_string(sparse.cols) + ", N]");
+    }
+    if (inputs.size() == 2 && inputs[1]->shape != std::vector<int>{weight[1]})
+    {
+        throw std::invalid_argument("SpMMOp: bias must have shape [N]");
+    }
+    return weight[1];
+}
+
+void SpMMOp::forward()
+{
+    const size_t n = check_spmm_inputs(*sparse, inputs);
+    allocate_output({sparse->rows, static_cast<int>(n)});
+
+    const float *weight = inputs[0]->data.data();
+    const float *bias = inputs.size() == 2 ? inputs[1]->data.data() : nullptr;
+    float *out = output->data.data();
+    parallel_for(sparse->rows, rows_grain, [&](size_t begin, size_t end)
+                 {
+        for (size_t r = begin; r < end; r++)
+        {
+            float *out_row = out + r * n;
+            if (bias)
+            {
+                std::copy(bias, bias + n, out_row);
+            }
+            else
+            {
+                std::fill(out_row, out_row + n, 0.0f);
+            }
+            for (int i = sparse->row_ptr[r]; i < sparse->row_ptr[r + 1]; i++)
+            {
+                const float value = sparse->values[i];
+                const float *weight_row = weight + static_cast<size_t>(sparse->col_idx[i]) * n;
+                for (size_t j = 0; j < n; j++)
+                {
+                    out_row[j] += value * weight_row[j];
+                }
+            }
+        } });
+
+    output->op = shared_from_this();
+}
+
+void SpMMOp::backward()
+{
+    const size_t n = check_spmm_inputs(*sparse, inputs);
+    const float *d_out = output->grad.data();
+
+    // d_weight[k] += sum over the entries (r, k) of value * d_out[r]; each
+    // chunk owns its weight rows, and columns without entries cost nothing
+    float *d_weight = input_grad(0);
+    parallel_for(sparse->cols, rows_grain, [&](size_t begin, size_t end)
+                 {
+        for (size_t k = begin; k < end; k++)
+        {
+            float *d_weight_row = d_weight + k * n;
+            for (int i = sparse->col_ptr[k]; i < sparse->col_ptr[k + 1]; i++)
+            {
+                const float value = sparse->t_values[i];
+                const float *d_out_row = d_out + static_cast<size_t>(sparse->t_row_idx[i]) * n;
+                for (size_t j = 0; j < n; j++)
+                {
+                    d_weight_row[j] += value * d_out_row[j];
+                }
+            }
+        } });
+
+    if (inputs.size() == 2)
+    {
+        float *d_bias = input_grad(1);
+        for (int r = 0; r < sparse->rows; r++)
+        {
+            const float *d_out_row = d_out + static_cast<size_t>(r) * n;
+            for (size_t j = 0; j < n; j++)
+            {
+                d_bias[j] += d_out_row[j];
+            }
+        }
+    }
+}
+
+std::shared_ptr<Tensor> spmm(const std::shared_ptr<const SparseTensor> &sparse, const std::shared_ptr<Tensor> &weight,
+                             const std::shared_ptr<Tensor> &bias)
+{
+    if (!sparse)
+    {
+        throw std::invalid_argument("spmm: sparse operand is null");
+    }
+    std::vector<std::shared_ptr<Tensor>> inputs{weight};
+    if (bias)
+    {
+        inputs.push_back(bias);
+    }
+    auto op = make_node<SpMMOp>(sparse, std::move(inputs));
+    op->run_forward();
+    return op->output;
+}
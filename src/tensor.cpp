@@ -2,17 +2,36 @@
 
 #include "tensor.h"
 #include "op.h"
+#include "engine.h"
+#include "thread_pool.h"
+#include "traversal.h"
+#include "memory_stats.h"
+#include "node_pool.h"
 
 #include <memory>
-#include <stack>
-#include <unordered_set>
 #include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
 
 #include <cuda_runtime.h>
 
 #include "tensor.h"
 #include "op.h"
 
+// Device allocations go through these so MemoryStats sees them
+static void device_alloc(float **ptr, int n)
+{
+    cudaMalloc(ptr, n * sizeof(float));
+    MemoryStats::device_bytes_changed(static_cast<long long>(n) * sizeof(float));
+}
+
+static void device_free(float *&ptr, int n)
+{
+    cudaFree(ptr);
+    ptr = nullptr;
+    MemoryStats::device_bytes_changed(-static_cast<long long>(n) * sizeof(float));
+}
+
 // Default constructor
 Tensor::Tensor()
 {
@@ -26,6 +45,7 @@ Tensor::Tensor()
         allocate_memory_on_device();
         copy_to_device();
     }
+    MemoryStats::tensor_created(this);
 }
 
 // Destructor
@@ -34,19 +54,18 @@ Tensor::~Tensor()
     // If data allocated on device, free it
     if (d_data)
     {
-        cudaFree(d_data);
+        device_free(d_data, size());
     }
     if (d_grad)
     {
-        cudaFree(d_grad);
+        device_free(d_grad, size());
     }
+    MemoryStats::tensor_destroyed(this);
 }
 
 // Constructs a tensor of given shape with optional initialization
-Tensor::Tensor(const std::vector<int> &shape, float init_val,
-               std::shared_ptr<Op> op,
-               std::vector<std::shared_ptr<Tensor>> children)
-    : shape(shape), op(op), children(children)
+Tensor::Tensor(const Shape &shape, float init_val, std::shared_ptr<Op> op)
+    : shape(shape), op(op)
 {
     int total_size = 1;
     for (auto s : shape)
@@ -65,6 +84,7 @@ Tensor::Tensor(const std::vector<int> &shape, float init_val,
         allocate_memory_on_device();
         copy_to_device();
     }
+    MemoryStats::tensor_created(this);
 }
 
 std::ostream &operator<<(std::ostream &os, const Tensor &tensor)
@@ -85,10 +105,11 @@ std::ostream &operator<<(std::ostream &os, const Tensor &tensor)
             os << ", ";
     }
     os << "], grad=[";
-    for (int i = 0; i < sz; i++)
+    int grad_sz = static_cast<int>(tensor.grad.size()); // Empty once released by backward()
+    for (int i = 0; i < grad_sz; i++)
     {
         os << tensor.grad[i];
-        if (i < sz - 1)
+        if (i < grad_sz - 1)
             os << ", ";
     }
     os << "])";
@@ -107,7 +128,8 @@ int Tensor::size() const
 
 std::shared_ptr<Tensor> Tensor::scalar_tensor(float val)
 {
-    auto t = std::make_shared<Tensor>(std::vector<int>{1}, val);
+    auto t = make_node<Tensor>(Shape{1}, val);
+    t->constant = true;
     return t;
 }
 
@@ -125,33 +147,33 @@ std::shared_ptr<Tensor> Tensor::operator+(const std::shared_ptr<Tensor> &other)
 {
     check_same_shape(shared_from_this(), other);
     // Create AddOp etc. Here assume we have AddOp adapted for arrays
-    std::shared_ptr<Op> add_op = std::make_shared<AddOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this(), other});
+    std::shared_ptr<Op> add_op = make_node<AddOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this(), other});
     // AddOp forward will fill the output->data
-    add_op->forward();
+    add_op->run_forward();
     return add_op->output;
 }
 
 std::shared_ptr<Tensor> Tensor::operator-(const std::shared_ptr<Tensor> &other)
 {
     check_same_shape(shared_from_this(), other);
-    std::shared_ptr<Op> sub_op = std::make_shared<SubtractOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this(), other});
-    sub_op->forward();
+    std::shared_ptr<Op> sub_op = make_node<SubtractOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this(), other});
+    sub_op->run_forward();
     return sub_op->output;
 }
 
 std::shared_ptr<Tensor> Tensor::operator*(const std::shared_ptr<Tensor> &other)
 {
     check_same_shape(shared_from_this(), other);
-    std::shared_ptr<Op> mul_op = std::make_shared<MultiplyOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this(), other});
-    mul_op->forward();
+    std::shared_ptr<Op> mul_op = make_node<MultiplyOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this(), other});
+    mul_op->run_forward();
     return mul_op->output;
 }
 
 std::shared_ptr<Tensor> Tensor::operator/(const std::shared_ptr<Tensor> &other)
 {
     check_same_shape(shared_from_this(), other);
-    std::shared_ptr<Op> div_op = std::make_shared<DivideOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this(), other});
-    div_op->forward();
+    std::shared_ptr<Op> div_op = make_node<DivideOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this(), other});
+    div_op->run_forward();
     return div_op->output;
 }
 
@@ -182,34 +204,68 @@ std::shared_ptr<Tensor> Tensor::operator/(float scalar)
 
 std::shared_ptr<Tensor> Tensor::tanh()
 {
-    std::shared_ptr<Op> tanh_op = std::make_shared<TanhOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this()});
-    tanh_op->forward();
+    std::shared_ptr<Op> tanh_op = make_node<TanhOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this()});
+    tanh_op->run_forward();
     return tanh_op->output;
 }
 
 std::shared_ptr<Tensor> Tensor::relu()
 {
-    std::shared_ptr<Op> relu_op = std::make_shared<ReluOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this()});
-    relu_op->forward();
+    std::shared_ptr<Op> relu_op = make_node<ReluOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this()});
+    relu_op->run_forward();
     return relu_op->output;
 }
 
 std::shared_ptr<Tensor> Tensor::exp()
 {
-    std::shared_ptr<Op> exp_op = std::make_shared<ExpOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this()});
-    exp_op->forward();
+    std::shared_ptr<Op> exp_op = make_node<ExpOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this()});
+    exp_op->run_forward();
     return exp_op->output;
 }
 
 std::shared_ptr<Tensor> Tensor::sum()
 {
-    auto op_ = std::make_shared<SumOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this()});
-    op_->forward();
+    auto op_ = make_node<SumOp>(std::vector<std::shared_ptr<Tensor>>{shared_from_this()});
+    op_->run_forward();
     return op_->output;
 }
 
-void Tensor::backward()
+void Tensor::backward(bool retain_graph)
+{
+    backward(retain_graph, nullptr);
+}
+
+void Tensor::backward(bool retain_graph, const LeafGradHook &on_leaf_ready)
 {
+    // Get the topological ordering of the compute graph
+    std::vector<std::shared_ptr<Tensor>> ordering;
+    topological_sort(ordering);
+
+    // A node freed by an earlier backward would silently act as a leaf,
+    // cutting off the gradient of everything behind it
+    for (auto &node : ordering)
+    {
+        if (node->graph_released)
+        {
+            throw std::runtime_error("graph already freed; call backward(retain_graph=True)");
+        }
+    }
+
+    // Nodes reused from an earlier, released graph need their buffers back,
+    // and intermediates left over from a retained graph start again from zero
+    for (auto &node : ordering)
+    {
+        node->allocate_grad();
+        if (node->op && node.get() != this)
+        {
+            std::fill(node->grad.begin(), node->grad.end(), 0.0f);
+            if (node->device == DeviceType::CUDA)
+            {
+                cudaMemset(node->d_grad, 0, node->size() * sizeof(float));
+            }
+        }
+    }
+
     // Initialize the gradient of the output tensor to 1.0
     std::fill(grad.begin(), grad.end(), 1.0);
 
@@ -219,9 +275,32 @@ void Tensor::backward()
         cudaMemcpy(d_grad, grad.data(), size() * sizeof(float), cudaMemcpyHostToDevice);
     }
 
-    // Get the topological ordering of the compute graph
-    std::vector<std::shared_ptr<Tensor>> ordering;
-    topological_sort(ordering);
+    // Wide CPU graphs are scheduled on the thread pool
+    if (device == DeviceType::CPU && get_num_threads() > 1 &&
+        static_cast<int>(ordering.size()) >= BackwardEngine::min_parallel_nodes)
+    {
+        BackwardEngine::execute(std::move(ordering), retain_graph, on_leaf_ready);
+        return;
+    }
+
+    // Consumers of each leaf whose backward has not run yet
+    std::unordered_map<Tensor *, int> pending_leaves;
+    if (on_leaf_ready)
+    {
+        for (auto &node : ordering)
+        {
+            if (node->op)
+            {
+                for (auto &child : node->children())
+                {
+                    if (!child->op)
+                    {
+                        pending_leaves[child.get()]++;
+                    }
+                }
+            }
+        }
+    }
 
     for (auto it = ordering.rbegin(); it != ordering.rend(); ++it)
     {
@@ -230,63 +309,79 @@ void Tensor::backward()
         if (tensor->op)
         {
             // Perform the backward pass
-            tensor->op->backward();
+            tensor->op->run_backward();
+
+            if (on_leaf_ready)
+            {
+                for (auto &child : tensor->children())
+                {
+                    auto leaf = pending_leaves.find(child.get());
+                    if (leaf != pending_leaves.end() && --leaf->second == 0)
+                    {
+                        on_leaf_ready(*child);
+                    }
+                }
+            }
+
+            if (!retain_graph)
+            {
+                tensor->release_graph(tensor.get() != this);
+                tensor->graph_released = true;
+                // Drop the ordering's reference so the node can be freed now
+                it->reset();
+            }
         }
     }
 }
 
-void Tensor::zero_grad()
+void Tensor::release_graph(bool release_grad)
 {
-    std::fill(grad.begin(), grad.end(), 0.0);
-    // If device is CUDA, copy the gradients to the device
-    if (device == DeviceType::CUDA)
+    if (op)
     {
-        cudaMemcpy(d_grad, grad.data(), size() * sizeof(float), cudaMemcpyHostToDevice);
+        op->inputs.clear();
+        op.reset();
     }
 
-    // Recursively zero the gradients of the children
-    for (auto child : children)
+    if (release_grad)
     {
-        child->zero_grad();
+        grad.release();
+        if (d_grad)
+        {
+            device_free(d_grad, size());
+        }
     }
 }
 
-// Builds a topological ordering of the compute graph
-void Tensor::topological_sort(std::vector<std::shared_ptr<Tensor>> &ordering)
+void Tensor::allocate_grad()
 {
-    // Visited set
-    std::unordered_set<std::shared_ptr<Tensor>> visited;
-
-    // Stack
-    std::stack<std::shared_ptr<Tensor>> stack;
-    stack.push(shared_from_this());
-
-    while (!stack.empty())
+    if (static_cast<int>(grad.size()) != size())
+    {
+        grad.assign(size(), 0.0f);
+    }
+    if (device == DeviceType::CUDA && d_grad == nullptr)
     {
-        // Get the top element
-        auto current = stack.top();
+        device_alloc(&d_grad, size());
+        cudaMemset(d_grad, 0, size() * sizeof(float));
+    }
+}
 
-        // If the current node is not visited
-        if (visited.find(current) == visited.end())
+void Tensor::zero_grad()
+{
+    // Each node is cleared once, however many paths lead to it
+    for_each_node(*this, [](Tensor &node)
+                  {
+        std::fill(node.grad.begin(), node.grad.end(), 0.0);
+        // If device is CUDA, copy the gradients to the device
+        if (node.device == DeviceType::CUDA && node.d_grad && !node.grad.empty())
         {
-            // Mark the current node as visited
-            visited.insert(current);
+            cudaMemcpy(node.d_grad, node.grad.data(), node.size() * sizeof(float), cudaMemcpyHostToDevice);
+        } });
+}
 
-            // Add children to the stack
-            for (auto child : current->children)
-            {
-                if (visited.find(child) == visited.end())
-                {
-                    stack.push(child);
-                }
-            }
-        }
-        else
-        {
-            stack.pop();
-            ordering.push_back(current);
-        }
-    }
+// Builds a topological ordering of the compute graph
+void Tensor::topological_sort(std::vector<std::shared_ptr<Tensor>> &ordering)
+{
+    topological_order(*this, ordering);
 }
 
 // Global operator overloads implementation
@@ -315,8 +410,11 @@ void Tensor::allocate_memory_on_device()
 {
     if (device == DeviceType::CUDA && d_data == nullptr)
     {
-        cudaMalloc(&d_data, size() * sizeof(float));
-        cudaMalloc(&d_grad, size() * sizeof(float));
+        device_alloc(&d_data, size());
+        if (d_grad == nullptr)
+        {
+            device_alloc(&d_grad, size());
+        }
 
         // Copy to GPU
         cudaMemcpy(d_data, data.data(), size() * sizeof(float), cudaMemcpyHostToDevice);
@@ -326,23 +424,20 @@ void Tensor::allocate_memory_on_device()
 
 void Tensor::to_device(DeviceType new_device)
 {
-    if (new_device == DeviceType::CUDA)
-    {
-        allocate_memory_on_device();
-        copy_to_device();
-        device = new_device;
-    }
-    else
-    {
-        copy_to_host();
-        device = new_device;
-    }
-
-    // Recursively move children to the same device
-    for (auto child : children)
-    {
-        child->to_device(new_device);
-    }
+    // Move the whole graph to the same device
+    for_each_node(*this, [new_device](Tensor &node)
+                  {
+        if (new_device == DeviceType::CUDA)
+        {
+            node.allocate_memory_on_device();
+            node.copy_to_device();
+            node.device = new_device;
+        }
+        else
+        {
+            node.copy_to_host();
+            node.device = new_device;
+        } });
 }
 
 void Tensor::copy_to_device()
@@ -350,7 +445,11 @@ void Tensor::copy_to_device()
     if (device == DeviceType::CUDA)
     {
         cudaMemcpy(d_data, data.data(), size() * sizeof(float), cudaMemcpyHostToDevice);
-        cudaMemcpy(d_grad, grad.data(), size() * sizeof(float), cudaMemcpyHostToDevice);
+        // The gradient of an intermediate may have been released by backward()
+        if (d_grad && !grad.empty())
+        {
+            cudaMemcpy(d_grad, grad.data(), size() * sizeof(float), cudaMemcpyHostToDevice);
+        }
     }
 }
 
@@ -359,6 +458,9 @@ void Tensor::copy_to_host()
     if (device == DeviceType::CUDA)
     {
         cudaMemcpy(data.data(), d_data, size() * sizeof(float), cudaMemcpyDeviceToHost);
-        cudaMemcpy(grad.data(), d_grad, size() * sizeof(float), cudaMemcpyDeviceToHost);
+        if (d_grad && !grad.empty())
+        {
+            cudaMemcpy(grad.data(), d_grad, size() * sizeof(float), cudaMemcpyDeviceToHost);
+        }
     }
 }
@@ -0,0 +1,210 @@
+// thread_pool.cpp
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+// Identifies the pool (and deque) of the calling worker thread, if any
+static thread_local ThreadPool *current_pool = nullptr;
+static thread_local int current_index = -1;
+
+ThreadPool::ThreadPool(int num_threads)
+{
+    if (num_threads <= 0)
+    {
+        throw std::invalid_argument("ThreadPool needs at least one thread.");
+    }
+    for (int i = 0; i < num_threads; i++)
+    {
+        queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    for (int i = 0; i < num_threads; i++)
+    {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    int index;
+    if (current_pool == this)
+    {
+        index = current_index;
+    }
+    else
+    {
+        index = static_cast<int>(next_queue.fetch_add(1) % queues.size());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::try_pop(int index, std::function<void()> &task)
+{
+    Queue &queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+    {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::try_steal(int index, std::function<void()> &task)
+{
+    int n = static_cast<int>(queues.size());
+    for (int offset = 1; offset < n; offset++)
+    {
+        Queue &victim = *queues[(index + offset) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(int index)
+{
+    current_pool = this;
+    current_index = index;
+
+    while (true)
+    {
+        std::function<void()> task;
+        if (try_pop(index, task) || try_steal(index, task))
+        {
+            {
+                std::lock_guard<std::mutex> lock(wake_mutex);
+                queued--;
+            }
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake.wait(lock, [this]
+                  { return stop || queued > 0; });
+        if (stop && queued == 0)
+        {
+            return;
+        }
+    }
+}
+
+// Global pool
+
+static std::mutex global_pool_mutex;
+static std::shared_ptr<ThreadPool> global_pool;
+static int num_threads_setting = 1;
+
+void set_num_threads(int num_threads)
+{
+    if (num_threads <= 0)
+    {
+        throw std::invalid_argument("Number of threads must be positive.");
+    }
+    std::lock_guard<std::mutex> lock(global_pool_mutex);
+    if (num_threads != num_threads_setting)
+    {
+        global_pool.reset();
+        num_threads_setting = num_threads;
+    }
+}
+
+int get_num_threads()
+{
+    std::lock_guard<std::mutex> lock(global_pool_mutex);
+    return num_threads_setting;
+}
+
+void parallel_for(size_t n, size_t grain, const std::function<void(size_t, size_t)> &fn)
+{
+    size_t chunks = std::min<size_t>(get_num_threads(), (n + std::max<size_t>(grain, 1) - 1) / std::max<size_t>(grain, 1));
+    if (chunks <= 1 || current_pool != nullptr)
+    {
+        fn(0, n);
+        return;
+    }
+
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t remaining = chunks - 1;
+    std::exception_ptr error;
+
+    auto run_chunk = [&](size_t c)
+    {
+        try
+        {
+            fn(n * c / chunks, n * (c + 1) / chunks);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+    };
+
+    std::shared_ptr<ThreadPool> pool = ThreadPool::global();
+    for (size_t c = 1; c < chunks; c++)
+    {
+        pool->submit([&, c]()
+                    {
+            run_chunk(c);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--remaining == 0)
+            {
+                done.notify_one();
+            } });
+    }
+    run_chunk(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&remaining]
+              { return remaining == 0; });
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+std::shared_ptr<ThreadPool> ThreadPool::global()
+{
+    std::lock_guard<std::mutex> lock(global_pool_mutex);
+    if (!global_pool)
+    {
+        global_pool = std::make_shared<ThreadPool>(num_threads_setting);
+    }
+    return global_pool;
+}
@@ -0,0 +1,48 @@
+// traversal.cpp
+
+#include "traversal.h"
+
+#include <atomic>
+
+static std::atomic<unsigned long> visit_generation{0};
+
+unsigned long next_visit_generation()
+{
+    return visit_generation.fetch_add(1) + 1;
+}
+
+void topological_order(Tensor &root, std::vector<std::shared_ptr<Tensor>> &ordering)
+{
+    // Each frame remembers the next child to descend into
+    struct Frame
+    {
+        Tensor *node;
+        size_t next_child;
+    };
+
+    unsigned long generation = next_visit_generation();
+    std::vector<Frame> stack;
+    root.visit_mark = generation;
+    stack.push_back({&root, 0});
+
+    while (!stack.empty())
+    {
+        Frame &frame = stack.back();
+        Tensor *node = frame.node;
+
+        if (frame.next_child < node->children().size())
+        {
+            Tensor *child = node->children()[frame.next_child++].get();
+            if (child->visit_mark != generation)
+            {
+                child->visit_mark = generation;
+                stack.push_back({child, 0});
+            }
+        }
+        else
+        {
+            stack.pop_back();
+            ordering.push_back(node->shared_from_this());
+        }
+    }
+}
@@ -0,0 +1,168 @@
+// expr_check.cpp
+//
+// Fused expressions (expr.h) against the same math built from eager ops:
+// values, gradients after backward() and jvp tangents. expr.h has no Python
+// binding, so this runs as a C++ test (ctest, or ./cugrad_expr_check).
+
+#include "expr.h"
+#include "forward_ad.h"
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+using TensorPtr = std::shared_ptr<Tensor>;
+using Build = std::function<TensorPtr(const TensorPtr &a, const TensorPtr &b, const TensorPtr &c)>;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAIL %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static void check_close(const float *x, const float *y, size_t n, const std::string &what)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (std::fabs(x[i] - y[i]) > 1e-5f * (1.0f + std::fabs(y[i])))
+        {
+            std::printf("FAIL %s: element %zu is %g, expected %g\n", what.c_str(), i, x[i], y[i]);
+            failures++;
+            return;
+        }
+    }
+}
+
+static TensorPtr tensor(std::initializer_list<float> values)
+{
+    auto t = std::make_shared<Tensor>(Shape{static_cast<int>(values.size())});
+    std::copy(values.begin(), values.end(), t->data.data());
+    return t;
+}
+
+// Fresh operands for each run, so gradients start from zero
+static std::vector<TensorPtr> operands()
+{
+    return {tensor({0.5f, -1.2f, 2.0f, -0.3f}), tensor({1.5f, 0.7f, -0.4f, 2.2f}),
+            tensor({-0.25f, 0.1f, 0.3f, -1.0f})};
+}
+
+static void compare(const std::string &name, const Build &eager, const Build &fused)
+{
+    auto x = operands();
+    auto y = operands();
+    auto expected = eager(x[0], x[1], x[2]);
+    auto actual = fused(y[0], y[1], y[2]);
+    check(actual->op && actual->op->op_type() == std::string("fused"), name + ": one fused node");
+    check_close(actual->data.data(), expected->data.data(), expected->data.size(), name + " value");
+
+    expected->backward();
+    actual->backward();
+    for (size_t k = 0; k < x.size(); k++)
+    {
+        check_close(y[k]->grad.data(), x[k]->grad.data(), x[k]->grad.size(), name + " grad " + std::to_string(k));
+    }
+
+    std::vector<TensorPtr> tangents = {tensor({1.0f, 0.5f, -2.0f, 0.25f}), tensor({-0.5f, 1.0f, 0.3f, 2.0f}),
+                                       tensor({0.75f, -1.0f, 1.5f, 0.0f})};
+    auto run = [](const Build &build)
+    {
+        return [&build](const std::vector<TensorPtr> &p)
+        { return std::vector<TensorPtr>{build(p[0], p[1], p[2])}; };
+    };
+    auto eager_jvp = jvp(run(eager), operands(), tangents);
+    auto fused_jvp = jvp(run(fused), operands(), tangents);
+    check_close(fused_jvp.first[0]->data.data(), eager_jvp.first[0]->data.data(), 4, name + " jvp value");
+    check_close(fused_jvp.second[0]->data.data(), eager_jvp.second[0]->data.data(), 4, name + " jvp tangent");
+}
+
+template <typename F>
+static void expect_invalid_argument(const std::string &what, F f)
+{
+    try
+    {
+        f();
+    }
+    catch (const std::invalid_argument &)
+    {
+        return;
+    }
+    std::printf("FAIL %s: no std::invalid_argument\n", what.c_str());
+    failures++;
+}
+
+int main()
+{
+    using expr::leaf;
+
+    compare(
+        "tanh(a * b + c)",
+        [](const TensorPtr &a, const TensorPtr &b, const TensorPtr &c)
+        { return (a * b + c)->tanh(); },
+        [](const TensorPtr &a, const TensorPtr &b, const TensorPtr &c)
+        { return expr::fuse((leaf(a) * b + c).tanh()); });
+
+    // One input slot, both factors accumulating into its gradient
+    compare(
+        "a * a",
+        [](const TensorPtr &a, const TensorPtr &, const TensorPtr &)
+        { return a * a; },
+        [](const TensorPtr &a, const TensorPtr &, const TensorPtr &)
+        { return expr::fuse(leaf(a) * a); });
+    {
+        auto a = tensor({1.0f, 2.0f});
+        check(expr::fuse(leaf(a) * a)->op->inputs.size() == 1, "a * a has one input");
+    }
+
+    compare(
+        "a / 2 - b",
+        [](const TensorPtr &a, const TensorPtr &b, const TensorPtr &)
+        { return a / std::make_shared<Tensor>(a->shape, 2.0f) - b; },
+        [](const TensorPtr &a, const TensorPtr &b, const TensorPtr &)
+        { return expr::fuse(leaf(a) / 2.0f - b); });
+
+    compare(
+        "relu(a - b) + exp(c)",
+        [](const TensorPtr &a, const TensorPtr &b, const TensorPtr &c)
+        { return (a - b)->relu() + c->exp(); },
+        [](const TensorPtr &a, const TensorPtr &b, const TensorPtr &c)
+        { return expr::fuse((leaf(a) - b).relu() + leaf(c).exp()); });
+
+    // In place into one of the operands
+    {
+        auto x = operands();
+        auto expected = x[0] * x[1];
+        expr::assign(*x[0], leaf(x[0]) * x[1]);
+        check_close(x[0]->data.data(), expected->data.data(), 4, "assign(a, a * b)");
+        check(!x[0]->op, "assign leaves a as a leaf");
+    }
+
+    auto a = tensor({1.0f, 2.0f, 3.0f});
+    auto b = tensor({1.0f, 2.0f});
+    expect_invalid_argument("shape mismatch", [&]
+                            { expr::fuse(leaf(a) * b); });
+    expect_invalid_argument("assign to another shape", [&]
+                            { expr::assign(*b, leaf(a) * 2.0f); });
+    expect_invalid_argument("null operand", [&]
+                            { expr::fuse(leaf(nullptr) + 1.0f); });
+    expect_invalid_argument("no tensor operand", [&]
+                            { expr::eval(expr::Scalar(1.0f) + 2.0f); });
+    a->device = DeviceType::CUDA;
+    expect_invalid_argument("CUDA operand", [&]
+                            { expr::fuse(leaf(a) * 2.0f); });
+    a->device = DeviceType::CPU;
+
+    if (failures)
+    {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("expr checks passed\n");
+    return 0;
+}
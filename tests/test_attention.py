@@ -0,0 +1,92 @@
+import unittest
+import numpy as np
+from cugrad.tensor import Tensor, attention
+from cugrad import set_device, DeviceType
+
+set_device(DeviceType.CPU)
+
+
+def attention_reference(q, k, v, mask=None, causal=False):
+    q, k, v = (x.astype(np.float64) for x in (q, k, v))
+    scores = q @ np.swapaxes(k, -1, -2) / np.sqrt(q.shape[-1])
+    allowed = np.ones(scores.shape[-2:], dtype=bool)
+    if mask is not None:
+        allowed &= mask != 0
+    if causal:
+        allowed &= np.tril(np.ones_like(allowed))
+    scores = np.where(allowed, scores, -np.inf)
+    row_max = np.max(scores, axis=-1, keepdims=True)
+    weights = np.exp(scores - np.where(np.isfinite(row_max), row_max, 0.0))
+    sums = weights.sum(axis=-1, keepdims=True)
+    return (weights / np.where(sums > 0, sums, 1.0)) @ v
+
+
+def random_tensor(rng, *shape):
+    return rng.normal(size=shape).astype(np.float32)
+
+
+class TestAttention(unittest.TestCase):
+    def check(self, q, k, v, mask=None, causal=False):
+        out = attention(Tensor(q), Tensor(k), Tensor(v), None if mask is None else Tensor(mask), causal)
+        expected = attention_reference(q, k, v, mask, causal)
+        self.assertEqual(out.shape, list(expected.shape))
+        np.testing.assert_allclose(np.array(out.data).reshape(expected.shape), expected, atol=1e-5)
+
+    def test_matches_reference(self):
+        rng = np.random.RandomState(0)
+        # Sequence lengths that span several tiles and end mid-tile
+        q, k, v = random_tensor(rng, 70, 8), random_tensor(rng, 130, 8), random_tensor(rng, 130, 5)
+        self.check(q, k, v)
+        mask = (rng.uniform(size=(70, 130)) > 0.3).astype(np.float32)
+        self.check(q, k, v, mask)
+
+        # Batch and head dimensions, causal
+        q, k, v = (random_tensor(rng, 2, 3, 40, 4) for _ in range(3))
+        self.check(q, k, v, causal=True)
+
+    def test_fully_masked_row(self):
+        rng = np.random.RandomState(1)
+        q, k, v = random_tensor(rng, 4, 3), random_tensor(rng, 6, 3), random_tensor(rng, 6, 2)
+        mask = np.ones((4, 6), dtype=np.float32)
+        mask[2] = 0.0
+        out = np.array(attention(Tensor(q), Tensor(k), Tensor(v), Tensor(mask)).data).reshape(4, 2)
+        np.testing.assert_array_equal(out[2], [0.0, 0.0])
+        np.testing.assert_allclose(out, attention_reference(q, k, v, mask), atol=1e-5)
+
+    def test_gradients(self):
+        # loss = sum(out * coef) against central differences
+        rng = np.random.RandomState(2)
+        arrays = [random_tensor(rng, 2, 37, 6), random_tensor(rng, 2, 70, 6), random_tensor(rng, 2, 70, 3)]
+        for causal in (False, True):
+            q, k, v = (Tensor(a) for a in arrays)
+            coef = Tensor(np.cos(np.arange(2 * 37 * 3)).reshape(2, 37, 3).astype(np.float32))
+
+            def loss():
+                return (attention(q, k, v, None, causal) * coef).sum()
+
+            loss().backward()
+            for tensor in (q, k, v):
+                grad = list(tensor.grad)
+                data = list(tensor.data)
+                for i in range(0, len(data), 13):
+                    eps = 1e-2
+                    tensor.data = data[:i] + [data[i] + eps] + data[i + 1:]
+                    plus = loss().data[0]
+                    tensor.data = data[:i] + [data[i] - eps] + data[i + 1:]
+                    minus = loss().data[0]
+                    tensor.data = data
+                    self.assertAlmostEqual(grad[i], (plus - minus) / (2 * eps), delta=2e-3 * max(1.0, abs(grad[i])))
+
+    def test_shape_errors(self):
+        rng = np.random.RandomState(3)
+        q, v = Tensor(random_tensor(rng, 3, 4)), Tensor(random_tensor(rng, 5, 4))
+        with self.assertRaises(ValueError):
+            attention(q, Tensor(random_tensor(rng, 5, 3)), v)
+        with self.assertRaises(ValueError):
+            attention(q, Tensor(random_tensor(rng, 5, 4)), Tensor(random_tensor(rng, 6, 4)))
+        with self.assertRaises(ValueError):
+            attention(q, Tensor(random_tensor(rng, 5, 4)), v, Tensor(random_tensor(rng, 5, 3)))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,115 @@
+import unittest
+import numpy as np
+from cugrad.tensor import Tensor, attention
+from cugrad import set_device, DeviceType, capture
+from cugrad.nn import MLP
+
+set_device(DeviceType.CPU)
+
+
+class TestCapture(unittest.TestCase):
+    def test_replay_matches_eager(self):
+        model = MLP(input_size=2, layer_sizes=[3, 1])
+        x = Tensor([0.5, -1.0])
+        target = Tensor([1.0])
+        out = model(x)
+        loss = (out - target) * (out - target)
+
+        graph = capture(loss, [x, target])
+        self.assertTrue(graph.num_ops() > 0)
+
+        # Replay with new values
+        model.zero_grad()
+        graph.replay([[2.0, 0.25], [0.0]])
+        replay_loss = list(graph.output.data)
+        replay_grads = [list(p.grad) for p in model.parameters()]
+
+        # Eager computation on the same values
+        model.zero_grad()
+        x2 = Tensor([2.0, 0.25])
+        target2 = Tensor([0.0])
+        out2 = model(x2)
+        loss2 = (out2 - target2) * (out2 - target2)
+        loss2.backward()
+
+        self.assertAlmostEqual(replay_loss[0], loss2.data[0], places=5)
+        for replayed, param in zip(replay_grads, model.parameters()):
+            for g_replay, g_eager in zip(replayed, param.grad):
+                self.assertAlmostEqual(g_replay, g_eager, places=5)
+
+    def test_replay_rejects_wrong_size(self):
+        x = Tensor([1.0, 2.0])
+        loss = (x * x).sum()
+        graph = capture(loss, [x])
+        with self.assertRaises(ValueError):
+            graph.replay([[1.0]])
+
+    def test_planned_replay_matches_unplanned(self):
+        model = MLP(input_size=3, layer_sizes=[8, 8, 1])
+        x = Tensor([0.1, 0.2, 0.3])
+        out = model(x)
+        loss = (out * out).sum()
+        graph = capture(loss, [x])
+
+        model.zero_grad()
+        graph.replay([[0.5, -0.5, 1.0]])
+        expected_loss = graph.output.data[0]
+        expected = [list(p.grad) for p in model.parameters()]
+
+        stats = graph.plan_memory()
+        self.assertTrue(stats.planned_bytes < stats.naive_bytes)
+
+        model.zero_grad()
+        graph.replay([[0.5, -0.5, 1.0]])
+        self.assertAlmostEqual(graph.output.data[0], expected_loss, places=5)
+        for grads, param in zip(expected, model.parameters()):
+            for a, b in zip(grads, param.grad):
+                self.assertAlmostEqual(a, b, places=5)
+
+    def test_optimize_merges_and_folds(self):
+        x = Tensor([0.5])
+        w = Tensor([2.0])
+        two = Tensor([2.0])
+        three = Tensor([3.0])
+        two.constant = True
+        three.constant = True
+
+        folded = (two * three).exp()
+        a = (x * w).tanh()
+        b = (w * x).tanh()
+        loss = ((a + b) * folded).sum()
+
+        graph = capture(loss, [x])
+        w.zero_grad()
+        graph.replay([[0.7]])
+        expected_loss = graph.output.data[0]
+        expected_grad = w.grad[0]
+
+        stats = graph.optimize()
+        self.assertEqual(stats.cse_merged, 2)
+        self.assertEqual(stats.constants_folded, 2)
+        self.assertEqual(stats.ops_after, graph.num_ops())
+        self.assertTrue(stats.ops_after < stats.ops_before)
+
+        w.zero_grad()
+        graph.replay([[0.7]])
+        self.assertAlmostEqual(graph.output.data[0], expected_loss, places=4)
+        self.assertAlmostEqual(w.grad[0], expected_grad, places=4)
+
+    def test_optimize_keeps_ops_that_differ_beyond_inputs(self):
+        rng = np.random.default_rng(0)
+        q, k, v = (Tensor(rng.standard_normal((3, 2)).astype(np.float32)) for _ in range(3))
+        loss = (attention(q, k, v) + attention(q, k, v, None, True)).sum()
+
+        graph = capture(loss, [q])
+        graph.replay()
+        expected_loss = graph.output.data[0]
+
+        stats = graph.optimize()
+        self.assertEqual(stats.cse_merged, 0)
+        graph.replay()
+        self.assertAlmostEqual(graph.output.data[0], expected_loss, places=4)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,79 @@
+import os
+import tempfile
+import unittest
+import numpy as np
+from cugrad.data import DataLoader
+from cugrad import set_device, DeviceType
+
+set_device(DeviceType.CPU)
+
+
+def make_dataset(rows=103, cols=4):
+    X = np.arange(rows * cols, dtype=np.float32).reshape(rows, cols)
+    y = np.arange(rows, dtype=np.float32)
+    return X, y
+
+
+class TestDataLoader(unittest.TestCase):
+    def collect(self, loader):
+        ids = []
+        for batch in loader:
+            inputs = np.array(batch.inputs.data).reshape(batch.inputs.shape)
+            targets = np.array(batch.targets.data).reshape(batch.targets.shape)
+            for row, target in zip(inputs, targets):
+                self.assertEqual(row[0], target[0] * row.shape[0])
+            ids.extend(int(t) for t in targets[:, 0])
+        return ids
+
+    def test_epoch_covers_every_row(self):
+        X, y = make_dataset()
+        loader = DataLoader(X, y, batch_size=10, num_workers=3, prefetch=2, seed=1)
+        self.assertEqual(len(loader), 11)
+        first = self.collect(loader)
+        second = self.collect(loader)
+        self.assertEqual(sorted(first), list(range(len(X))))
+        self.assertEqual(sorted(second), list(range(len(X))))
+        self.assertNotEqual(first, second)
+        self.assertEqual(loader.epoch, 2)
+
+    def test_order_is_seeded(self):
+        X, y = make_dataset()
+        runs = [self.collect(DataLoader(X, y, batch_size=16, seed=5)) for _ in range(2)]
+        self.assertEqual(runs[0], runs[1])
+        self.assertEqual(self.collect(DataLoader(X, y, batch_size=16, shuffle=False)), list(range(len(X))))
+
+    def test_drop_last_and_split_rows(self):
+        X, y = make_dataset()
+        loader = DataLoader(X, y, batch_size=10, drop_last=True, split_rows=True)
+        batches = list(loader)
+        self.assertEqual(len(batches), 10)
+        for batch in batches:
+            self.assertEqual(batch.inputs.shape, [10, 4])
+            self.assertEqual(len(batch.input_rows), 10)
+            self.assertEqual(batch.input_rows[3].data, batch.inputs.data[12:16])
+            self.assertEqual(batch.target_rows[3].data, [batch.targets.data[3]])
+
+    def test_from_npy(self):
+        X, y = make_dataset()
+        with tempfile.TemporaryDirectory() as tmp:
+            x_path = os.path.join(tmp, "x.npy")
+            y_path = os.path.join(tmp, "y.npy")
+            np.save(x_path, X)
+            np.save(y_path, y)
+            loader = DataLoader.from_npy(x_path, y_path, batch_size=25)
+            self.assertEqual(loader.num_rows, len(X))
+            self.assertEqual(sorted(self.collect(loader)), list(range(len(X))))
+            del loader
+
+            np.save(x_path, X.astype(np.float64))
+            with self.assertRaises(ValueError):
+                DataLoader.from_npy(x_path)
+
+    def test_mismatched_rows(self):
+        X, y = make_dataset()
+        with self.assertRaises(ValueError):
+            DataLoader(X, y[:-1])
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,88 @@
+import unittest
+import numpy as np
+from cugrad.tensor import Tensor
+from cugrad.nn import MLP, DataParallel
+from cugrad.optimizer import SGD, Adam
+from cugrad import set_device, DeviceType
+
+set_device(DeviceType.CPU)
+
+
+def make_batch(batch=12, features=3, seed=0):
+    rng = np.random.RandomState(seed)
+    X = rng.normal(size=(batch, features)).astype(np.float32)
+    y = np.tanh(X.sum(axis=1, keepdims=True)).astype(np.float32)
+    return X, y
+
+
+def squared_error(output, target):
+    error = output - target
+    return (error * error).sum()
+
+
+def reference_step(model, optimizer, X, y, loss_fn=squared_error):
+    optimizer.zero_grad()
+    loss = None
+    for row, target in zip(X, y):
+        sample = loss_fn(model(Tensor(row)), Tensor(target))
+        loss = sample if loss is None else loss + sample
+    loss = loss * Tensor([1.0 / len(X)])
+    loss.backward()
+    optimizer.step()
+    return loss.data[0]
+
+
+class TestDataParallel(unittest.TestCase):
+    def test_matches_single_model(self):
+        X, y = make_batch()
+        for optimizer_type in (SGD, Adam):
+            reference = MLP(3, [8, 1])
+            model = reference.clone()
+            ref_optimizer = optimizer_type(reference.parameters(), lr=0.05)
+            parallel = DataParallel(model, optimizer_type(model.parameters(), lr=0.05), num_replicas=3,
+                                    bucket_elements=8)
+            self.assertEqual(parallel.num_replicas, 3)
+            self.assertGreater(parallel.num_buckets, 1)
+
+            for _ in range(3):
+                expected = reference_step(reference, ref_optimizer, X, y)
+                loss = parallel.train_step(Tensor(X), Tensor(y))
+                self.assertAlmostEqual(loss, expected, places=4)
+
+            for index in range(3):
+                for p, q in zip(reference.parameters(), parallel.replica(index).parameters()):
+                    for a, b in zip(p.data, q.data):
+                        self.assertAlmostEqual(a, b, places=5)
+
+    def test_custom_loss(self):
+        X, y = make_batch()
+
+        def squashed_error(output, target):
+            error = (output - target).tanh()
+            return (error * error).sum()
+
+        reference = MLP(3, [8, 1])
+        model = reference.clone()
+        ref_optimizer = SGD(reference.parameters(), lr=0.05)
+        parallel = DataParallel(model, SGD(model.parameters(), lr=0.05), num_replicas=2, loss=squashed_error)
+        for _ in range(2):
+            expected = reference_step(reference, ref_optimizer, X, y, squashed_error)
+            self.assertAlmostEqual(parallel.train_step(Tensor(X), Tensor(y)), expected, places=4)
+
+    def test_small_batch_and_errors(self):
+        X, y = make_batch(batch=2)
+        model = MLP(3, [4, 1])
+        parallel = DataParallel(model, SGD(model.parameters(), lr=0.1), num_replicas=4)
+        # Replicas without rows still take part in the reduction
+        parallel.train_step(Tensor(X), Tensor(y))
+        for p, q in zip(parallel.replica(0).parameters(), parallel.replica(3).parameters()):
+            self.assertEqual(p.data, q.data)
+
+        with self.assertRaises(ValueError):
+            parallel.train_step(Tensor(X), Tensor(np.zeros((2, 2), dtype=np.float32)))
+        # Still usable after a failed step
+        parallel.train_step(Tensor(X), Tensor(y))
+
+
+if __name__ == "__main__":
+    unittest.main()
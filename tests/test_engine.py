@@ -0,0 +1,40 @@
+import unittest
+from cugrad.tensor import Tensor
+from cugrad import set_device, DeviceType, set_num_threads, get_num_threads
+from cugrad.nn import MLP
+
+set_device(DeviceType.CPU)
+
+
+def parameter_grads(model, num_threads):
+    set_num_threads(num_threads)
+    model.zero_grad()
+    x = Tensor([0.1 * i for i in range(8)])
+    target = Tensor([1.0])
+    out = model(x)
+    loss = (out - target) * (out - target)
+    loss.backward()
+    return [g for p in model.parameters() for g in p.grad]
+
+
+class TestParallelBackward(unittest.TestCase):
+    def tearDown(self):
+        set_num_threads(1)
+
+    def test_set_num_threads(self):
+        set_num_threads(3)
+        self.assertEqual(get_num_threads(), 3)
+        with self.assertRaises(ValueError):
+            set_num_threads(0)
+
+    def test_parallel_matches_serial(self):
+        model = MLP(input_size=8, layer_sizes=[32, 32, 1])
+        serial = parameter_grads(model, 1)
+        parallel = parameter_grads(model, 4)
+        self.assertEqual(len(serial), len(parallel))
+        for a, b in zip(serial, parallel):
+            self.assertAlmostEqual(a, b, places=4)
+
+
+if __name__ == "__main__":
+    unittest.main()
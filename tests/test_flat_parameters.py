@@ -0,0 +1,39 @@
+import unittest
+from cugrad.tensor import Tensor
+from cugrad.nn import MLP
+from cugrad.optimizer import SGD
+from cugrad import set_device, DeviceType
+
+set_device(DeviceType.CPU)
+
+
+class TestFlatParameters(unittest.TestCase):
+    def test_flatten_keeps_values(self):
+        model = MLP(3, [4, 1])
+        before = [list(p.data) for p in model.parameters()]
+        model.flatten_parameters()
+        self.assertTrue(model.is_flat)
+        self.assertEqual([list(p.data) for p in model.parameters()], before)
+
+    def test_step_and_zero_grad(self):
+        model = MLP(3, [4, 1])
+        model.flatten_parameters()
+        optimizer = SGD(model.parameters(), lr=0.1)
+
+        loss = model(Tensor([0.5, -1.0, 2.0])).sum()
+        loss.backward()
+        params = model.parameters()
+        expected = [[d - 0.1 * g for d, g in zip(p.data, p.grad)] for p in params]
+        self.assertTrue(any(g != 0.0 for p in params for g in p.grad))
+
+        optimizer.step()
+        for p, e in zip(params, expected):
+            for a, b in zip(p.data, e):
+                self.assertAlmostEqual(a, b, places=5)
+
+        optimizer.zero_grad()
+        self.assertTrue(all(g == 0.0 for p in params for g in p.grad))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,64 @@
+import unittest
+import math
+import cugrad
+from cugrad.tensor import Tensor
+from cugrad import set_device, DeviceType, jvp
+from cugrad.nn import MLP
+
+set_device(DeviceType.CPU)
+
+
+class TestForwardAD(unittest.TestCase):
+    def test_jvp_elementwise(self):
+        def fn(x, y):
+            return (x * y).tanh() + x.exp()
+
+        x = Tensor([0.5, -1.0])
+        y = Tensor([2.0, 0.25])
+        out, tangent = jvp(fn, [x, y], [Tensor([1.0, 0.0]), Tensor([0.0, 0.0])])
+
+        for i, (a, b) in enumerate([(0.5, 2.0), (-1.0, 0.25)]):
+            t = math.tanh(a * b)
+            self.assertAlmostEqual(out.data[i], t + math.exp(a), places=5)
+            # d/dx [tanh(x*y) + exp(x)] = (1 - tanh^2) * y + exp(x)
+            self.assertAlmostEqual(tangent.data[i], (1 - t * t) * b + math.exp(a), places=5)
+
+    def test_jvp_matches_backward(self):
+        model = MLP(input_size=3, layer_sizes=[4, 1])
+        x = Tensor([0.1, 0.2, 0.3])
+        direction = [1.0, -2.0, 0.5]
+
+        out, tangent = jvp(lambda inp: model(inp), [x], [Tensor(direction)])
+
+        model.zero_grad()
+        y = model(x)
+        y.backward()
+        expected = sum(g * d for g, d in zip(x.grad, direction))
+        self.assertAlmostEqual(out.data[0], y.data[0], places=5)
+        self.assertAlmostEqual(tangent.data[0], expected, places=4)
+
+    def test_jvp_multiple_outputs(self):
+        x = Tensor([3.0])
+        outs, tangents = jvp(lambda a: [a * a, a.sum()], [x], [Tensor([1.0])])
+        self.assertEqual(len(outs), 2)
+        self.assertAlmostEqual(tangents[0].data[0], 6.0, places=5)
+        self.assertAlmostEqual(tangents[1].data[0], 1.0, places=5)
+
+    def test_jvp_clears_every_tangent(self):
+        model = MLP(input_size=3, layer_sizes=[4, 1])
+        x = Tensor([0.1, 0.2, 0.3])
+        with cugrad.no_grad():
+            # The outputs are detached, so the weights are not reachable from them
+            out, tangent = jvp(lambda inp: model(inp), [x], [Tensor([1.0, 0.0, 0.0])])
+        self.assertNotEqual(tangent.data, [0.0])
+        self.assertEqual(x.tangent, [])
+        for param in model.parameters():
+            self.assertEqual(param.tangent, [])
+
+        # Later ops on the weights take the ordinary path again
+        y = model(x)
+        self.assertEqual(y.tangent, [])
+
+
+if __name__ == "__main__":
+    unittest.main()
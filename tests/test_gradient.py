@@ -216,6 +216,58 @@ class TestGradients(unittest.TestCase):
         expected_grad = [1.0, 1.0, 1.0]
         self.assertEqual(t.grad, expected_grad)
 
+    # -------------------- Graph release Tests --------------------
+
+    def test_backward_releases_graph(self):
+        a = Tensor([2.0])
+        b = Tensor([3.0])
+        c = a * b
+        d = c + a
+        d.backward()
+
+        # Leaves and the root keep their gradients, intermediates are freed
+        self.assertEqual(a.grad, [4.0])
+        self.assertEqual(b.grad, [2.0])
+        self.assertEqual(d.grad, [1.0])
+        self.assertEqual(c.grad, [])
+        self.assertIsNone(d.op)
+        self.assertEqual(d.children, [])
+
+    def test_backward_retain_graph(self):
+        a = Tensor([2.0])
+        b = Tensor([3.0])
+        c = a * b
+        d = c + a
+        d.backward(retain_graph=True)
+        self.assertEqual(c.grad, [1.0])
+        self.assertIsNotNone(d.op)
+
+        # A second backward through the retained graph accumulates
+        d.backward()
+        self.assertEqual(a.grad, [8.0])
+
+    def test_backward_through_freed_graph_raises(self):
+        x = Tensor([2.0])
+        y = x.tanh()
+        l1 = y.sum()
+        l2 = (y * y).sum()
+        l1.backward()
+        # y lost its op to the first backward; treating it as a leaf would
+        # silently drop the second loss's gradient with respect to x
+        with self.assertRaises(RuntimeError):
+            l2.backward()
+        with self.assertRaises(RuntimeError):
+            l1.backward()
+
+        x = Tensor([2.0])
+        y = x.tanh()
+        l1 = y.sum()
+        l2 = (y * y).sum()
+        l1.backward(retain_graph=True)
+        l2.backward()
+        t = math.tanh(2.0)
+        self.assertAlmostEqual(x.grad[0], (1 + 2 * t) * (1 - t * t), places=4)
+
 
 if __name__ == "__main__":
     unittest.main()
@@ -0,0 +1,109 @@
+import unittest
+import numpy as np
+from cugrad.tensor import Tensor
+from cugrad.nn import MLP, Layer
+from cugrad.optimizer import SGD
+from cugrad.data import DataLoader
+from cugrad import set_device, DeviceType, memory_snapshot, get_num_threads, set_num_threads
+
+set_device(DeviceType.CPU)
+
+
+class TestGraphNodes(unittest.TestCase):
+    def test_children_are_op_inputs(self):
+        a = Tensor([1.0, 2.0])
+        b = Tensor([3.0, 4.0])
+        c = a * b
+        self.assertEqual(c.op.op_type, "mul")
+        self.assertEqual(len(c.children), 2)
+        self.assertIs(c.children[0], a)
+        self.assertIs(c.children[1], b)
+        self.assertEqual(a.children, [])
+
+    def test_children_cannot_disagree_with_op(self):
+        a = Tensor([1.0])
+        with self.assertRaises(ValueError):
+            Tensor([1], 0.0, None, [a])
+
+    def test_shape_round_trip(self):
+        t = Tensor([1.0] * 6)
+        self.assertEqual(t.shape, [6])
+        t.shape = [2, 3]
+        self.assertEqual(t.shape, [2, 3])
+        t.shape = [1, 1, 2, 1, 3, 1]
+        self.assertEqual(t.shape, [1, 1, 2, 1, 3, 1])
+
+    def test_shared_node_is_listed_once(self):
+        x = Tensor([0.5, -1.0, 2.0])
+        # x feeds every neuron of the layer
+        out = Layer(3, 4)(x).sum()
+        ordering = out.topological_sort()
+        self.assertEqual(sum(1 for node in ordering if node is x), 1)
+        self.assertEqual(len({id(node) for node in ordering}), len(ordering))
+        self.assertIs(ordering[-1], out)
+
+        out.backward()
+        ones = Tensor([1.0, 1.0, 1.0])
+        diamond = x * ones + x
+        diamond.zero_grad()
+        diamond.backward()
+        self.assertEqual(x.grad, [2.0, 2.0, 2.0])
+
+    def test_deep_graph_does_not_overflow(self):
+        x = Tensor([1.0])
+        step = Tensor([0.001])
+        y = x
+        for _ in range(100000):
+            y = y + step
+        self.assertEqual(len(y.topological_sort()), 100002)
+        y.zero_grad()
+        y.backward()
+        self.assertEqual(x.grad, [1.0])
+        self.assertEqual(step.grad, [100000.0])
+
+    def test_training_reuses_node_memory(self):
+        model = MLP(4, [8, 1])
+        optimizer = SGD(model.parameters(), lr=0.01)
+        x = Tensor([0.1, 0.2, 0.3, 0.4])
+
+        def step():
+            optimizer.zero_grad()
+            model(x).sum().backward()
+            optimizer.step()
+
+        step()
+        reserved = memory_snapshot().node_pool_bytes
+        for _ in range(20):
+            step()
+        self.assertEqual(memory_snapshot().node_pool_bytes, reserved)
+
+        # Rows are allocated on the loader's workers and freed here, and
+        # backward frees graph nodes on the pool threads
+        X = np.linspace(0.0, 1.0, 64 * 4, dtype=np.float32).reshape(64, 4)
+        loader = DataLoader(X, np.zeros((64, 1), dtype=np.float32), batch_size=16, num_workers=2, split_rows=True)
+
+        def epoch():
+            for batch in loader:
+                optimizer.zero_grad()
+                loss = None
+                for row in batch.input_rows:
+                    out = model(row).sum()
+                    loss = out if loss is None else loss + out
+                loss.backward()
+                optimizer.step()
+
+        threads = get_num_threads()
+        set_num_threads(4)
+        try:
+            for _ in range(5):
+                epoch()
+            reserved = memory_snapshot().node_pool_bytes
+            for _ in range(10):
+                epoch()
+            self.assertEqual(memory_snapshot().node_pool_bytes, reserved)
+        finally:
+            set_num_threads(threads)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,109 @@
+import threading
+import unittest
+import numpy as np
+from cugrad.tensor import Tensor
+from cugrad.nn import MLP, Layer
+from cugrad.inference import InferencePlan, InferenceServer, available_int8_kernels, set_int8_kernel
+from cugrad import set_device, DeviceType
+
+set_device(DeviceType.CPU)
+
+
+def make_inputs(rows=40, features=3, seed=0):
+    rng = np.random.RandomState(seed)
+    return rng.normal(size=(rows, features)).astype(np.float32)
+
+
+class TestInference(unittest.TestCase):
+    def test_plan_matches_module(self):
+        X = make_inputs()
+        for model in (MLP(3, [8, 8, 2]), Layer(3, 4, False)):
+            plan = InferencePlan.freeze(model)
+            self.assertEqual(plan.input_size, 3)
+            outputs = plan.run(X)
+            self.assertEqual(outputs.shape, (len(X), plan.output_size))
+            for row, output in zip(X, outputs):
+                np.testing.assert_allclose(output, model(Tensor(row)).data, rtol=1e-5, atol=1e-6)
+            np.testing.assert_allclose(plan.run(X[0]), outputs[0], rtol=1e-6)
+
+        with self.assertRaises(ValueError):
+            plan.run(np.zeros((2, 5), dtype=np.float32))
+
+    def test_plan_is_a_snapshot(self):
+        model = MLP(3, [4, 1])
+        plan = InferencePlan.freeze(model)
+        before = plan.run(make_inputs(rows=1))
+        for p in model.parameters():
+            p.data = [v + 1.0 for v in p.data]
+        np.testing.assert_array_equal(plan.run(make_inputs(rows=1)), before)
+
+    def test_int8_quantization(self):
+        X = make_inputs(rows=256, features=16, seed=1)
+        model = MLP(16, [32, 32, 2])
+        plan = InferencePlan.freeze(model)
+        quantized = plan.quantize(X[:128])
+        self.assertTrue(quantized.quantized)
+        self.assertFalse(plan.quantized)
+        self.assertLess(quantized.weight_bytes * 2, plan.weight_bytes)
+
+        report = quantized.compare(plan, X[128:])
+        self.assertEqual(report.rows, 128)
+        self.assertEqual(report.reference_weight_bytes, plan.weight_bytes)
+        self.assertLess(report.rms_error, 0.05 * report.reference_rms)
+        self.assertLessEqual(report.mean_abs_error, report.max_abs_error)
+
+        # Every kernel computes the same integer products
+        kernels = available_int8_kernels()
+        self.assertEqual(kernels[-1], "scalar")
+        try:
+            set_int8_kernel("scalar")
+            expected = quantized.run(X)
+            for kernel in kernels:
+                set_int8_kernel(kernel)
+                np.testing.assert_array_equal(quantized.run(X), expected)
+        finally:
+            set_int8_kernel("auto")
+
+        with self.assertRaises(ValueError):
+            set_int8_kernel("no_such_kernel")
+
+    def test_server_batches_concurrent_requests(self):
+        X = make_inputs(rows=64)
+        model = MLP(3, [8, 1])
+        plan = InferencePlan.freeze(model)
+        expected = plan.run(X)
+        server = InferenceServer(plan, max_batch=8, max_delay_us=5000, num_workers=2)
+
+        results = [None] * len(X)
+
+        def client(start):
+            for i in range(start, len(X), 8):
+                results[i] = server.infer(X[i].tolist())
+
+        threads = [threading.Thread(target=client, args=(start,)) for start in range(8)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        np.testing.assert_allclose(np.array(results), expected, rtol=1e-6)
+
+        futures = [server.submit(row.tolist()) for row in X[:10]]
+        np.testing.assert_allclose(np.array([f.result() for f in futures]), expected[:10], rtol=1e-6)
+
+        stats = server.stats()
+        self.assertEqual(stats.requests, 74)
+        self.assertEqual(sum(n * count for n, count in enumerate(stats.batch_histogram)), 74)
+        self.assertEqual(sum(stats.batch_histogram), stats.batches)
+        self.assertLessEqual(len(stats.batch_histogram), 9)
+        self.assertGreater(stats.mean_batch_size, 1.0)
+        self.assertLessEqual(stats.p50_latency_us, stats.p99_latency_us)
+        self.assertLessEqual(stats.p99_latency_us, stats.max_latency_us)
+
+        server.reset_stats()
+        self.assertEqual(server.stats().requests, 0)
+        with self.assertRaises(ValueError):
+            server.infer([1.0, 2.0])
+
+
+if __name__ == "__main__":
+    unittest.main()
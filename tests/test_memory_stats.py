@@ -0,0 +1,67 @@
+import threading
+import unittest
+from cugrad.tensor import Tensor
+from cugrad import set_device, DeviceType, memory_snapshot, memory_diff, memory_summary, largest_graphs
+
+set_device(DeviceType.CPU)
+
+
+class TestMemoryStats(unittest.TestCase):
+    def test_graph_is_counted_and_released(self):
+        a = Tensor([1.0, 2.0, 3.0])
+        before = memory_snapshot()
+
+        loss = (a * a).tanh().sum()
+        loss.label = "loss"
+        during = memory_diff(before, memory_snapshot())
+        self.assertEqual(during.live_ops, 3)
+        self.assertEqual(during.ops_by_op_type, {"mul": 1, "tanh": 1, "sum": 1})
+        self.assertTrue(during.host_bytes > 0)
+
+        roots = [g.root.label for g in largest_graphs()]
+        self.assertIn("loss", roots)
+        self.assertIn("loss (sum)", memory_summary())
+
+        loss.backward()
+        del loss
+        after = memory_diff(before, memory_snapshot())
+        self.assertEqual(after.live_tensors, 0)
+        self.assertEqual(after.live_ops, 0)
+        self.assertEqual(after.host_bytes, 0)
+
+    def test_counts_graphs_built_on_other_threads(self):
+        a = Tensor([1.0, 2.0, 3.0])
+        before = memory_snapshot()
+        losses = []
+
+        def build():
+            for _ in range(10):
+                losses.append((a * a).tanh().sum())
+
+        threads = [threading.Thread(target=build) for _ in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(memory_diff(before, memory_snapshot()).live_ops, 120)
+
+        # Freed here, after the threads that created them have exited
+        for loss in losses:
+            loss.backward()
+        del losses, loss
+        after = memory_diff(before, memory_snapshot())
+        self.assertEqual(after.live_tensors, 0)
+        self.assertEqual(after.live_ops, 0)
+        self.assertEqual(after.host_bytes, 0)
+
+    def test_peak_tracks_highest_usage(self):
+        before = memory_snapshot()
+        big = Tensor([0.0] * 10000)
+        peak = memory_snapshot().peak_host_bytes
+        del big
+        self.assertTrue(peak >= before.host_bytes + 10000 * 4)
+        self.assertEqual(memory_snapshot().peak_host_bytes, peak)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,94 @@
+import math
+import unittest
+from cugrad.tensor import Tensor
+from cugrad.nn import MLP
+from cugrad.optimizer import SGD, Adam, AdamW
+from cugrad import set_device, DeviceType
+
+set_device(DeviceType.CPU)
+
+
+def backward_square(param):
+    # loss = sum(p^2), so grad = 2p
+    loss = (param * param).sum()
+    loss.backward()
+
+
+class TestOptimizers(unittest.TestCase):
+    def run_steps(self, optimizer, param, steps):
+        for _ in range(steps):
+            optimizer.zero_grad()
+            backward_square(param)
+            optimizer.step()
+
+    def test_sgd_momentum(self):
+        for nesterov in (False, True):
+            param = Tensor([1.0, -2.0])
+            self.run_steps(SGD([param], lr=0.1, momentum=0.9, nesterov=nesterov, weight_decay=0.01), param, 3)
+
+            expected = [1.0, -2.0]
+            velocity = [0.0, 0.0]
+            for _ in range(3):
+                for i in range(2):
+                    g = 2 * expected[i] + 0.01 * expected[i]
+                    velocity[i] = 0.9 * velocity[i] + g
+                    expected[i] -= 0.1 * (g + 0.9 * velocity[i] if nesterov else velocity[i])
+            for a, b in zip(param.data, expected):
+                self.assertAlmostEqual(a, b, places=5)
+
+    def test_adam_and_adamw(self):
+        for cls, decoupled in ((Adam, False), (AdamW, True)):
+            param = Tensor([1.0, -2.0])
+            self.run_steps(cls([param], lr=0.1, weight_decay=0.1), param, 3)
+
+            expected = [1.0, -2.0]
+            m = [0.0, 0.0]
+            v = [0.0, 0.0]
+            for t in range(1, 4):
+                for i in range(2):
+                    g = 2 * expected[i]
+                    if decoupled:
+                        expected[i] *= 1 - 0.1 * 0.1
+                    else:
+                        g += 0.1 * expected[i]
+                    m[i] = 0.9 * m[i] + 0.1 * g
+                    v[i] = 0.999 * v[i] + 0.001 * g * g
+                    m_hat = m[i] / (1 - 0.9 ** t)
+                    v_hat = v[i] / (1 - 0.999 ** t)
+                    expected[i] -= 0.1 * m_hat / (math.sqrt(v_hat) + 1e-8)
+            for a, b in zip(param.data, expected):
+                self.assertAlmostEqual(a, b, places=4)
+
+    def test_grad_norm_clipping(self):
+        param = Tensor([3.0, 4.0])
+        optimizer = SGD([param], lr=1.0)
+        optimizer.max_grad_norm = 1.0
+        backward_square(param)
+        optimizer.step()
+        # grad = [6, 8] has norm 10 and is scaled to norm 1
+        self.assertAlmostEqual(optimizer.last_grad_norm(), 10.0, places=4)
+        self.assertAlmostEqual(param.data[0], 3.0 - 0.6, places=4)
+        self.assertAlmostEqual(param.data[1], 4.0 - 0.8, places=4)
+
+        with self.assertRaises(ValueError):
+            optimizer.max_grad_norm = -1.0
+
+    def test_flat_matches_unflat(self):
+        x = Tensor([0.5, -1.0, 2.0])
+        models = [MLP(3, [4, 1]), MLP(3, [4, 1])]
+        for p, q in zip(models[0].parameters(), models[1].parameters()):
+            q.data = p.data
+        models[1].flatten_parameters()
+        optimizers = [Adam(model.parameters(), lr=0.01) for model in models]
+        for _ in range(3):
+            for model, optimizer in zip(models, optimizers):
+                optimizer.zero_grad()
+                model(x).sum().backward()
+                optimizer.step()
+        for p, q in zip(models[0].parameters(), models[1].parameters()):
+            for a, b in zip(p.data, q.data):
+                self.assertAlmostEqual(a, b, places=6)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,84 @@
+import multiprocessing
+import random
+import unittest
+import numpy as np
+
+
+def run_rank(rank, world_size, port, results):
+    from cugrad import set_device, DeviceType
+    from cugrad.distributed import ProcessGroup, broadcast_parameters
+    from cugrad.nn import MLP
+    from cugrad.optimizer import SGD
+    from cugrad.tensor import Tensor
+
+    set_device(DeviceType.CPU)
+    group = ProcessGroup(rank, world_size, base_port=port, timeout=30.0)
+
+    values = np.arange(10001, dtype=np.float32) + rank
+    group.all_reduce(values)
+
+    tensor = Tensor([float(rank)] * 5)
+    work = group.all_reduce_async(tensor)
+    work.wait()
+
+    broadcasted = np.full(7, float(rank), dtype=np.float32)
+    group.broadcast(broadcasted, root=world_size - 1)
+    group.barrier()
+
+    # Ranks start from different weights and see different data; after
+    # broadcasting and averaging they must stay identical
+    model = MLP(3, [4, 1])
+    model.flatten_parameters()
+    for p in model.parameters():
+        p.data = [v + rank for v in p.data]
+    broadcast_parameters(group, model)
+    optimizer = SGD(model.parameters(), lr=0.1)
+    optimizer.set_process_group(group, bucket_elements=4)
+    x = Tensor([float(rank), 1.0, -1.0])
+    for step in range(3):
+        if step == 1:
+            # A backward that throws must not leave the next one refused
+            stale = model(x).sum()
+            stale.backward()
+            try:
+                optimizer.backward(stale)
+            except RuntimeError:
+                pass
+            else:
+                raise AssertionError("backward on a freed graph did not raise")
+        optimizer.zero_grad()
+        loss = model(x).sum()
+        if step % 2:
+            optimizer.backward(loss)
+        else:
+            loss.backward()
+        optimizer.step()
+
+    results.put((rank, values[:3].tolist(), tensor.data, broadcasted.tolist(),
+                 [p.data for p in model.parameters()]))
+
+
+class TestProcessGroup(unittest.TestCase):
+    def test_collectives(self):
+        world_size = 3
+        port = random.randint(20000, 40000)
+        ctx = multiprocessing.get_context("spawn")
+        results = ctx.Queue()
+        procs = [ctx.Process(target=run_rank, args=(rank, world_size, port, results)) for rank in range(world_size)]
+        for proc in procs:
+            proc.start()
+        outputs = sorted(results.get(timeout=60) for _ in procs)
+        for proc in procs:
+            proc.join(timeout=30)
+            self.assertEqual(proc.exitcode, 0)
+
+        offset = sum(range(world_size))
+        for rank, reduced, tensor, broadcasted, params in outputs:
+            self.assertEqual(reduced, [offset + world_size * i for i in range(3)])
+            self.assertEqual(tensor, [float(offset)] * 5)
+            self.assertEqual(broadcasted, [float(world_size - 1)] * 7)
+            self.assertEqual(params, outputs[0][4])
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,68 @@
+import unittest
+import json
+import os
+import tempfile
+from cugrad.tensor import Tensor
+from cugrad import set_device, DeviceType, profiler
+
+set_device(DeviceType.CPU)
+
+
+class TestProfiler(unittest.TestCase):
+    def test_records_forward_and_backward(self):
+        a = Tensor([1.0, 2.0, 3.0])
+        b = Tensor([4.0, 5.0, 6.0])
+        with profiler.profile() as prof:
+            loss = (a * b).tanh().sum()
+            loss.backward()
+
+        events = prof.events()
+        kinds = {(e.op_type, e.backward) for e in events}
+        for op_type in ["mul", "tanh", "sum"]:
+            self.assertIn((op_type, False), kinds)
+            self.assertIn((op_type, True), kinds)
+
+        mul = [e for e in events if e.op_type == "mul" and not e.backward][0]
+        self.assertEqual(mul.input_shapes, [[3], [3]])
+        self.assertEqual(mul.output_shape, [3])
+        self.assertEqual(mul.flops, 3)
+        self.assertTrue(mul.bytes > 0)
+        self.assertIn("tanh (backward)", prof.summary())
+
+    def test_op_time_counts_only_that_op(self):
+        a = Tensor([1.0, 2.0, 3.0])
+        with profiler.profile() as prof:
+            # Each step frees its ops, whose memory the next step reuses
+            for _ in range(5):
+                (a * a).tanh().sum().backward()
+            loss = (a * a).tanh().sum()
+            loss.backward(retain_graph=True)
+
+        op = loss.op
+        own = [e for e in prof.events() if e.op_id == op.id]
+        self.assertEqual(len(own), 2)
+        self.assertAlmostEqual(profiler.op_time_us(op), sum(e.duration_us for e in own))
+        self.assertEqual(len({e.op_id for e in prof.events()}), 18)
+
+    def test_disabled_records_nothing(self):
+        profiler.clear()
+        a = Tensor([1.0, 2.0])
+        (a * a).sum().backward()
+        self.assertFalse(profiler.is_enabled())
+        self.assertEqual(len(profiler.events()), 0)
+
+    def test_chrome_trace(self):
+        a = Tensor([1.0, 2.0])
+        with profiler.profile() as prof:
+            (a + a).sum().backward()
+
+        path = os.path.join(tempfile.mkdtemp(), "trace.json")
+        prof.export_chrome_trace(path)
+        with open(path) as f:
+            trace = json.load(f)
+        self.assertEqual(len(trace["traceEvents"]), len(prof.events()))
+        self.assertEqual(trace["traceEvents"][0]["ph"], "X")
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,122 @@
+import unittest
+import numpy as np
+from cugrad.tensor import Tensor
+from cugrad.nn import LSTM, GRU
+from cugrad import set_device, DeviceType
+
+set_device(DeviceType.CPU)
+
+
+def sigmoid(x):
+    return 1.0 / (1.0 + np.exp(-x))
+
+
+def values(tensor, shape):
+    return np.array(tensor.data, dtype=np.float64).reshape(shape)
+
+
+def lstm_reference(model, x):
+    H = model.hidden_size
+    w_ih = values(model.weight_ih, (model.input_size, 4 * H))
+    w_hh = values(model.weight_hh, (H, 4 * H))
+    bias = values(model.bias, (4 * H,))
+    h, c = np.zeros(H), np.zeros(H)
+    outputs = []
+    for row in x:
+        g = row @ w_ih + h @ w_hh + bias
+        i, f, n, o = sigmoid(g[:H]), sigmoid(g[H:2 * H]), np.tanh(g[2 * H:3 * H]), sigmoid(g[3 * H:])
+        c = f * c + i * n
+        h = o * np.tanh(c)
+        outputs.append(h)
+    return np.array(outputs)
+
+
+def gru_reference(model, x):
+    H = model.hidden_size
+    w_ih = values(model.weight_ih, (model.input_size, 3 * H))
+    w_hh = values(model.weight_hh, (H, 3 * H))
+    b_ih = values(model.bias_ih, (3 * H,))
+    b_hh = values(model.bias_hh, (3 * H,))
+    h = np.zeros(H)
+    outputs = []
+    for row in x:
+        gi = row @ w_ih + b_ih
+        gh = h @ w_hh + b_hh
+        r = sigmoid(gi[:H] + gh[:H])
+        z = sigmoid(gi[H:2 * H] + gh[H:2 * H])
+        n = np.tanh(gi[2 * H:] + r * gh[2 * H:])
+        h = (1 - z) * n + z * h
+        outputs.append(h)
+    return np.array(outputs)
+
+
+def make_sequence(steps=6, features=3, seed=0):
+    rng = np.random.RandomState(seed)
+    return rng.normal(size=(steps, features)).astype(np.float32)
+
+
+class TestRecurrent(unittest.TestCase):
+    def check_gradients(self, model, x):
+        # loss = sum(outputs * weights) against central differences
+        steps = x.shape[0]
+        coef = Tensor(np.sin(np.arange(steps * model.hidden_size)).reshape(steps, model.hidden_size).astype(np.float32))
+        inputs = Tensor(x)
+
+        def loss():
+            return (model(inputs) * coef).sum()
+
+        model.zero_grad()
+        inputs.zero_grad()
+        loss().backward()
+        for tensor in model.parameters() + [inputs]:
+            grad = list(tensor.grad)
+            data = list(tensor.data)
+            for i in range(0, len(data), max(1, len(data) // 7)):
+                eps = 1e-2
+                tensor.data = data[:i] + [data[i] + eps] + data[i + 1:]
+                plus = loss().data[0]
+                tensor.data = data[:i] + [data[i] - eps] + data[i + 1:]
+                minus = loss().data[0]
+                tensor.data = data
+                self.assertAlmostEqual(grad[i], (plus - minus) / (2 * eps), delta=2e-3 * max(1.0, abs(grad[i])))
+
+    def test_lstm(self):
+        x = make_sequence()
+        model = LSTM(3, 5)
+        self.assertEqual(len(model.parameters()), 3)
+        out = model(Tensor(x))
+        self.assertEqual(out.shape, [6, 5])
+        np.testing.assert_allclose(values(out, (6, 5)), lstm_reference(model, x), atol=1e-5)
+        self.check_gradients(model, x)
+
+        # Explicit initial state; the gradients reach it
+        h0 = Tensor([0.1] * 5)
+        c0 = Tensor([-0.2] * 5)
+        model.forward(Tensor(x), h0, c0).sum().backward()
+        self.assertTrue(any(g != 0.0 for g in h0.grad))
+        self.assertTrue(any(g != 0.0 for g in c0.grad))
+
+        copy = model.clone()
+        np.testing.assert_array_equal(copy(Tensor(x)).data, model(Tensor(x)).data)
+
+    def test_gru(self):
+        x = make_sequence(seed=1)
+        model = GRU(3, 4)
+        self.assertEqual(len(model.parameters()), 4)
+        out = model(Tensor(x))
+        np.testing.assert_allclose(values(out, (6, 4)), gru_reference(model, x), atol=1e-5)
+        self.check_gradients(model, x)
+
+        h0 = Tensor([0.3] * 4)
+        model.forward(Tensor(x), h0).sum().backward()
+        self.assertTrue(any(g != 0.0 for g in h0.grad))
+
+    def test_shape_errors(self):
+        with self.assertRaises(ValueError):
+            LSTM(3, 5)(Tensor(make_sequence(features=4)))
+        with self.assertRaises(ValueError):
+            GRU(3, 4).forward(Tensor(make_sequence()), Tensor([0.0] * 5))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,98 @@
+import unittest
+import numpy as np
+from cugrad.tensor import Tensor, SparseTensor, spmm
+from cugrad.nn import SparseLinear
+from cugrad import set_device, DeviceType, capture
+
+set_device(DeviceType.CPU)
+
+
+def sparse_features(rows=20, cols=200, density=0.05, seed=0):
+    rng = np.random.RandomState(seed)
+    dense = rng.normal(size=(rows, cols)).astype(np.float32)
+    dense[rng.uniform(size=dense.shape) > density] = 0.0
+    return dense
+
+
+class TestSparse(unittest.TestCase):
+    def test_conversions(self):
+        dense = sparse_features()
+        sparse = SparseTensor.from_dense(dense)
+        self.assertEqual(sparse.shape, [20, 200])
+        self.assertEqual(sparse.nnz, np.count_nonzero(dense))
+        np.testing.assert_array_equal(sparse.to_dense(), dense)
+
+        rows, cols = np.nonzero(dense)
+        np.testing.assert_array_equal(SparseTensor.from_coo((20, 200), rows, cols, dense[rows, cols]).to_dense(), dense)
+        indptr = np.concatenate([[0], np.cumsum(np.count_nonzero(dense, axis=1))])
+        np.testing.assert_array_equal(SparseTensor.from_csr((20, 200), indptr, cols, dense[rows, cols]).to_dense(), dense)
+
+        # Duplicate coordinates are summed
+        coo = SparseTensor.from_coo((2, 2), [0, 0, 1], [1, 1, 0], [1.0, 2.0, 4.0])
+        self.assertEqual(coo.nnz, 2)
+        np.testing.assert_array_equal(coo.to_dense(), [[0.0, 3.0], [4.0, 0.0]])
+
+        with self.assertRaises(ValueError):
+            SparseTensor.from_coo((2, 2), [2], [0], [1.0])
+        with self.assertRaises(ValueError):
+            SparseTensor.from_csr((2, 2), [0, 1], [0], [1.0])
+
+    def test_scipy(self):
+        try:
+            import scipy.sparse
+        except ImportError:
+            self.skipTest("scipy is not installed")
+        dense = sparse_features(seed=1)
+        for matrix in (scipy.sparse.csr_matrix(dense), scipy.sparse.coo_matrix(dense)):
+            np.testing.assert_array_equal(SparseTensor.from_scipy(matrix).to_dense(), dense)
+
+    def test_spmm_gradients(self):
+        dense = sparse_features(seed=2)
+        rng = np.random.RandomState(3)
+        weight = Tensor(rng.normal(size=(200, 6)).astype(np.float32))
+        bias = Tensor(rng.normal(size=6).astype(np.float32))
+        coef = np.cos(np.arange(20 * 6)).reshape(20, 6).astype(np.float32)
+
+        out = spmm(SparseTensor.from_dense(dense), weight, bias)
+        self.assertEqual(out.shape, [20, 6])
+        w = np.array(weight.data).reshape(200, 6)
+        b = np.array(bias.data)
+        np.testing.assert_allclose(np.array(out.data).reshape(20, 6), dense @ w + b, rtol=1e-5, atol=1e-5)
+
+        (out * Tensor(coef)).sum().backward()
+        np.testing.assert_allclose(np.array(weight.grad).reshape(200, 6), dense.T @ coef, rtol=1e-5, atol=1e-5)
+        np.testing.assert_allclose(bias.grad, coef.sum(axis=0), rtol=1e-5, atol=1e-5)
+
+        with self.assertRaises(ValueError):
+            spmm(SparseTensor.from_dense(dense), Tensor(np.zeros((199, 6), dtype=np.float32)))
+
+    def test_sparse_linear(self):
+        dense = sparse_features(seed=4)
+        layer = SparseLinear(200, 3)
+        self.assertEqual(len(layer.parameters()), 2)
+        out = layer.forward(SparseTensor.from_dense(dense))
+        np.testing.assert_array_equal(layer(Tensor(dense)).data, out.data)
+        expected = dense @ np.array(layer.weight.data).reshape(200, 3) + np.array(layer.bias.data)
+        np.testing.assert_allclose(np.array(out.data).reshape(20, 3), expected, rtol=1e-5, atol=1e-5)
+
+        copy = layer.clone()
+        np.testing.assert_array_equal(copy(Tensor(dense)).data, out.data)
+
+    def test_capture_keeps_spmm_over_different_matrices(self):
+        weight = Tensor(np.random.RandomState(5).normal(size=(200, 4)).astype(np.float32))
+        first = SparseTensor.from_dense(sparse_features(seed=6))
+        second = SparseTensor.from_dense(sparse_features(seed=7))
+        loss = (spmm(first, weight) + spmm(second, weight)).sum()
+
+        graph = capture(loss, [weight])
+        graph.replay()
+        expected_loss = graph.output.data[0]
+
+        stats = graph.optimize()
+        self.assertEqual(stats.cse_merged, 0)
+        graph.replay()
+        self.assertAlmostEqual(graph.output.data[0], expected_loss, places=3)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -35,6 +35,23 @@ class TestTensor(unittest.TestCase):
         c.to_device(DeviceType.CPU)
         self.assertEqual(c.data, [2.0])
 
+    def test_scalar_and_vector_paths_agree(self):
+        # [1] tensors take the scalar fast paths and inline storage,
+        # [6] ones the generic loops and heap storage
+        def run(n):
+            x = Tensor([0.5] * n)
+            y = Tensor([1.5] * n)
+            z = (((x * y).tanh() / (x + y) - y).exp() + x).relu().sum()
+            z.backward()
+            return z.data[0] / n, x.grad[0], y.grad[0]
+
+        for scalar, vector in zip(run(1), run(6)):
+            self.assertAlmostEqual(scalar, vector, places=5)
+
+    def test_scalar_division_by_zero(self):
+        with self.assertRaises(ValueError):
+            Tensor([1.0]) / Tensor([0.0])
+
     def test_catch_shape_mismatch(self):
         a = Tensor([1])
         b = Tensor([2,1])
@@ -0,0 +1,81 @@
+import threading
+import unittest
+import numpy as np
+import cugrad
+from cugrad.tensor import Tensor
+from cugrad.nn import MLP
+from cugrad.optimizer import SGD
+from cugrad import set_device, DeviceType
+
+set_device(DeviceType.CPU)
+
+
+def train(seed, steps=50):
+    cugrad.manual_seed(seed)
+    model = MLP(3, [8, 1])
+    optimizer = SGD(model.parameters(), lr=0.05)
+    x = Tensor([0.5, -0.2, 0.1])
+    target = Tensor([0.3])
+    for _ in range(steps):
+        optimizer.zero_grad()
+        diff = model(x) - target
+        (diff * diff).sum().backward()
+        optimizer.step()
+    return [list(p.data) for p in model.parameters()]
+
+
+class TestThreading(unittest.TestCase):
+    def test_manual_seed(self):
+        cugrad.manual_seed(7)
+        first = MLP(3, [4, 1]).parameters()[0].data
+        cugrad.manual_seed(7)
+        self.assertEqual(MLP(3, [4, 1]).parameters()[0].data, first)
+        self.assertNotEqual(MLP(3, [4, 1]).parameters()[0].data, first)
+
+    def test_no_grad(self):
+        model = MLP(3, [4, 1])
+        x = Tensor([1.0, 2.0, 3.0])
+        self.assertTrue(cugrad.is_grad_enabled())
+        with cugrad.no_grad():
+            self.assertFalse(cugrad.is_grad_enabled())
+            out = model(x)
+            self.assertIsNone(out.op)
+            self.assertEqual(out.children, [])
+        self.assertTrue(cugrad.is_grad_enabled())
+        np.testing.assert_array_equal(out.data, model(x).data)
+        self.assertIsNotNone(model(x).op)
+
+    def test_per_thread_state(self):
+        seen = {}
+
+        def worker():
+            seen["device"] = cugrad.get_device()
+            seen["grad"] = cugrad.is_grad_enabled()
+            cugrad.set_device(DeviceType.CPU)
+
+        with cugrad.no_grad():
+            thread = threading.Thread(target=worker)
+            thread.start()
+            thread.join()
+        self.assertEqual(seen["device"], cugrad.get_default_device())
+        self.assertTrue(seen["grad"])
+
+    def test_concurrent_training(self):
+        # Each thread trains its own model; the results match a serial run
+        seeds = [1, 2, 3, 4]
+        expected = [train(seed) for seed in seeds]
+        results = [None] * len(seeds)
+
+        def worker(i):
+            results[i] = train(seeds[i])
+
+        threads = [threading.Thread(target=worker, args=(i,)) for i in range(len(seeds))]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(results, expected)
+
+
+if __name__ == "__main__":
+    unittest.main()